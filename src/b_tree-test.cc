@@ -0,0 +1,273 @@
+#include "b_tree.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <unistd.h>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+
+namespace yukino {
+
+class BTreeTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        unlink(kFileName);
+        tree_.reset(new BTree());
+        auto rv = tree_->Open(kFileName);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+
+    virtual void TearDown() override {
+        tree_.reset();
+        unlink(kFileName);
+    }
+
+    void Reopen() {
+        tree_.reset(new BTree());
+        auto rv = tree_->Open(kFileName);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+
+protected:
+    std::unique_ptr<BTree> tree_;
+
+    static const char kFileName[];
+};
+
+const char BTreeTest::kFileName[] = "b_tree-test.pages";
+
+TEST_F(BTreeTest, Sanity) {
+    auto rv = tree_->Put(yuki::Slice("name"), 1, yuki::Slice("Jake"));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = tree_->Put(yuki::Slice("age"), 2, yuki::Slice("100"));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(2, tree_->num_keys());
+
+    std::string value;
+    uint64_t version_number = 0;
+    rv = tree_->Get(yuki::Slice("name"), &version_number, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ("Jake", value);
+    EXPECT_EQ(1, version_number);
+
+    rv = tree_->Put(yuki::Slice("name"), 3, yuki::Slice("Mike"));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(2, tree_->num_keys());
+    rv = tree_->Get(yuki::Slice("name"), nullptr, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ("Mike", value);
+
+    EXPECT_TRUE(tree_->Delete(yuki::Slice("name")));
+    EXPECT_FALSE(tree_->Delete(yuki::Slice("name")));
+    rv = tree_->Get(yuki::Slice("name"), nullptr, nullptr);
+    EXPECT_TRUE(rv.Failed());
+    EXPECT_EQ(1, tree_->num_keys());
+
+    std::string large(BTree::MAX_KEY_SIZE + 1, 'k');
+    rv = tree_->Put(yuki::Slice(large), 0, yuki::Slice("v"));
+    EXPECT_TRUE(rv.Failed());
+}
+
+TEST_F(BTreeTest, SplitAndCursor) {
+    static const int kNumKeys = 100000;
+
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("key-%08d", (i * 7919) % kNumKeys);
+        auto rv = tree_->Put(yuki::Slice(key), i, yuki::Slice(key));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    EXPECT_EQ(kNumKeys, tree_->num_keys());
+    EXPECT_LT(1, tree_->height());
+
+    BTree::Cursor cursor(tree_.get());
+    int i = 0;
+    std::string value;
+    for (cursor.SeekToFirst(); cursor.Valid(); cursor.Next()) {
+        auto key = yuki::Strings::Format("key-%08d", i++);
+        ASSERT_EQ(key, cursor.key().ToString());
+        cursor.value(&value);
+        ASSERT_EQ(key, value);
+    }
+    EXPECT_EQ(kNumKeys, i);
+
+    cursor.Seek(yuki::Slice("key-00050000"));
+    ASSERT_TRUE(cursor.Valid());
+    EXPECT_EQ("key-00050000", cursor.key().ToString());
+    cursor.Seek(yuki::Slice("key-00050000x"));
+    ASSERT_TRUE(cursor.Valid());
+    EXPECT_EQ("key-00050001", cursor.key().ToString());
+    cursor.Seek(yuki::Slice("z"));
+    EXPECT_FALSE(cursor.Valid());
+}
+
+TEST_F(BTreeTest, OverflowValues) {
+    std::string large(BTree::PAGE_SIZE * 3 + 17, 'v');
+
+    auto rv = tree_->Put(yuki::Slice("large"), 0, yuki::Slice(large));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    auto num_pages = tree_->num_pages();
+
+    std::string value;
+    rv = tree_->Get(yuki::Slice("large"), nullptr, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(large, value);
+
+    // Replaced overflow pages be reused.
+    large[0] = 'x';
+    for (int i = 0; i < 10; i++) {
+        rv = tree_->Put(yuki::Slice("large"), i, yuki::Slice(large));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    EXPECT_GE(num_pages + 4, tree_->num_pages());
+    rv = tree_->Get(yuki::Slice("large"), nullptr, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(large, value);
+}
+
+TEST_F(BTreeTest, Reopen) {
+    static const int kNumKeys = 20000;
+
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("key-%d", i);
+        auto rv = tree_->Put(yuki::Slice(key), i, yuki::Slice(key));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    for (int i = 0; i < kNumKeys; i += 2) {
+        auto key = yuki::Strings::Format("key-%d", i);
+        ASSERT_TRUE(tree_->Delete(yuki::Slice(key)));
+    }
+    auto rv = tree_->Commit(3, 7);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    Reopen();
+    EXPECT_EQ(kNumKeys / 2, tree_->num_keys());
+
+    int64_t log_version, log_applied;
+    tree_->GetLogPosition(&log_version, &log_applied);
+    EXPECT_EQ(3, log_version);
+    EXPECT_EQ(7, log_applied);
+
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("key-%d", i);
+        std::string value;
+        auto rv = tree_->Get(yuki::Slice(key), nullptr, &value);
+        if (i % 2) {
+            ASSERT_TRUE(rv.Ok()) << rv.ToString();
+            EXPECT_EQ(key, value);
+        } else {
+            EXPECT_TRUE(rv.Failed());
+        }
+    }
+}
+
+TEST_F(BTreeTest, CrashAfterCommit) {
+    static const int kNumKeys = 20000;
+
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("key-%d", i);
+        auto rv = tree_->Put(yuki::Slice(key), i, yuki::Slice(key));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    auto rv = tree_->Commit(1, 5);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // Changes after the commit be written back as the kernel may do, then
+    // the process dies without committing.
+    std::string value(200, 'v');
+    std::string large(BTree::PAGE_SIZE * 2, 'v');
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("key-%d", i);
+        if (i % 3 == 0) {
+            ASSERT_TRUE(tree_->Delete(yuki::Slice(key)));
+        } else {
+            rv = tree_->Put(yuki::Slice(key), 0,
+                            yuki::Slice(i % 100 == 1 ? large : value));
+            ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        }
+    }
+    ASSERT_TRUE(tree_->Sync().Ok());
+    Reopen();
+
+    EXPECT_EQ(kNumKeys, tree_->num_keys());
+    int64_t log_version, log_applied;
+    tree_->GetLogPosition(&log_version, &log_applied);
+    EXPECT_EQ(1, log_version);
+    EXPECT_EQ(5, log_applied);
+
+    uint64_t version_number;
+    rv = tree_->Get(yuki::Slice("key-3"), &version_number, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(3, version_number);
+
+    BTree::Cursor cursor(tree_.get());
+    int n = 0;
+    for (cursor.SeekToFirst(); cursor.Valid(); cursor.Next(), n++) {
+        cursor.value(&value);
+        ASSERT_EQ(cursor.key().ToString(), value);
+    }
+    EXPECT_EQ(kNumKeys, n);
+}
+
+TEST_F(BTreeTest, FreeListAfterReopen) {
+    std::string large(BTree::PAGE_SIZE * 3 + 17, 'v');
+
+    auto rv = tree_->Put(yuki::Slice("large"), 0, yuki::Slice(large));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = tree_->Commit(0, 0);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    auto num_pages = tree_->num_pages();
+
+    // Pages of the last commit be reused after the next one, in the same
+    // process or after reopening.
+    for (int i = 0; i < 10; i++) {
+        rv = tree_->Put(yuki::Slice("large"), i, yuki::Slice(large));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        rv = tree_->Commit(0, i);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        if (i % 3 == 0) {
+            Reopen();
+        }
+    }
+    EXPECT_GE(num_pages * 2 + 4, tree_->num_pages());
+
+    std::string value;
+    rv = tree_->Get(yuki::Slice("large"), nullptr, &value);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(large, value);
+}
+
+TEST_F(BTreeTest, RandomOperations) {
+    std::map<std::string, std::string> expected;
+    std::mt19937 rand(7);
+
+    for (int i = 0; i < 50000; i++) {
+        auto key = yuki::Strings::Format("%d", rand() % 5000);
+        key.append(rand() % 300, 'k');
+
+        if (rand() % 3 == 0) {
+            EXPECT_EQ(expected.erase(key) > 0,
+                      tree_->Delete(yuki::Slice(key)));
+        } else {
+            std::string value(rand() % 4 ? rand() % 200 : rand() % 20000,
+                              'a' + i % 26);
+            auto rv = tree_->Put(yuki::Slice(key), i, yuki::Slice(value));
+            ASSERT_TRUE(rv.Ok()) << rv.ToString();
+            expected[key] = value;
+        }
+    }
+    ASSERT_EQ(static_cast<int64_t>(expected.size()), tree_->num_keys());
+
+    BTree::Cursor cursor(tree_.get());
+    auto iter = expected.begin();
+    std::string value;
+    for (cursor.SeekToFirst(); cursor.Valid(); cursor.Next(), ++iter) {
+        ASSERT_TRUE(iter != expected.end());
+        ASSERT_EQ(iter->first, cursor.key().ToString());
+        cursor.value(&value);
+        ASSERT_EQ(iter->second, value);
+    }
+    EXPECT_TRUE(iter == expected.end());
+}
+
+} // namespace yukino
@@ -0,0 +1,902 @@
+#include "b_tree.h"
+#include "crc32.h"
+#include "glog/logging.h"
+#include "yuki/varint.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+
+namespace yukino {
+
+namespace {
+
+const char kMagic[8] = {'Y', 'K', 'N', 'B', 'T', 'R', 'E', 'E'};
+
+// Grow the file by doubling, but 1GB at most once.
+const size_t kMaxGrowSize = 1UL << 30;
+
+const size_t kOverflowCapacity = BTree::PAGE_SIZE - sizeof(BTree::PageHeader);
+
+const size_t kFreeListCapacity =
+    (BTree::PAGE_SIZE - sizeof(BTree::PageHeader)) / sizeof(uint32_t);
+
+struct LeafCell {
+    yuki::Slice    key;
+    uint64_t       version_number;
+    uint32_t       value_size;
+    const uint8_t *value; // value bytes, or the first overflow page.
+    size_t         size;  // size of the whole cell.
+};
+
+inline uint32_t DecodeFixed32(const uint8_t *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline void EncodeFixed32(uint32_t value, uint8_t *p) {
+    memcpy(p, &value, sizeof(value));
+}
+
+inline void AppendFixed32(uint32_t value, std::string *buf) {
+    buf->append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline void AppendVarint32(uint32_t value, std::string *buf) {
+    uint8_t scratch[yuki::Varint::kMax32Len];
+    auto len = yuki::Varint::Encode32(value, scratch);
+    buf->append(reinterpret_cast<const char *>(scratch), len);
+}
+
+inline void AppendVarint64(uint64_t value, std::string *buf) {
+    uint8_t scratch[yuki::Varint::kMax64Len];
+    auto len = yuki::Varint::Encode64(value, scratch);
+    buf->append(reinterpret_cast<const char *>(scratch), len);
+}
+
+void ParseLeafCell(const uint8_t *cell, LeafCell *parsed) {
+    size_t len;
+    auto p = cell;
+
+    auto key_size = yuki::Varint::Decode32(p, &len);
+    p += len;
+    parsed->key = yuki::Slice(reinterpret_cast<const char *>(p), key_size);
+    p += key_size;
+
+    parsed->version_number = yuki::Varint::Decode64(p, &len);
+    p += len;
+
+    parsed->value_size = yuki::Varint::Decode32(p, &len);
+    p += len;
+    parsed->value = p;
+
+    if (parsed->value_size > BTree::MAX_INLINE_VALUE_SIZE) {
+        p += sizeof(uint32_t);
+    } else {
+        p += parsed->value_size;
+    }
+    parsed->size = p - cell;
+}
+
+void BuildLeafCell(yuki::SliceRef key, uint64_t version_number,
+                   yuki::SliceRef value, uint32_t overflow, std::string *buf) {
+    buf->clear();
+    AppendVarint32(static_cast<uint32_t>(key.Length()), buf);
+    buf->append(key.Data(), key.Length());
+    AppendVarint64(version_number, buf);
+    AppendVarint32(static_cast<uint32_t>(value.Length()), buf);
+    if (overflow) {
+        AppendFixed32(overflow, buf);
+    } else {
+        buf->append(value.Data(), value.Length());
+    }
+}
+
+void BuildInternalCell(uint32_t child, yuki::SliceRef key, std::string *buf) {
+    buf->clear();
+    AppendFixed32(child, buf);
+    AppendVarint32(static_cast<uint32_t>(key.Length()), buf);
+    buf->append(key.Data(), key.Length());
+}
+
+} // namespace
+
+BTree::BTree()
+    : num_keys_(0) {
+}
+
+BTree::~BTree() {
+    if (base_) {
+        munmap(base_, map_size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+yuki::Status BTree::Open(const std::string &file_name) {
+    using yuki::Status;
+
+    DCHECK_LT(fd_, 0) << "reopen the tree.";
+
+    fd_ = open(file_name.c_str(), O_RDWR|O_CREAT, 0664);
+    if (fd_ < 0) {
+        PLOG(ERROR) << "open " << file_name << " fail";
+        return Status::Systemf("open %s fail", file_name.c_str());
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) < 0) {
+        PLOG(ERROR) << "stat " << file_name << " fail";
+        return Status::Systemf("stat %s fail", file_name.c_str());
+    }
+
+    bool is_new = st.st_size == 0;
+    size_t size = is_new ? INITIAL_NUM_PAGES * PAGE_SIZE : st.st_size;
+    if (size % PAGE_SIZE != 0 || size < (NUM_META_PAGES + 1) * PAGE_SIZE) {
+        return Status::Corruptionf("bad page file size: %zd", size);
+    }
+    if (is_new && ftruncate(fd_, size) < 0) {
+        PLOG(ERROR) << "truncate " << file_name << " fail";
+        return Status::Systemf("truncate %s fail", file_name.c_str());
+    }
+
+    auto mapped = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) {
+        PLOG(ERROR) << "mmap " << file_name << " fail";
+        return Status::Systemf("mmap %s fail", file_name.c_str());
+    }
+    base_ = static_cast<char *>(mapped);
+    map_size_ = size;
+    // Pages be touched by key, not by sequence.
+    madvise(base_, map_size_, MADV_RANDOM);
+
+    if (is_new) {
+        memset(&meta_, 0, sizeof(meta_));
+        memcpy(meta_.magic, kMagic, sizeof(meta_.magic));
+        meta_.page_size = PAGE_SIZE;
+        meta_.root      = NUM_META_PAGES;
+        meta_.height    = 1;
+        meta_.num_pages = NUM_META_PAGES + 1;
+        fresh_.insert(meta_.root);
+        Rebuild(meta_.root, PAGE_LEAF, 0, std::vector<yuki::Slice>());
+        return Commit(0, 0);
+    }
+
+    // The meta page be written at last in a commit, a torn one be skipped.
+    const Meta *found = nullptr;
+    for (int i = 0; i < NUM_META_PAGES; i++) {
+        auto m = reinterpret_cast<const Meta *>(page(i));
+        if (memcmp(m->magic, kMagic, sizeof(m->magic)) != 0 ||
+            m->checksum != MetaChecksum(*m)) {
+            continue;
+        }
+        if (!found || m->sequence > found->sequence) {
+            found = m;
+        }
+    }
+    if (!found) {
+        return Status::Corruptionf("%s: no valid meta page",
+                                   file_name.c_str());
+    }
+    meta_ = *found;
+    if (meta_.page_size != PAGE_SIZE) {
+        return Status::Corruptionf("%s: page size %u, expected %d",
+                                   file_name.c_str(), meta_.page_size,
+                                   PAGE_SIZE);
+    }
+    if (static_cast<size_t>(meta_.num_pages) * PAGE_SIZE > map_size_ ||
+        meta_.root < NUM_META_PAGES || meta_.root >= meta_.num_pages) {
+        return Status::Corruptionf("%s: bad meta page", file_name.c_str());
+    }
+    num_keys_.store(meta_.num_keys);
+    return LoadFreeList(file_name);
+}
+
+yuki::Status BTree::Put(yuki::SliceRef key, uint64_t version_number,
+                        yuki::SliceRef value) {
+    using yuki::Status;
+
+    if (key.Length() > MAX_KEY_SIZE) {
+        return Status::Errorf(Status::kInvalidArgument,
+                              "key too large (%zd > %d)", key.Length(),
+                              MAX_KEY_SIZE);
+    }
+
+    WriterLock lock(&lock_);
+
+    // Copies of the path, one new page for every level at most, and a new
+    // root.
+    uint32_t num_overflow_pages = 0;
+    if (value.Length() > MAX_INLINE_VALUE_SIZE) {
+        num_overflow_pages = static_cast<uint32_t>(
+            (value.Length() + kOverflowCapacity - 1) / kOverflowCapacity);
+    }
+    auto rv = Reserve(num_overflow_pages + 2 * meta_.height + 1);
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    uint32_t overflow = 0;
+    if (num_overflow_pages > 0) {
+        overflow = WriteOverflow(value);
+    }
+    std::string cell;
+    BuildLeafCell(key, version_number, value, overflow, &cell);
+
+    std::vector<uint32_t> path;
+    auto id = FindWritableLeaf(key, &path);
+    bool equal;
+    auto index = LowerBound(header(id), key, &equal);
+    if (equal) {
+        FreeOverflow(Cell(header(id), index));
+        RemoveCell(id, index);
+    } else {
+        meta_.num_keys++;
+        num_keys_.fetch_add(1);
+    }
+    InsertCell(id, index, cell, &path);
+    return Status::OK();
+}
+
+bool BTree::Delete(yuki::SliceRef key) {
+    WriterLock lock(&lock_);
+
+    bool equal;
+    LowerBound(header(FindLeaf(key, nullptr)), key, &equal);
+    if (!equal) {
+        return false;
+    }
+
+    // Copies of the path.
+    auto rv = Reserve(meta_.height);
+    if (rv.Failed()) {
+        LOG(ERROR) << "delete key fail: " << rv.ToString();
+        return false;
+    }
+    std::vector<uint32_t> path;
+    auto id = FindWritableLeaf(key, &path);
+    auto index = LowerBound(header(id), key, nullptr);
+
+    FreeOverflow(Cell(header(id), index));
+    RemoveCell(id, index);
+    meta_.num_keys--;
+    num_keys_.fetch_sub(1);
+    return true;
+}
+
+yuki::Status BTree::Get(yuki::SliceRef key, uint64_t *version_number,
+                        std::string *value) {
+    using yuki::Status;
+
+    ReaderLock lock(&lock_);
+
+    auto h = header(FindLeaf(key, nullptr));
+    bool equal;
+    auto index = LowerBound(h, key, &equal);
+    if (!equal) {
+        return Status::NotFoundf("key not found.");
+    }
+
+    if (version_number) {
+        LeafCell cell;
+        ParseLeafCell(Cell(h, index), &cell);
+        *version_number = cell.version_number;
+    }
+    if (value) {
+        ReadValue(Cell(h, index), value);
+    }
+    return Status::OK();
+}
+
+yuki::Status BTree::Sync() {
+    using yuki::Status;
+
+    // Readers can go on, but the file can not be remapped.
+    ReaderLock lock(&lock_);
+    if (msync(base_, map_size_, MS_SYNC) < 0 || fdatasync(fd_) < 0) {
+        PLOG(ERROR) << "sync page file fail";
+        return Status::Systemf("sync page file fail");
+    }
+    return Status::OK();
+}
+
+yuki::Status BTree::Commit(int64_t log_version, int64_t log_applied) {
+    using yuki::Status;
+
+    WriterLock lock(&lock_);
+
+    // Ids of free pages be written to new pages, the freed pages of the last
+    // commit be free in the new one.
+    std::vector<uint32_t> list;
+    auto rv = WriteFreeList(&list);
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    // All pages of the new tree be on the file before the meta points to it.
+    Meta m = meta_;
+    m.log_version = log_version;
+    m.log_applied = log_applied;
+    m.sequence++;
+    m.checksum = MetaChecksum(m);
+    // The older one be overwritten, a torn one leaves the last commit.
+    auto slot = page(static_cast<uint32_t>(m.sequence % NUM_META_PAGES));
+    bool ok = msync(base_, map_size_, MS_SYNC) == 0 && fdatasync(fd_) == 0;
+    if (ok) {
+        memcpy(slot, &m, sizeof(m));
+        ok = msync(slot, PAGE_SIZE, MS_SYNC) == 0 && fdatasync(fd_) == 0;
+        if (!ok) {
+            // The kernel may write it later, its free list be reused.
+            memset(slot, 0, sizeof(m));
+        }
+    }
+    if (!ok) {
+        PLOG(ERROR) << "commit page file fail";
+        // Never be referenced, as other new pages.
+        for (auto id : list) {
+            FreePage(id);
+        }
+        return Status::Systemf("commit page file fail");
+    }
+    meta_ = m;
+
+    fresh_.clear();
+    free_.insert(free_.end(), pending_free_.begin(), pending_free_.end());
+    pending_free_.swap(list);
+    return Status::OK();
+}
+
+void BTree::GetLogPosition(int64_t *log_version, int64_t *log_applied) const {
+    ReaderLock lock(const_cast<RWSpinLock *>(&lock_));
+    *log_version = meta_.log_version;
+    *log_applied = meta_.log_applied;
+}
+
+uint32_t BTree::num_pages() const {
+    ReaderLock lock(const_cast<RWSpinLock *>(&lock_));
+    return meta_.num_pages;
+}
+
+uint32_t BTree::height() const {
+    ReaderLock lock(const_cast<RWSpinLock *>(&lock_));
+    return meta_.height;
+}
+
+/*static*/ yuki::Slice BTree::CellKey(uint8_t type, const uint8_t *cell) {
+    if (type == PAGE_INTERNAL) {
+        cell += sizeof(uint32_t);
+    }
+
+    size_t len;
+    auto key_size = yuki::Varint::Decode32(cell, &len);
+    return yuki::Slice(reinterpret_cast<const char *>(cell + len), key_size);
+}
+
+/*static*/ size_t BTree::CellSize(uint8_t type, const uint8_t *cell) {
+    if (type == PAGE_INTERNAL) {
+        size_t len;
+        auto key_size = yuki::Varint::Decode32(cell + sizeof(uint32_t), &len);
+        return sizeof(uint32_t) + len + key_size;
+    }
+
+    LeafCell parsed;
+    ParseLeafCell(cell, &parsed);
+    return parsed.size;
+}
+
+/*static*/ uint32_t BTree::CellChild(const uint8_t *cell) {
+    return DecodeFixed32(cell);
+}
+
+/*static*/ uint32_t BTree::Child(PageHeader *h, int pos) {
+    return pos == 0 ? h->next : CellChild(Cell(h, pos - 1));
+}
+
+/*static*/ uint32_t BTree::MetaChecksum(const Meta &m) {
+    return crc32(0, &m, offsetof(Meta, checksum));
+}
+
+/*static*/ int BTree::LowerBound(PageHeader *h, yuki::SliceRef key,
+                                 bool *equal) {
+    int lo = 0, hi = h->num_cells;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (CellKey(h->type, Cell(h, mid)).Compare(key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (equal) {
+        *equal = lo < h->num_cells &&
+                 CellKey(h->type, Cell(h, lo)).Compare(key) == 0;
+    }
+    return lo;
+}
+
+/*static*/ int BTree::UpperBound(PageHeader *h, yuki::SliceRef key) {
+    int lo = 0, hi = h->num_cells;
+    while (lo < hi) {
+        auto mid = lo + (hi - lo) / 2;
+        if (CellKey(h->type, Cell(h, mid)).Compare(key) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+uint32_t BTree::FindLeaf(yuki::SliceRef key,
+                         std::vector<uint32_t> *path) const {
+    auto id = meta_.root;
+    for (;;) {
+        auto h = header(id);
+        if (h->type == PAGE_LEAF) {
+            return id;
+        }
+        DCHECK_EQ(PAGE_INTERNAL, h->type);
+
+        if (path) {
+            path->push_back(id);
+        }
+        id = Child(h, UpperBound(h, key));
+    }
+}
+
+uint32_t BTree::FindWritableLeaf(yuki::SliceRef key,
+                                 std::vector<uint32_t> *path) {
+    meta_.root = Writable(meta_.root);
+    auto id = meta_.root;
+    for (;;) {
+        auto h = header(id);
+        if (h->type == PAGE_LEAF) {
+            return id;
+        }
+        DCHECK_EQ(PAGE_INTERNAL, h->type);
+
+        path->push_back(id);
+        auto pos = UpperBound(h, key);
+        auto child = Child(h, pos);
+        auto copy = Writable(child);
+        if (copy != child) {
+            // The parent be written already, point it to the copy.
+            if (pos == 0) {
+                h->next = copy;
+            } else {
+                EncodeFixed32(copy, reinterpret_cast<uint8_t *>(page(id)) +
+                              CellOffsets(h)[pos - 1]);
+            }
+        }
+        id = copy;
+    }
+}
+
+// Pages be reserved, the file can not be remapped here.
+uint32_t BTree::Writable(uint32_t id) {
+    if (fresh_.count(id)) {
+        return id;
+    }
+    auto copy = AllocatePage();
+    memcpy(page(copy), page(id), PAGE_SIZE);
+    FreePage(id);
+    return copy;
+}
+
+void BTree::InsertCell(uint32_t id, int index, yuki::SliceRef cell,
+                       std::vector<uint32_t> *path) {
+    auto h = header(id);
+    auto used = sizeof(PageHeader) + (h->num_cells + 1) * sizeof(uint16_t) +
+                cell.Length();
+    if (used > h->cell_begin) {
+        if (used > static_cast<size_t>(h->cell_begin) + h->garbage) {
+            Split(id, index, cell, path);
+            return;
+        }
+        Compact(id);
+    }
+
+    h->cell_begin -= cell.Length();
+    memcpy(page(id) + h->cell_begin, cell.Data(), cell.Length());
+
+    auto offsets = CellOffsets(h);
+    memmove(offsets + index + 1, offsets + index,
+            (h->num_cells - index) * sizeof(uint16_t));
+    offsets[index] = h->cell_begin;
+    h->num_cells++;
+}
+
+void BTree::RemoveCell(uint32_t id, int index) {
+    auto h = header(id);
+    DCHECK_LT(index, h->num_cells);
+
+    h->garbage += CellSize(h->type, Cell(h, index));
+    auto offsets = CellOffsets(h);
+    memmove(offsets + index, offsets + index + 1,
+            (h->num_cells - index - 1) * sizeof(uint16_t));
+    h->num_cells--;
+
+    if (h->num_cells == 0) {
+        h->cell_begin = PAGE_SIZE;
+        h->garbage = 0;
+    }
+}
+
+void BTree::Split(uint32_t id, int index, yuki::SliceRef cell,
+                  std::vector<uint32_t> *path) {
+    // Pages be reserved, the file can not be remapped here.
+    auto right = AllocatePage();
+
+    auto h = header(id);
+    auto type = h->type;
+    auto next = h->next;
+
+    std::vector<yuki::Slice> cells;
+    size_t total = 0;
+    for (int i = 0; i < h->num_cells; i++) {
+        auto p = Cell(h, i);
+        cells.emplace_back(reinterpret_cast<const char *>(p),
+                           CellSize(type, p));
+        total += cells.back().Length() + sizeof(uint16_t);
+    }
+    cells.insert(cells.begin() + index, cell);
+    total += cell.Length() + sizeof(uint16_t);
+
+    // Split by bytes, both sides can not be empty.
+    size_t k = 0, left_size = 0;
+    while (k < cells.size() && left_size < total / 2) {
+        left_size += cells[k++].Length() + sizeof(uint16_t);
+    }
+    k = std::max<size_t>(1, std::min(k, cells.size() - 1));
+
+    // Rebuild() copies cells first, they can point to the page itself.
+    std::string separator(CellKey(type, reinterpret_cast<const uint8_t *>(
+                                  cells[k].Data())).ToString());
+    if (type == PAGE_LEAF) {
+        Rebuild(right, type, 0,
+                std::vector<yuki::Slice>(cells.begin() + k, cells.end()));
+        Rebuild(id, type, 0,
+                std::vector<yuki::Slice>(cells.begin(), cells.begin() + k));
+    } else {
+        // The middle cell be moved up, its child be the leftmost one.
+        auto leftmost = CellChild(reinterpret_cast<const uint8_t *>(
+                                  cells[k].Data()));
+        Rebuild(right, type, leftmost,
+                std::vector<yuki::Slice>(cells.begin() + k + 1, cells.end()));
+        Rebuild(id, type, next,
+                std::vector<yuki::Slice>(cells.begin(), cells.begin() + k));
+    }
+
+    std::string parent_cell;
+    BuildInternalCell(right, separator, &parent_cell);
+    if (path->empty()) {
+        auto root = AllocatePage();
+        Rebuild(root, PAGE_INTERNAL, id,
+                std::vector<yuki::Slice>(1, yuki::Slice(parent_cell)));
+        meta_.root = root;
+        meta_.height++;
+        return;
+    }
+
+    auto parent = path->back();
+    path->pop_back();
+    InsertCell(parent, UpperBound(header(parent), separator), parent_cell,
+               path);
+}
+
+void BTree::Rebuild(uint32_t id, uint8_t type, uint32_t next,
+                    const std::vector<yuki::Slice> &cells) {
+    std::vector<char> buf(PAGE_SIZE);
+
+    auto h = reinterpret_cast<PageHeader *>(buf.data());
+    h->type       = type;
+    h->padding    = 0;
+    h->num_cells  = static_cast<uint16_t>(cells.size());
+    h->cell_begin = PAGE_SIZE;
+    h->garbage    = 0;
+    h->next       = next;
+
+    auto offsets = CellOffsets(h);
+    for (size_t i = 0; i < cells.size(); i++) {
+        h->cell_begin -= cells[i].Length();
+        memcpy(buf.data() + h->cell_begin, cells[i].Data(), cells[i].Length());
+        offsets[i] = h->cell_begin;
+    }
+    DCHECK_GE(h->cell_begin,
+              sizeof(PageHeader) + cells.size() * sizeof(uint16_t));
+
+    memcpy(page(id), buf.data(), PAGE_SIZE);
+}
+
+void BTree::Compact(uint32_t id) {
+    auto h = header(id);
+
+    std::vector<yuki::Slice> cells;
+    for (int i = 0; i < h->num_cells; i++) {
+        auto p = Cell(h, i);
+        cells.emplace_back(reinterpret_cast<const char *>(p),
+                           CellSize(h->type, p));
+    }
+    Rebuild(id, h->type, h->next, cells);
+}
+
+uint32_t BTree::WriteOverflow(yuki::SliceRef value) {
+    uint32_t first = 0, prev = 0;
+
+    auto p = value.Data();
+    auto left = value.Length();
+    while (left > 0) {
+        auto id = AllocatePage();
+        auto h = header(id);
+        h->type       = PAGE_OVERFLOW;
+        h->num_cells  = 0;
+        h->cell_begin = PAGE_SIZE;
+        h->garbage    = 0;
+        h->next       = 0;
+
+        auto n = std::min(left, kOverflowCapacity);
+        memcpy(h + 1, p, n);
+        p    += n;
+        left -= n;
+
+        if (prev) {
+            header(prev)->next = id;
+        } else {
+            first = id;
+        }
+        prev = id;
+    }
+    return first;
+}
+
+void BTree::ReadOverflow(uint32_t first, size_t size, std::string *buf) const {
+    buf->clear();
+    buf->reserve(size);
+
+    auto id = first;
+    while (buf->size() < size) {
+        auto h = header(id);
+        DCHECK_EQ(PAGE_OVERFLOW, h->type);
+
+        auto n = std::min(size - buf->size(), kOverflowCapacity);
+        buf->append(reinterpret_cast<const char *>(h + 1), n);
+        id = h->next;
+    }
+}
+
+void BTree::FreeOverflow(const uint8_t *cell) {
+    LeafCell parsed;
+    ParseLeafCell(cell, &parsed);
+    if (parsed.value_size <= MAX_INLINE_VALUE_SIZE) {
+        return;
+    }
+
+    auto id = DecodeFixed32(parsed.value);
+    while (id) {
+        auto next = header(id)->next;
+        FreePage(id);
+        id = next;
+    }
+}
+
+void BTree::ReadValue(const uint8_t *cell, std::string *buf) const {
+    LeafCell parsed;
+    ParseLeafCell(cell, &parsed);
+    if (parsed.value_size > MAX_INLINE_VALUE_SIZE) {
+        ReadOverflow(DecodeFixed32(parsed.value), parsed.value_size, buf);
+    } else {
+        buf->assign(reinterpret_cast<const char *>(parsed.value),
+                    parsed.value_size);
+    }
+}
+
+yuki::Status BTree::LoadFreeList(const std::string &file_name) {
+    using yuki::Status;
+
+    // Pages of the list be in the last commit.
+    auto id = meta_.free_list;
+    while (id) {
+        if (id < NUM_META_PAGES || id >= meta_.num_pages ||
+            header(id)->type != PAGE_FREE_LIST ||
+            pending_free_.size() >= meta_.num_pages) {
+            return Status::Corruptionf("%s: bad free list page %u",
+                                       file_name.c_str(), id);
+        }
+        auto h = header(id);
+        auto ids = reinterpret_cast<const uint8_t *>(h + 1);
+        for (int i = 0; i < h->num_cells; i++) {
+            free_.push_back(DecodeFixed32(ids + i * sizeof(uint32_t)));
+        }
+        pending_free_.push_back(id);
+        id = h->next;
+    }
+    if (free_.size() != meta_.num_free) {
+        return Status::Corruptionf("%s: %zd free pages, expected %u",
+                                   file_name.c_str(), free_.size(),
+                                   meta_.num_free);
+    }
+    return Status::OK();
+}
+
+// Pages of the list be taken from the free ones first, so the ids be the
+// free pages after them.
+yuki::Status BTree::WriteFreeList(std::vector<uint32_t> *pages) {
+    auto n = (free_.size() + pending_free_.size() + kFreeListCapacity - 1) /
+             kFreeListCapacity;
+    auto rv = Reserve(static_cast<uint32_t>(n));
+    if (rv.Failed()) {
+        return rv;
+    }
+    while (pages->size() < n) {
+        pages->push_back(AllocatePage());
+    }
+
+    std::vector<uint32_t> ids(free_);
+    ids.insert(ids.end(), pending_free_.begin(), pending_free_.end());
+    size_t k = 0;
+    for (size_t i = 0; i < pages->size(); i++) {
+        auto h = header((*pages)[i]);
+        h->type       = PAGE_FREE_LIST;
+        h->padding    = 0;
+        h->num_cells  = 0;
+        h->cell_begin = PAGE_SIZE;
+        h->garbage    = 0;
+        h->next       = i + 1 < pages->size() ? (*pages)[i + 1] : 0;
+
+        auto p = reinterpret_cast<uint8_t *>(h + 1);
+        for (; k < ids.size() && h->num_cells < kFreeListCapacity; k++) {
+            EncodeFixed32(ids[k], p + h->num_cells++ * sizeof(uint32_t));
+        }
+    }
+    DCHECK_EQ(ids.size(), k);
+    meta_.free_list = pages->empty() ? 0 : pages->front();
+    meta_.num_free  = static_cast<uint32_t>(ids.size());
+    return yuki::Status::OK();
+}
+
+yuki::Status BTree::Reserve(uint32_t num_pages) {
+    using yuki::Status;
+
+    auto need = (static_cast<size_t>(meta_.num_pages) + num_pages) *
+                PAGE_SIZE;
+    if (need <= map_size_) {
+        return Status::OK();
+    }
+
+    auto size = map_size_;
+    while (size < need) {
+        size += std::min(size, kMaxGrowSize);
+    }
+    if (size / PAGE_SIZE > UINT32_MAX) {
+        return Status::Corruptionf("page file too large");
+    }
+
+    if (ftruncate(fd_, size) < 0) {
+        PLOG(ERROR) << "grow page file fail";
+        return Status::Systemf("grow page file fail");
+    }
+    auto mapped = mmap(nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapped == MAP_FAILED) {
+        PLOG(ERROR) << "remap page file fail";
+        return Status::Systemf("remap page file fail");
+    }
+    munmap(base_, map_size_);
+    base_ = static_cast<char *>(mapped);
+    map_size_ = size;
+    madvise(base_, map_size_, MADV_RANDOM);
+    return Status::OK();
+}
+
+uint32_t BTree::AllocatePage() {
+    uint32_t id;
+    if (!free_.empty()) {
+        id = free_.back();
+        free_.pop_back();
+    } else {
+        DCHECK_LE((static_cast<size_t>(meta_.num_pages) + 1) * PAGE_SIZE,
+                  map_size_);
+        id = meta_.num_pages++;
+    }
+    fresh_.insert(id);
+    return id;
+}
+
+// Pages of the last commit be reused after the next one.
+void BTree::FreePage(uint32_t id) {
+    if (fresh_.erase(id)) {
+        free_.push_back(id);
+    } else {
+        pending_free_.push_back(id);
+    }
+}
+
+BTree::Cursor::Cursor(BTree *tree)
+    : tree_(DCHECK_NOTNULL(tree))
+    , lock_(&tree->lock_) {
+}
+
+void BTree::Cursor::SeekToFirst() {
+    path_.clear();
+    Descend(tree_->meta_.root);
+    SkipEmptyLeaves();
+}
+
+void BTree::Cursor::Seek(yuki::SliceRef target) {
+    path_.clear();
+    auto id = tree_->meta_.root;
+    for (;;) {
+        auto h = tree_->header(id);
+        if (h->type == PAGE_LEAF) {
+            break;
+        }
+        auto pos = UpperBound(h, target);
+        path_.emplace_back(id, pos);
+        id = Child(h, pos);
+    }
+    page_ = id;
+    index_ = LowerBound(tree_->header(page_), target, nullptr);
+    SkipEmptyLeaves();
+}
+
+void BTree::Cursor::Next() {
+    DCHECK(Valid());
+    index_++;
+    SkipEmptyLeaves();
+}
+
+yuki::Slice BTree::Cursor::key() const {
+    DCHECK(Valid());
+    return CellKey(PAGE_LEAF, Cell(tree_->header(page_), index_));
+}
+
+uint64_t BTree::Cursor::version_number() const {
+    DCHECK(Valid());
+    LeafCell parsed;
+    ParseLeafCell(Cell(tree_->header(page_), index_), &parsed);
+    return parsed.version_number;
+}
+
+void BTree::Cursor::value(std::string *buf) const {
+    DCHECK(Valid());
+    tree_->ReadValue(Cell(tree_->header(page_), index_), buf);
+}
+
+// Go down to the leftmost leaf of the page.
+void BTree::Cursor::Descend(uint32_t id) {
+    while (tree_->header(id)->type != PAGE_LEAF) {
+        path_.emplace_back(id, 0);
+        id = tree_->header(id)->next;
+    }
+    page_ = id;
+    index_ = 0;
+}
+
+// Go up to the first parent has a right child, then down to its leftmost
+// leaf.
+void BTree::Cursor::NextLeaf() {
+    while (!path_.empty()) {
+        auto &top = path_.back();
+        auto h = tree_->header(top.first);
+        if (top.second < h->num_cells) {
+            top.second++;
+            Descend(Child(h, top.second));
+            return;
+        }
+        path_.pop_back();
+    }
+    page_ = 0;
+}
+
+void BTree::Cursor::SkipEmptyLeaves() {
+    while (page_ != 0 && index_ >= tree_->header(page_)->num_cells) {
+        NextLeaf();
+    }
+}
+
+} // namespace yukino
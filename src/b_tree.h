@@ -0,0 +1,232 @@
+#ifndef YUKINO_B_TREE_H_
+#define YUKINO_B_TREE_H_
+
+#include "rw_spin_lock.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include <stdint.h>
+
+namespace yukino {
+
+//
+// B+tree on a memory-mapped file of fixed size pages, keys be sorted by
+// bytes. The kernel page cache is the buffer of hot pages: the tree can be
+// larger than memory, and be opened without loading anything.
+//
+// File layout:
+// [meta page 0][meta page 1][page 2][page 3]...
+//
+// Pages of the last commit never be changed. A page be copied to a new one
+// at the first writing after the commit, with the path from the root, and
+// freed pages be reused only after the next commit. Commit() writes pages
+// back, then the meta to the older meta page, with the larger sequence and
+// the checksum. Opening takes the valid meta of the larger sequence, so after
+// a crash the tree be the one of the last commit, pages written back by the
+// kernel after it (or torn) be not referenced.
+//
+// Page:
+// [PageHeader][cell offsets (uint16)...] ... [cells]
+// Leaf cell:
+// [key-length(varint32)][key][version(varint64)][value-length(varint32)]
+// [value bytes] or [first overflow page(fixed32)] for the large value
+// Internal cell:
+// [child page(fixed32)][key-length(varint32)][key]
+// keys >= cell's key and < next cell's key be in the child, smaller keys be in
+// the leftmost child.
+// Free list page:
+// [PageHeader][free page(fixed32)...], num_cells be the number of pages.
+//
+// Writers be serialized by the writer lock, because the file may be remapped
+// for growing. Readers and cursors hold the reader lock.
+// Empty leaves be not merged, they be reused after keys coming back.
+//
+class BTree {
+public:
+    enum {
+        PAGE_SIZE = 8192,
+        MAX_KEY_SIZE = 1024,
+        // Larger values be stored in the overflow pages.
+        MAX_INLINE_VALUE_SIZE = 1024,
+        INITIAL_NUM_PAGES = 64,
+        NUM_META_PAGES = 2,
+    };
+
+    enum PageType : uint8_t {
+        PAGE_FREE_LIST,
+        PAGE_LEAF,
+        PAGE_INTERNAL,
+        PAGE_OVERFLOW,
+    };
+
+    struct Meta {
+        char     magic[8];   // "YKNBTREE"
+        uint32_t page_size;
+        uint32_t root;
+        uint32_t height;
+        uint32_t num_pages;  // pages in use, include the meta pages.
+        uint32_t free_list;  // first free list page, 0 be none.
+        uint32_t num_free;   // pages in the free list.
+        int64_t  num_keys;
+        // The WAL position applied to the tree, see Commit().
+        int64_t  log_version;
+        int64_t  log_applied;
+        uint64_t sequence;   // of the commit.
+        uint32_t checksum;   // crc32 of the fields above.
+        uint32_t padding;
+    };
+
+    struct PageHeader {
+        uint8_t  type;
+        uint8_t  padding;
+        uint16_t num_cells;
+        uint16_t cell_begin; // cells be stored from here to the page end.
+        uint16_t garbage;    // bytes of removed cells.
+        // internal: leftmost child, overflow and free list: next page,
+        // leaf: 0, pages be copied, so no sibling link.
+        uint32_t next;
+    };
+
+    BTree();
+    BTree(const BTree &) = delete;
+    void operator = (const BTree &) = delete;
+    ~BTree();
+
+    // Open the file, create it if not exist.
+    yuki::Status Open(const std::string &file_name);
+
+    yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                     yuki::SliceRef value);
+    bool Delete(yuki::SliceRef key);
+
+    // `version_number' and `value' can be null.
+    yuki::Status Get(yuki::SliceRef key, uint64_t *version_number,
+                     std::string *value);
+
+    // Write dirty pages back to the file, the tree opened from the file be
+    // still the last committed one.
+    yuki::Status Sync();
+
+    // Make the tree on the file be the current one. The owner records the
+    // WAL file and the number of records in it be applied, so the redo after
+    // reopening starts right after them, every record be applied once.
+    // Must be called without writers.
+    yuki::Status Commit(int64_t log_version, int64_t log_applied);
+
+    // Position of the last commit.
+    void GetLogPosition(int64_t *log_version, int64_t *log_applied) const;
+
+    int64_t num_keys() const { return num_keys_.load(); }
+    uint32_t num_pages() const;
+    uint32_t height() const;
+
+    //
+    // Ordered cursor, holds the reader lock in its life time, so do not write
+    // the tree in the same thread before it destroied.
+    //
+    class Cursor {
+    public:
+        explicit Cursor(BTree *tree);
+        Cursor(const Cursor &) = delete;
+        void operator = (const Cursor &) = delete;
+
+        bool Valid() const { return page_ != 0; }
+        void SeekToFirst();
+        // Seek to the first key >= target.
+        void Seek(yuki::SliceRef target);
+        void Next();
+
+        yuki::Slice key() const;
+        uint64_t version_number() const;
+        void value(std::string *buf) const;
+
+    private:
+        void Descend(uint32_t id);
+        void NextLeaf();
+        void SkipEmptyLeaves();
+
+        BTree *tree_;
+        ReaderLock lock_;
+        // Internal pages from the root, with the position of the child be
+        // walked in, leaves be reached through them.
+        std::vector<std::pair<uint32_t, int>> path_;
+        uint32_t page_ = 0;
+        int index_ = 0;
+    };
+
+private:
+    char *page(uint32_t id) const {
+        return base_ + static_cast<size_t>(id) * PAGE_SIZE;
+    }
+    PageHeader *header(uint32_t id) const {
+        return reinterpret_cast<PageHeader *>(page(id));
+    }
+
+    static uint16_t *CellOffsets(PageHeader *h) {
+        return reinterpret_cast<uint16_t *>(h + 1);
+    }
+    static const uint8_t *Cell(PageHeader *h, int i) {
+        return reinterpret_cast<const uint8_t *>(h) + CellOffsets(h)[i];
+    }
+    static yuki::Slice CellKey(uint8_t type, const uint8_t *cell);
+    static size_t CellSize(uint8_t type, const uint8_t *cell);
+    static uint32_t CellChild(const uint8_t *cell);
+    // Child at `pos' of the internal page, 0 be the leftmost one.
+    static uint32_t Child(PageHeader *h, int pos);
+    static uint32_t MetaChecksum(const Meta &m);
+
+    // First cell >= key.
+    static int LowerBound(PageHeader *h, yuki::SliceRef key, bool *equal);
+    // First cell > key.
+    static int UpperBound(PageHeader *h, yuki::SliceRef key);
+
+    uint32_t FindLeaf(yuki::SliceRef key, std::vector<uint32_t> *path) const;
+    // As FindLeaf(), but pages on the path be copied if they be in the last
+    // commit, so they can be written in place.
+    uint32_t FindWritableLeaf(yuki::SliceRef key, std::vector<uint32_t> *path);
+    uint32_t Writable(uint32_t id);
+
+    void InsertCell(uint32_t id, int index, yuki::SliceRef cell,
+                    std::vector<uint32_t> *path);
+    void RemoveCell(uint32_t id, int index);
+    void Split(uint32_t id, int index, yuki::SliceRef cell,
+               std::vector<uint32_t> *path);
+    void Rebuild(uint32_t id, uint8_t type, uint32_t next,
+                 const std::vector<yuki::Slice> &cells);
+    void Compact(uint32_t id);
+
+    uint32_t WriteOverflow(yuki::SliceRef value);
+    void ReadOverflow(uint32_t first, size_t size, std::string *buf) const;
+    void FreeOverflow(const uint8_t *cell);
+    void ReadValue(const uint8_t *cell, std::string *buf) const;
+
+    yuki::Status LoadFreeList(const std::string &file_name);
+    yuki::Status WriteFreeList(std::vector<uint32_t> *pages);
+
+    // Grow the file, so `num_pages' more pages can be allocated.
+    yuki::Status Reserve(uint32_t num_pages);
+    uint32_t AllocatePage();
+    void FreePage(uint32_t id);
+
+    int fd_ = -1;
+    char *base_ = nullptr;
+    size_t map_size_ = 0;
+    std::atomic<int64_t> num_keys_;
+    RWSpinLock lock_;
+    Meta meta_; // of the current tree, be written to the file by Commit().
+    std::unordered_set<uint32_t> fresh_; // allocated after the last commit.
+    std::vector<uint32_t> free_;         // can be reused now.
+    std::vector<uint32_t> pending_free_; // in the last commit, be reused
+                                         // after the next one.
+};
+
+static_assert(sizeof(BTree::PageHeader) == 12, "Fixed page header size.");
+static_assert(sizeof(BTree::Meta) <= BTree::PAGE_SIZE, "Meta too large.");
+
+} // namespace yukino
+
+#endif // YUKINO_B_TREE_H_
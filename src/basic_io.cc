@@ -43,7 +43,7 @@ public:
 
     virtual bool Read(size_t need, yuki::Slice *buf, std::string */*stub*/)
         override {
-        if (buf_ >= end_) {
+        if (buf_ >= end_ && need > 0) {
             return false;
         }
         need = std::min(static_cast<size_t>(end_ - buf_), need);
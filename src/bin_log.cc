@@ -1,17 +1,61 @@
 #include "bin_log.h"
 #include "basic_io.h"
 #include "serialized_io.h"
+#include "crc32.h"
 #include "obj.h"
+#include <algorithm>
 
 namespace yukino {
 
+namespace {
+
+enum RecordType {
+    kZeroType   = 0, // preallocated or padding.
+    kFullType   = 1,
+    kFirstType  = 2,
+    kMiddleType = 3,
+    kLastType   = 4,
+};
+
+// [crc32(fixed32)] [length(fixed16)] [type(byte)]
+static const size_t kHeaderSize = 4 + 2 + 1;
+
+inline uint32_t RecordChecksum(char type, const char *data, size_t size) {
+    return crc32(crc32(0, &type, 1), data, size);
+}
+
+// Logs before the framing be a sequence of bare payloads, check if
+// `data' starts with one of them.
+bool IsUnframedRecord(yuki::Slice data) {
+    SerializedInputStream deserializer(NewBufferedInputStream(data), true);
+    uint8_t byte;
+    int64_t version;
+    uint32_t n;
+    if (!deserializer.ReadByte(&byte) || byte >= MAX_COMMANDS ||
+        !deserializer.ReadSInt64(&version) || !deserializer.ReadInt32(&n)) {
+        return false;
+    }
+    while (n--) {
+        Handle<Obj> obj(ObjDeserialize(&deserializer));
+        if (!obj.get()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
 BinLogWriter::BinLogWriter(OutputStream *stream,
                            bool ownership,
                            size_t block_size,
                            size_t initial_size)
     : block_stream_(stream)
     , ownership_(ownership)
+    , block_size_(block_size)
     , written_bytes_(initial_size) {
+    DCHECK_GT(block_size_, kHeaderSize);
+    DCHECK_LE(block_size_, 0xffffUL + kHeaderSize);
 }
 
 BinLogWriter::~BinLogWriter() {
@@ -20,26 +64,78 @@ BinLogWriter::~BinLogWriter() {
     }
 }
 
-// [code(byte)] [version(varint64)] [argc(varint32)] [payload]
+// payload: [code(byte)] [version(varint64)] [argc(varint32)] [args]
 yuki::Status BinLogWriter::Append(CmdCode cmd_code, int64_t version,
                                   const std::vector<Handle<Obj>> &args) {
-    using yuki::Status;
-    using yuki::Slice;
+    record_.clear();
+    {
+        SerializedOutputStream serializer(NewBufferedOutputStream(&record_),
+                                          true);
+        serializer.WriteByte(static_cast<char>(cmd_code));
+        serializer.WriteSInt64(version);
+        serializer.WriteInt32(static_cast<uint32_t>(args.size()));
+        for (const auto &obj : args) {
+            ObjSerialize(obj.get(), &serializer);
+        }
+    }
 
-    SerializedOutputStream serializer(block_stream_, false);
+    buf_.clear();
+    const char *p = record_.data();
+    size_t left = record_.size();
+    bool begin = true;
+    for (;;) {
+        auto avail = block_size_ - (written_bytes_ + buf_.size()) % block_size_;
+        if (avail < kHeaderSize) {
+            buf_.append(avail, '\0'); // switch to the next block.
+            continue;
+        }
+
+        auto size = std::min(left, avail - kHeaderSize);
+        bool end = (size == left);
+        int type;
+        if (begin && end) {
+            type = kFullType;
+        } else if (begin) {
+            type = kFirstType;
+        } else if (end) {
+            type = kLastType;
+        } else {
+            type = kMiddleType;
+        }
+        EmitFragment(type, p, size);
 
-    size_t bytes = 0;
-    bytes += serializer.WriteByte(static_cast<char>(cmd_code));
-    bytes += serializer.WriteSInt64(version);
-    bytes += serializer.WriteInt32(static_cast<uint32_t>(args.size()));
-    for (const auto &obj : args) {
-        bytes += ObjSerialize(obj.get(), &serializer);
+        p += size;
+        left -= size;
+        begin = false;
+        if (end) {
+            break;
+        }
     }
 
-    written_bytes_ += bytes;
+    auto written = block_stream_->Write(buf_.data(), buf_.size());
+    written_bytes_ += written;
+    if (written != buf_.size() && block_stream_->status().Ok()) {
+        return yuki::Status::Systemf("write log fail, %zu/%zu", written,
+                                     buf_.size());
+    }
     return block_stream_->status();
 }
 
+void BinLogWriter::EmitFragment(int type, const char *data, size_t size) {
+    auto crc = RecordChecksum(static_cast<char>(type), data, size);
+    char header[kHeaderSize];
+    header[0] = static_cast<char>(crc & 0xff);
+    header[1] = static_cast<char>((crc >> 8) & 0xff);
+    header[2] = static_cast<char>((crc >> 16) & 0xff);
+    header[3] = static_cast<char>((crc >> 24) & 0xff);
+    header[4] = static_cast<char>(size & 0xff);
+    header[5] = static_cast<char>((size >> 8) & 0xff);
+    header[6] = static_cast<char>(type);
+
+    buf_.append(header, kHeaderSize);
+    buf_.append(data, size);
+}
+
 void BinLogWriter::Reset(OutputStream *stream) {
     if (stream == block_stream_) {
         return;
@@ -54,7 +150,8 @@ void BinLogWriter::Reset(OutputStream *stream) {
 BinLogReader::BinLogReader(InputStream *stream, bool ownership,
                            size_t block_size)
     : block_stream_(stream)
-    , ownership_(ownership) {
+    , ownership_(ownership)
+    , block_size_(block_size) {
 }
 
 BinLogReader::~BinLogReader() {
@@ -63,32 +160,151 @@ BinLogReader::~BinLogReader() {
     }
 }
 
-#define CALL(expr) if (!expr) { return false; } (void)0
+#define CALL(expr) if (!expr) { goto corrupted; } (void)0
 
 bool BinLogReader::Read(Operator *op, yuki::Status *status) {
     using yuki::Status;
     using yuki::Slice;
 
-    SerializedInputStream deserializer(block_stream_, false);
-    uint8_t byte;
-    CALL(deserializer.ReadByte(&byte));
-    op->cmd = static_cast<CmdCode>(byte);
+    *status = Status::OK();
 
-    CALL(deserializer.ReadSInt64(&op->version));
+    bool in_record = false;
+    record_.clear();
+    for (;;) {
+        int type;
+        Slice fragment;
+        if (!ReadFragment(&type, &fragment, status)) {
+            if (position_ == 0 && block_stream_->status().Ok() &&
+                IsUnframedRecord(block_)) {
+                *status = Status::Corruptionf("unsupported log format, "
+                                              "not framed. Redo it with an "
+                                              "older build.");
+            }
+            return false; // the torn record in the end be dropped.
+        }
 
-    op->args.clear();
-    uint32_t n;
-    CALL(deserializer.ReadInt32(&n));
-    while (n--) {
-        auto obj = ObjDeserialize(&deserializer);
-        if (!obj) {
-            *status = block_stream_->status();
+        if (type == kFullType || type == kFirstType) {
+            if (in_record) {
+                *status = Status::Corruptionf("partial record at %zu",
+                                              position_);
+                return false;
+            }
+            record_.assign(fragment.Data(), fragment.Length());
+            in_record = true;
+        } else if (type == kMiddleType || type == kLastType) {
+            if (!in_record) {
+                *status = Status::Corruptionf("orphan fragment at %zu",
+                                              position_);
+                return false;
+            }
+            record_.append(fragment.Data(), fragment.Length());
+        } else {
+            *status = Status::Corruptionf("unknown record type %d at %zu",
+                                          type, position_);
             return false;
         }
 
-        op->args.emplace_back(obj);
+        if (type == kFullType || type == kLastType) {
+            break;
+        }
+    }
+    offset_ = position_;
+
+    {
+        SerializedInputStream deserializer(
+                NewBufferedInputStream(Slice(record_)), true);
+        uint8_t byte;
+        uint32_t n;
+        CALL(deserializer.ReadByte(&byte));
+        op->cmd = static_cast<CmdCode>(byte);
+
+        CALL(deserializer.ReadSInt64(&op->version));
+
+        op->args.clear();
+        CALL(deserializer.ReadInt32(&n));
+        while (n--) {
+            auto obj = ObjDeserialize(&deserializer);
+            if (!obj) {
+                goto corrupted;
+            }
+
+            op->args.emplace_back(obj);
+        }
+        return true;
+    }
+
+corrupted:
+    *status = Status::Corruptionf("bad record before %zu", offset_);
+    return false;
+}
+
+#undef CALL
+
+bool BinLogReader::ReadFragment(int *type, yuki::Slice *fragment,
+                                yuki::Status *status) {
+    using yuki::Status;
+    using yuki::Slice;
+
+    for (;;) {
+        if (block_.Length() < kHeaderSize) {
+            if (eof_) {
+                return false;
+            }
+
+            // Skip the trailer, read the next block.
+            position_ += block_.Length();
+            Slice block;
+            if (!block_stream_->Read(block_size_, &block, &stub_)) {
+                block = Slice();
+            }
+            if (block.Length() < block_size_) {
+                *status = block_stream_->status();
+                eof_ = true;
+                if (status->Failed()) {
+                    return false;
+                }
+            }
+            block_ = block;
+            continue;
+        }
+
+        auto header = reinterpret_cast<const uint8_t *>(block_.Data());
+        uint32_t crc = static_cast<uint32_t>(header[0]) |
+                       (static_cast<uint32_t>(header[1]) << 8) |
+                       (static_cast<uint32_t>(header[2]) << 16) |
+                       (static_cast<uint32_t>(header[3]) << 24);
+        size_t size = static_cast<size_t>(header[4]) |
+                      (static_cast<size_t>(header[5]) << 8);
+        *type = header[6];
+
+        if (kHeaderSize + size > block_.Length()) {
+            if (eof_) {
+                return false; // torn in writing.
+            }
+            *status = Status::Corruptionf("bad record length at %zu",
+                                          position_);
+            return false;
+        }
+
+        if (*type == kZeroType && size == 0) {
+            // Zero filled, nothing in the rest of this block.
+            position_ += block_.Length();
+            block_ = Slice();
+            continue;
+        }
+
+        auto data = block_.Data() + kHeaderSize;
+        if (crc != RecordChecksum(static_cast<char>(*type), data, size)) {
+            *status = Status::Corruptionf("record checksum fail at %zu",
+                                          position_);
+            return false;
+        }
+
+        *fragment = Slice(data, size);
+        position_ += kHeaderSize + size;
+        block_ = Slice(data + size, block_.Length() - kHeaderSize - size);
+        return true;
     }
-    return true;
 }
 
-} // namespace yukino
\ No newline at end of file
+} // namespace yukino
@@ -6,6 +6,7 @@
 #include "yuki/slice.h"
 #include "yuki/status.h"
 #include <stdint.h>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -15,12 +16,21 @@ struct Obj;
 class OutputStream;
 class InputStream;
 
+// The log file be split into blocks, LevelDB style:
+// record := [crc32(fixed32)] [length(fixed16)] [type(byte)] [payload]
+// A record be fragmented if it can not fit in the rest of the block, the
+// block trailer less than one header be filled by zero.
+static const size_t kLogBlockSize = 32 * 1024;
+
 class BinLogWriter {
 public:
+    // `initial_size' be the size of the file appended to, for the
+    // position in the block.
     BinLogWriter(OutputStream *stream, bool ownership, size_t block_size,
                  size_t initial_size);
     ~BinLogWriter();
 
+    // The whole framed record be written by one Write().
     yuki::Status Append(CmdCode cmd_code, int64_t version,
                         const std::vector<Handle<Obj>> &args);
 
@@ -28,9 +38,14 @@ public:
 
     size_t written_bytes() const { return written_bytes_; }
 private:
+    void EmitFragment(int type, const char *data, size_t size);
+
     OutputStream *block_stream_;
     bool ownership_;
+    const size_t block_size_;
     size_t written_bytes_ = 0;
+    std::string record_;  // the payload
+    std::string buf_;     // the framed record
 };
 
 struct Operator {
@@ -44,11 +59,25 @@ public:
     BinLogReader(InputStream *stream, bool ownership, size_t block_size);
     ~BinLogReader();
 
+    // Return false at the end, or `status' be set if the log be corrupted.
+    // The torn record in the end (crashed in writing) be ignored.
     bool Read(Operator *op, yuki::Status *status);
 
+    // Bytes till the end of the last record read.
+    size_t offset() const { return offset_; }
+
 private:
+    bool ReadFragment(int *type, yuki::Slice *fragment, yuki::Status *status);
+
     InputStream *block_stream_;
     bool ownership_;
+    const size_t block_size_;
+    std::string stub_;
+    yuki::Slice block_;   // rest of the current block
+    size_t position_ = 0; // position of block_ in the file
+    size_t offset_ = 0;
+    bool eof_ = false;
+    std::string record_;
 };
 
 } // namespace yukino
@@ -14,9 +14,16 @@
 #include "yuki/varint.h"
 #include "yuki/strings.h"
 #include <stdarg.h>
+#include <strings.h>
+#include <algorithm>
+#include <unordered_set>
 
 namespace yukino {
 
+// Keys of one batch when sweeping the whole db by Scan().
+static const int64_t kScanBatchSize    = 1024;
+static const int64_t kScanDefaultCount = 10;
+
 const Command kCommands[] = {
 #define DEF_CMD(name, argc) { #name, CMD_##name, argc },
     DECL_COMMANDS(DEF_CMD)
@@ -210,6 +217,11 @@ yuki::Status Client::OutgoingWrite() {
     return Status::OK();
 }
 
+// Args be null if out of memory.
+static bool IsNullArg(const Handle<Obj> &arg) {
+    return arg.get() == nullptr;
+}
+
 bool Client::ProcessTextInputBuffer(yuki::SliceRef buf, size_t *proced) {
     using yuki::Slice;
 
@@ -260,6 +272,9 @@ bool Client::ProcessTextInputBuffer(yuki::SliceRef buf, size_t *proced) {
     if (!cmd_entry) {
         AddErrorReply("Command %.*s not support.", cmd.Length(), cmd.Data());
         rv = false;
+    } else if (std::any_of(args.begin(), args.end(), IsNullArg)) {
+        AddErrorReply("Not enough memory.");
+        rv = false;
     } else {
         rv = ProcessCommand(*cmd_entry, Slice(), args);
     }
@@ -274,9 +289,13 @@ bool Client::ProcessBinaryInputBuffer(yuki::SliceRef buf, size_t *proced) {
     return false;
 }
 
-#define APPEND_LOG(ts) \
+#define APPEND_LOG_AS(code, ts, log_args) \
     do { \
-        auto append_log_rv = db->AppendLog(cmd.code, (ts), args); \
+        if (std::any_of((log_args).begin(), (log_args).end(), IsNullArg)) { \
+            AddErrorReply("%s fail: not enough memory.", cmd.z); \
+            return false; \
+        } \
+        auto append_log_rv = db->AppendLog((code), (ts), (log_args)); \
         if (append_log_rv.Failed()) { \
             AddErrorReply("%s append log fail: %s", cmd.z, \
                           append_log_rv.ToString().c_str()); \
@@ -284,6 +303,8 @@ bool Client::ProcessBinaryInputBuffer(yuki::SliceRef buf, size_t *proced) {
         } \
     } while (0)
 
+#define APPEND_LOG(ts) APPEND_LOG_AS(cmd.code, ts, args)
+
 #define GET_KEY(key, index) \
     String *key = nullptr; \
     do { \
@@ -427,19 +448,193 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
         GET_KEY(key, 0);
         auto ts = worker_->server()->current_milsces();
 
-        APPEND_LOG(ts);
-        auto rv = db->Put(key->data(), ts, args[1].get());
+        // Numeric strings be stored as integers, small ones be shared.
+        Handle<Obj> value(ObjIntegerIf(args[1].get()));
+
+        int64_t expire_at = 0;
+        if (!GetExpireTime(cmd, args, 2, ts, &expire_at)) {
+            return false;
+        }
+        auto log_args = &args;
+        std::vector<Handle<Obj>> expire_args;
+        if (expire_at > 0) {
+            if (!db->expirable()) {
+                AddErrorReply("SET EX not support, db can not expire keys.");
+                return false;
+            }
+            // Log the absolute time, so the redo expires it at the same
+            // time.
+            expire_args.assign(args.begin(), args.begin() + 2);
+            expire_args.emplace_back(String::New(Slice("PXAT", 4)));
+            expire_args.emplace_back(Integer::New(expire_at));
+            log_args = &expire_args;
+        }
+
+        WriteScope writing(db);
+        APPEND_LOG_AS(CMD_SET, ts, *log_args);
+        auto rv = (expire_at > 0) ?
+            db->PutExpire(key->data(), expire_at, value.get()) :
+            db->Put(key->data(), ts, value.get());
         if (rv.Failed()) {
             AddErrorReply("SET fail: %s", rv.ToString().c_str());
             return false;
         }
-        
+
+        AddStringReply(Slice("ok", 2));
+    } return true;
+
+    case CMD_INCR:
+    case CMD_DECR:
+    case CMD_INCRBY: {
+        GET_KEY(key, 0);
+        int64_t delta = (cmd.code == CMD_DECR) ? -1 : 1;
+        if (cmd.code == CMD_INCRBY && !ObjCastIntIf(args[1].get(), &delta)) {
+            AddErrorReply("Bad type, expect integer.");
+            return false;
+        }
+        auto ts = worker_->server()->current_milsces();
+
+        // All be logged as "INCRBY key delta", only the delta.
+        std::vector<Handle<Obj>> log_args;
+        log_args.emplace_back(args[0]);
+        log_args.emplace_back(Integer::New(delta));
+
+        WriteScope writing(db);
+        APPEND_LOG_AS(CMD_INCRBY, ts, log_args);
+        Handle<Obj> value;
+        auto rv = db->Update(key->data(), ts, [&value, delta] (Obj *old) {
+            value = ObjIncrBy(old, delta);
+            return value.get();
+        });
+        if (rv.Failed()) {
+            AddErrorReply("%s fail: %s", cmd.z, rv.ToString().c_str());
+            return false;
+        }
+        if (!value.get()) {
+            AddErrorReply("%s fail: not an integer or overflow.", cmd.z);
+            return false;
+        }
+        AddIntegerReply(static_cast<Integer *>(value.get())->data());
+    } return true;
+
+    case CMD_EXPIRE:
+    case CMD_PEXPIREAT: {
+        GET_KEY(key, 0);
+        if (!db->expirable()) {
+            AddErrorReply("%s not support, db can not expire keys.", cmd.z);
+            return false;
+        }
+        int64_t value = 0;
+        if (!ObjCastIntIf(args[1].get(), &value)) {
+            AddErrorReply("Bad type, expect integer.");
+            return false;
+        }
+        auto ts = worker_->server()->current_milsces();
+        auto expire_at = (cmd.code == CMD_EXPIRE) ? ts + value * 1000 : value;
+        if (expire_at <= 0) {
+            expire_at = 1; // already expired, but 0 means persistent.
+        }
+
+        if (db->Get(key->data(), nullptr, nullptr).Failed()) {
+            AddIntegerReply(0);
+            return true;
+        }
+        std::vector<Handle<Obj>> log_args;
+        log_args.push_back(args[0]);
+        log_args.emplace_back(Integer::New(expire_at));
+        WriteScope writing(db);
+        APPEND_LOG_AS(CMD_PEXPIREAT, 0, log_args);
+        AddIntegerReply(db->Expire(key->data(), expire_at) ? 1 : 0);
+    } return true;
+
+    case CMD_TTL: {
+        GET_KEY(key, 0);
+
+        Version version;
+        if (db->Get(key->data(), &version, nullptr).Failed()) {
+            AddIntegerReply(-2);
+        } else if (version.type != VERSION_EXPIRE) {
+            AddIntegerReply(-1);
+        } else {
+            auto ttl = static_cast<int64_t>(version.number) -
+                       worker_->server()->current_milsces();
+            AddIntegerReply(ttl < 0 ? 0 : (ttl + 500) / 1000);
+        }
+    } return true;
+
+    case CMD_PERSIST: {
+        GET_KEY(key, 0);
+
+        Version version;
+        if (db->Get(key->data(), &version, nullptr).Failed() ||
+            version.type != VERSION_EXPIRE) {
+            AddIntegerReply(0);
+            return true;
+        }
+        WriteScope writing(db);
+        APPEND_LOG(0);
+        AddIntegerReply(db->Expire(key->data(), 0) ? 1 : 0);
+    } return true;
+
+    case CMD_MGET: {
+        std::vector<Slice> keys;
+        keys.reserve(args.size());
+        for (size_t i = 0; i < args.size(); i++) {
+            GET_KEY(key, i);
+            keys.push_back(key->data());
+        }
+
+        std::vector<Obj *> values(keys.size(), nullptr);
+        db->MultiGet(keys.size(), keys.data(), values.data());
+
+        AddArrayHead(values.size());
+        for (auto value : values) {
+            if (value && value->type() != YKN_INTEGER &&
+                value->type() != YKN_STRING) {
+                AddObjReply(nullptr);
+            } else {
+                AddObjReply(value);
+            }
+            if (value) {
+                ObjRelease(value);
+            }
+        }
+    } return true;
+
+    case CMD_MSET: {
+        if (args.size() % 2 != 0) {
+            AddErrorReply("%s bad arguments number, expect key-value pairs.",
+                          cmd.z);
+            return false;
+        }
+        for (size_t i = 0; i < args.size(); i += 2) {
+            if (args[i]->type() != YKN_STRING) {
+                AddErrorReply("%s bad key type, expected STRING.", cmd.z);
+                return false;
+            }
+        }
+        auto ts = worker_->server()->current_milsces();
+
+        WriteScope writing(db);
+        APPEND_LOG(ts);
+        for (size_t i = 0; i < args.size(); i += 2) {
+            auto key = static_cast<String *>(args[i].get());
+            // Same as SET, numeric strings be integers.
+            Handle<Obj> value(ObjIntegerIf(args[i + 1].get()));
+            auto rv = db->Put(key->data(), ts, value.get());
+            if (rv.Failed()) {
+                AddErrorReply("MSET fail: %s", rv.ToString().c_str());
+                return false;
+            }
+        }
+
         AddStringReply(Slice("ok", 2));
     } return true;
 
     case CMD_DEL: {
         GET_KEY(key, 0);
 
+        WriteScope writing(db);
         APPEND_LOG(0);
         auto rv = db->Delete(key->data());
         if (rv) {
@@ -459,18 +654,78 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
         }
 
         auto num_keys = db->num_keys();
-        if (limit <= 0) {
+        if (limit <= 0 || limit > num_keys) {
             limit = num_keys;
         }
 
-        AddArrayHead(limit < num_keys ? limit : num_keys);
-        std::unique_ptr<Iterator> iter(db->iterator());
-        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-            if (limit-- <= 0) {
-                break;
+        std::vector<std::string> keys;
+        if (db->ordered()) {
+            std::unique_ptr<Iterator> iter(db->iterator());
+            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                if (static_cast<int64_t>(keys.size()) >= limit) {
+                    break;
+                }
+                keys.push_back(iter->key()->key().ToString());
+            }
+        } else {
+            // Sweep in batches, so the resizing and writers be not blocked
+            // by the whole iteration.
+            // Keys can be visited twice if the table resized, so they be
+            // deduplicated during the sweep, and the limit be counted on
+            // the unique ones.
+            auto now = WallMilsces();
+            std::unordered_set<std::string> seen;
+            uint64_t cursor = 0;
+            do {
+                cursor = db->Scan(cursor, kScanBatchSize,
+                                  [&keys, &seen, now, limit] (KeyBoundle *key,
+                                                              Obj *) {
+                    if (static_cast<int64_t>(keys.size()) >= limit ||
+                        key->version().expired(now)) {
+                        return;
+                    }
+                    auto rv = seen.insert(key->key().ToString());
+                    if (rv.second) {
+                        keys.push_back(*rv.first);
+                    }
+                });
+            } while (cursor != 0 && static_cast<int64_t>(keys.size()) < limit);
+        }
+
+        AddArrayHead(keys.size());
+        for (const auto &key : keys) {
+            AddStringReply(yuki::Slice(key));
+        }
+    } return true;
+
+    case CMD_SCAN: {
+        int64_t cursor = 0, count = kScanDefaultCount;
+        if (!ObjCastIntIf(args[0].get(), &cursor) || cursor < 0) {
+            AddErrorReply("Bad cursor, expect integer.");
+            return false;
+        }
+        if (args.size() > 1 && !ObjCastIntIf(args[1].get(), &count)) {
+            AddErrorReply("Bad type, expect integer.");
+            return false;
+        }
+        if (count <= 0) {
+            count = kScanDefaultCount;
+        }
+
+        std::vector<std::string> keys;
+        auto now = WallMilsces();
+        auto next = db->Scan(static_cast<uint64_t>(cursor), count,
+                             [&keys, now] (KeyBoundle *key, Obj *) {
+            if (!key->version().expired(now)) {
+                keys.push_back(key->key().ToString());
             }
+        });
 
-            AddStringReply(iter->key()->key());
+        AddArrayHead(2);
+        AddIntegerReply(static_cast<int64_t>(next));
+        AddArrayHead(keys.size());
+        for (const auto &key : keys) {
+            AddStringReply(yuki::Slice(key));
         }
     } return true;
 
@@ -481,11 +736,15 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
             return false;
         }
         for (int i = 1; i < args.size(); i++) {
-            list->stub()->InsertTail(args[i].get());
+            if (!list->stub()->InsertTail(args[i].get())) {
+                AddErrorReply("LIST not enough memory");
+                return false;
+            }
         }
         GET_KEY(key, 0);
 
         auto ts = worker_->server()->current_milsces();
+        WriteScope writing(db);
         APPEND_LOG(ts);
         auto rv = db->Put(key->data(), ts, list.get());
         if (rv.Failed()) {
@@ -495,6 +754,46 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
         AddStringReply(Slice("ok", 2));
     } return true;
 
+    case CMD_RANGE:
+    case CMD_PREFIX:
+    case CMD_RCOUNT: {
+        if (!db->ordered()) {
+            AddErrorReply("%s not support, db is not ordered.", cmd.z);
+            return false;
+        }
+        GET_KEY(begin, 0);
+
+        int64_t limit = 0;
+        size_t limit_index = (cmd.code == CMD_PREFIX) ? 1 : 2;
+        if (args.size() > limit_index) {
+            if (!ObjCastIntIf(args[limit_index].get(), &limit)) {
+                AddErrorReply("Bad type, expect integer.");
+                return false;
+            }
+        }
+
+        if (cmd.code == CMD_PREFIX) {
+            return AddRangeReply(db, begin->data(), Slice(), begin->data(),
+                                 limit);
+        }
+
+        GET_KEY(end, 1);
+        if (cmd.code == CMD_RANGE) {
+            return AddRangeReply(db, begin->data(), end->data(), Slice(),
+                                 limit);
+        }
+
+        int64_t count = 0;
+        std::unique_ptr<Iterator> iter(db->iterator());
+        for (iter->Seek(begin->data()); iter->Valid(); iter->Next()) {
+            if (iter->key()->key().Compare(end->data()) >= 0) {
+                break;
+            }
+            count++;
+        }
+        AddIntegerReply(count);
+    } return true;
+
     case CMD_LPUSH:
     case CMD_RPUSH: {
         Handle<List> list;
@@ -504,14 +803,32 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
             return false;
         }
 
+        WriteScope writing(db);
         APPEND_LOG(0);
         for (int i = 1; i < args.size(); i++) {
-            if (cmd.code == CMD_LPUSH) {
-                list->stub()->InsertHead(args[i].get());
-            } else {
+            auto ok = (cmd.code == CMD_LPUSH) ?
+                list->stub()->InsertHead(args[i].get()) :
                 list->stub()->InsertTail(args[i].get());
+            if (!ok) {
+                AddErrorReply("%s not enough memory", cmd.z);
+                return false;
             }
         }
+        if (db->copy_values()) {
+            db->Put(key->data(), 0, list.get());
+        } else {
+            db->RecountUsage(key->data());
+        }
+        AddIntegerReply(list->stub()->size());
+    } return true;
+
+    case CMD_LLEN: {
+        Handle<List> list;
+        GET_KEY(key, 0);
+
+        if (!GetList(key->data(), db, list.address())) {
+            return false;
+        }
         AddIntegerReply(list->stub()->size());
     } return true;
 
@@ -524,6 +841,7 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
             return false;
         }
 
+        WriteScope writing(db);
         APPEND_LOG(0);
         Obj *value = nullptr;
         if (cmd.code == CMD_LPOP) {
@@ -531,6 +849,11 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
         } else {
             list->stub()->PopTail(&value);
         }
+        if (db->copy_values()) {
+            db->Put(key->data(), 0, list.get());
+        } else {
+            db->RecountUsage(key->data());
+        }
         AddObjReply(value);
         ObjRelease(value);
     } return true;
@@ -543,6 +866,67 @@ bool Client::ProcessCommand(const Command &cmd, yuki::SliceRef key,
     return false;
 }
 
+bool Client::AddRangeReply(DB *db, yuki::SliceRef begin, yuki::SliceRef end,
+                           yuki::SliceRef prefix, int64_t limit) {
+    // Keys be copied, some iterators reuse the key buffer after Next().
+    std::vector<std::string> keys;
+    std::unique_ptr<Iterator> iter(db->iterator());
+    for (iter->Seek(begin); iter->Valid(); iter->Next()) {
+        if (limit > 0 && static_cast<int64_t>(keys.size()) >= limit) {
+            break;
+        }
+
+        auto key = iter->key()->key();
+        if (!end.Empty() && key.Compare(end) >= 0) {
+            break;
+        }
+        if (!prefix.Empty() && (key.Length() < prefix.Length() ||
+            memcmp(key.Data(), prefix.Data(), prefix.Length()) != 0)) {
+            break;
+        }
+        keys.push_back(key.ToString());
+    }
+
+    AddArrayHead(keys.size());
+    for (const auto &key : keys) {
+        AddStringReply(yuki::Slice(key));
+    }
+    return true;
+}
+
+bool Client::GetExpireTime(const Command &cmd,
+                           const std::vector<Handle<Obj>> &args,
+                           size_t index, int64_t now, int64_t *expire_at) {
+    *expire_at = 0;
+    if (args.size() <= index) {
+        return true;
+    }
+    if (args.size() != index + 2 || args[index]->type() != YKN_STRING) {
+        AddErrorReply("%s bad expire option, expect EX, PX or PXAT.", cmd.z);
+        return false;
+    }
+
+    auto option = static_cast<String *>(args[index].get())->data();
+    int64_t value = 0;
+    if (!ObjCastIntIf(args[index + 1].get(), &value) || value <= 0) {
+        AddErrorReply("%s bad expire time, expect positive integer.", cmd.z);
+        return false;
+    }
+    if (option.Length() == 2 && strncasecmp(option.Data(), "EX", 2) == 0) {
+        *expire_at = now + value * 1000;
+    } else if (option.Length() == 2 &&
+               strncasecmp(option.Data(), "PX", 2) == 0) {
+        *expire_at = now + value;
+    } else if (option.Length() == 4 &&
+               strncasecmp(option.Data(), "PXAT", 4) == 0) {
+        *expire_at = value;
+    } else {
+        AddErrorReply("%s bad expire option, expect EX, PX or PXAT.", cmd.z);
+        return false;
+    }
+    return true;
+}
+
 bool Client::GetList(yuki::SliceRef key, DB *db, List **list) {
     using yuki::Status;
 
@@ -693,9 +1077,14 @@ void Client::AddObjReply(Obj *ob) {
         AddStringReply(static_cast<String*>(ob)->data());
         break;
 
-    case YKN_INTEGER:
-        AddIntegerReply(static_cast<Integer*>(ob)->data());
-        break;
+    case YKN_INTEGER: {
+        // Numeric strings be stored as integers, but be replied as the
+        // strings they were set.
+        char buf[sizeof("-9223372036854775808")];
+        auto n = snprintf(buf, sizeof(buf), "%" PRId64,
+                          static_cast<Integer*>(ob)->data());
+        AddStringReply(Slice(buf, n));
+    } break;
 
     default:
         DLOG(FATAL) << "noreached";
@@ -60,6 +60,17 @@ public:
 
     bool GetList(yuki::SliceRef key, DB *db, List **list);
 
+    // Parse [EX seconds|PX milliseconds|PXAT unix-milliseconds] from
+    // args[index], 0 if no option.
+    bool GetExpireTime(const Command &cmd,
+                       const std::vector<Handle<Obj>> &args,
+                       size_t index, int64_t now, int64_t *expire_at);
+
+    // Reply at most `limit' keys from `begin', until `end' (exclusive) or
+    // the first key without `prefix', if they are not empty.
+    bool AddRangeReply(DB *db, yuki::SliceRef begin, yuki::SliceRef end,
+                       yuki::SliceRef prefix, int64_t limit);
+
     void AddErrorReply(const char *fmt, ...);
     void AddStringReply(yuki::SliceRef str);
     void AddIntegerReply(int64_t value);
@@ -1,10 +1,16 @@
 #include "cocurrent_hash_map.h"
+#include "epoch.h"
+#include "handle.h"
 #include "iterator.h"
 #include "key.h"
 #include "obj.h"
 #include "yuki/strings.h"
 #include "gtest/gtest.h"
 #include <thread>
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace yukino {
 
@@ -76,13 +82,13 @@ TEST_F(CocurrentHashMapTest, ResizeSlots) {
     ASSERT_EQ(4, map_->num_keys());
 
     map_->TEST_ResizeSlots(1023);
-    ASSERT_EQ(1860, map_->num_slots());
+    ASSERT_EQ(2048, map_->num_slots());
 
     map_->TEST_ResizeSlots(1860);
-    ASSERT_EQ(3381, map_->num_slots());
+    ASSERT_EQ(4096, map_->num_slots());
 
     map_->TEST_ResizeSlots(1);
-    ASSERT_EQ(1023, map_->num_slots());
+    ASSERT_EQ(1024, map_->num_slots());
 
     EXPECT_TRUE(map_->Exist(yuki::Slice("1")));
     EXPECT_TRUE(map_->Exist(yuki::Slice("2")));
@@ -90,6 +96,476 @@ TEST_F(CocurrentHashMapTest, ResizeSlots) {
     EXPECT_TRUE(map_->Exist(yuki::Slice("4")));
 }
 
+TEST_F(CocurrentHashMapTest, IncrementalRehash) {
+    const auto N = 2000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+    while (map_->IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+        ;
+    ASSERT_FALSE(map_->is_rehashing());
+
+    map_->TEST_BeginResizeSlots(N * 4);
+    ASSERT_TRUE(map_->is_rehashing());
+    ASSERT_TRUE(map_->IncrementalRehash(1));
+
+    // Both tables can be seen during rehashing.
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        EXPECT_TRUE(map_->Exist(yuki::Slice(key))) << key;
+    }
+
+    int count = 0;
+    {
+        std::unique_ptr<Iterator> iter(map_->iterator());
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            count++;
+        }
+    }
+    EXPECT_EQ(N, count);
+
+    for (int i = 0; i < N; i += 2) {
+        auto key = yuki::Strings::Format("%d", i);
+        EXPECT_TRUE(map_->Delete(yuki::Slice(key))) << key;
+    }
+    while (map_->IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+        ;
+    ASSERT_FALSE(map_->is_rehashing());
+    EXPECT_EQ(N / 2, map_->num_keys());
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        EXPECT_EQ(i % 2 != 0, map_->Exist(yuki::Slice(key))) << key;
+    }
+}
+
+TEST_F(CocurrentHashMapTest, MultiGet) {
+    const auto N = 2000;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < N; i++) {
+        keys.push_back(yuki::Strings::Format("%d", i));
+        if (i % 3 != 0) {
+            map_->Put(yuki::Slice(keys.back()), 0,
+                      String::New(yuki::Slice(keys.back())));
+        }
+    }
+
+    // Half of keys in old table, the others in new table.
+    map_->TEST_BeginResizeSlots(N * 4);
+    ASSERT_TRUE(map_->is_rehashing());
+    for (int i = 0; i < 512; i++) {
+        map_->IncrementalRehash(1);
+    }
+
+    std::vector<yuki::Slice> slices(keys.begin(), keys.end());
+    std::vector<Obj *> values(N, nullptr);
+    auto num_found = map_->MultiGet(N, slices.data(), values.data());
+    EXPECT_EQ(N - (N + 2) / 3, num_found);
+    for (int i = 0; i < N; i++) {
+        if (i % 3 == 0) {
+            EXPECT_EQ(nullptr, values[i]) << keys[i];
+            continue;
+        }
+        ASSERT_NE(nullptr, values[i]) << keys[i];
+        EXPECT_EQ(keys[i], static_cast<String *>(values[i])->data().ToString());
+        ObjRelease(values[i]);
+    }
+}
+
+TEST_F(CocurrentHashMapTest, Scan) {
+    const auto N = 2000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+
+    // Table grows and shrinks between calls, no key can be missed.
+    std::set<std::string> keys;
+    uint64_t cursor = 0;
+    int num_calls = 0;
+    do {
+        cursor = map_->Scan(cursor, 16, [&keys] (KeyBoundle *key, Obj *) {
+            keys.insert(key->key().ToString());
+        });
+        if (++num_calls % 10 == 0) {
+            map_->IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP);
+            if (!map_->is_rehashing()) {
+                map_->TEST_BeginResizeSlots(num_calls % 20 ? N * 8 : N);
+            }
+        }
+    } while (cursor != 0);
+    EXPECT_EQ(N, keys.size());
+    EXPECT_LT(1, num_calls);
+}
+
+TEST_F(CocurrentHashMapTest, MemoryUsage) {
+    const auto N = 2000;
+
+    EXPECT_EQ(0, map_->memory_usage());
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+    auto usage = map_->memory_usage();
+    EXPECT_LT(N * sizeof(CocurrentHashMap::Node), usage);
+
+    // Moving and replacing by the same size.
+    map_->TEST_ResizeSlots(N * 8);
+    EXPECT_EQ(usage, map_->memory_usage());
+    map_->Put(yuki::Slice("0"), 0, String::New(yuki::Slice("1")));
+    EXPECT_EQ(usage, map_->memory_usage());
+
+    std::string large(256, 'v');
+    map_->Put(yuki::Slice("0"), 0, String::New(yuki::Slice(large)));
+    EXPECT_LT(usage + 200, map_->memory_usage());
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        ASSERT_TRUE(map_->Delete(yuki::Slice(key)));
+    }
+    EXPECT_EQ(0, map_->memory_usage());
+}
+
+TEST_F(CocurrentHashMapTest, ListMemoryUsage) {
+    Handle<List> list(List::New());
+    ASSERT_TRUE(map_->Put(yuki::Slice("l"), 0, list.get()).Ok());
+    auto usage = map_->memory_usage();
+    EXPECT_LT(0, usage);
+
+    // Changed in place, be counted by recounting only.
+    std::string large(256, 'v');
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_TRUE(list->stub()->InsertTail(String::New(yuki::Slice(large))));
+    }
+    EXPECT_EQ(usage, map_->memory_usage());
+    map_->RecountUsage(yuki::Slice("l"));
+    EXPECT_LT(usage + 1000 * 256, map_->memory_usage());
+
+    for (int i = 0; i < 500; i++) {
+        Obj *value = nullptr;
+        ASSERT_TRUE(list->stub()->PopHead(&value));
+        ObjRelease(value);
+    }
+    auto grown = map_->memory_usage();
+    map_->RecountUsage(yuki::Slice("l"));
+    EXPECT_GT(grown - 500 * 256, map_->memory_usage());
+
+    ASSERT_TRUE(map_->Delete(yuki::Slice("l")));
+    EXPECT_EQ(0, map_->memory_usage());
+}
+
+TEST_F(CocurrentHashMapTest, DeleteValue) {
+    Handle<Obj> v1(String::New(yuki::Slice("v1")));
+    Handle<Obj> v2(String::New(yuki::Slice("v2")));
+    ASSERT_TRUE(map_->Put(yuki::Slice("k"), 0, v1.get()).Ok());
+
+    Handle<Obj> value;
+    ASSERT_TRUE(map_->Get(yuki::Slice("k"), nullptr, value.address()).Ok());
+    ASSERT_TRUE(map_->Put(yuki::Slice("k"), 0, v2.get()).Ok());
+    EXPECT_FALSE(map_->DeleteValue(yuki::Slice("k"), value.get()));
+    EXPECT_TRUE(map_->Exist(yuki::Slice("k")));
+
+    ASSERT_TRUE(map_->Get(yuki::Slice("k"), nullptr, value.address()).Ok());
+    EXPECT_TRUE(map_->DeleteValue(yuki::Slice("k"), value.get()));
+    EXPECT_FALSE(map_->Exist(yuki::Slice("k")));
+    EXPECT_FALSE(map_->DeleteValue(yuki::Slice("k"), value.get()));
+}
+
+TEST_F(CocurrentHashMapTest, Sample) {
+    map_->set_access_policy(EVICT_LRU);
+
+    int64_t num_visited = 0;
+    auto counting = [&num_visited] (KeyBoundle *, uint32_t) { num_visited++; };
+    EXPECT_EQ(0, map_->Sample(5, counting));
+
+    const auto N = 2000;
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+    map_->TEST_BeginResizeSlots(N * 8);
+
+    auto n = map_->Sample(5, [] (KeyBoundle *key, uint32_t clock) {
+        EXPECT_LT(0U, clock) << key->key().ToString();
+    });
+    EXPECT_LE(5, n);
+}
+
+TEST_F(CocurrentHashMapTest, Expire) {
+    const auto N = 100;
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+    EXPECT_FALSE(map_->Expire(yuki::Slice("none"), 1));
+
+    auto now = WallMilsces();
+    for (int i = 0; i < N; i += 2) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        // Half in the past, the others live for a while.
+        ASSERT_TRUE(map_->Expire(yuki::Slice(key), i % 4 ? 1 : now + 60000));
+    }
+    EXPECT_EQ(N / 2, map_->num_expires());
+
+    Version ver;
+    ASSERT_TRUE(map_->Get(yuki::Slice("k.0"), &ver, nullptr).Ok());
+    EXPECT_EQ(VERSION_EXPIRE, ver.type);
+    EXPECT_EQ(now + 60000, static_cast<int64_t>(ver.number));
+
+    // Expired keys be not found, and be deleted by the lookup.
+    auto rv = map_->Get(yuki::Slice("k.2"), nullptr, nullptr);
+    EXPECT_EQ(yuki::Status::kNotFound, rv.Code());
+    EXPECT_EQ(N - 1, map_->num_keys());
+    EXPECT_FALSE(map_->Exist(yuki::Slice("k.6")));
+    EXPECT_EQ(N - 2, map_->num_keys());
+
+    // Active deleting keeps the living ones.
+    EXPECT_FALSE(map_->DeleteExpired(yuki::Slice("k.0"), now));
+    EXPECT_TRUE(map_->DeleteExpired(yuki::Slice("k.10"), now));
+    EXPECT_EQ(N - 3, map_->num_keys());
+
+    // Persist and overwrite clear the expiring time.
+    ASSERT_TRUE(map_->Expire(yuki::Slice("k.0"), 0));
+    ASSERT_TRUE(map_->Get(yuki::Slice("k.0"), &ver, nullptr).Ok());
+    EXPECT_EQ(VERSION_PLAIN, ver.type);
+    map_->Put(yuki::Slice("k.4"), 0, Integer::New(4));
+    ASSERT_TRUE(map_->Get(yuki::Slice("k.4"), &ver, nullptr).Ok());
+    EXPECT_EQ(VERSION_PLAIN, ver.type);
+
+    // Moved by resizing, still expiring.
+    map_->TEST_ResizeSlots(N * 8);
+    std::vector<yuki::Slice> keys;
+    std::vector<std::string> stub;
+    for (int i = 0; i < N; i++) {
+        stub.push_back(yuki::Strings::Format("k.%d", i));
+    }
+    for (const auto &key : stub) {
+        keys.emplace_back(key);
+    }
+    std::vector<Obj *> values(N);
+    EXPECT_EQ(N - N / 4, map_->MultiGet(N, keys.data(), values.data()));
+    for (auto value : values) {
+        if (value) {
+            ObjRelease(value);
+        }
+    }
+    EXPECT_EQ(N - N / 4, map_->num_keys());
+    EXPECT_EQ(N / 4 - 2, map_->num_expires());
+}
+
+TEST_F(CocurrentHashMapTest, PutExpire) {
+    auto now = WallMilsces();
+
+    // New one and the replaced one, both expiring at once.
+    ASSERT_TRUE(map_->PutExpire(yuki::Slice("a"), now + 60000,
+                                Integer::New(1)).Ok());
+    map_->Put(yuki::Slice("b"), 0, Integer::New(2));
+    ASSERT_TRUE(map_->PutExpire(yuki::Slice("b"), now + 60000,
+                                Integer::New(3)).Ok());
+    EXPECT_EQ(2, map_->num_expires());
+
+    Version ver;
+    Obj *value = nullptr;
+    ASSERT_TRUE(map_->Get(yuki::Slice("b"), &ver, &value).Ok());
+    EXPECT_EQ(VERSION_EXPIRE, ver.type);
+    EXPECT_EQ(now + 60000, static_cast<int64_t>(ver.number));
+    int64_t n = 0;
+    EXPECT_TRUE(ObjCastIntIf(value, &n));
+    EXPECT_EQ(3, n);
+    ObjRelease(value);
+
+    // Expiring again replaces the time, a plain Put() clears it.
+    ASSERT_TRUE(map_->PutExpire(yuki::Slice("a"), 1, Integer::New(1)).Ok());
+    EXPECT_FALSE(map_->Exist(yuki::Slice("a")));
+    map_->Put(yuki::Slice("b"), 0, Integer::New(4));
+    EXPECT_EQ(0, map_->num_expires());
+}
+
+TEST_F(CocurrentHashMapTest, HashFingerprint) {
+    const auto N = 1000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+    // Nodes moved by stored hash must still be found by the key's hash.
+    map_->TEST_ResizeSlots(N * 8);
+    ASSERT_FALSE(map_->is_rehashing());
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        auto hash = CocurrentHashMap::Hash(key.data(), key.size());
+
+        auto node = map_->UnsafeFindRoom(yuki::Slice(key), hash,
+                                         map_->Take(hash));
+        ASSERT_NE(nullptr, node) << key;
+        EXPECT_EQ(hash, node->hash);
+
+        // Same key with a wrong fingerprint never matches.
+        EXPECT_EQ(nullptr, map_->UnsafeFindRoom(yuki::Slice(key), hash ^ 1,
+                                                map_->Take(hash)));
+    }
+}
+
+TEST_F(CocurrentHashMapTest, InlineValue) {
+    // Not a shared one.
+    static const int64_t kInteger = Integer::NUM_SHARED + 100;
+
+    auto small   = ObjAddRef(String::New(yuki::Slice("Jake")));
+    auto large   = ObjAddRef(String::New(yuki::Slice(std::string(256, 'x'))));
+    auto list    = ObjAddRef(List::New());
+    auto integer = ObjAddRef(Integer::New(kInteger));
+
+    ASSERT_TRUE(map_->Put(yuki::Slice("small"), 0, small).Ok());
+    ASSERT_TRUE(map_->Put(yuki::Slice("large"), 0, large).Ok());
+    ASSERT_TRUE(map_->Put(yuki::Slice("list"), 0, list).Ok());
+    ASSERT_TRUE(map_->Put(yuki::Slice("int"), 0, integer).Ok());
+
+    auto node_of = [&] (const char *key) {
+        auto hash = CocurrentHashMap::Hash(key, strlen(key));
+        return map_->UnsafeFindRoom(yuki::Slice(key), hash, map_->Take(hash));
+    };
+
+    // Small values be copied into the entry, others be shared.
+    EXPECT_TRUE(node_of("small")->is_value_inline());
+    EXPECT_TRUE(node_of("int")->is_value_inline());
+    EXPECT_FALSE(node_of("large")->is_value_inline());
+    EXPECT_FALSE(node_of("list")->is_value_inline());
+    EXPECT_EQ(large, node_of("large")->value.load());
+    EXPECT_EQ(1, small->RefCount());
+    EXPECT_EQ(2, large->RefCount());
+
+    // Inline value still be valid after its key deleted.
+    Obj *obj = nullptr;
+    ASSERT_TRUE(map_->Get(yuki::Slice("small"), nullptr, &obj).Ok());
+    ASSERT_TRUE(map_->Delete(yuki::Slice("small")));
+    for (int i = 0; i < 3; i++) {
+        Epoch::Quiescent();
+    }
+    EXPECT_EQ("Jake", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+
+    // Replace inline value by large one, and back.
+    ASSERT_TRUE(map_->Put(yuki::Slice("int"), 0, large).Ok());
+    EXPECT_FALSE(node_of("int")->is_value_inline());
+    ASSERT_TRUE(map_->Put(yuki::Slice("large"), 0, integer).Ok());
+    EXPECT_TRUE(node_of("large")->is_value_inline());
+    EXPECT_EQ(3, map_->num_keys());
+
+    ASSERT_TRUE(map_->Get(yuki::Slice("large"), nullptr, &obj).Ok());
+    ASSERT_EQ(YKN_INTEGER, obj->type());
+    EXPECT_EQ(kInteger, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+
+    // Inline values survive rehashing.
+    map_->TEST_ResizeSlots(4096);
+    ASSERT_TRUE(map_->Get(yuki::Slice("large"), nullptr, &obj).Ok());
+    EXPECT_EQ(kInteger, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+
+    // Shared integers be referenced, not copied.
+    ASSERT_TRUE(map_->Put(yuki::Slice("shared"), 0, Integer::New(1)).Ok());
+    EXPECT_FALSE(node_of("shared")->is_value_inline());
+    EXPECT_EQ(Integer::New(1), node_of("shared")->value.load());
+
+    ObjRelease(small);
+    ObjRelease(large);
+    ObjRelease(list);
+    ObjRelease(integer);
+}
+
+TEST_F(CocurrentHashMapTest, Update) {
+    auto incr = [] (Obj *old) { return ObjIncrBy(old, 1); };
+
+    ASSERT_TRUE(map_->Update(yuki::Slice("n"), 0, incr).Ok());
+    ASSERT_TRUE(map_->Update(yuki::Slice("n"), 0, incr).Ok());
+    EXPECT_EQ(1, map_->num_keys());
+
+    Obj *obj = nullptr;
+    ASSERT_TRUE(map_->Get(yuki::Slice("n"), nullptr, &obj).Ok());
+    EXPECT_EQ(2, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+
+    // Null from proc keeps it.
+    ASSERT_TRUE(map_->Update(yuki::Slice("n"), 0, [] (Obj *old) {
+        EXPECT_NE(nullptr, old);
+        return static_cast<Obj *>(nullptr);
+    }).Ok());
+    ASSERT_TRUE(map_->Update(yuki::Slice("none"), 0, [] (Obj *old) {
+        EXPECT_EQ(nullptr, old);
+        return static_cast<Obj *>(nullptr);
+    }).Ok());
+    EXPECT_EQ(1, map_->num_keys());
+
+    // Updating keeps the expiring time.
+    auto expire_at = WallMilsces() + 60000;
+    ASSERT_TRUE(map_->Expire(yuki::Slice("n"), expire_at));
+    ASSERT_TRUE(map_->Update(yuki::Slice("n"), 0, incr).Ok());
+    Version version;
+    ASSERT_TRUE(map_->Get(yuki::Slice("n"), &version, &obj).Ok());
+    EXPECT_EQ(VERSION_EXPIRE, version.type);
+    EXPECT_EQ(static_cast<uint64_t>(expire_at), version.number);
+    EXPECT_EQ(3, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+
+    // But not an expired one.
+    ASSERT_TRUE(map_->Expire(yuki::Slice("n"), 1));
+    ASSERT_TRUE(map_->Update(yuki::Slice("n"), 0, incr).Ok());
+    ASSERT_TRUE(map_->Get(yuki::Slice("n"), &version, &obj).Ok());
+    EXPECT_NE(VERSION_EXPIRE, version.type);
+    EXPECT_EQ(1, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+
+    // Expiring be checked at the time of the command, as the redo does.
+    ASSERT_TRUE(map_->PutExpire(yuki::Slice("m"), 1000, Integer::New(5)).Ok());
+    ASSERT_TRUE(map_->Update(yuki::Slice("m"), 500, incr).Ok());
+    int64_t seen = 0;
+    ASSERT_TRUE(map_->Update(yuki::Slice("m"), 900, [&seen] (Obj *old) {
+        EXPECT_TRUE(old && ObjCastIntIf(old, &seen));
+        return static_cast<Obj *>(nullptr);
+    }).Ok());
+    EXPECT_EQ(6, seen);
+    EXPECT_FALSE(map_->Exist(yuki::Slice("m")));
+    ASSERT_TRUE(map_->Update(yuki::Slice("m"), 2000, incr).Ok());
+    ASSERT_TRUE(map_->Get(yuki::Slice("m"), &version, &obj).Ok());
+    EXPECT_NE(VERSION_EXPIRE, version.type);
+    EXPECT_EQ(1, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+}
+
+TEST_F(CocurrentHashMapTest, MutliThreadUpdating) {
+    static const int kNumIncrs = 10000;
+    static const int kNumKeys  = 8;
+
+    std::thread threads[4];
+    for (auto &thread : threads) {
+        thread = std::thread([this] () {
+            for (int i = 0; i < kNumIncrs; i++) {
+                auto key = yuki::Strings::Format("k.%d", i % kNumKeys);
+                map_->Update(yuki::Slice(key), 0, [] (Obj *old) {
+                    return ObjIncrBy(old, 1);
+                });
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (int i = 0; i < kNumKeys; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        Obj *obj = nullptr;
+        ASSERT_TRUE(map_->Get(yuki::Slice(key), nullptr, &obj).Ok());
+        EXPECT_EQ(arraysize(threads) * kNumIncrs / kNumKeys,
+                  static_cast<Integer *>(obj)->data()) << key;
+        ObjRelease(obj);
+    }
+}
+
 TEST_F(CocurrentHashMapTest, LargePut) {
     const auto N = 100000;
 
@@ -170,7 +646,7 @@ TEST_F(CocurrentHashMapTest, MutliThreadDeleting) {
     }
 
     ASSERT_EQ(0, map_->num_keys());
-    ASSERT_EQ(1023, map_->num_slots());
+    ASSERT_EQ(1024, map_->num_slots());
 }
 
 TEST_F(CocurrentHashMapTest, MutliThreadGetting) {
@@ -209,4 +685,112 @@ TEST_F(CocurrentHashMapTest, MutliThreadGetting) {
 
 }
 
+TEST_F(CocurrentHashMapTest, BulkPut) {
+    const int N = 8000;
+
+    map_->Reserve(N);
+    auto num_slots = map_->num_slots();
+    EXPECT_FALSE(map_->is_rehashing());
+
+    // Ranges of threads be overlapped, the duplicated keys be put once.
+    std::thread threads[4];
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i] = std::move(std::thread([&] (int num) {
+            auto begin = num * N / arraysize(threads);
+            for (int j = begin; j < begin + N / 2 && j < N; j++) {
+                auto key = yuki::Strings::Format("%d", j);
+                Version version;
+                version.type   = j % 10 == 0 ? VERSION_EXPIRE : 0;
+                version.number = j % 10 == 0 ? WallMilsces() + 100000 : 0;
+                Handle<Obj> value(String::New(yuki::Slice(key)));
+                auto rv = map_->BulkPut(yuki::Slice(key), version,
+                                        value.get());
+                ASSERT_TRUE(rv.Ok()) << rv.ToString();
+            }
+        }, i));
+    }
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(num_slots, map_->num_slots());
+    EXPECT_EQ(N, map_->num_keys());
+    EXPECT_EQ(N / 10, map_->num_expires());
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        Version version;
+        Obj *value = nullptr;
+        ASSERT_TRUE(map_->Get(yuki::Slice(key), &version, &value).Ok()) << key;
+        Handle<Obj> holder(value);
+        EXPECT_EQ(key, static_cast<String *>(value)->data().ToString());
+        EXPECT_EQ(i % 10 == 0 ? VERSION_EXPIRE : 0, version.type);
+    }
+
+    // Usage be counted as Put() does.
+    CocurrentHashMap other(1023);
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        Handle<Obj> value(String::New(yuki::Slice(key)));
+        other.Put(yuki::Slice(key), 0, value.get());
+        if (i % 10 == 0) {
+            other.Expire(yuki::Slice(key), WallMilsces() + 100000);
+        }
+    }
+    EXPECT_EQ(other.memory_usage(), map_->memory_usage());
+}
+
+
+// Worst-case latency of operations during the map keep growing.
+TEST_F(CocurrentHashMapTest, ResizeUnderLoad) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    const int N = 300000;
+    std::atomic<bool> stop(false);
+    std::atomic<int64_t> get_worst(0);
+
+    std::thread readers[2];
+    for (int i = 0; i < arraysize(readers); i++) {
+        readers[i] = std::move(std::thread([&] () {
+            int64_t worst = 0;
+            while (!stop.load()) {
+                auto key = yuki::Strings::Format("%d", rand() % N);
+                auto jiffies = steady_clock::now();
+                map_->Exist(yuki::Slice(key));
+                auto cost = duration_cast<microseconds>(steady_clock::now() -
+                                                        jiffies).count();
+                worst = std::max<int64_t>(worst, cost);
+            }
+            auto expected = get_worst.load();
+            while (worst > expected &&
+                   !get_worst.compare_exchange_weak(expected, worst))
+                ;
+        }));
+    }
+
+    int64_t put_worst = 0;
+    auto start = steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        auto jiffies = steady_clock::now();
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+        auto cost = duration_cast<microseconds>(steady_clock::now() -
+                                                jiffies).count();
+        put_worst = std::max<int64_t>(put_worst, cost);
+    }
+    auto total = duration_cast<microseconds>(steady_clock::now() -
+                                             start).count();
+    stop.store(true);
+    for (int i = 0; i < arraysize(readers); i++) {
+        readers[i].join();
+    }
+
+    EXPECT_EQ(N, map_->num_keys());
+    printf("put %d keys: %.2f QPS, put worst: %lld us, get worst: %lld us\n",
+           N, N / (total / 1000000.0),
+           static_cast<long long>(put_worst),
+           static_cast<long long>(get_worst.load()));
+}
+
 } // namespace yukino
\ No newline at end of file
@@ -1,7 +1,21 @@
 #include "cocurrent_hash_map.h"
+#include "epoch.h"
+#include "hash.h"
 #include "iterator.h"
 #include "key.h"
 #include "obj.h"
+#include "slab.h"
+#include "yuki/utils.h"
+#include <algorithm>
+#include <thread>
+
+#if defined(__GNUC__)
+#   define PREFETCH(p)           __builtin_prefetch((p), 0, 3)
+#   define PREFETCH_FOR_WRITE(p) __builtin_prefetch((p), 1, 3)
+#else
+#   define PREFETCH(p)           (void)(p)
+#   define PREFETCH_FOR_WRITE(p) (void)(p)
+#endif
 
 namespace yukino {
 
@@ -12,13 +26,16 @@ public:
     typedef CocurrentHashMap::Slot Slot;
     typedef CocurrentHashMap::Node Node;
 
-    IteratorImpl(RWSpinLock *rwlock, Slot *begin, Slot *end)
+    // The gaint lock must be held by reader and the rehashing must be
+    // paused before the iterator created, iterator will release them.
+    IteratorImpl(RWSpinLock *rwlock, std::atomic<int> *num_iterators,
+                 Slot *old_begin, Slot *old_end, Slot *begin, Slot *end)
         : rwlock_(DCHECK_NOTNULL(rwlock))
-        , begin_(DCHECK_NOTNULL(begin))
-        , end_(DCHECK_NOTNULL(end)) {
-        DCHECK_NE(begin, end);
-
-        rwlock_->ReadLock();
+        , num_iterators_(DCHECK_NOTNULL(num_iterators)) {
+        begin_[0] = old_begin;
+        end_[0]   = old_end;
+        begin_[1] = DCHECK_NOTNULL(begin);
+        end_[1]   = DCHECK_NOTNULL(end);
     }
 
     virtual ~IteratorImpl() override;
@@ -30,41 +47,41 @@ public:
     virtual Obj *value() const override;
 
 private:
+    void SeekToNonEmptySlot();
+
+    // Deleted nodes can not be freed under the iterator.
+    EpochGuard epoch_;
     RWSpinLock *rwlock_;
-    Slot *begin_;
-    Slot *end_;
+    std::atomic<int> *num_iterators_;
+    Slot *begin_[2];
+    Slot *end_[2];
+    int table_ = 0;
     Node *node_ = nullptr;
     Slot *now_ = nullptr;
 };
 
 IteratorImpl::~IteratorImpl() {
     DCHECK_NOTNULL(rwlock_)->Unlock();
+    num_iterators_->fetch_sub(1);
 }
 
 bool IteratorImpl::Valid() const {
-    return now_ < end_ && node_ != nullptr;
+    return node_ != nullptr;
 }
 
 void IteratorImpl::SeekToFirst() {
-    for (now_ = begin_; now_ < end_; now_++) {
-        if (now_->node) {
-            node_ = now_->node;
-            break;
-        }
-    }
+    table_ = 0;
+    now_   = begin_[0];
+    SeekToNonEmptySlot();
 }
 
 void IteratorImpl::Next() {
     DCHECK(Valid());
 
-    node_ = node_->next;
+    node_ = node_->next.load(std::memory_order_acquire);
     if (!node_) {
-        while (now_++ < end_) {
-            if (now_->node) {
-                node_ = now_->node;
-                break;
-            }
-        }
+        now_++;
+        SeekToNonEmptySlot();
     }
 }
 
@@ -74,220 +91,1105 @@ yuki::Status IteratorImpl::status() const {
 
 KeyBoundle *IteratorImpl::key() const {
     DCHECK(Valid());
-    return DCHECK_NOTNULL(node_->key);
+    return node_->key();
 }
 
 Obj *IteratorImpl::value() const {
     DCHECK(Valid());
-    return DCHECK_NOTNULL(node_->value);
+    return DCHECK_NOTNULL(node_->value.load(std::memory_order_acquire));
+}
+
+void IteratorImpl::SeekToNonEmptySlot() {
+    node_ = nullptr;
+    while (table_ < 2) {
+        for (; now_ < end_[table_]; now_++) {
+            node_ = now_->node.load(std::memory_order_acquire);
+            if (node_) {
+                return;
+            }
+        }
+        if (++table_ < 2) {
+            now_ = begin_[table_];
+        }
+    }
+}
+
+inline int64_t RoundUpPowerOf2(int64_t n) {
+    if (n <= 0) {
+        return 0;
+    }
+    int64_t v = 1;
+    while (v < n) {
+        v <<= 1;
+    }
+    return v;
+}
+
+// Compare num_keys / num_slots with fator, without dividing. The double
+// product is exact for any table can be made in memory.
+inline bool KeyRateAbove(int64_t num_keys, int64_t num_slots, double fator) {
+    return static_cast<double>(num_keys) >
+        static_cast<double>(num_slots) * fator;
+}
+
+inline bool KeyRateBelow(int64_t num_keys, int64_t num_slots, double fator) {
+    return static_cast<double>(num_keys) <
+        static_cast<double>(num_slots) * fator;
+}
+
+inline size_t AlignedSize(size_t size) {
+    return (size + 7) & ~static_cast<size_t>(7);
+}
+
+// Size of value be inlined, or 0 if it can not be inlined. Shared values be
+// referenced only, copying them costs more.
+size_t InlineValueSize(Obj *value) {
+    if (value->immortal()) {
+        return 0;
+    }
+    size_t size = 0;
+    switch (value->type()) {
+        case YKN_STRING:
+            size = String::PredictSize(static_cast<String *>(value)->data());
+            break;
+
+        case YKN_INTEGER:
+            size = Integer::PredictSize(static_cast<Integer *>(value)->data());
+            break;
+
+        default:
+            return 0;
+    }
+    return size <= CocurrentHashMap::MAX_INLINE_VALUE_SIZE ? size : 0;
+}
+
+// Bytes of the value out of the entry. Lists and hashes be changed in place,
+// count their elements as last counted, so the same value always be counted
+// the same until UnsafeRecount().
+size_t ValueUsage(Obj *value) {
+    if (value->immortal()) {
+        return 0;
+    }
+    switch (value->type()) {
+        case YKN_STRING:
+            return String::PredictSize(static_cast<String *>(value)->data());
+        case YKN_INTEGER:
+            return Integer::PredictSize(static_cast<Integer *>(value)->data());
+        case YKN_LIST:
+            return List::PredictSize() +
+                static_cast<List *>(value)->stub()->counted_bytes();
+        case YKN_HASH:
+            return Hash::PredictSize() +
+                static_cast<Hash *>(value)->stub()->counted_bytes();
+        default:
+            return 0;
+    }
+}
+
+// Bytes of the entry, and the value if it's not inlined.
+int64_t EntryUsage(const CocurrentHashMap::Node *node) {
+    auto key = node->key();
+    size_t size = node->value_offset + sizeof(*node) +
+        KeyBoundle::PredictBoundleSize(key->key(), key->version().number);
+    if (!node->is_value_inline()) {
+        size += ValueUsage(node->value.load(std::memory_order_relaxed));
+    }
+    return static_cast<int64_t>(size);
+}
+
+inline uint64_t NextRandom() {
+    static thread_local uint64_t seed = (HashSeed() ^
+        reinterpret_cast<uintptr_t>(&seed)) | 1;
+
+    // xorshift64
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+inline uint64_t ReverseBits(uint64_t v) {
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((v & 0x0f0f0f0f0f0f0f0fULL) << 4);
+    v = ((v >> 8) & 0x00ff00ff00ff00ffULL) | ((v & 0x00ff00ff00ff00ffULL) << 8);
+    v = ((v >> 16) & 0x0000ffff0000ffffULL) | ((v & 0x0000ffff0000ffffULL) << 16);
+    return (v >> 32) | (v << 32);
+}
+
+// Increase the masked bits of cursor from the high bit, so slots be split
+// by resizing were all visited, or not yet.
+inline uint64_t NextCursor(uint64_t cursor, uint64_t mask) {
+    cursor |= ~mask;
+    cursor = ReverseBits(cursor);
+    cursor++;
+    return ReverseBits(cursor);
+}
+
+int64_t VisitSlot(const CocurrentHashMap::Slot *slot,
+                  const std::function<void (KeyBoundle *, Obj *)> &proc) {
+    int64_t n = 0;
+    auto node = slot->node.load(std::memory_order_acquire);
+    while (node) {
+        proc(node->key(), node->value.load(std::memory_order_acquire));
+        n++;
+        node = node->next.load(std::memory_order_acquire);
+    }
+    return n;
+}
+
+int64_t SampleSlot(const CocurrentHashMap::Slot *slot,
+                   const std::function<void (KeyBoundle *, uint32_t)> &proc) {
+    int64_t n = 0;
+    auto node = slot->node.load(std::memory_order_acquire);
+    while (node) {
+        proc(node->key(), node->access.load(std::memory_order_relaxed));
+        n++;
+        node = node->next.load(std::memory_order_acquire);
+    }
+    return n;
+}
+
+void DeleteSlots(void *p) {
+    delete[] static_cast<CocurrentHashMap::Slot *>(p);
+}
+
+void DeleteTable(void *p) {
+    delete static_cast<CocurrentHashMap::Table *>(p);
+}
+
+void ReleaseObj(void *p) {
+    ObjRelease(static_cast<Obj *>(p));
 }
 
 } // namespace
 
-/*static*/ unsigned int CocurrentHashMap::Hash(const char *p, size_t n) {
-    // JSHash
-    unsigned int hash = 1315423911;
-    for (size_t i = 0; i < n; i++) {
-        hash ^= ((hash << 5) + (*p++) + (hash >> 2));
+/*static*/ uint64_t CocurrentHashMap::Hash(const char *p, size_t n) {
+    return Hash64(p, n, HashSeed());
+}
+
+/*static*/ CocurrentHashMap::Node *
+CocurrentHashMap::NewNode(yuki::SliceRef key, const Version &version,
+                          uint64_t hash, Obj *value) {
+    auto value_size = AlignedSize(InlineValueSize(DCHECK_NOTNULL(value)));
+    auto key_size   = KeyBoundle::PredictBoundleSize(key, version.number);
+
+    auto size = value_size + sizeof(Node) + key_size;
+    auto base = static_cast<char *>(Slab::Allocate(size));
+    if (!base) {
+        return nullptr;
+    }
+
+    auto node = reinterpret_cast<Node *>(base + value_size);
+    if (value_size > 0) {
+        Obj *inlined;
+        if (value->type() == YKN_STRING) {
+            inlined = String::Build(static_cast<String *>(value)->data(),
+                                    base, value_size);
+        } else {
+            inlined = Integer::Build(static_cast<Integer *>(value)->data(),
+                                     base, value_size);
+        }
+        // Only the node hold it, the last releasing frees the entry.
+        node->value.store(ObjAddRef(DCHECK_NOTNULL(inlined)),
+                          std::memory_order_relaxed);
+    } else {
+        node->value.store(ObjAddRef(value), std::memory_order_relaxed);
+    }
+    node->next.store(nullptr, std::memory_order_relaxed);
+    node->hash         = hash;
+    node->value_offset = static_cast<uint32_t>(value_size);
+    node->access.store(0, std::memory_order_relaxed);
+    KeyBoundle::Build(key, version.type, version.number, node + 1, key_size);
+    return node;
+}
+
+/*static*/ void CocurrentHashMap::FreeNode(void *p) {
+    auto node = static_cast<Node *>(p);
+    if (node->is_value_inline()) {
+        // The entry be freed with the inline value.
+        ObjRelease(node->value.load(std::memory_order_relaxed));
+    } else {
+        ObjRelease(node->value.load(std::memory_order_relaxed));
+        Slab::Free(node);
     }
-    return (hash & 0x7FFFFFFF);
 }
 
-CocurrentHashMap::CocurrentHashMap(int initial_size)
+CocurrentHashMap::CocurrentHashMap(int64_t initial_size)
     : slots_(nullptr)
     , num_slots_(0)
-    , min_num_slots_(initial_size)
+    , min_num_slots_(RoundUpPowerOf2(initial_size))
     , num_keys_(0)
+    , balance_fator_(0.9)
+    , balance_fator_down_(0.2)
+    , old_slots_(nullptr)
+    , num_old_slots_(0)
     , rehash_(0)
-    , balance_fator_(0.9f)
-    , balance_fator_down_(0.2f) {
-    if (initial_size <= 0) {
-        return;
-    }
-
-    slots_ = new Slot[initial_size];
-    if (slots_) {
-        InitSlots(slots_, initial_size);
-        num_slots_ = initial_size;
+    , num_rehashed_(0)
+    , num_moving_(0)
+    , num_iterators_(0)
+    , rehash_epoch_(0)
+    , table_(nullptr)
+    , access_policy_(EVICT_NONE)
+    , memory_usage_(0)
+    , num_expires_(0) {
+    if (initial_size > 0) {
+        slots_ = new Slot[min_num_slots_];
+        if (slots_) {
+            InitSlots(slots_, min_num_slots_);
+            num_slots_ = min_num_slots_;
+        }
     }
+    PublishTable();
 }
 
 CocurrentHashMap::~CocurrentHashMap() {
-    for (int i = 0; i < num_slots_; i++) {
-        auto slot = &slots_[i];
+    Slot *tables[] = {old_slots_, slots_};
+    int64_t num_slots[] = {num_old_slots_, num_slots_};
 
-        while (slot->node) {
-            auto node = slot->node;
-            slot->node = node->next;
+    for (size_t i = 0; i < arraysize(tables); i++) {
+        for (int64_t j = 0; j < num_slots[i]; j++) {
+            auto slot = &tables[i][j];
 
-            free(node->key);
-            ObjRelease(node->value);
-            delete node;
+            auto node = slot->node.load(std::memory_order_relaxed);
+            while (node) {
+                auto next = node->next.load(std::memory_order_relaxed);
+                FreeNode(node);
+                node = next;
+            }
         }
     }
+    delete[] old_slots_;
     delete[] slots_;
+    delete table_.load();
 }
 
 yuki::Status CocurrentHashMap::Put(yuki::SliceRef key, uint64_t version_number,
                                    Obj *value) {
+    Version version;
+    version.type   = VERSION_PLAIN;
+    version.number = version_number;
+    return Put(key, Hash(key.Data(), key.Length()), version, value);
+}
+
+yuki::Status CocurrentHashMap::PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                         Obj *value) {
+    DCHECK_GT(expire_at, 0);
+    Version version;
+    version.type   = VERSION_EXPIRE;
+    version.number = expire_at;
+    return Put(key, Hash(key.Data(), key.Length()), version, value);
+}
+
+yuki::Status CocurrentHashMap::Put(yuki::SliceRef key, uint64_t hash,
+                                   const Version &version, Obj *value) {
     using yuki::Status;
 
+    IncrementalRehash(REHASH_STEPS_PER_OP);
+
     auto num_keys = std::atomic_load_explicit(&num_keys_,
                                               std::memory_order_acquire);
     ExtendIfNeed(num_keys + 1);
 
     ReaderLock gaint(&gaint_lock_);
-    auto slot = Take(key);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            return UnsafePutValue(old, node, version, value);
+        }
+    }
+
+    auto slot = Take(hash);
 
     WriterLock scope(&slot->rwlock);
-    auto node = UnsafeFindOrMakeRoom(key, slot);
-    if (!node) {
-        return Status::Systemf("not enough memory.");
+    auto node = UnsafeFindRoom(key, hash, slot);
+    if (node) {
+        return UnsafePutValue(slot, node, version, value);
     }
 
-    if (!DCHECK_NOTNULL(node)->key) {
-        node->key = MakeKeyBoundle(key, 0, version_number);
-    }
-    if (!node->key) {
+    node = NewNode(key, version, hash, value);
+    if (!node) {
         return Status::Systemf("not enough memory.");
     }
-    if (node->value != value) {
-        ObjRelease(node->value);
-        node->value = ObjAddRef(value);
+    node->access.store(AccessClock::New(access_policy_),
+                       std::memory_order_relaxed);
+    if (version.type == VERSION_EXPIRE) {
+        // Count it before publishing, readers never miss an expiring entry.
+        num_expires_.fetch_add(1, std::memory_order_relaxed);
     }
+    UnsafeMakeRoom(node, slot);
+    memory_usage_.fetch_add(EntryUsage(node), std::memory_order_relaxed);
+    UnsafeRecount(value);
+
+    std::atomic_fetch_add_explicit(&num_keys_, 1, std::memory_order_release);
     return yuki::Status::OK();
 }
 
 bool CocurrentHashMap::Delete(yuki::SliceRef key) {
+    return Delete(key, Hash(key.Data(), key.Length()));
+}
+
+bool CocurrentHashMap::Delete(yuki::SliceRef key, uint64_t hash) {
+    IncrementalRehash(REHASH_STEPS_PER_OP);
+
     auto num_keys = std::atomic_load_explicit(&num_keys_,
                                               std::memory_order_acquire);
     ShrinkIfNeed(num_keys - 1);
 
     ReaderLock gaint(&gaint_lock_);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        if (UnsafeDeleteRoom(key, hash, old)) {
+            return true;
+        }
+    }
 
-    auto slot = Take(key);
+    auto slot = Take(hash);
     WriterLock scope(&slot->rwlock);
 
-    return UnsafeDeleteRoom(key, slot);
+    return UnsafeDeleteRoom(key, hash, slot);
 }
 
 yuki::Status CocurrentHashMap::Get(yuki::SliceRef key, Version *ver,
                                    Obj **value) {
-    using yuki::Status;
+    return Get(key, Hash(key.Data(), key.Length()), ver, value);
+}
 
-    ReaderLock gaint(&gaint_lock_);
-    auto slot = Take(key);
+yuki::Status CocurrentHashMap::Get(yuki::SliceRef key, uint64_t hash,
+                                   Version *ver, Obj **value) {
+    using yuki::Status;
 
-    ReaderLock scope(&slot->rwlock);
-    auto node = UnsafeFindRoom(key, slot);
-    if (!node) {
-        return Status::NotFoundf("key not found.");
-    }
+    int64_t now = 0;
+    {
+        EpochGuard epoch;
+        auto node = LockFreeFind(key, hash);
+        if (!node) {
+            return Status::NotFoundf("key not found.");
+        }
 
-    if (ver) {
-        *ver = node->key->version();
-    }
-    if (value) {
-        *value = ObjAddRef(node->value);
+        if (!Expired(node, &now)) {
+            Touch(node);
+            if (ver) {
+                *ver = node->key()->version();
+            }
+            if (value) {
+                *value = ObjAddRef(node->value.load(std::memory_order_acquire));
+            }
+            return Status::OK();
+        }
     }
 
-    return Status::OK();
+    // Remove the expired one lazily, out of the epoch.
+    DeleteExpired(key, hash, now);
+    return Status::NotFoundf("key not found.");
 }
 
 yuki::Status
 CocurrentHashMap::Exec(yuki::SliceRef key,
                        std::function<void (const Version &, Obj *)> proc) {
+    return Exec(key, Hash(key.Data(), key.Length()), std::move(proc));
+}
+
+yuki::Status
+CocurrentHashMap::Exec(yuki::SliceRef key, uint64_t hash,
+                       std::function<void (const Version &, Obj *)> proc) {
     using yuki::Status;
 
+    int64_t now = 0;
+    {
+        // The value can not be freed in the epoch, no need to hold a
+        // reference.
+        EpochGuard epoch;
+        auto node = LockFreeFind(key, hash);
+        if (!node) {
+            return Status::NotFoundf("key not found.");
+        }
+
+        if (!Expired(node, &now)) {
+            Touch(node);
+            proc(node->key()->version(),
+                 node->value.load(std::memory_order_acquire));
+            return Status::OK();
+        }
+    }
+
+    DeleteExpired(key, hash, now);
+    return Status::NotFoundf("key not found.");
+}
+
+yuki::Status
+CocurrentHashMap::Update(yuki::SliceRef key, uint64_t version_number,
+                         std::function<Obj *(Obj *)> proc) {
+    return Update(key, Hash(key.Data(), key.Length()), version_number,
+                  std::move(proc));
+}
+
+yuki::Status
+CocurrentHashMap::Update(yuki::SliceRef key, uint64_t hash,
+                         uint64_t version_number,
+                         std::function<Obj *(Obj *)> proc) {
+    using yuki::Status;
+
+    IncrementalRehash(REHASH_STEPS_PER_OP);
+
+    auto num_keys = std::atomic_load_explicit(&num_keys_,
+                                              std::memory_order_acquire);
+    ExtendIfNeed(num_keys + 1);
+
     ReaderLock gaint(&gaint_lock_);
-    auto slot = Take(key);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            return UnsafeUpdate(old, node, version_number, proc);
+        }
+    }
 
-    ReaderLock scope(&slot->rwlock);
-    auto node = UnsafeFindRoom(key, slot);
-    if (!node) {
-        return Status::NotFoundf("key not found.");
+    auto slot = Take(hash);
+
+    WriterLock scope(&slot->rwlock);
+    auto node = UnsafeFindRoom(key, hash, slot);
+    if (node) {
+        return UnsafeUpdate(slot, node, version_number, proc);
+    }
+
+    auto value = proc(nullptr);
+    if (!value) {
+        return Status::OK();
     }
 
-    proc(node->key->version(), ObjAddRef(node->value));
-    ObjRelease(node->value);
+    Version version;
+    version.type   = 0;
+    version.number = version_number;
+    node = NewNode(key, version, hash, value);
+    if (!node) {
+        return Status::Systemf("not enough memory.");
+    }
+    node->access.store(AccessClock::New(access_policy_),
+                       std::memory_order_relaxed);
+    UnsafeMakeRoom(node, slot);
+    memory_usage_.fetch_add(EntryUsage(node), std::memory_order_relaxed);
+    UnsafeRecount(value);
 
+    std::atomic_fetch_add_explicit(&num_keys_, 1, std::memory_order_release);
     return Status::OK();
 }
 
+size_t CocurrentHashMap::MultiGet(size_t n, const yuki::Slice *keys,
+                                  Obj **values) {
+    uint64_t hashes[MULTI_GET_GROUP_SIZE];
+
+    size_t num_found = 0;
+    for (size_t base = 0; base < n; base += MULTI_GET_GROUP_SIZE) {
+        auto m = std::min<size_t>(MULTI_GET_GROUP_SIZE, n - base);
+        for (size_t i = 0; i < m; i++) {
+            hashes[i] = Hash(keys[base + i].Data(), keys[base + i].Length());
+        }
+        num_found += MultiGet(m, keys + base, hashes, values + base);
+    }
+    return num_found;
+}
+
+size_t CocurrentHashMap::MultiGet(size_t n, const yuki::Slice *keys,
+                                  const uint64_t *hashes, Obj **values) {
+    static_assert(MULTI_GET_GROUP_SIZE <= 32, "Expired mask is 32 bits.");
+    Node *nodes[MULTI_GET_GROUP_SIZE];
+
+    size_t num_found = 0;
+    for (size_t base = 0; base < n; base += MULTI_GET_GROUP_SIZE) {
+        auto m = std::min<size_t>(MULTI_GET_GROUP_SIZE, n - base);
+        auto group_hashes = hashes + base;
+        uint32_t expired = 0;
+        int64_t now = 0;
+
+      {
+        EpochGuard epoch;
+        auto table = table_.load(std::memory_order_acquire);
+
+        // Slots of the group.
+        for (size_t i = 0; i < m; i++) {
+            auto hash = group_hashes[i];
+            if (table->old_slots) {
+                PREFETCH(&table->old_slots[hash & (table->num_old_slots - 1)]);
+            }
+            if (table->num_slots > 0) {
+                PREFETCH(&table->slots[hash & (table->num_slots - 1)]);
+            }
+        }
+
+        // Chain heads, the key boundle follows the node header.
+        for (size_t i = 0; i < m; i++) {
+            auto hash = group_hashes[i];
+            if (table->old_slots) {
+                auto slot = &table->old_slots[hash & (table->num_old_slots - 1)];
+                auto head = slot->node.load(std::memory_order_acquire);
+                if (head) {
+                    PREFETCH(head);
+                }
+            }
+            if (table->num_slots > 0) {
+                auto slot = &table->slots[hash & (table->num_slots - 1)];
+                auto head = slot->node.load(std::memory_order_acquire);
+                if (head) {
+                    PREFETCH(head);
+                    PREFETCH(head->key());
+                }
+            }
+        }
+
+        // Resolve nodes, values will be referenced.
+        for (size_t i = 0; i < m; i++) {
+            nodes[i] = LockFreeFind(table, keys[base + i], group_hashes[i]);
+            if (nodes[i]) {
+                PREFETCH_FOR_WRITE(
+                    nodes[i]->value.load(std::memory_order_acquire));
+            }
+        }
+
+        for (size_t i = 0; i < m; i++) {
+            if (!nodes[i]) {
+                values[base + i] = nullptr;
+                continue;
+            }
+            if (Expired(nodes[i], &now)) {
+                values[base + i] = nullptr;
+                expired |= 1U << i;
+                continue;
+            }
+            Touch(nodes[i]);
+            auto value = nodes[i]->value.load(std::memory_order_acquire);
+            values[base + i] = ObjAddRef(value);
+            num_found++;
+        }
+      }
+
+        for (size_t i = 0; expired != 0 && i < m; i++) {
+            if (expired & (1U << i)) {
+                DeleteExpired(keys[base + i], group_hashes[i], now);
+            }
+        }
+    }
+    return num_found;
+}
+
 Iterator *CocurrentHashMap::iterator() {
-    return new IteratorImpl(&gaint_lock_, slots_, slots_ + num_slots_);
+    gaint_lock_.ReadLock();
+
+    // Pause the rehashing, so no one node can be moved under the iterator.
+    num_iterators_.fetch_add(1);
+    while (num_moving_.load() > 0) {
+        std::this_thread::yield();
+    }
+    return new IteratorImpl(&gaint_lock_, &num_iterators_,
+                            old_slots_, old_slots_ + num_old_slots_,
+                            slots_, slots_ + num_slots_);
 }
 
-CocurrentHashMap::Node *
-CocurrentHashMap::UnsafeFindOrMakeRoom(yuki::SliceRef key, Slot *slot) {
-    Node stub;
-    stub.next = slot->node;
-    auto p = &stub;
-    auto node = slot->node;
-    while (node) {
-        if (DCHECK_NOTNULL(node->key)->key().Compare(key) == 0) {
-            break;
+uint64_t
+CocurrentHashMap::Scan(uint64_t cursor, int64_t count,
+                       std::function<void (KeyBoundle *, Obj *)> proc) {
+    // Nodes can not be freed in the epoch, and can not be moved out of the
+    // tables we see, the moving waits readers of the last table.
+    EpochGuard epoch;
+    auto table = table_.load(std::memory_order_acquire);
+    if (table->num_slots == 0) {
+        return 0;
+    }
+
+    // Sparse table: visit 10 times slots of `count' at most.
+    int64_t num_visited = 0;
+    int64_t num_steps = 0;
+    do {
+        num_visited += ScanStep(table, &cursor, proc);
+    } while (cursor != 0 && num_visited < count && ++num_steps < count * 10);
+    return cursor;
+}
+
+int64_t CocurrentHashMap::ScanStep(
+        const Table *table, uint64_t *cursor,
+        const std::function<void (KeyBoundle *, Obj *)> &proc) {
+    auto v = *cursor;
+    int64_t n = 0;
+
+    if (!table->old_slots) {
+        auto mask = static_cast<uint64_t>(table->num_slots - 1);
+        n += VisitSlot(&table->slots[v & mask], proc);
+        *cursor = NextCursor(v, mask);
+        return n;
+    }
+
+    // Visit the old table first: moving nodes be linked to the new table
+    // before unlinked from the old one, so no one can be missed.
+    // One slot of the smaller table, all its expansions of the larger one.
+    auto old_mask = static_cast<uint64_t>(table->num_old_slots - 1);
+    auto new_mask = static_cast<uint64_t>(table->num_slots - 1);
+    if (old_mask < new_mask) {
+        n += VisitSlot(&table->old_slots[v & old_mask], proc);
+        do {
+            n += VisitSlot(&table->slots[v & new_mask], proc);
+            v = NextCursor(v, new_mask);
+        } while (v & (old_mask ^ new_mask));
+    } else {
+        auto index = v & new_mask;
+        do {
+            n += VisitSlot(&table->old_slots[v & old_mask], proc);
+            v = NextCursor(v, old_mask);
+        } while (v & (old_mask ^ new_mask));
+        n += VisitSlot(&table->slots[index], proc);
+    }
+    *cursor = v;
+    return n;
+}
+
+int64_t
+CocurrentHashMap::Sample(int64_t n,
+                         std::function<void (KeyBoundle *, uint32_t)> proc) {
+    EpochGuard epoch;
+    auto table = table_.load(std::memory_order_acquire);
+    if (table->num_slots == 0) {
+        return 0;
+    }
+
+    // Sparse table: visit 10 times slots of `n' at most.
+    int64_t num_visited = 0;
+    auto i = NextRandom();
+    for (int64_t steps = 0; num_visited < n && steps < n * 10; steps++, i++) {
+        if (table->old_slots) {
+            num_visited += SampleSlot(
+                &table->old_slots[i & (table->num_old_slots - 1)], proc);
         }
-        p = node;
-        node = node->next;
+        num_visited += SampleSlot(&table->slots[i & (table->num_slots - 1)],
+                                  proc);
     }
+    return num_visited;
+}
+
+bool CocurrentHashMap::IncrementalRehash(int num_steps) {
+    bool done;
+    {
+        ReaderLock gaint(&gaint_lock_);
+        if (!old_slots_) {
+            return false;
+        }
+        done = UnsafeRehashSteps(num_steps);
+    }
+    if (done) {
+        FinishRehash();
+    }
+    return !done;
+}
+
+void CocurrentHashMap::Reserve(int64_t num_keys) {
+    while (IncrementalRehash(REHASH_STEPS_PER_OP))
+        ;
+    if (ExtendIfNeed(num_keys_.load() + num_keys)) {
+        while (IncrementalRehash(REHASH_STEPS_PER_OP))
+            ;
+    }
+}
+
+yuki::Status CocurrentHashMap::BulkPut(yuki::SliceRef key,
+                                       const Version &version, Obj *value) {
+    return BulkPut(key, Hash(key.Data(), key.Length()), version, value);
+}
+
+yuki::Status CocurrentHashMap::BulkPut(yuki::SliceRef key, uint64_t hash,
+                                       const Version &version, Obj *value) {
+    using yuki::Status;
+
+    // Is the key in [p, last) of a chain?
+    auto found = [key, hash] (Node *p, Node *last) {
+        for (; p != last; p = p->next.load(std::memory_order_acquire)) {
+            if (p->hash == hash && p->key()->key().Compare(key) == 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    EpochGuard epoch;
+    auto table = table_.load(std::memory_order_acquire);
+    DCHECK_GT(table->num_slots, 0);
+    if (table->old_slots) {
+        auto old = &table->old_slots[hash & (table->num_old_slots - 1)];
+        if (UnsafeFindRoom(key, hash, old)) {
+            return Status::OK();
+        }
+    }
+    auto slot = &table->slots[hash & (table->num_slots - 1)];
+    auto head = slot->node.load(std::memory_order_acquire);
+    if (found(head, nullptr)) {
+        return Status::OK();
+    }
+
+    auto node = NewNode(key, version, hash, value);
     if (!node) {
-        node = new Node;
-        if (!node) {
-            return nullptr;
+        return Status::Systemf("not enough memory.");
+    }
+    node->access.store(AccessClock::New(access_policy_),
+                       std::memory_order_relaxed);
+    bool expirable = version.type == VERSION_EXPIRE;
+    if (expirable) {
+        num_expires_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    for (;;) {
+        node->next.store(head, std::memory_order_relaxed);
+        if (slot->node.compare_exchange_weak(head, node,
+                                             std::memory_order_release,
+                                             std::memory_order_acquire)) {
+            break;
         }
-        p->next = node;
-        memset(node, 0, sizeof(*node));
 
-        std::atomic_fetch_add_explicit(&num_keys_, 1,
-                                       std::memory_order_release);
+        // Others pushed ahead, only the new nodes need be checked.
+        if (found(head, node->next.load(std::memory_order_relaxed))) {
+            if (expirable) {
+                num_expires_.fetch_sub(1, std::memory_order_relaxed);
+            }
+            FreeNode(node); // never be published.
+            return Status::OK();
+        }
     }
-    slot->node = stub.next;
+    memory_usage_.fetch_add(EntryUsage(node), std::memory_order_relaxed);
+    UnsafeRecount(value);
+
+    std::atomic_fetch_add_explicit(&num_keys_, 1, std::memory_order_release);
+    return Status::OK();
+}
+
+CocurrentHashMap::Node *
+CocurrentHashMap::UnsafeMakeRoom(Node *node, Slot *slot) {
+    node->next.store(slot->node.load(std::memory_order_relaxed),
+                     std::memory_order_relaxed);
+
+    // Publish the node after it be made.
+    slot->node.store(node, std::memory_order_release);
     return node;
 }
 
-bool CocurrentHashMap::UnsafeDeleteRoom(yuki::SliceRef key, Slot *slot) {
-    Node stub;
-    stub.key  = nullptr;
-    stub.next = slot->node;
-    auto p = &stub;
-    auto node = slot->node;
+bool CocurrentHashMap::UnsafeDeleteRoom(yuki::SliceRef key, uint64_t hash,
+                                        Slot *slot) {
+    auto p = &slot->node;
+    auto node = p->load(std::memory_order_relaxed);
     while (node) {
-        if (DCHECK_NOTNULL(node->key)->key().Compare(key) == 0) {
+        if (node->hash == hash && node->key()->key().Compare(key) == 0) {
             break;
         }
-        p = node;
-        node = node->next;
+        p = &node->next;
+        node = p->load(std::memory_order_relaxed);
     }
-    if (node) {
-        p->next = node->next;
-        free(node->key);
-        ObjRelease(node->value);
-        delete node;
+    if (!node) {
+        return false;
+    }
+
+    // Readers may still stand on this node, so retire it to the epoch.
+    p->store(node->next.load(std::memory_order_relaxed),
+             std::memory_order_release);
+    memory_usage_.fetch_sub(EntryUsage(node), std::memory_order_relaxed);
+    if (node->key()->version().type == VERSION_EXPIRE) {
+        num_expires_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    Epoch::Retire(node, FreeNode);
 
-        std::atomic_fetch_sub_explicit(&num_keys_, 1,
-                                       std::memory_order_release);
+    std::atomic_fetch_sub_explicit(&num_keys_, 1, std::memory_order_release);
+    return true;
+}
+
+// The counted bytes of a value only be changed here, under the lock of its
+// entry, so adding and subtracting of ValueUsage() always match.
+void CocurrentHashMap::UnsafeRecount(Obj *value) {
+    int64_t delta = 0;
+    switch (value->type()) {
+        case YKN_LIST:
+            delta = static_cast<List *>(value)->stub()->Recount();
+            break;
+        case YKN_HASH:
+            delta = static_cast<yukino::Hash *>(value)->stub()->Recount();
+            break;
+        default:
+            return;
     }
-    slot->node = stub.next;
-    return !!node;
+    memory_usage_.fetch_add(delta, std::memory_order_relaxed);
 }
 
 CocurrentHashMap::Node *
-CocurrentHashMap::UnsafeFindRoom(yuki::SliceRef key, Slot *slot) {
-    auto node = slot->node;
+CocurrentHashMap::UnsafeFindRoom(yuki::SliceRef key, uint64_t hash,
+                                 Slot *slot) {
+    auto node = slot->node.load(std::memory_order_acquire);
     while (node) {
-        if (DCHECK_NOTNULL(node->key)->key().Compare(key) == 0) {
+        if (node->hash == hash && node->key()->key().Compare(key) == 0) {
             break;
         }
-        node = node->next;
+        node = node->next.load(std::memory_order_acquire);
     }
     return node;
 }
 
-bool CocurrentHashMap::ExtendIfNeed(int num_keys) {
+yuki::Status CocurrentHashMap::UnsafePutValue(Slot *slot, Node *node,
+                                              const Version &version,
+                                              Obj *value) {
+    if (version.type != VERSION_EXPIRE) {
+        UnsafeReplaceValue(slot, node, version.number, value);
+        return yuki::Status::OK();
+    }
+
+    Touch(node);
+    if (!UnsafeReplaceNode(slot, node, version, value)) {
+        return yuki::Status::Systemf("not enough memory.");
+    }
+    return yuki::Status::OK();
+}
+
+void CocurrentHashMap::UnsafeReplaceValue(Slot *slot, Node *node,
+                                          uint64_t version_number,
+                                          Obj *value) {
+    Touch(node);
+    auto version = node->key()->version();
+    if (version.type == VERSION_EXPIRE) {
+        // Writing a new value clears the expiring time.
+        version.type   = VERSION_PLAIN;
+        version.number = version_number;
+        UnsafeReplaceNode(slot, node, version, value);
+        return;
+    }
+
+    auto old = node->value.load(std::memory_order_relaxed);
+    if (old == value) {
+        return;
+    }
+    if (!node->is_value_inline() && !InlineValueSize(value)) {
+        memory_usage_.fetch_add(static_cast<int64_t>(ValueUsage(value)) -
+                                static_cast<int64_t>(ValueUsage(old)),
+                                std::memory_order_relaxed);
+        node->value.store(ObjAddRef(value), std::memory_order_release);
+        Epoch::Retire(old, ReleaseObj);
+        UnsafeRecount(value);
+        return;
+    }
+
+    // Inline value can not be changed, make a new entry instead of it.
+    UnsafeReplaceNode(slot, node, version, value);
+}
+
+bool CocurrentHashMap::UnsafeReplaceNode(Slot *slot, Node *node,
+                                         const Version &version,
+                                         Obj *value) {
+    auto fresh = NewNode(node->key()->key(), version, node->hash, value);
+    if (!fresh) {
+        // Keep the old entry alive.
+        LOG(ERROR) << "not enough memory for new entry.";
+        return false;
+    }
+    fresh->access.store(node->access.load(std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+    memory_usage_.fetch_add(EntryUsage(fresh) - EntryUsage(node),
+                            std::memory_order_relaxed);
+    UnsafeRecount(value);
+
+    // Count it before publishing, readers never miss an expiring entry.
+    int was = node->key()->version().type == VERSION_EXPIRE;
+    int now = version.type == VERSION_EXPIRE;
+    if (now != was) {
+        num_expires_.fetch_add(now - was);
+    }
+
+    auto p = &slot->node;
+    while (p->load(std::memory_order_relaxed) != node) {
+        p = &p->load(std::memory_order_relaxed)->next;
+    }
+    fresh->next.store(node->next.load(std::memory_order_relaxed),
+                      std::memory_order_relaxed);
+    p->store(fresh, std::memory_order_release);
+    Epoch::Retire(node, FreeNode);
+    return true;
+}
+
+// Must be called under the slot lock (writer).
+yuki::Status
+CocurrentHashMap::UnsafeUpdate(Slot *slot, Node *node, uint64_t version_number,
+                               const std::function<Obj *(Obj *)> &proc) {
+    // Checked at the time of the command, the redo gets the same.
+    int64_t now = static_cast<int64_t>(version_number);
+    auto expired = Expired(node, &now);
+    auto value = proc(expired ? nullptr
+                              : node->value.load(std::memory_order_relaxed));
+    if (!value) {
+        return yuki::Status::OK();
+    }
+    if (expired || node->key()->version().type != VERSION_EXPIRE) {
+        UnsafeReplaceValue(slot, node, version_number, value);
+        return yuki::Status::OK();
+    }
+
+    // Keep the expiring time, unlike Put().
+    Touch(node);
+    if (!UnsafeReplaceNode(slot, node, node->key()->version(), value)) {
+        return yuki::Status::Systemf("not enough memory.");
+    }
+    return yuki::Status::OK();
+}
+
+bool CocurrentHashMap::Expire(yuki::SliceRef key, int64_t expire_at) {
+    return Expire(key, Hash(key.Data(), key.Length()), expire_at);
+}
+
+bool CocurrentHashMap::Expire(yuki::SliceRef key, uint64_t hash,
+                              int64_t expire_at) {
+    ReaderLock gaint(&gaint_lock_);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        if (UnsafeFindRoom(key, hash, old)) {
+            return UnsafeExpire(old, key, hash, expire_at);
+        }
+    }
+
+    auto slot = Take(hash);
+    WriterLock scope(&slot->rwlock);
+    return UnsafeExpire(slot, key, hash, expire_at);
+}
+
+bool CocurrentHashMap::UnsafeExpire(Slot *slot, yuki::SliceRef key,
+                                    uint64_t hash, int64_t expire_at) {
+    auto node = UnsafeFindRoom(key, hash, slot);
+    int64_t now = 0;
+    if (!node || Expired(node, &now)) {
+        return false;
+    }
+
+    auto version = node->key()->version();
+    if (expire_at > 0) {
+        version.type   = VERSION_EXPIRE;
+        version.number = expire_at;
+    } else if (version.type == VERSION_EXPIRE) {
+        version.type   = VERSION_PLAIN;
+        version.number = 0;
+    } else {
+        return true; // already persistent.
+    }
+    return UnsafeReplaceNode(slot, node, version,
+                             node->value.load(std::memory_order_relaxed));
+}
+
+bool CocurrentHashMap::DeleteExpired(yuki::SliceRef key, int64_t now) {
+    return DeleteExpired(key, Hash(key.Data(), key.Length()), now);
+}
+
+bool CocurrentHashMap::DeleteExpired(yuki::SliceRef key, uint64_t hash,
+                                     int64_t now) {
+    ReaderLock gaint(&gaint_lock_);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            return Expired(node, &now) && UnsafeDeleteRoom(key, hash, old);
+        }
+    }
+
+    auto slot = Take(hash);
+    WriterLock scope(&slot->rwlock);
+    auto node = UnsafeFindRoom(key, hash, slot);
+    return node && Expired(node, &now) && UnsafeDeleteRoom(key, hash, slot);
+}
+
+bool CocurrentHashMap::DeleteValue(yuki::SliceRef key, Obj *value) {
+    return DeleteValue(key, Hash(key.Data(), key.Length()), value);
+}
+
+bool CocurrentHashMap::DeleteValue(yuki::SliceRef key, uint64_t hash,
+                                   Obj *value) {
+    ReaderLock gaint(&gaint_lock_);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            return node->value.load(std::memory_order_relaxed) == value &&
+                   UnsafeDeleteRoom(key, hash, old);
+        }
+    }
+
+    auto slot = Take(hash);
+    WriterLock scope(&slot->rwlock);
+    auto node = UnsafeFindRoom(key, hash, slot);
+    return node && node->value.load(std::memory_order_relaxed) == value &&
+           UnsafeDeleteRoom(key, hash, slot);
+}
+
+void CocurrentHashMap::RecountUsage(yuki::SliceRef key) {
+    RecountUsage(key, Hash(key.Data(), key.Length()));
+}
+
+void CocurrentHashMap::RecountUsage(yuki::SliceRef key, uint64_t hash) {
+    ReaderLock gaint(&gaint_lock_);
+    auto old = TakeOld(hash);
+    if (old) {
+        WriterLock scope(&old->rwlock);
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            UnsafeRecount(node->value.load(std::memory_order_relaxed));
+            return;
+        }
+    }
+
+    auto slot = Take(hash);
+    WriterLock scope(&slot->rwlock);
+    auto node = UnsafeFindRoom(key, hash, slot);
+    if (node) {
+        UnsafeRecount(node->value.load(std::memory_order_relaxed));
+    }
+}
+
+bool CocurrentHashMap::Expired(const Node *node, int64_t *now) const {
+    if (num_expires_.load(std::memory_order_acquire) == 0) {
+        return false;
+    }
+    auto version = node->key()->version();
+    if (version.type != VERSION_EXPIRE) {
+        return false;
+    }
+    if (*now == 0) {
+        *now = WallMilsces();
+    }
+    return version.expired(*now);
+}
+
+CocurrentHashMap::Node *CocurrentHashMap::LockFreeFind(yuki::SliceRef key,
+                                                       uint64_t hash) {
+    return LockFreeFind(table_.load(std::memory_order_acquire), key, hash);
+}
+
+CocurrentHashMap::Node *
+CocurrentHashMap::LockFreeFind(const Table *table, yuki::SliceRef key,
+                               uint64_t hash) {
+    // Moving node be linked to new table before unlinked from old table,
+    // so check the old table first.
+    if (table->old_slots) {
+        auto old = &table->old_slots[hash & (table->num_old_slots - 1)];
+        auto node = UnsafeFindRoom(key, hash, old);
+        if (node) {
+            return node;
+        }
+    }
+    if (table->num_slots == 0) {
+        return nullptr;
+    }
+    return UnsafeFindRoom(key, hash,
+                          &table->slots[hash & (table->num_slots - 1)]);
+}
+
+bool CocurrentHashMap::ExtendIfNeed(int64_t num_keys) {
     gaint_lock_.ReadLock();
-    auto key_rate = static_cast<float>(num_keys) / static_cast<float>(num_slots_);
-    if (key_rate <= balance_fator_) {
+    if (old_slots_) {
+        gaint_lock_.Unlock();
+        return false;
+    }
+    if (!KeyRateAbove(num_keys, num_slots_, balance_fator_)) {
         gaint_lock_.Unlock();
         return false;
     }
@@ -296,10 +1198,13 @@ bool CocurrentHashMap::ExtendIfNeed(int num_keys) {
     return ResizeSlots(num_keys);
 }
 
-bool CocurrentHashMap::ShrinkIfNeed(int num_keys) {
+bool CocurrentHashMap::ShrinkIfNeed(int64_t num_keys) {
     gaint_lock_.ReadLock();
-    auto key_rate = static_cast<float>(num_keys) / static_cast<float>(num_slots_);
-    if (key_rate >= balance_fator_down_) {
+    if (old_slots_) {
+        gaint_lock_.Unlock();
+        return false;
+    }
+    if (!KeyRateBelow(num_keys, num_slots_, balance_fator_down_)) {
         gaint_lock_.Unlock();
         return false;
     }
@@ -312,15 +1217,19 @@ bool CocurrentHashMap::ShrinkIfNeed(int num_keys) {
     return ResizeSlots(num_keys);
 }
 
-bool CocurrentHashMap::ResizeSlots(int num_keys) {
+bool CocurrentHashMap::ResizeSlots(int64_t num_keys) {
     DCHECK_GT(balance_fator_, balance_fator_down_);
 
-    WriterLock gaint(&gaint_lock_);
-    if (static_cast<float>(num_keys) / static_cast<float>(num_slots_) >=
-        balance_fator_down_ &&
-        static_cast<float>(num_keys) / static_cast<float>(num_slots_) <=
-        balance_fator_) {
-
+    int64_t num_slots;
+    {
+        ReaderLock gaint(&gaint_lock_);
+        if (old_slots_) {
+            return false; // the last rehashing not finish yet.
+        }
+        num_slots = num_slots_;
+    }
+    if (!KeyRateBelow(num_keys, num_slots, balance_fator_down_) &&
+        !KeyRateAbove(num_keys, num_slots, balance_fator_)) {
         return true;
     }
 
@@ -328,55 +1237,149 @@ bool CocurrentHashMap::ResizeSlots(int num_keys) {
     //   ^--->
     // num_keys / num_slots = mid_fator;
     // num_keys = mid_fator * num_slots;
-    auto new_num_slots = static_cast<int>(num_keys /
-                                          (balance_fator_down_ +
-                                           (balance_fator_ -
-                                            balance_fator_down_) / 2));
+    auto new_num_slots = static_cast<int64_t>(num_keys /
+                                              (balance_fator_down_ +
+                                               (balance_fator_ -
+                                                balance_fator_down_) / 2));
+    new_num_slots = RoundUpPowerOf2(new_num_slots);
     if (new_num_slots < min_num_slots_) {
         new_num_slots = min_num_slots_;
     }
+    if (new_num_slots == num_slots) {
+        return true;
+    }
+
+    // Make the new table out of gaint lock, only switch tables in it.
     auto new_slots = new Slot[new_num_slots];
     if (!new_slots) {
         return false;
     }
     InitSlots(new_slots, new_num_slots);
-    Rehash(slots_, num_slots_, new_slots, new_num_slots);
-    delete[] slots_;
 
+    WriterLock gaint(&gaint_lock_);
+    if (old_slots_ || num_slots_ != num_slots) {
+        delete[] new_slots; // someone else resized it.
+        return false;
+    }
+
+    if (num_slots_ > 0) {
+        old_slots_     = slots_;
+        num_old_slots_ = num_slots_;
+        rehash_.store(0);
+        num_rehashed_.store(0);
+    } else {
+        Epoch::Retire(slots_, DeleteSlots);
+    }
     slots_     = new_slots;
     num_slots_ = new_num_slots;
+    PublishTable();
+
+    // Readers of the last snapshot only look up the old table, they must
+    // leave before any node be moved out of it.
+    rehash_epoch_ = Epoch::current();
     return true;
 }
 
-void CocurrentHashMap::Rehash(Slot *from, int num_from, Slot *to, int num_to) {
-    for (int i = 0; i < num_from; i++) {
-        auto from_slot = &from[i];
+bool CocurrentHashMap::UnsafeRehashSteps(int num_steps) {
+    if (!Epoch::Synchronized(rehash_epoch_)) {
+        Epoch::TryAdvance();
+        return false;
+    }
 
-        while (from_slot->node) {
-            auto node = from_slot->node;
-            from_slot->node = node->next;
+    num_moving_.fetch_add(1);
+    if (num_iterators_.load() > 0) {
+        num_moving_.fetch_sub(1);
+        return false;
+    }
 
-            auto key = DCHECK_NOTNULL(node->key)->key();
-            auto to_slot_index = (Hash(key.Data(), key.Length()) | 1) %
-                num_to;
-            auto to_slot = &to[to_slot_index];
+    bool done = false;
+    while (num_steps--) {
+        auto i = rehash_.fetch_add(1);
+        if (i >= num_old_slots_) {
+            break;
+        }
+        UnsafeMoveSlot(&old_slots_[i]);
+        if (num_rehashed_.fetch_add(1) + 1 == num_old_slots_) {
+            done = true;
+            break;
+        }
+    }
+    num_moving_.fetch_sub(1);
+    return done;
+}
 
-            node->next = to_slot->node;
-            to_slot->node = node;
+void CocurrentHashMap::UnsafeMoveSlot(Slot *from) {
+    WriterLock scope(&from->rwlock);
+
+    // Lock-free readers check the old table first, so link a copy to the
+    // new table first, then unlink the origin one from old table.
+    auto node = from->node.load(std::memory_order_relaxed);
+    while (node) {
+        // No need to hash the key again.
+        auto to = Take(node->hash);
+        WriterLock to_scope(&to->rwlock);
+
+        auto copied = NewNode(node->key()->key(), node->key()->version(),
+                              node->hash,
+                              node->value.load(std::memory_order_relaxed));
+        if (!copied) {
+            LOG(ERROR) << "not enough memory for moving entry.";
+            break;
         }
+        copied->access.store(node->access.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+        UnsafeMakeRoom(copied, to);
+
+        auto next = node->next.load(std::memory_order_relaxed);
+        from->node.store(next, std::memory_order_release);
+        Epoch::Retire(node, FreeNode);
+        node = next;
+    }
+
+    // Out of memory, move the rest nodes themselves from the tail. The tail
+    // be linked to the new table before unlinked from the old one, so
+    // readers never miss it.
+    for (;;) {
+        auto prev = &from->node;
+        auto tail = prev->load(std::memory_order_relaxed);
+        if (!tail) {
+            break;
+        }
+        for (auto next = tail->next.load(std::memory_order_relaxed); next;
+             next = tail->next.load(std::memory_order_relaxed)) {
+            prev = &tail->next;
+            tail = next;
+        }
+
+        auto to = Take(tail->hash);
+        WriterLock to_scope(&to->rwlock);
+        UnsafeMakeRoom(tail, to);
+        prev->store(nullptr, std::memory_order_release);
     }
 }
 
-KeyBoundle *CocurrentHashMap::MakeKeyBoundle(yuki::SliceRef key, uint8_t type,
-                                             uint64_t version_number) {
-    auto key_boundle_size = KeyBoundle::PredictBoundleSize(key, version_number);
-    auto key_buf = malloc(key_boundle_size);
-    if (!key_buf) {
-        return nullptr;
+void CocurrentHashMap::FinishRehash() {
+    WriterLock gaint(&gaint_lock_);
+    if (!old_slots_ || num_rehashed_.load() < num_old_slots_) {
+        return;
     }
 
-    return KeyBoundle::Build(key, type, version_number, key_buf,
-                             key_boundle_size);
+    Epoch::Retire(old_slots_, DeleteSlots);
+    old_slots_     = nullptr;
+    num_old_slots_ = 0;
+    PublishTable();
+}
+
+// Must be called under the gaint writer lock.
+void CocurrentHashMap::PublishTable() {
+    auto table = new Table;
+    table->slots         = slots_;
+    table->num_slots     = num_slots_;
+    table->old_slots     = old_slots_;
+    table->num_old_slots = num_old_slots_;
+
+    Epoch::Retire(table_.exchange(table, std::memory_order_acq_rel),
+                  DeleteTable);
 }
 
-} // namespace yukino
\ No newline at end of file
+} // namespace yukino
@@ -1,10 +1,12 @@
 #ifndef YUKINO_COCURRENT_HASH_MAP_H_
 #define YUKINO_COCURRENT_HASH_MAP_H_
 
+#include "mem_table.h"
 #include "rw_spin_lock.h"
 #include "yuki/slice.h"
 #include "yuki/status.h"
 #include <atomic>
+#include <stdint.h>
 #include <string.h>
 #include <pthread.h>
 
@@ -15,90 +17,270 @@ struct KeyBoundle;
 struct Version;
 class Iterator;
 
-class CocurrentHashMap {
+//
+// Writers lock the gaint lock (reader) and slots (writer), readers only run in
+// an epoch guard without any lock. Unlinked nodes, keys and values be retired
+// to the epoch, and freed after all readers passed.
+//
+class CocurrentHashMap : public MemTable {
 public:
+    //
+    // Entry, in one allocation:
+    // [inline value (optional)][Node][KeyBoundle]
+    // Small String and Integer values be copied into the entry, the entry
+    // be freed when the inline value released at last.
+    //
     struct Node {
-        KeyBoundle *key;
-        Obj        *value;
-        Node       *next;
+        std::atomic<Obj *>   value;
+        std::atomic<Node *>  next;
+        uint64_t             hash; // full hash of key, compared before key bytes.
+        uint32_t             value_offset; // not 0: value inlined before node.
+        std::atomic<uint32_t> access; // access clock, see AccessClock.
+
+        KeyBoundle *key() const {
+            return reinterpret_cast<KeyBoundle *>(const_cast<Node *>(this + 1));
+        }
+        bool is_value_inline() const { return value_offset != 0; }
     };
 
+    // Max size of value can be inlined.
+    enum { MAX_INLINE_VALUE_SIZE = 64 };
+
     struct Slot {
         RWSpinLock rwlock;
-        Node  *node;
+        std::atomic<Node *> node;
+    };
+
+    // Tables snapshot for lock-free readers.
+    struct Table {
+        Slot   *slots;
+        int64_t num_slots;
+        Slot   *old_slots;
+        int64_t num_old_slots;
     };
 
-    CocurrentHashMap(int initial_size);
-    ~CocurrentHashMap();
+    CocurrentHashMap(int64_t initial_size);
+    virtual ~CocurrentHashMap() override;
+
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) override;
+    virtual bool Delete(yuki::SliceRef key) override;
+
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) override;
+
+    virtual yuki::Status
+    Exec(yuki::SliceRef key,
+         std::function<void (const Version &, Obj *)> proc) override;
+
+    // Under the slot lock (writer). The value be replaced, never be changed
+    // in place, lock-free readers may hold the old one.
+    virtual yuki::Status
+    Update(yuki::SliceRef key, uint64_t version_number,
+           std::function<Obj *(Obj *)> proc) override;
 
-    yuki::Status Put(yuki::SliceRef key, uint64_t version_number, Obj *value);
-    bool Delete(yuki::SliceRef key);
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys,
+                            Obj **values) override;
 
-    yuki::Status Get(yuki::SliceRef key, Version *ver, Obj **value);
-    inline bool Exist(yuki::SliceRef key);
+    // The iterator holds the gaint lock and pauses the rehashing in its life
+    // time, use Scan() for long sweeps.
+    virtual Iterator *iterator() override;
 
-    yuki::Status Exec(yuki::SliceRef key,
+    // Reverse binary cursor (as Redis SCAN), it survives resizing between
+    // calls. Every call runs in an epoch guard only, no lock be held.
+    // Keys exist in the whole scan be visited at least once, some may be
+    // visited more than once if the table resized.
+    virtual uint64_t
+    Scan(uint64_t cursor, int64_t count,
+         std::function<void (KeyBoundle *, Obj *)> proc) override;
+
+    // The expiring time be in the version of key boundle (VERSION_EXPIRE),
+    // changing it makes a new entry. Expired keys be not found, and be
+    // removed by the accessing.
+    virtual bool Expire(yuki::SliceRef key, int64_t expire_at) override;
+    virtual yuki::Status PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                   Obj *value) override;
+    virtual bool DeleteExpired(yuki::SliceRef key, int64_t now) override;
+    virtual bool DeleteValue(yuki::SliceRef key, Obj *value) override;
+    virtual int64_t num_expires() const override { return num_expires_; }
+    virtual bool expirable() const override { return true; }
+
+    // Same as above, but with the pre-computed hash of key. A plain version
+    // be as Put(), an expiring one be as PutExpire().
+    yuki::Status Put(yuki::SliceRef key, uint64_t hash, const Version &version,
+                     Obj *value);
+    bool Delete(yuki::SliceRef key, uint64_t hash);
+    yuki::Status Get(yuki::SliceRef key, uint64_t hash, Version *ver,
+                     Obj **value);
+    yuki::Status Exec(yuki::SliceRef key, uint64_t hash,
                       std::function<void (const Version &, Obj *)> proc);
+    yuki::Status Update(yuki::SliceRef key, uint64_t hash,
+                        uint64_t version_number,
+                        std::function<Obj *(Obj *)> proc);
+    size_t MultiGet(size_t n, const yuki::Slice *keys, const uint64_t *hashes,
+                    Obj **values);
+    bool Expire(yuki::SliceRef key, uint64_t hash, int64_t expire_at);
+    bool DeleteExpired(yuki::SliceRef key, uint64_t hash, int64_t now);
+    bool DeleteValue(yuki::SliceRef key, uint64_t hash, Obj *value);
+    void RecountUsage(yuki::SliceRef key, uint64_t hash);
+
+    // MultiGet() resolves keys group by group: prefetch slots of the whole
+    // group, then chain heads, then values, so the cache misses of one group
+    // be overlapped instead of one by one.
+    enum { MULTI_GET_GROUP_SIZE = 16 };
+
+    // Move at most `num_steps' slots from the old table to the new one.
+    // Return true if the rehashing still in progress.
+    virtual bool IncrementalRehash(int num_steps) override;
 
-    Iterator *iterator();
+    // Resize the table in one time, and wait for the rehashing finished.
+    virtual void Reserve(int64_t num_keys) override;
 
-    Node *UnsafeFindOrMakeRoom(yuki::SliceRef key, Slot *slot);
-    bool  UnsafeDeleteRoom(yuki::SliceRef key, Slot *slot);
-    Node *UnsafeFindRoom(yuki::SliceRef key, Slot *slot);
+    // New node be pushed to the head of the slot by CAS, without the gaint
+    // lock and slot lock, the table never be resized here.
+    virtual yuki::Status BulkPut(yuki::SliceRef key, const Version &version,
+                                 Obj *value) override;
+    yuki::Status BulkPut(yuki::SliceRef key, uint64_t hash,
+                         const Version &version, Obj *value);
+
+    virtual int64_t memory_usage() const override { return memory_usage_; }
+    virtual void RecountUsage(yuki::SliceRef key) override;
+
+    // Must be set before any access.
+    virtual void set_access_policy(EvictionPolicy policy) override {
+        access_policy_ = policy;
+    }
 
-    inline Slot *Take(yuki::SliceRef key);
+    // Walk slots from a random one, as dictGetSomeKeys() of Redis.
+    virtual int64_t
+    Sample(int64_t n,
+           std::function<void (KeyBoundle *, uint32_t)> proc) override;
 
-    static unsigned int Hash(const char *p, size_t n);
+    Node *UnsafeMakeRoom(Node *node, Slot *slot);
+    bool  UnsafeDeleteRoom(yuki::SliceRef key, uint64_t hash, Slot *slot);
+    void  UnsafeRecount(Obj *value);
+    // Can be called in a epoch guard without slot lock.
+    Node *UnsafeFindRoom(yuki::SliceRef key, uint64_t hash, Slot *slot);
+
+    inline Slot *Take(uint64_t hash);
+    inline Slot *TakeOld(uint64_t hash);
+
+    // Seeded 64 bits hash, the seed is random for every process.
+    static uint64_t Hash(const char *p, size_t n);
+
+    static Node *NewNode(yuki::SliceRef key, const Version &version,
+                         uint64_t hash, Obj *value);
+    static void FreeNode(void *node);
 
     RWSpinLock *gaint_lock() { return &gaint_lock_; }
 
-    float balance_fator() const { return balance_fator_; }
-    float balance_fator_down() const { return balance_fator_down_; }
-    int num_keys() const { return num_keys_; }
-    int num_slots() const { return num_slots_; }
+    double balance_fator() const { return balance_fator_; }
+    double balance_fator_down() const { return balance_fator_down_; }
+    virtual int64_t num_keys() const override { return num_keys_; }
+    int64_t num_slots() const { return num_slots_; }
+    bool is_rehashing() const { return old_slots_ != nullptr; }
 
+    enum { REHASH_STEPS_PER_OP = 16 };
 
     // For testing:
-    void TEST_ResizeSlots(int num_keys) { ResizeSlots(num_keys); }
+    void TEST_ResizeSlots(int64_t num_keys) {
+        ResizeSlots(num_keys);
+        while (IncrementalRehash(REHASH_STEPS_PER_OP))
+            ;
+    }
+    void TEST_BeginResizeSlots(int64_t num_keys) { ResizeSlots(num_keys); }
 
 private:
-    inline void InitSlots(Slot *slots, int num_slots);
+    inline void InitSlots(Slot *slots, int64_t num_slots);
 
-    inline bool ExtendIfNeed(int num_keys);
-    inline bool ShrinkIfNeed(int num_keys);
-    bool ResizeSlots(int num_keys);
+    inline bool ExtendIfNeed(int64_t num_keys);
+    inline bool ShrinkIfNeed(int64_t num_keys);
+    bool ResizeSlots(int64_t num_keys);
 
-    void Rehash(Slot *from, int num_from, Slot *to, int num_to);
+    bool UnsafeRehashSteps(int num_steps);
+    void UnsafeMoveSlot(Slot *from);
+    yuki::Status UnsafePutValue(Slot *slot, Node *node, const Version &version,
+                                Obj *value);
+    void UnsafeReplaceValue(Slot *slot, Node *node, uint64_t version_number,
+                            Obj *value);
+    bool UnsafeReplaceNode(Slot *slot, Node *node, const Version &version,
+                           Obj *value);
+    yuki::Status UnsafeUpdate(Slot *slot, Node *node, uint64_t version_number,
+                              const std::function<Obj *(Obj *)> &proc);
+    bool UnsafeExpire(Slot *slot, yuki::SliceRef key, uint64_t hash,
+                      int64_t expire_at);
+    inline void Touch(Node *node);
+    // `now' be got in need, only if any key can expire.
+    bool Expired(const Node *node, int64_t *now) const;
+    void FinishRehash();
+    void PublishTable();
 
-    KeyBoundle *MakeKeyBoundle(yuki::SliceRef key, uint8_t type,
-                               uint64_t version_number);
+    // Visit slots of one cursor in the table, return number of keys.
+    int64_t ScanStep(const Table *table, uint64_t *cursor,
+                     const std::function<void (KeyBoundle *, Obj *)> &proc);
 
-    Slot *slots_;
-    int   num_slots_;
-    const int min_num_slots_;
-    float balance_fator_;
-    float balance_fator_down_;
-    std::atomic<int> num_keys_;
-    std::atomic<int> rehash_;
+    Node *LockFreeFind(yuki::SliceRef key, uint64_t hash);
+    Node *LockFreeFind(const Table *table, yuki::SliceRef key, uint64_t hash);
+
+    Slot   *slots_;
+    int64_t num_slots_;
+    const int64_t min_num_slots_;
+    double  balance_fator_;
+    double  balance_fator_down_;
+    std::atomic<int64_t> num_keys_;
+
+    // Progressive rehashing: the old table keeps living beside the new one
+    // until every old slot be moved. New keys always go to the new table.
+    Slot   *old_slots_;
+    int64_t num_old_slots_;
+    std::atomic<int64_t> rehash_;       // next old slot to move
+    std::atomic<int64_t> num_rehashed_; // old slots already moved
+    std::atomic<int>     num_moving_;   // threads moving slots now
+    std::atomic<int>     num_iterators_; // living iterators pause the moving
+    uint64_t rehash_epoch_;          // moving waits readers of last table
     RWSpinLock gaint_lock_;
+
+    std::atomic<Table *> table_;     // published under gaint writer lock
+
+    EvictionPolicy access_policy_;
+    std::atomic<int64_t> memory_usage_;
+    std::atomic<int64_t> num_expires_;
 };
 
-inline CocurrentHashMap::Slot *CocurrentHashMap::Take(yuki::SliceRef key) {
-    auto slot_index = (Hash(key.Data(), key.Length()) | 1) % num_slots_;
+static_assert(sizeof(CocurrentHashMap::Node) == 32, "Fixed node header size.");
+
+// Number of slots is always power of 2.
+inline CocurrentHashMap::Slot *CocurrentHashMap::Take(uint64_t hash) {
+    auto slot_index = hash & (num_slots_ - 1);
     return &slots_[slot_index];
 }
 
-inline void CocurrentHashMap::InitSlots(Slot *slots, int num_slots) {
-    for (int i = 0; i < num_slots; i++) {
-        slots[i].node = nullptr;
+inline CocurrentHashMap::Slot *CocurrentHashMap::TakeOld(uint64_t hash) {
+    if (!old_slots_) {
+        return nullptr;
     }
+    auto slot_index = hash & (num_old_slots_ - 1);
+    return &old_slots_[slot_index];
 }
 
-inline bool CocurrentHashMap::Exist(yuki::SliceRef key) {
-    auto rv = Get(key, nullptr, nullptr);
-    return rv.Ok();
+// Lock-free readers update the clock racily, a lost update is harmless.
+inline void CocurrentHashMap::Touch(Node *node) {
+    if (access_policy_ != EVICT_LRU && access_policy_ != EVICT_LFU) {
+        return;
+    }
+    auto clock = node->access.load(std::memory_order_relaxed);
+    auto touched = AccessClock::Touch(access_policy_, clock);
+    if (touched != clock) {
+        node->access.store(touched, std::memory_order_relaxed);
+    }
+}
+
+inline void CocurrentHashMap::InitSlots(Slot *slots, int64_t num_slots) {
+    for (int64_t i = 0; i < num_slots; i++) {
+        slots[i].node.store(nullptr, std::memory_order_relaxed);
+    }
 }
 
 } // namespace yukino
 
-#endif // YUKINO_COCURRENT_HASH_MAP_H_
\ No newline at end of file
+#endif // YUKINO_COCURRENT_HASH_MAP_H_
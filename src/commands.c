@@ -1,6 +1,6 @@
 /* ANSI-C code produced by gperf version 3.0.3 */
-/* Command-line: /Applications/Xcode.app/Contents/Developer/Toolchains/XcodeDefault.xctoolchain/usr/bin/gperf -L ANSI-C -C -N yukino_command -K z -t -c -n commands.gperf  */
-/* Computed positions: -k'1,3' */
+/* Command-line: gperf -L ANSI-C -C -N yukino_command -K z -t -c commands.gperf  */
+/* Computed positions: -k'1,2' */
 
 #if !((' ' == 32) && ('!' == 33) && ('"' == 34) && ('#' == 35) \
       && ('%' == 37) && ('&' == 38) && ('\'' == 39) && ('(' == 40) \
@@ -40,12 +40,12 @@ struct command {
     int argc;
 };
 
-#define TOTAL_KEYWORDS 13
+#define TOTAL_KEYWORDS 26
 #define MIN_WORD_LENGTH 3
-#define MAX_WORD_LENGTH 6
-#define MIN_HASH_VALUE 0
-#define MAX_HASH_VALUE 30
-/* maximum key range = 31, duplicates = 0 */
+#define MAX_WORD_LENGTH 9
+#define MIN_HASH_VALUE 5
+#define MAX_HASH_VALUE 55
+/* maximum key range = 51, duplicates = 0 */
 
 #ifdef __GNUC__
 __inline
@@ -54,40 +54,39 @@ __inline
 inline
 #endif
 #endif
-/*ARGSUSED*/
 static unsigned int
 hash (register const char *str, register unsigned int len)
 {
   static const unsigned char asso_values[] =
     {
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31,  3, 31, 31,  4, 31,
-      14,  4, 31, 31, 31,  4, 10, 15,  0, 31,
-       5, 31,  0, 15, 10, 10,  0, 31, 31, 31,
-       5, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31, 31, 31, 31,
-      31, 31, 31, 31, 31, 31, 31
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 26,  5, 56, 20,  6,
+       9, 13, 12, 20, 14,  0,  0,  1, 56, 18,
+       3, 11, 25, 22,  2,  5, 25, 56, 56, 14,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56, 56, 56, 56,
+      56, 56, 56, 56, 56, 56, 56
     };
-  return asso_values[(unsigned char)str[2]+1] + asso_values[(unsigned char)str[0]];
+  return len + asso_values[(unsigned char)str[1]+1] + asso_values[(unsigned char)str[0]];
 }
 
 const struct command *
@@ -95,45 +94,80 @@ yukino_command (register const char *str, register unsigned int len)
 {
   static const struct command wordlist[] =
     {
-#line 22 "commands.gperf"
-      {"RPUSH",  CMD_RPUSH,  2},
-      {""}, {""}, {""},
-#line 13 "commands.gperf"
-      {"DUMP",   CMD_DUMP,   0},
-#line 23 "commands.gperf"
-      {"RPOP",   CMD_RPOP,   1},
-      {""}, {""}, {""},
+      {""}, {""}, {""}, {""}, {""},
+#line 19 "commands.gperf"
+      {"LLEN",   CMD_LLEN,   1},
+      {""},
+#line 25 "commands.gperf"
+      {"MSET",   CMD_MSET,   2},
+      {""}, {""},
+#line 32 "commands.gperf"
+      {"TTL",    CMD_TTL,    1},
+      {""}, {""},
 #line 17 "commands.gperf"
       {"KEYS",   CMD_KEYS,   0},
+      {""},
+#line 21 "commands.gperf"
+      {"LPOP",   CMD_LPOP,   1},
 #line 20 "commands.gperf"
       {"LPUSH",  CMD_LPUSH,  2},
-      {""}, {""},
-#line 11 "commands.gperf"
-      {"AUTH",   CMD_AUTH,   1},
+#line 24 "commands.gperf"
+      {"MGET",   CMD_MGET,   1},
+#line 18 "commands.gperf"
+      {"LIST",   CMD_LIST,   0},
+#line 33 "commands.gperf"
+      {"PERSIST", CMD_PERSIST, 1},
+      {""},
+#line 31 "commands.gperf"
+      {"PEXPIREAT", CMD_PEXPIREAT, 2},
+      {""}, {""}, {""},
 #line 14 "commands.gperf"
       {"GET",    CMD_GET,    1},
-#line 21 "commands.gperf"
-      {"LPOP",   CMD_LPOP,   1},
-      {""}, {""}, {""},
+#line 30 "commands.gperf"
+      {"EXPIRE", CMD_EXPIRE, 2},
+      {""}, {""}, {""}, {""},
+#line 27 "commands.gperf"
+      {"PREFIX", CMD_PREFIX, 1},
 #line 16 "commands.gperf"
       {"DEL",    CMD_DEL,    1},
-#line 18 "commands.gperf"
-      {"LIST",   CMD_LIST,   0},
-      {""}, {""}, {""},
-#line 19 "commands.gperf"
-      {"LLEN",   CMD_LLEN,   1},
+#line 35 "commands.gperf"
+      {"DECR",   CMD_DECR,   1},
 #line 15 "commands.gperf"
       {"SET",    CMD_SET,    2},
-      {""}, {""}, {""}, {""},
+#line 26 "commands.gperf"
+      {"RANGE",  CMD_RANGE,  2},
+      {""},
 #line 12 "commands.gperf"
-      {"SELECT", CMD_SELECT, 1}
+      {"SELECT", CMD_SELECT, 1},
+      {""}, {""},
+#line 23 "commands.gperf"
+      {"RPOP",   CMD_RPOP,   1},
+#line 22 "commands.gperf"
+      {"RPUSH",  CMD_RPUSH,  2},
+#line 34 "commands.gperf"
+      {"INCR",   CMD_INCR,   1},
+      {""},
+#line 36 "commands.gperf"
+      {"INCRBY", CMD_INCRBY, 2},
+      {""},
+#line 29 "commands.gperf"
+      {"SCAN",   CMD_SCAN,   1},
+      {""}, {""},
+#line 13 "commands.gperf"
+      {"DUMP",   CMD_DUMP,   0},
+      {""},
+#line 28 "commands.gperf"
+      {"RCOUNT", CMD_RCOUNT, 2},
+      {""}, {""}, {""},
+#line 11 "commands.gperf"
+      {"AUTH",   CMD_AUTH,   1}
     };
 
   if (len <= MAX_WORD_LENGTH && len >= MIN_WORD_LENGTH)
     {
       unsigned int key = hash (str, len);
 
-      if (key <= MAX_HASH_VALUE)
+      if (key <= MAX_HASH_VALUE && key >= MIN_HASH_VALUE)
         {
           register const char *s = wordlist[key].z;
 
@@ -0,0 +1,99 @@
+#include "compact_hash.h"
+#include "handle.h"
+#include "obj.h"
+#include "yuki/utils.h"
+#include "gtest/gtest.h"
+#include <map>
+#include <string>
+#include <thread>
+
+namespace yukino {
+
+TEST(CompactHashTest, Sanity) {
+    CompactHash hash(CompactHash::max_packed());
+    ASSERT_TRUE(hash.packed());
+
+    ASSERT_TRUE(hash.Put(yuki::Slice("name"),
+                         String::New(yuki::Slice("Jake"))).Ok());
+    ASSERT_TRUE(hash.Put(yuki::Slice("age"), Integer::New(100)).Ok());
+    ASSERT_TRUE(hash.Put(yuki::Slice("age"), Integer::New(99)).Ok());
+    EXPECT_EQ(2, hash.num_keys());
+    EXPECT_TRUE(hash.packed());
+
+    Obj *value = nullptr;
+    ASSERT_TRUE(hash.Get(yuki::Slice("age"), &value).Ok());
+    ASSERT_EQ(YKN_INTEGER, value->type());
+    EXPECT_EQ(99, static_cast<Integer *>(value)->data());
+    ObjRelease(value);
+
+    EXPECT_TRUE(hash.Get(yuki::Slice("none"), &value).Failed());
+
+    EXPECT_TRUE(hash.Delete(yuki::Slice("name")));
+    EXPECT_FALSE(hash.Delete(yuki::Slice("name")));
+    EXPECT_EQ(1, hash.num_keys());
+}
+
+TEST(CompactHashTest, Convert) {
+    CompactHash hash(CompactHash::max_packed());
+
+    std::map<std::string, int64_t> expected;
+    for (int i = 0; i < CompactHash::max_packed(); i++) {
+        auto key = std::to_string(i);
+        ASSERT_TRUE(hash.Put(yuki::Slice(key), Integer::New(i)).Ok());
+        expected[key] = i;
+    }
+    EXPECT_TRUE(hash.packed());
+
+    ASSERT_TRUE(hash.Put(yuki::Slice("over"), Integer::New(-1)).Ok());
+    expected["over"] = -1;
+    EXPECT_FALSE(hash.packed());
+    EXPECT_EQ(CompactHash::max_packed() + 1, hash.num_keys());
+
+    std::map<std::string, int64_t> visited;
+    hash.ForEach([&visited](yuki::SliceRef key, Obj *value) {
+        visited[key.ToString()] = static_cast<Integer *>(value)->data();
+    });
+    EXPECT_EQ(expected, visited);
+
+    Obj *value = nullptr;
+    ASSERT_TRUE(hash.Get(yuki::Slice("7"), &value).Ok());
+    EXPECT_EQ(7, static_cast<Integer *>(value)->data());
+    ObjRelease(value);
+}
+
+TEST(CompactHashTest, ConvertByLargeValue) {
+    CompactHash hash(CompactHash::max_packed());
+    ASSERT_TRUE(hash.Put(yuki::Slice("a"), Integer::New(1)).Ok());
+
+    std::string large(ListPack::MAX_STRING_SIZE + 1, 'x');
+    ASSERT_TRUE(hash.Put(yuki::Slice("a"),
+                         String::New(yuki::Slice(large))).Ok());
+    EXPECT_FALSE(hash.packed());
+    EXPECT_EQ(1, hash.num_keys());
+
+    Obj *value = nullptr;
+    ASSERT_TRUE(hash.Get(yuki::Slice("a"), &value).Ok());
+    EXPECT_EQ(large, static_cast<String *>(value)->data().ToString());
+    ObjRelease(value);
+}
+
+TEST(CompactHashTest, MutliThreadPut) {
+    static const int kNumKeys = 1000;
+
+    CompactHash hash(CompactHash::max_packed());
+    std::thread writers[4];
+    for (int i = 0; i < arraysize(writers); i++) {
+        writers[i] = std::move(std::thread([&hash] (int id) {
+            for (int j = id; j < kNumKeys; j += arraysize(writers)) {
+                auto key = std::to_string(j);
+                hash.Put(yuki::Slice(key), Integer::New(j));
+            }
+        }, i));
+    }
+    for (auto &thread : writers) {
+        thread.join();
+    }
+    EXPECT_EQ(kNumKeys, hash.num_keys());
+}
+
+} // namespace yukino
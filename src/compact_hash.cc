@@ -0,0 +1,167 @@
+#include "compact_hash.h"
+#include "cocurrent_hash_map.h"
+#include "handle.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "glog/logging.h"
+#include <memory>
+
+namespace yukino {
+
+/*static*/ int CompactHash::max_packed_ = CompactHash::DEFAULT_MAX_PACKED;
+
+CompactHash::CompactHash(int64_t initial_size)
+    : map_(nullptr)
+    , initial_size_(initial_size)
+    , counted_bytes_(0) {
+    if (max_packed_ <= 0) {
+        map_ = new CocurrentHashMap(initial_size_);
+    }
+}
+
+CompactHash::~CompactHash() {
+    delete map_;
+}
+
+yuki::Status CompactHash::Put(yuki::SliceRef key, Obj *value) {
+    {
+        WriterLock scope(&rwlock_);
+        if (!map_) {
+            auto offset = UnsafeFind(key);
+            if (offset < pack_.end() && ListPack::Packable(value)) {
+                pack_.Replace(pack_.Next(offset), value);
+                ObjRelease(ObjAddRef(value)); // Copied, no reference.
+                return yuki::Status::OK();
+            }
+            if (offset == pack_.end() &&
+                pack_.size() / 2 < static_cast<size_t>(max_packed_) &&
+                ListPack::Packable(key) && ListPack::Packable(value)) {
+                offset = pack_.Insert(pack_.end(), key);
+                pack_.Insert(offset, value);
+                ObjRelease(ObjAddRef(value));
+                return yuki::Status::OK();
+            }
+            auto rv = UnsafeUnpack();
+            if (rv.Failed()) {
+                return rv;
+            }
+        }
+    }
+
+    ReaderLock scope(&rwlock_);
+    return map_->Put(key, 0, value);
+}
+
+bool CompactHash::Delete(yuki::SliceRef key) {
+    {
+        WriterLock scope(&rwlock_);
+        if (!map_) {
+            auto offset = UnsafeFind(key);
+            if (offset == pack_.end()) {
+                return false;
+            }
+            pack_.Erase(pack_.Next(offset));
+            pack_.Erase(offset);
+            return true;
+        }
+    }
+
+    ReaderLock scope(&rwlock_);
+    return map_->Delete(key);
+}
+
+yuki::Status CompactHash::Get(yuki::SliceRef key, Obj **value) {
+    ReaderLock scope(&rwlock_);
+    if (map_) {
+        return map_->Get(key, nullptr, value);
+    }
+
+    auto offset = UnsafeFind(key);
+    if (offset == pack_.end()) {
+        return yuki::Status::NotFoundf("key not found.");
+    }
+    *value = ObjAddRef(pack_.Get(pack_.Next(offset)));
+    if (!*value) {
+        return yuki::Status::Systemf("not enough memory.");
+    }
+    return yuki::Status::OK();
+}
+
+void CompactHash::ForEach(std::function<void (yuki::SliceRef, Obj *)> proc) {
+    ReaderLock scope(&rwlock_);
+    if (map_) {
+        std::unique_ptr<Iterator> iter(map_->iterator());
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            proc(iter->key()->key(), iter->value());
+        }
+        return;
+    }
+
+    for (auto i = pack_.begin(); i < pack_.end(); i = pack_.Next(i)) {
+        Handle<Obj> field(pack_.Get(i));
+        i = pack_.Next(i);
+        Handle<Obj> value(pack_.Get(i));
+        CHECK(field.get() && value.get()) << "Out of memory for decoding.";
+        proc(static_cast<String *>(field.get())->data(), value.get());
+    }
+}
+
+int64_t CompactHash::num_keys() const {
+    ReaderLock scope(&rwlock_);
+    if (map_) {
+        return map_->num_keys();
+    }
+    return static_cast<int64_t>(pack_.size() / 2);
+}
+
+bool CompactHash::packed() const {
+    ReaderLock scope(&rwlock_);
+    return map_ == nullptr;
+}
+
+size_t CompactHash::bytes() const {
+    ReaderLock scope(&rwlock_);
+    if (map_) {
+        return static_cast<size_t>(map_->memory_usage());
+    }
+    return pack_.bytes();
+}
+
+int64_t CompactHash::Recount() {
+    auto now = static_cast<int64_t>(bytes());
+    return now - counted_bytes_.exchange(now, std::memory_order_relaxed);
+}
+
+size_t CompactHash::UnsafeFind(yuki::SliceRef key) const {
+    for (auto i = pack_.begin(); i < pack_.end(); i = pack_.Next(i)) {
+        if (pack_.Equals(i, key)) {
+            return i;
+        }
+        i = pack_.Next(i); // skip the value.
+    }
+    return pack_.end();
+}
+
+yuki::Status CompactHash::UnsafeUnpack() {
+    DCHECK(map_ == nullptr);
+    std::unique_ptr<CocurrentHashMap> map(new CocurrentHashMap(initial_size_));
+    for (auto i = pack_.begin(); i < pack_.end(); i = pack_.Next(i)) {
+        Handle<Obj> field(pack_.Get(i));
+        i = pack_.Next(i);
+        Handle<Obj> value(pack_.Get(i));
+        if (!field.get() || !value.get()) {
+            return yuki::Status::Systemf("not enough memory.");
+        }
+        auto rv = map->Put(static_cast<String *>(field.get())->data(), 0,
+                           value.get());
+        if (rv.Failed()) {
+            return rv;
+        }
+    }
+    map_ = map.release();
+    pack_.Clear();
+    return yuki::Status::OK();
+}
+
+} // namespace yukino
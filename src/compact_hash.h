@@ -0,0 +1,81 @@
+#ifndef YUKINO_COMPACT_HASH_H_
+#define YUKINO_COMPACT_HASH_H_
+
+#include "list_pack.h"
+#include "rw_spin_lock.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <atomic>
+#include <functional>
+#include <stdint.h>
+
+namespace yukino {
+
+struct Obj;
+class CocurrentHashMap;
+
+//
+// Fields of a Hash value. Small hashes be packed in a ListPack as
+// [field][value] pairs, looked up by walking. It be converted to a
+// CocurrentHashMap when grows over `max_packed' fields, or any field or
+// value can not be packed.
+//
+// The packed one be locked by the hash lock, the converted one holds the
+// lock (reader) only for reaching the map, the map locks itself.
+//
+class CompactHash {
+public:
+    enum { DEFAULT_MAX_PACKED = 64 };
+
+    explicit CompactHash(int64_t initial_size);
+    CompactHash(const CompactHash &) = delete;
+    CompactHash(CompactHash &&) = delete;
+    void operator = (const CompactHash &) = delete;
+
+    ~CompactHash();
+
+    yuki::Status Put(yuki::SliceRef key, Obj *value);
+    bool Delete(yuki::SliceRef key);
+
+    // The value holds a reference.
+    yuki::Status Get(yuki::SliceRef key, Obj **value);
+
+    // Visit all fields under the hash lock (reader). Dies if a packed one
+    // can not be decoded for out of memory.
+    void ForEach(std::function<void (yuki::SliceRef, Obj *)> proc);
+
+    int64_t num_keys() const;
+
+    bool packed() const;
+
+    // Approximate bytes of the fields, out of the hash itself.
+    size_t bytes() const;
+
+    // See QuickList::Recount().
+    int64_t Recount();
+    int64_t counted_bytes() const {
+        return counted_bytes_.load(std::memory_order_relaxed);
+    }
+
+    // Must be set before any hash be made.
+    static void set_max_packed(int n) { max_packed_ = n; }
+    static int max_packed() { return max_packed_; }
+
+private:
+    // Offset of the field, or end of the pack if not found.
+    size_t UnsafeFind(yuki::SliceRef key) const;
+    // Keep packed if out of memory.
+    yuki::Status UnsafeUnpack();
+
+    mutable RWSpinLock rwlock_;
+    ListPack pack_;
+    CocurrentHashMap *map_;
+    const int64_t initial_size_;
+    std::atomic<int64_t> counted_bytes_;
+
+    static int max_packed_;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_COMPACT_HASH_H_
@@ -47,6 +47,7 @@ TEST(ConfigurationTest, ProcessDBItems) {
     EXPECT_EQ(DB_HASH, conf.db_conf(0).type);
     EXPECT_FALSE(conf.db_conf(0).persistent);
     EXPECT_EQ(0, conf.db_conf(0).memory_limit);
+    EXPECT_EQ(EVICT_NONE, conf.db_conf(0).eviction);
 
     args.clear();
     args.push_back(yuki::Slice("db"));
@@ -60,6 +61,67 @@ TEST(ConfigurationTest, ProcessDBItems) {
     EXPECT_EQ(DB_ORDER, conf.db_conf(1).type);
     EXPECT_FALSE(conf.db_conf(1).persistent);
     EXPECT_EQ(1024000, conf.db_conf(1).memory_limit);
+    EXPECT_EQ(EVICT_LRU, conf.db_conf(1).eviction);
+}
+
+TEST(ConfigurationTest, ProcessEvictionPolicy) {
+    Configuration conf;
+
+    std::vector<yuki::Slice> args;
+    auto rv = yuki::Strings::Split("db hash memory 1024 allkeys-lfu", "\\s+",
+                                   &args);
+    ASSERT_TRUE(rv.Ok());
+    rv = conf.ProcessConfItem(args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(1024, conf.db_conf(0).memory_limit);
+    EXPECT_EQ(EVICT_LFU, conf.db_conf(0).eviction);
+
+    args.back() = yuki::Slice("allkeys-random");
+    rv = conf.ProcessConfItem(args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(EVICT_RANDOM, conf.db_conf(1).eviction);
+
+    args.back() = yuki::Slice("volatile-lru");
+    rv = conf.ProcessConfItem(args);
+    EXPECT_TRUE(rv.Failed());
+}
+
+TEST(ConfigurationTest, ProcessFlatHashDBItem) {
+    Configuration conf;
+
+    std::vector<yuki::Slice> args;
+    auto rv = yuki::Strings::Split("db hash-flat persistent 1024", "\\s+",
+                                   &args);
+    ASSERT_TRUE(rv.Ok());
+    rv = conf.ProcessConfItem(args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    EXPECT_EQ(1, conf.num_db_conf());
+    EXPECT_EQ(DB_HASH_FLAT, conf.db_conf(0).type);
+    EXPECT_TRUE(conf.db_conf(0).persistent);
+    EXPECT_EQ(1024, conf.db_conf(0).memory_limit);
+}
+
+TEST(ConfigurationTest, ProcessLogFsync) {
+    Configuration conf;
+
+    EXPECT_EQ(FSYNC_EVERYSEC, conf.log_fsync());
+
+    std::vector<yuki::Slice> args;
+    auto rv = yuki::Strings::Split("log_fsync always", "\\s+", &args);
+    ASSERT_TRUE(rv.Ok());
+    rv = conf.ProcessConfItem(args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(FSYNC_ALWAYS, conf.log_fsync());
+
+    args.back() = yuki::Slice("no");
+    rv = conf.ProcessConfItem(args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(FSYNC_NO, conf.log_fsync());
+
+    args.back() = yuki::Slice("sometimes");
+    rv = conf.ProcessConfItem(args);
+    EXPECT_TRUE(rv.Failed());
 }
 
 TEST(ConfigurationTest, LoadFileTest1) {
@@ -100,6 +162,9 @@ TEST(ConfigurationTest, RewriteConf) {
 "num_workers 4\n"
 "auth no\n"
 "pass_digest \"\"\n"
+"log_fsync everysec\n"
+"list_max_packed 128\n"
+"hash_max_packed 64\n"
 "## DBs conf : ##\n", buf);
 }
 
@@ -7,6 +7,17 @@
 
 namespace yukino {
 
+template<>
+struct ValueTraits<FsyncPolicy> {
+    static bool Parse(yuki::SliceRef buf, FsyncPolicy *value) {
+        return ParseFsyncPolicy(buf, value);
+    }
+
+    static std::string ToString(const FsyncPolicy &value) {
+        return FsyncPolicyName(value);
+    }
+};
+
 #define DEF_INIT(name, type, default_value) name##_(default_value),
 Configuration::Configuration()
     : DECL_CONF_ITEMS(DEF_INIT)
@@ -72,12 +83,21 @@ Configuration::ProcessConfItem(const std::vector<yuki::Slice> &args) {
         DBConf dbconf;
 
         // db hash persistent // db 0
+        // db hash-flat persistent // db 0
         // db order persistent // db 0
+        // db page persistent // db 0
+        // db hash memory 1024000 allkeys-lfu // db 0
         if (args[1].Compare(Slice("hash", 4)) == 0 ||
-            args[1].Compare(Slice("order", 5)) == 0) {
+            args[1].Compare(Slice("hash-flat", 9)) == 0 ||
+            args[1].Compare(Slice("order", 5)) == 0 ||
+            args[1].Compare(Slice("page", 4)) == 0) {
 
             if (args[1].Compare(Slice("hash", 4)) == 0) {
                 dbconf.type = DB_HASH;
+            } else if (args[1].Compare(Slice("hash-flat", 9)) == 0) {
+                dbconf.type = DB_HASH_FLAT;
+            } else if (args[1].Compare(Slice("page", 4)) == 0) {
+                dbconf.type = DB_PAGE;
             } else {
                 dbconf.type = DB_ORDER;
             }
@@ -103,6 +123,18 @@ Configuration::ProcessConfItem(const std::vector<yuki::Slice> &args) {
                                           "[db] bad argument type");
                 }
             }
+
+            // The limit must hold, evict the least recently used keys if
+            // not be specified.
+            dbconf.eviction = dbconf.memory_limit > 0 ? EVICT_LRU : EVICT_NONE;
+            if (args.size() >= 5) {
+                if (!ParseEvictionPolicy(args[4], &dbconf.eviction)) {
+                    return Status::Errorf(Status::kInvalidArgument,
+                                          "actual %s, expected allkeys-lru/"
+                                          "allkeys-lfu/allkeys-random",
+                                          args[4].ToString().c_str());
+                }
+            }
         } else {
             return Status::Errorf(Status::kInvalidArgument,
                                   "db[%d] type %s not support",
@@ -173,15 +205,16 @@ yuki::Status Configuration::RewriteStream(OutputStream *output) const {
     for (const auto &dbconf : db_conf_) {
         switch (dbconf.type) {
             case DB_HASH:
+            case DB_HASH_FLAT:
             case DB_ORDER:
-                output->Fprintf("db %s %s %l\n",
-                                dbconf.type == DB_HASH ? "hash" : "order",
-                                dbconf.persistent ? "persistent" : "memory",
-                                dbconf.memory_limit);
-                break;
-
             case DB_PAGE:
-                // TODO:
+                output->Fprintf("db %s %s %l %s\n",
+                                dbconf.type == DB_HASH ? "hash" :
+                                (dbconf.type == DB_HASH_FLAT ? "hash-flat" :
+                                 (dbconf.type == DB_PAGE ? "page" : "order")),
+                                dbconf.persistent ? "persistent" : "memory",
+                                dbconf.memory_limit,
+                                EvictionPolicyName(dbconf.eviction));
                 break;
 
             default:
@@ -1,6 +1,8 @@
 #ifndef YUKINO_CONFIGURATION_H_
 #define YUKINO_CONFIGURATION_H_
 
+#include "eviction.h"
+#include "group_commit_log.h"
 #include "yuki/status.h"
 #include "yuki/slice.h"
 #include <vector>
@@ -8,15 +10,18 @@
 
 namespace yukino {
 
-#define DECL_CONF_ITEMS(_)                    \
-    _(address,      std::string, "127.0.0.1") \
-    _(port,         int,         7000       ) \
-    _(data_dir,     std::string, "."        ) \
-    _(daemonize,    bool,        false      ) \
-    _(pid_file,     std::string, ""         ) \
-    _(num_workers,  int,         4          ) \
-    _(auth,         bool,        false      ) \
-    _(pass_digest,  std::string, ""         )
+#define DECL_CONF_ITEMS(_)                           \
+    _(address,          std::string, "127.0.0.1"   ) \
+    _(port,             int,         7000          ) \
+    _(data_dir,         std::string, "."           ) \
+    _(daemonize,        bool,        false         ) \
+    _(pid_file,         std::string, ""            ) \
+    _(num_workers,      int,         4             ) \
+    _(auth,             bool,        false         ) \
+    _(pass_digest,      std::string, ""            ) \
+    _(log_fsync,        FsyncPolicy, FSYNC_EVERYSEC) \
+    _(list_max_packed,  int,         128           ) \
+    _(hash_max_packed,  int,         64            )
 
 class InputStream;
 class OutputStream;
@@ -25,12 +30,15 @@ enum DBType {
     DB_HASH,  // hash map db
     DB_ORDER, // tree map db
     DB_PAGE,  // btree based page map db
+    DB_HASH_FLAT, // open-addressing hash map db
 };
 
 struct DBConf {
     DBType type;
     bool   persistent;
-    long   memory_limit;
+    long   memory_limit; // bytes, 0 for no limit.
+    EvictionPolicy eviction;
+    FsyncPolicy log_fsync = FSYNC_EVERYSEC; // from the `log_fsync' item.
 };
 
 class Configuration {
@@ -72,6 +80,7 @@ private:
 
 // db hash persistent // db 0
 // db order           // db 1
+// db hash memory 1024000 allkeys-lru // db 2
 
 } // namespace yukino
 
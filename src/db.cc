@@ -1,6 +1,10 @@
 #include "db.h"
 #include "hash_db.h"
+#include "page_db.h"
 #include "configuration.h"
+#include "iterator.h"
+#include "key.h"
+#include <memory>
 
 namespace yukino {
 
@@ -10,21 +14,57 @@ DB::DB() {
 DB::~DB() {
 }
 
+uint64_t DB::Scan(uint64_t cursor, int64_t count,
+                  std::function<void (KeyBoundle *, Obj *)> proc) {
+    // Count by position of the iterator, as the default MemTable::Scan().
+    std::unique_ptr<Iterator> iter(iterator());
+
+    uint64_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+        if (i < cursor) {
+            continue;
+        }
+        if (i >= cursor + count) {
+            return i;
+        }
+        proc(iter->key(), iter->value());
+    }
+    return 0;
+}
+
+yuki::Status DB::BulkPut(yuki::SliceRef key, const Version &version,
+                         Obj *value) {
+    if (version.type != VERSION_EXPIRE) {
+        return Put(key, version.number, value);
+    }
+    auto rv = Put(key, 0, value);
+    if (rv.Ok()) {
+        Expire(key, static_cast<int64_t>(version.number));
+    }
+    return rv;
+}
+
+yuki::Status DB::PutExpire(yuki::SliceRef key, int64_t expire_at,
+                           Obj *value) {
+    auto rv = Put(key, 0, value);
+    if (rv.Ok()) {
+        Expire(key, expire_at);
+    }
+    return rv;
+}
+
 /*static*/ DB *DB::New(const yukino::DBConf &conf,
                        const std::string &data_dir,
                        int id,
                        BackgroundWorkQueue *queue) {
     switch (conf.type) {
         case DB_HASH:
-            return new HashDB(conf, data_dir, id, 1023, queue);
-
+        case DB_HASH_FLAT:
         case DB_ORDER:
-            // TODO:
-            break;
+            return new HashDB(conf, data_dir, id, 1023, queue);
 
         case DB_PAGE:
-            // TODO:
-            break;
+            return new PageDB(conf, data_dir, id, queue);
 
         default:
             DLOG(FATAL) << "noreached";
@@ -4,12 +4,14 @@
 #include "handle.h"
 #include "yuki/slice.h"
 #include "yuki/status.h"
+#include <functional>
 #include <stdint.h>
 
 namespace yukino {
 
 struct Obj;
 struct Version;
+struct KeyBoundle;
 struct DBConf;
 class Iterator;
 class BackgroundWorkQueue;
@@ -33,7 +35,22 @@ public:
 
     virtual Iterator *iterator() = 0;
 
-    virtual int num_keys() const = 0;
+    // Stateless cursor scan in batches, see MemTable::Scan().
+    virtual uint64_t Scan(uint64_t cursor, int64_t count,
+                          std::function<void (KeyBoundle *, Obj *)> proc);
+
+    virtual int64_t num_keys() const = 0;
+
+    // Is the iterator ordered by key? Range commands need it.
+    virtual bool ordered() const = 0;
+
+    // Values from Get() be copies of the stored ones (DB_PAGE), so in-place
+    // changes must be Put back.
+    virtual bool copy_values() const { return false; }
+
+    // The stored list or hash of the key be changed in place, count it
+    // again, see MemTable::RecountUsage().
+    virtual void RecountUsage(yuki::SliceRef /*key*/) {}
 
     virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
                              Obj *value) = 0;
@@ -42,10 +59,60 @@ public:
 
     virtual yuki::Status Get(yuki::SliceRef key, Version *ver, Obj **value) = 0;
 
+    // Atomic read-modify-write of one key, see MemTable::Update().
+    virtual yuki::Status Update(yuki::SliceRef key, uint64_t version_number,
+                                std::function<Obj *(Obj *)> proc) = 0;
+
+    // For loading tables, see MemTable::Reserve() and MemTable::BulkPut().
+    virtual void Reserve(int64_t /*num_keys*/) {}
+    virtual yuki::Status BulkPut(yuki::SliceRef key, const Version &version,
+                                 Obj *value);
+
+    // values[i] be null if keys[i] not found, otherwise hold a reference.
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys,
+                            Obj **values) = 0;
+
+    // Logging and applying of one write run between them, so checkpoints
+    // can cut the log and take the snapshot between writes. Can not be
+    // nested. See WriteScope.
+    virtual void BeginWrite() {}
+    virtual void EndWrite() {}
+
+    // Periodic job from server cron, should return in `budget_milsces' ms.
+    virtual void Cron(int64_t budget_milsces) = 0;
+
+    // Can keys be expired? See MemTable::Expire().
+    virtual bool expirable() const { return false; }
+
+    virtual bool Expire(yuki::SliceRef /*key*/, int64_t /*expire_at*/) {
+        return false;
+    }
+
+    // See MemTable::PutExpire().
+    virtual yuki::Status PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                   Obj *value);
+
+    // Delete expired keys by sampling, from worker's time event, should
+    // return in `budget_milsces' ms.
+    virtual void ActiveExpire(int64_t /*budget_milsces*/) {}
+
     static DB *New(const DBConf &conf, const std::string &data_dir, int id,
                    BackgroundWorkQueue *queue);
 }; // class DB
 
+class WriteScope {
+public:
+    explicit WriteScope(DB *db) : db_(db) { db_->BeginWrite(); }
+    ~WriteScope() { db_->EndWrite(); }
+
+    WriteScope(const WriteScope &) = delete;
+    WriteScope(WriteScope &&) = delete;
+    void operator = (const WriteScope &) = delete;
+
+private:
+    DB *db_;
+};
+
 } // namespace yukino
 
 #endif // YUKINO_DB_H_
@@ -0,0 +1,102 @@
+#include "epoch.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <thread>
+
+namespace yukino {
+
+namespace {
+
+std::atomic<int> num_freed(0);
+
+void CountingFree(void *p) {
+    num_freed.fetch_add(1);
+    delete static_cast<int *>(p);
+}
+
+} // namespace
+
+TEST(EpochTest, Sanity) {
+    num_freed.store(0);
+    Epoch::Quiescent();
+    auto retired = Epoch::num_retired();
+
+    Epoch::Retire(new int(1), CountingFree);
+    EXPECT_EQ(retired + 1, Epoch::num_retired());
+
+    Epoch::Quiescent();
+    Epoch::Quiescent();
+    Epoch::Quiescent();
+    EXPECT_EQ(1, num_freed.load());
+}
+
+TEST(EpochTest, ReaderBlocksReclamation) {
+    num_freed.store(0);
+
+    std::atomic<int> step(0);
+    std::thread reader([&] () {
+        EpochGuard guard;
+        step.store(1);
+        while (step.load() != 2) {
+            std::this_thread::yield();
+        }
+    });
+    while (step.load() != 1) {
+        std::this_thread::yield();
+    }
+
+    auto epoch = Epoch::current();
+    Epoch::Retire(new int(1), CountingFree);
+    for (int i = 0; i < 8; i++) {
+        Epoch::Quiescent();
+    }
+    // The reader stands in `epoch', the global epoch can advance once only.
+    EXPECT_LE(Epoch::current(), epoch + 1);
+    EXPECT_FALSE(Epoch::Synchronized(epoch));
+    EXPECT_EQ(0, num_freed.load());
+
+    step.store(2);
+    reader.join();
+
+    for (int i = 0; i < 3; i++) {
+        Epoch::Quiescent();
+    }
+    EXPECT_TRUE(Epoch::Synchronized(epoch));
+    EXPECT_EQ(1, num_freed.load());
+}
+
+TEST(EpochTest, Nesting) {
+    auto epoch = Epoch::current();
+    {
+        EpochGuard a;
+        {
+            EpochGuard b;
+        }
+        // Still in `a', can not pass this epoch.
+        Epoch::TryAdvance();
+        Epoch::TryAdvance();
+        EXPECT_FALSE(Epoch::Synchronized(epoch));
+    }
+    Epoch::TryAdvance();
+    Epoch::TryAdvance();
+    EXPECT_TRUE(Epoch::Synchronized(epoch));
+}
+
+TEST(EpochTest, ExitedThreadRetiring) {
+    num_freed.store(0);
+
+    std::thread writer([] () {
+        for (int i = 0; i < 10; i++) {
+            Epoch::Retire(new int(i), CountingFree);
+        }
+    });
+    writer.join();
+
+    // Left retired memory be reclaimed by others.
+    for (int i = 0; i < 3; i++) {
+        Epoch::Quiescent();
+    }
+    EXPECT_EQ(10, num_freed.load());
+}
+
+} // namespace yukino
@@ -0,0 +1,165 @@
+#include "epoch.h"
+#include "glog/logging.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace yukino {
+
+namespace {
+
+// Try to reclaim after every this number of retiring.
+const size_t kReclaimInterval = 64;
+
+struct Retired {
+    void *p;
+    Epoch::Deleter deleter;
+    uint64_t epoch;
+};
+
+// One participant per thread, never be freed, reused after thread exit.
+struct Participant {
+    std::atomic<uint64_t> state;  // (epoch << 1) | active
+    std::atomic<bool>     in_use;
+    Participant          *next;
+    int                   nesting;
+    std::vector<Retired>  retired;
+};
+
+std::atomic<uint64_t> global_epoch(1);
+std::atomic<Participant *> participants(nullptr);
+
+// Retired memory left by exited threads.
+std::mutex orphans_mutex;
+std::vector<Retired> orphans;
+
+void Reclaim(std::vector<Retired> *retired) {
+    auto epoch = global_epoch.load(std::memory_order_acquire);
+
+    size_t n = 0;
+    for (const auto &item : *retired) {
+        if (item.epoch + 2 <= epoch) {
+            item.deleter(item.p);
+        } else {
+            (*retired)[n++] = item;
+        }
+    }
+    retired->resize(n);
+}
+
+Participant *AcquireParticipant() {
+    for (auto p = participants.load(); p; p = p->next) {
+        bool expected = false;
+        if (!p->in_use.load() &&
+            p->in_use.compare_exchange_strong(expected, true)) {
+            return p;
+        }
+    }
+
+    auto p = new Participant;
+    p->state.store(0);
+    p->in_use.store(true);
+    p->nesting = 0;
+    p->next = participants.load();
+    while (!participants.compare_exchange_weak(p->next, p))
+        ;
+    return p;
+}
+
+class ThreadParticipant {
+public:
+    ~ThreadParticipant() {
+        if (!participant_) {
+            return;
+        }
+        Reclaim(&participant_->retired);
+        if (!participant_->retired.empty()) {
+            std::unique_lock<std::mutex> lock(orphans_mutex);
+            orphans.insert(orphans.end(), participant_->retired.begin(),
+                           participant_->retired.end());
+        }
+        participant_->retired.clear();
+        participant_->nesting = 0;
+        participant_->state.store(0, std::memory_order_release);
+        participant_->in_use.store(false, std::memory_order_release);
+    }
+
+    Participant *Get() {
+        if (!participant_) {
+            participant_ = AcquireParticipant();
+        }
+        return participant_;
+    }
+
+private:
+    Participant *participant_ = nullptr;
+};
+
+thread_local ThreadParticipant self;
+
+} // namespace
+
+/*static*/ void Epoch::Enter() {
+    auto p = self.Get();
+    if (p->nesting++ > 0) {
+        return;
+    }
+    auto epoch = global_epoch.load(std::memory_order_relaxed);
+    p->state.store((epoch << 1) | 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+/*static*/ void Epoch::Exit() {
+    auto p = self.Get();
+    DCHECK_GT(p->nesting, 0);
+    if (--p->nesting == 0) {
+        p->state.store(0, std::memory_order_release);
+    }
+}
+
+/*static*/ void Epoch::Retire(void *p, Deleter deleter) {
+    if (!p) {
+        return;
+    }
+
+    // Unlinking must be seen before the epoch be read.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    auto participant = self.Get();
+    participant->retired.push_back({p, deleter, global_epoch.load()});
+    if (participant->retired.size() % kReclaimInterval == 0) {
+        TryAdvance();
+        Reclaim(&participant->retired);
+    }
+}
+
+/*static*/ bool Epoch::TryAdvance() {
+    auto epoch = global_epoch.load();
+    for (auto p = participants.load(); p; p = p->next) {
+        auto state = p->state.load();
+        if ((state & 1) && (state >> 1) != epoch) {
+            return false;
+        }
+    }
+    return global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+/*static*/ void Epoch::Quiescent() {
+    TryAdvance();
+    Reclaim(&self.Get()->retired);
+
+    std::unique_lock<std::mutex> lock(orphans_mutex, std::try_to_lock);
+    if (lock.owns_lock() && !orphans.empty()) {
+        Reclaim(&orphans);
+    }
+}
+
+/*static*/ uint64_t Epoch::current() {
+    return global_epoch.load(std::memory_order_acquire);
+}
+
+/*static*/ size_t Epoch::num_retired() {
+    return self.Get()->retired.size();
+}
+
+} // namespace yukino
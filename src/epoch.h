@@ -0,0 +1,57 @@
+#ifndef YUKINO_EPOCH_H_
+#define YUKINO_EPOCH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace yukino {
+
+//
+// Epoch-based memory reclamation:
+// Lock-free readers run in an epoch guard, writers retire the memory they
+// unlinked instead of freeing it. Retired memory be freed after the global
+// epoch advanced twice, then no reader can see it anymore.
+//
+// Worker event loops call Quiescent() before sleeping, it advances the epoch
+// and reclaims the retired memory of this thread. The cron, saving and
+// loading threads call it after their work, the same.
+//
+class Epoch {
+public:
+    typedef void (*Deleter)(void *);
+
+    // Enter or exit a read-side critical section, can be nested.
+    static void Enter();
+    static void Exit();
+
+    // Free `p' by `deleter' when all readers passed current epoch.
+    static void Retire(void *p, Deleter deleter);
+
+    // Advance the global epoch if all active readers are in it.
+    static bool TryAdvance();
+
+    // Advance the epoch and reclaim the retired memory can be freed.
+    static void Quiescent();
+
+    static uint64_t current();
+
+    // Has every reader which saw `epoch' already left?
+    static bool Synchronized(uint64_t epoch) { return current() >= epoch + 2; }
+
+    // Number of retired but not yet freed memory in this thread.
+    static size_t num_retired();
+}; // class Epoch
+
+class EpochGuard {
+public:
+    EpochGuard() { Epoch::Enter(); }
+    ~EpochGuard() { Epoch::Exit(); }
+
+    EpochGuard(const EpochGuard &) = delete;
+    EpochGuard(EpochGuard &&) = delete;
+    void operator = (const EpochGuard &) = delete;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_EPOCH_H_
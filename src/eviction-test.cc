@@ -0,0 +1,50 @@
+#include "eviction.h"
+#include "gtest/gtest.h"
+#include <string>
+
+namespace yukino {
+
+TEST(EvictionTest, PolicyName) {
+    EvictionPolicy policy = EVICT_NONE;
+    EXPECT_TRUE(ParseEvictionPolicy(yuki::Slice("allkeys-lfu"), &policy));
+    EXPECT_EQ(EVICT_LFU, policy);
+    EXPECT_TRUE(ParseEvictionPolicy(yuki::Slice("allkeys-random"), &policy));
+    EXPECT_EQ(EVICT_RANDOM, policy);
+    EXPECT_FALSE(ParseEvictionPolicy(yuki::Slice("allkeys"), &policy));
+    EXPECT_STREQ("allkeys-lru", EvictionPolicyName(EVICT_LRU));
+}
+
+TEST(EvictionTest, LFUCounter) {
+    auto clock = AccessClock::New(EVICT_LFU);
+    auto idle = AccessClock::Idle(EVICT_LFU, clock);
+
+    for (int i = 0; i < 1000; i++) {
+        clock = AccessClock::Touch(EVICT_LFU, clock);
+    }
+    EXPECT_GT(idle, AccessClock::Idle(EVICT_LFU, clock));
+    // Logarithmic, 1000 accesses can not make it full.
+    EXPECT_LT(0x0fU, AccessClock::Idle(EVICT_LFU, clock));
+}
+
+TEST(EvictionTest, PoolKeepsIdlest) {
+    EvictionPool pool;
+
+    for (int i = 0; i < 100; i++) {
+        pool.Insert(yuki::Slice(std::to_string(i)), i);
+    }
+    EXPECT_EQ(EvictionPool::POOL_SIZE, pool.size());
+
+    // Sampled again, the idle be updated.
+    pool.Insert(yuki::Slice("99"), 1);
+
+    std::string key;
+    ASSERT_TRUE(pool.Pop(&key));
+    EXPECT_EQ("98", key);
+    ASSERT_TRUE(pool.Pop(&key));
+    EXPECT_EQ("97", key);
+    while (pool.Pop(&key)) {
+    }
+    EXPECT_EQ(0, pool.size());
+}
+
+} // namespace yukino
@@ -0,0 +1,154 @@
+#include "eviction.h"
+#include "hash.h"
+#include <time.h>
+#include <utility>
+
+namespace yukino {
+
+namespace {
+
+inline uint32_t NowSeconds() {
+    return static_cast<uint32_t>(time(nullptr));
+}
+
+inline uint32_t NowMinutes() {
+    return static_cast<uint32_t>(time(nullptr) / 60) & 0xffffU;
+}
+
+// The counter decays one for every minute since the last decay.
+inline uint32_t LFUDecay(uint32_t clock) {
+    auto elapsed = (NowMinutes() - (clock >> 8)) & 0xffffU;
+    auto counter = clock & 0xffU;
+    return elapsed > counter ? 0 : counter - elapsed;
+}
+
+// [0, 1)
+inline double RandomReal() {
+    static thread_local uint64_t seed = (HashSeed() ^
+        reinterpret_cast<uintptr_t>(&seed)) | 1;
+
+    // xorshift64
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return static_cast<double>(seed >> 11) * (1.0 / 9007199254740992.0);
+}
+
+} // namespace
+
+const char *EvictionPolicyName(EvictionPolicy policy) {
+    switch (policy) {
+        case EVICT_LRU:
+            return "allkeys-lru";
+        case EVICT_LFU:
+            return "allkeys-lfu";
+        case EVICT_RANDOM:
+            return "allkeys-random";
+        default:
+            return "noeviction";
+    }
+}
+
+bool ParseEvictionPolicy(yuki::SliceRef name, EvictionPolicy *policy) {
+    static const EvictionPolicy kPolicies[] = {
+        EVICT_NONE, EVICT_LRU, EVICT_LFU, EVICT_RANDOM,
+    };
+
+    for (auto p : kPolicies) {
+        if (name.Compare(yuki::Slice(EvictionPolicyName(p))) == 0) {
+            *policy = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*static*/ uint32_t AccessClock::New(EvictionPolicy policy) {
+    switch (policy) {
+        case EVICT_LRU:
+            return NowSeconds();
+        case EVICT_LFU:
+            return (NowMinutes() << 8) | LFU_INIT_VALUE;
+        default:
+            return 0;
+    }
+}
+
+/*static*/ uint32_t AccessClock::Touch(EvictionPolicy policy, uint32_t clock) {
+    switch (policy) {
+        case EVICT_LRU:
+            return NowSeconds();
+
+        case EVICT_LFU: {
+            auto counter = LFUDecay(clock);
+            if (counter < 0xff) {
+                // The more it be accessed, the harder it grows.
+                double base = counter > LFU_INIT_VALUE ?
+                    counter - LFU_INIT_VALUE : 0;
+                if (RandomReal() < 1.0 / (base * LFU_LOG_FACTOR + 1)) {
+                    counter++;
+                }
+            }
+            return (NowMinutes() << 8) | counter;
+        }
+
+        default:
+            return clock;
+    }
+}
+
+/*static*/ uint64_t AccessClock::Idle(EvictionPolicy policy, uint32_t clock) {
+    switch (policy) {
+        case EVICT_LRU:
+            return static_cast<uint32_t>(NowSeconds() - clock);
+        case EVICT_LFU:
+            return 0xff - LFUDecay(clock);
+        default:
+            return 0;
+    }
+}
+
+void EvictionPool::Insert(yuki::SliceRef key, uint64_t idle) {
+    // Sampled again, the old idle be useless.
+    for (size_t i = 0; i < size_; i++) {
+        if (key.Compare(yuki::Slice(entries_[i].key)) == 0) {
+            for (size_t j = i; j + 1 < size_; j++) {
+                entries_[j] = std::move(entries_[j + 1]);
+            }
+            size_--;
+            break;
+        }
+    }
+
+    size_t i = 0;
+    while (i < size_ && entries_[i].idle < idle) {
+        i++;
+    }
+    if (size_ == POOL_SIZE) {
+        if (i == 0) {
+            return; // less idle than all in the pool.
+        }
+        // Drop the least idle one.
+        for (size_t j = 0; j + 1 < i; j++) {
+            entries_[j] = std::move(entries_[j + 1]);
+        }
+        i--;
+    } else {
+        for (size_t j = size_; j > i; j--) {
+            entries_[j] = std::move(entries_[j - 1]);
+        }
+        size_++;
+    }
+    entries_[i].idle = idle;
+    entries_[i].key.assign(key.Data(), key.Length());
+}
+
+bool EvictionPool::Pop(std::string *key) {
+    if (size_ == 0) {
+        return false;
+    }
+    *key = std::move(entries_[--size_].key);
+    return true;
+}
+
+} // namespace yukino
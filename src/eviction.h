@@ -0,0 +1,74 @@
+#ifndef YUKINO_EVICTION_H_
+#define YUKINO_EVICTION_H_
+
+#include "yuki/slice.h"
+#include <string>
+#include <stdint.h>
+
+namespace yukino {
+
+// Which keys be evicted, when the db uses more memory than its limit.
+enum EvictionPolicy {
+    EVICT_NONE,   // no limit, keys never be evicted.
+    EVICT_LRU,    // allkeys-lru
+    EVICT_LFU,    // allkeys-lfu
+    EVICT_RANDOM, // allkeys-random
+};
+
+const char *EvictionPolicyName(EvictionPolicy policy);
+bool ParseEvictionPolicy(yuki::SliceRef name, EvictionPolicy *policy);
+
+//
+// Approximate access clock, 32 bits in every hash map node:
+// LRU: [32 bits: seconds of the last access]
+// LFU: [8 bits: 0][16 bits: minutes of the last decay][8 bits: counter]
+// The LFU counter grows logarithmically, and decays one per minute idle.
+//
+struct AccessClock {
+    enum {
+        LFU_INIT_VALUE = 5,
+        LFU_LOG_FACTOR = 10,
+    };
+
+    // Clock of a new key.
+    static uint32_t New(EvictionPolicy policy);
+
+    // Clock after the key be accessed once.
+    static uint32_t Touch(EvictionPolicy policy, uint32_t clock);
+
+    // The larger, the better to evict.
+    static uint64_t Idle(EvictionPolicy policy, uint32_t clock);
+};
+
+//
+// Best candidates of sampled keys, as the eviction pool of Redis: keys be
+// sampled in every evicting, and the pool keeps the idlest ones between
+// evictings, so the approximation gets better round by round.
+// Not thread safe.
+//
+class EvictionPool {
+public:
+    enum { POOL_SIZE = 16 };
+
+    // Insert the key if it's idler than the least idle one, or the pool
+    // not full yet.
+    void Insert(yuki::SliceRef key, uint64_t idle);
+
+    // Pop the idlest key.
+    bool Pop(std::string *key);
+
+    size_t size() const { return size_; }
+
+private:
+    struct Entry {
+        uint64_t    idle;
+        std::string key;
+    };
+
+    Entry  entries_[POOL_SIZE]; // ascending by idle
+    size_t size_ = 0;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_EVICTION_H_
@@ -0,0 +1,273 @@
+#include "flat_hash_map.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <map>
+#include <string>
+
+namespace yukino {
+
+class FlatHashMapTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        ASSERT_EQ(nullptr, map_);
+        map_ = new FlatHashMap(1023);
+    }
+
+    virtual void TearDown() override {
+        ASSERT_NE(nullptr, map_);
+        delete map_;
+        map_ = nullptr;
+    }
+
+protected:
+    FlatHashMap *map_ = nullptr;
+};
+
+TEST_F(FlatHashMapTest, Sanity) {
+    auto rv = map_->Put(yuki::Slice("name"), 0, String::New(yuki::Slice("Jake")));
+    ASSERT_TRUE(rv.Ok());
+    rv = map_->Put(yuki::Slice("age"), 0, String::New(yuki::Slice("100")));
+    ASSERT_TRUE(rv.Ok());
+    EXPECT_EQ(2, map_->num_keys());
+
+    Obj *obj = nullptr;
+    rv = map_->Get(yuki::Slice("name"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok());
+
+    ASSERT_EQ(YKN_STRING, obj->type());
+    auto str = static_cast<String *>(obj);
+    ASSERT_EQ("Jake", str->data().ToString());
+    ObjRelease(str);
+
+    rv = map_->Put(yuki::Slice("name"), 0, String::New(yuki::Slice("Mike")));
+    ASSERT_TRUE(rv.Ok());
+    EXPECT_EQ(2, map_->num_keys());
+
+    rv = map_->Get(yuki::Slice("name"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ("Mike", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+}
+
+TEST_F(FlatHashMapTest, LongKey) {
+    std::string key(200, 'k');
+    Version ver;
+
+    auto rv = map_->Put(yuki::Slice(key), 1000, Integer::New(1));
+    ASSERT_TRUE(rv.Ok());
+    rv = map_->Get(yuki::Slice(key), &ver, nullptr);
+    ASSERT_TRUE(rv.Ok());
+    EXPECT_EQ(1000, ver.number);
+
+    rv = map_->Put(yuki::Slice("k"), 2000, Integer::New(1));
+    ASSERT_TRUE(rv.Ok());
+    rv = map_->Get(yuki::Slice("k"), &ver, nullptr);
+    ASSERT_TRUE(rv.Ok());
+    EXPECT_EQ(2000, ver.number);
+
+    EXPECT_TRUE(map_->Delete(yuki::Slice(key)));
+    EXPECT_FALSE(map_->Exist(yuki::Slice(key)));
+    EXPECT_TRUE(map_->Exist(yuki::Slice("k")));
+}
+
+TEST_F(FlatHashMapTest, Deletion) {
+    map_->Put(yuki::Slice("id.1000"), 0, String::New(yuki::Slice("Jake")));
+    map_->Put(yuki::Slice("id.1001"), 0, String::New(yuki::Slice("Jake")));
+    map_->Put(yuki::Slice("id.1002"), 0, String::New(yuki::Slice("Jake")));
+
+    EXPECT_TRUE(map_->Delete(yuki::Slice("id.1000")));
+    EXPECT_TRUE(map_->Delete(yuki::Slice("id.1002")));
+    EXPECT_TRUE(map_->Delete(yuki::Slice("id.1001")));
+    EXPECT_FALSE(map_->Delete(yuki::Slice("id.1001")));
+
+    auto rv = map_->Get(yuki::Slice("id.1000"), nullptr, nullptr);
+    EXPECT_TRUE(rv.Failed());
+    EXPECT_EQ(yuki::Status::kNotFound, rv.Code());
+    EXPECT_EQ(0, map_->num_keys());
+}
+
+TEST_F(FlatHashMapTest, Iterator) {
+    const auto N = 1000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("id.%d", i);
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+
+    int count = 0;
+    std::unique_ptr<Iterator> iter(map_->iterator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        auto key = iter->key()->key().ToString();
+        auto value = static_cast<Integer *>(iter->value())->data();
+        EXPECT_EQ(yuki::Strings::Format("id.%d", value), key);
+        count++;
+    }
+    EXPECT_EQ(N, count);
+}
+
+TEST_F(FlatHashMapTest, Scan) {
+    const auto N = 2000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("id.%d", i);
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+
+    // Every key be visited once if no resizing between calls.
+    std::map<std::string, int> keys;
+    uint64_t cursor = 0;
+    int num_calls = 0;
+    do {
+        cursor = map_->Scan(cursor, 16, [&keys] (KeyBoundle *key, Obj *) {
+            keys[key->key().ToString()]++;
+        });
+        num_calls++;
+    } while (cursor != 0);
+    EXPECT_EQ(N, keys.size());
+    for (const auto &pair : keys) {
+        EXPECT_EQ(1, pair.second) << pair.first;
+    }
+    EXPECT_LT(N / 16 / 2, num_calls);
+}
+
+TEST_F(FlatHashMapTest, GrowAndShrink) {
+    const auto N = 100000;
+    auto initial_groups = map_->num_groups();
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        auto rv = map_->Put(yuki::Slice(key), 0, Integer::New(i));
+        ASSERT_TRUE(rv.Ok()) << "key:" << key;
+    }
+    ASSERT_EQ(N, map_->num_keys());
+    EXPECT_LT(initial_groups, map_->num_groups());
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        Obj *obj = nullptr;
+        auto rv = map_->Get(yuki::Slice(key), nullptr, &obj);
+        ASSERT_TRUE(rv.Ok()) << "key:" << key;
+        ASSERT_EQ(i, static_cast<Integer *>(obj)->data());
+        ObjRelease(obj);
+    }
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        ASSERT_TRUE(map_->Delete(yuki::Slice(key))) << "key:" << key;
+    }
+    EXPECT_EQ(0, map_->num_keys());
+    EXPECT_EQ(initial_groups, map_->num_groups());
+}
+
+// Deleted slots must be reused, so the table need not grow.
+TEST_F(FlatHashMapTest, ChurnWithTombstones) {
+    const auto N = 500;
+
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < N; i++) {
+            auto key = yuki::Strings::Format("%d.%d", round, i);
+            map_->Put(yuki::Slice(key), 0, Integer::New(i));
+        }
+        for (int i = 0; i < N; i++) {
+            auto key = yuki::Strings::Format("%d.%d", round, i);
+            ASSERT_TRUE(map_->Delete(yuki::Slice(key))) << key;
+        }
+    }
+    EXPECT_EQ(0, map_->num_keys());
+    EXPECT_FALSE(map_->Exist(yuki::Slice("0.0")));
+}
+
+TEST_F(FlatHashMapTest, MutliThreadPutting) {
+    std::thread threads[8];
+
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i] = std::move(std::thread([&] (int num) {
+            for (int j = num * 1000; j < (num + 1) * 1000; j++) {
+                auto key = yuki::Strings::Format("%d", j);
+                auto val = yuki::Strings::Format("<%d>", j);
+                auto rv = map_->Put(yuki::Slice(key), 0,
+                                    String::New(yuki::Slice(val)));
+                ASSERT_TRUE(rv.Ok()) << "key:" << key << " val:" << val;
+            }
+        }, i));
+    }
+
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(arraysize(threads) * 1000, map_->num_keys());
+    for (int i = 0; i < arraysize(threads) * 1000; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        EXPECT_TRUE(map_->Exist(yuki::Slice(key)));
+    }
+}
+
+TEST_F(FlatHashMapTest, MutliThreadUpdating) {
+    static const int kNumIncrs = 10000;
+
+    std::thread threads[4];
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i] = std::move(std::thread([&] () {
+            for (int j = 0; j < kNumIncrs; j++) {
+                auto key = yuki::Strings::Format("k.%d", j % 8);
+                auto rv = map_->Update(yuki::Slice(key), 0, [] (Obj *old) {
+                    return ObjIncrBy(old, 1);
+                });
+                ASSERT_TRUE(rv.Ok());
+            }
+        }));
+    }
+
+    for (int i = 0; i < arraysize(threads); i++) {
+        threads[i].join();
+    }
+
+    EXPECT_EQ(8, map_->num_keys());
+    for (int i = 0; i < 8; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        Obj *obj = nullptr;
+        ASSERT_TRUE(map_->Get(yuki::Slice(key), nullptr, &obj).Ok());
+        EXPECT_EQ(arraysize(threads) * kNumIncrs / 8,
+                  static_cast<Integer *>(obj)->data());
+        ObjRelease(obj);
+    }
+}
+
+TEST_F(FlatHashMapTest, MutliThreadGetting) {
+    const int N = 1000;
+    std::thread readers[8];
+
+    std::thread writer([&] () {
+        for (int i = 0; i < arraysize(readers) * N; i++) {
+            auto key = yuki::Strings::Format("%d", i);
+            auto rv = map_->Put(yuki::Slice(key), 0, Integer::New(i));
+            ASSERT_TRUE(rv.Ok()) << "key:" << key;
+        }
+    });
+
+    std::atomic<int> hit(0);
+    for (int i = 0; i < arraysize(readers); i++) {
+        readers[i] = std::move(std::thread([&] () {
+            for (int j = 0; j < arraysize(readers) * N; j++) {
+                auto key = yuki::Strings::Format("%lu",
+                                                 rand() % arraysize(readers) * N);
+                if (map_->Exist(yuki::Slice(key))) {
+                    hit.fetch_add(1);
+                }
+            }
+        }));
+    }
+
+    writer.join();
+    for (auto i = 0; i < arraysize(readers); i++) {
+        readers[i].join();
+    }
+    EXPECT_GT(hit.load(), 0);
+}
+
+} // namespace yukino
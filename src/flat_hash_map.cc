@@ -0,0 +1,489 @@
+#include "flat_hash_map.h"
+#include "cocurrent_hash_map.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "slab.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace yukino {
+
+namespace {
+
+inline uint32_t MatchByte(const int8_t *group, int8_t byte) {
+#if defined(__SSE2__)
+    auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(byte), ctrl)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < FlatHashMap::GROUP_SIZE; i++) {
+        if (group[i] == byte) {
+            mask |= (1u << i);
+        }
+    }
+    return mask;
+#endif
+}
+
+// Match empty or deleted control bytes, both of them less than -1.
+inline uint32_t MatchFree(const int8_t *group) {
+#if defined(__SSE2__)
+    auto ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < FlatHashMap::GROUP_SIZE; i++) {
+        if (group[i] < -1) {
+            mask |= (1u << i);
+        }
+    }
+    return mask;
+#endif
+}
+
+// Scan cursor: [shard(8 bits)] [group(56 bits)]
+const int      kScanShardShift = 56;
+const uint64_t kScanGroupMask  = (1ULL << kScanShardShift) - 1;
+
+inline int8_t H2(uint64_t hash) {
+    return static_cast<int8_t>(hash & 0x7f);
+}
+
+inline uint64_t H1(uint64_t hash) {
+    return hash >> 7;
+}
+
+class IteratorImpl : public Iterator {
+public:
+    typedef FlatHashMap::Shard Shard;
+
+    IteratorImpl(Shard *begin, Shard *end)
+        : begin_(DCHECK_NOTNULL(begin))
+        , end_(DCHECK_NOTNULL(end))
+        , shard_(end) {
+    }
+
+    virtual ~IteratorImpl() override;
+    virtual bool Valid() const override;
+    virtual void SeekToFirst() override;
+    virtual void Next() override;
+    virtual yuki::Status status() const override;
+    virtual KeyBoundle *key() const override;
+    virtual Obj *value() const override;
+
+private:
+    void SeekToFullSlot();
+
+    Shard *begin_;
+    Shard *end_;
+    Shard *shard_;
+    int64_t index_ = 0;
+};
+
+IteratorImpl::~IteratorImpl() {
+    if (shard_ < end_) {
+        shard_->rwlock.Unlock();
+    }
+}
+
+bool IteratorImpl::Valid() const {
+    return shard_ < end_;
+}
+
+void IteratorImpl::SeekToFirst() {
+    if (shard_ < end_) {
+        shard_->rwlock.Unlock();
+    }
+    shard_ = begin_;
+    index_ = 0;
+    shard_->rwlock.ReadLock();
+    SeekToFullSlot();
+}
+
+void IteratorImpl::Next() {
+    DCHECK(Valid());
+
+    index_++;
+    SeekToFullSlot();
+}
+
+yuki::Status IteratorImpl::status() const {
+    return yuki::Status::OK();
+}
+
+KeyBoundle *IteratorImpl::key() const {
+    DCHECK(Valid());
+    return DCHECK_NOTNULL(shard_->slots[index_].key_boundle());
+}
+
+Obj *IteratorImpl::value() const {
+    DCHECK(Valid());
+    return DCHECK_NOTNULL(shard_->slots[index_].value);
+}
+
+// Only hold the lock of current shard.
+void IteratorImpl::SeekToFullSlot() {
+    while (shard_ < end_) {
+        auto capacity = FlatHashMap::Capacity(shard_->num_groups);
+        for (; index_ < capacity; index_++) {
+            if (shard_->ctrl[index_] >= 0) {
+                return;
+            }
+        }
+
+        shard_->rwlock.Unlock();
+        if (++shard_ < end_) {
+            shard_->rwlock.ReadLock();
+        }
+        index_ = 0;
+    }
+}
+
+int64_t InitialNumGroups(int64_t initial_size) {
+    auto per_shard = initial_size / FlatHashMap::NUM_SHARDS;
+    int64_t num_groups = 1;
+    while (FlatHashMap::MaxLoad(num_groups) < per_shard) {
+        num_groups <<= 1;
+    }
+    return num_groups;
+}
+
+} // namespace
+
+FlatHashMap::FlatHashMap(int64_t initial_size)
+    : min_num_groups_(InitialNumGroups(initial_size))
+    , num_keys_(0) {
+    for (int i = 0; i < NUM_SHARDS; i++) {
+        InitShard(&shards_[i], min_num_groups_);
+    }
+}
+
+FlatHashMap::~FlatHashMap() {
+    for (int i = 0; i < NUM_SHARDS; i++) {
+        auto shard = &shards_[i];
+
+        for (int64_t j = 0; j < Capacity(shard->num_groups); j++) {
+            if (shard->ctrl[j] >= 0) {
+                FreeSlot(&shard->slots[j]);
+            }
+        }
+        delete[] shard->ctrl;
+        delete[] shard->slots;
+    }
+}
+
+yuki::Status FlatHashMap::Put(yuki::SliceRef key, uint64_t version_number,
+                              Obj *value) {
+    auto hash  = CocurrentHashMap::Hash(key.Data(), key.Length());
+    auto shard = TakeShard(hash);
+
+    WriterLock scope(&shard->rwlock);
+    return UnsafePut(shard, key, hash, version_number, value);
+}
+
+yuki::Status
+FlatHashMap::Update(yuki::SliceRef key, uint64_t version_number,
+                    std::function<Obj *(Obj *)> proc) {
+    auto hash  = CocurrentHashMap::Hash(key.Data(), key.Length());
+    auto shard = TakeShard(hash);
+
+    WriterLock scope(&shard->rwlock);
+    auto index = UnsafeFind(shard, key, hash);
+    auto value = proc(index >= 0 ? shard->slots[index].value : nullptr);
+    if (!value) {
+        return yuki::Status::OK();
+    }
+    return UnsafePut(shard, key, hash, version_number, value);
+}
+
+// Must be called under the shard lock (writer).
+yuki::Status FlatHashMap::UnsafePut(Shard *shard, yuki::SliceRef key,
+                                    uint64_t hash, uint64_t version_number,
+                                    Obj *value) {
+    using yuki::Status;
+
+    auto index = UnsafeFind(shard, key, hash);
+    if (index >= 0) {
+        auto slot = &shard->slots[index];
+        if (slot->value != value) {
+            ObjRelease(slot->value);
+            slot->value = ObjAddRef(value);
+        }
+        return Status::OK();
+    }
+
+    if (shard->growth_left == 0) {
+        // Only rehash in place if most of used slots are deleted.
+        auto num_groups = shard->num_groups;
+        if (shard->num_keys >= MaxLoad(num_groups) / 2) {
+            num_groups <<= 1;
+        }
+        if (!UnsafeResize(shard, num_groups)) {
+            return Status::Systemf("not enough memory.");
+        }
+    }
+
+    index = UnsafeFindFree(shard, hash);
+    DCHECK_GE(index, 0);
+
+    auto slot = &shard->slots[index];
+    auto size = KeyBoundle::PredictBoundleSize(key, version_number);
+    if (size <= INLINE_KEY_SIZE) {
+        KeyBoundle::Build(key, 0, version_number, slot->key, INLINE_KEY_SIZE);
+        slot->is_inline = 1;
+    } else {
+        auto buf = Slab::Allocate(size);
+        if (!buf) {
+            return Status::Systemf("not enough memory.");
+        }
+        *reinterpret_cast<KeyBoundle **>(slot->key) =
+            KeyBoundle::Build(key, 0, version_number, buf, size);
+        slot->is_inline = 0;
+    }
+    slot->value = ObjAddRef(value);
+
+    if (shard->ctrl[index] == CTRL_EMPTY) {
+        shard->growth_left--;
+    }
+    shard->ctrl[index] = H2(hash);
+    shard->num_keys++;
+    num_keys_.fetch_add(1);
+    return Status::OK();
+}
+
+bool FlatHashMap::Delete(yuki::SliceRef key) {
+    auto hash  = CocurrentHashMap::Hash(key.Data(), key.Length());
+    auto shard = TakeShard(hash);
+
+    WriterLock scope(&shard->rwlock);
+    auto index = UnsafeFind(shard, key, hash);
+    if (index < 0) {
+        return false;
+    }
+    FreeSlot(&shard->slots[index]);
+
+    // If the group has any empty slot, no probing can pass through it, so
+    // the slot can be empty directly.
+    auto group = shard->ctrl + (index & ~(GROUP_SIZE - 1));
+    if (MatchByte(group, CTRL_EMPTY)) {
+        shard->ctrl[index] = CTRL_EMPTY;
+        shard->growth_left++;
+    } else {
+        shard->ctrl[index] = CTRL_DELETED;
+    }
+    shard->num_keys--;
+    num_keys_.fetch_sub(1);
+
+    if (shard->num_groups > min_num_groups_ &&
+        shard->num_keys < MaxLoad(shard->num_groups) / 4) {
+        UnsafeResize(shard, shard->num_groups >> 1);
+    }
+    return true;
+}
+
+yuki::Status FlatHashMap::Get(yuki::SliceRef key, Version *ver, Obj **value) {
+    using yuki::Status;
+
+    auto hash  = CocurrentHashMap::Hash(key.Data(), key.Length());
+    auto shard = TakeShard(hash);
+
+    ReaderLock scope(&shard->rwlock);
+    auto index = UnsafeFind(shard, key, hash);
+    if (index < 0) {
+        return Status::NotFoundf("key not found.");
+    }
+
+    auto slot = &shard->slots[index];
+    if (ver) {
+        *ver = slot->key_boundle()->version();
+    }
+    if (value) {
+        *value = ObjAddRef(slot->value);
+    }
+    return Status::OK();
+}
+
+yuki::Status
+FlatHashMap::Exec(yuki::SliceRef key,
+                  std::function<void (const Version &, Obj *)> proc) {
+    using yuki::Status;
+
+    auto hash  = CocurrentHashMap::Hash(key.Data(), key.Length());
+    auto shard = TakeShard(hash);
+
+    ReaderLock scope(&shard->rwlock);
+    auto index = UnsafeFind(shard, key, hash);
+    if (index < 0) {
+        return Status::NotFoundf("key not found.");
+    }
+
+    auto slot = &shard->slots[index];
+    proc(slot->key_boundle()->version(), ObjAddRef(slot->value));
+    ObjRelease(slot->value);
+    return Status::OK();
+}
+
+Iterator *FlatHashMap::iterator() {
+    return new IteratorImpl(shards_, shards_ + NUM_SHARDS);
+}
+
+uint64_t FlatHashMap::Scan(uint64_t cursor, int64_t count,
+                           std::function<void (KeyBoundle *, Obj *)> proc) {
+    auto i = cursor >> kScanShardShift;
+    auto group = static_cast<int64_t>(cursor & kScanGroupMask);
+
+    int64_t visited = 0;
+    for (; i < NUM_SHARDS; i++, group = 0) {
+        auto shard = &shards_[i];
+
+        ReaderLock scope(&shard->rwlock);
+        for (; group < shard->num_groups; group++) {
+            if (visited > 0 && visited >= count) {
+                return (i << kScanShardShift) | static_cast<uint64_t>(group);
+            }
+            auto base = group * GROUP_SIZE;
+            for (int j = 0; j < GROUP_SIZE; j++) {
+                if (shard->ctrl[base + j] >= 0) {
+                    auto slot = &shard->slots[base + j];
+                    proc(slot->key_boundle(), slot->value);
+                    visited++;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+int64_t FlatHashMap::num_groups() const {
+    int64_t n = 0;
+    for (int i = 0; i < NUM_SHARDS; i++) {
+        n += shards_[i].num_groups;
+    }
+    return n;
+}
+
+inline FlatHashMap::Shard *FlatHashMap::TakeShard(uint64_t hash) {
+    // Use the highest 4 bits, H1 and H2 use the low bits.
+    static_assert(NUM_SHARDS == 16, "Shard bits must match NUM_SHARDS.");
+    return &shards_[(hash >> 60) & (NUM_SHARDS - 1)];
+}
+
+// Triangular probing over groups, it can visit every group when number of
+// groups is power of 2.
+int64_t FlatHashMap::UnsafeFind(Shard *shard, yuki::SliceRef key,
+                                uint64_t hash) {
+    const auto h2   = H2(hash);
+    const auto mask = static_cast<uint64_t>(shard->num_groups - 1);
+
+    auto g = H1(hash) & mask;
+    for (int64_t i = 1; i <= shard->num_groups; i++) {
+        auto group = shard->ctrl + g * GROUP_SIZE;
+
+        for (auto m = MatchByte(group, h2); m; m &= (m - 1)) {
+            auto index = static_cast<int64_t>(g * GROUP_SIZE +
+                                              __builtin_ctz(m));
+            auto boundle = shard->slots[index].key_boundle();
+            if (boundle->key().Compare(key) == 0) {
+                return index;
+            }
+        }
+        if (MatchByte(group, CTRL_EMPTY)) {
+            return -1;
+        }
+        g = (g + i) & mask;
+    }
+    return -1;
+}
+
+int64_t FlatHashMap::UnsafeFindFree(Shard *shard, uint64_t hash) {
+    const auto mask = static_cast<uint64_t>(shard->num_groups - 1);
+
+    auto g = H1(hash) & mask;
+    for (int64_t i = 1; i <= shard->num_groups; i++) {
+        auto m = MatchFree(shard->ctrl + g * GROUP_SIZE);
+        if (m) {
+            return static_cast<int64_t>(g * GROUP_SIZE + __builtin_ctz(m));
+        }
+        g = (g + i) & mask;
+    }
+    return -1;
+}
+
+void FlatHashMap::Reserve(int64_t num_keys) {
+    auto shard_size = (num_keys + NUM_SHARDS - 1) / NUM_SHARDS;
+    for (auto &shard : shards_) {
+        WriterLock scope(&shard.rwlock);
+        auto num_groups = shard.num_groups;
+        while (MaxLoad(num_groups) < shard.num_keys + shard_size) {
+            num_groups <<= 1;
+        }
+        if (num_groups != shard.num_groups &&
+            !UnsafeResize(&shard, num_groups)) {
+            LOG(ERROR) << "not enough memory for reserving.";
+            return;
+        }
+    }
+}
+
+bool FlatHashMap::UnsafeResize(Shard *shard, int64_t num_groups) {
+    Shard fresh;
+    if (!InitShard(&fresh, num_groups)) {
+        return false;
+    }
+
+    for (int64_t i = 0; i < Capacity(shard->num_groups); i++) {
+        if (shard->ctrl[i] < 0) {
+            continue;
+        }
+
+        auto slot = &shard->slots[i];
+        auto key  = slot->key_boundle()->key();
+        auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+
+        auto index = UnsafeFindFree(&fresh, hash);
+        DCHECK_GE(index, 0);
+        fresh.ctrl[index]  = H2(hash);
+        fresh.slots[index] = *slot;
+    }
+    delete[] shard->ctrl;
+    delete[] shard->slots;
+
+    shard->ctrl        = fresh.ctrl;
+    shard->slots       = fresh.slots;
+    shard->num_groups  = num_groups;
+    shard->growth_left = MaxLoad(num_groups) - shard->num_keys;
+    return true;
+}
+
+/*static*/ bool FlatHashMap::InitShard(Shard *shard, int64_t num_groups) {
+    DCHECK_GT(num_groups, 0);
+    DCHECK_EQ(0, num_groups & (num_groups - 1));
+
+    auto capacity = Capacity(num_groups);
+    shard->ctrl  = new int8_t[capacity];
+    shard->slots = new Slot[capacity];
+    if (!shard->ctrl || !shard->slots) {
+        delete[] shard->ctrl;
+        delete[] shard->slots;
+        return false;
+    }
+    memset(shard->ctrl, CTRL_EMPTY, capacity);
+
+    shard->num_groups  = num_groups;
+    shard->num_keys    = 0;
+    shard->growth_left = MaxLoad(num_groups);
+    return true;
+}
+
+/*static*/ void FlatHashMap::FreeSlot(Slot *slot) {
+    ObjRelease(slot->value);
+    if (!slot->is_inline) {
+        Slab::Free(slot->key_boundle());
+    }
+}
+
+} // namespace yukino
@@ -0,0 +1,131 @@
+#ifndef YUKINO_FLAT_HASH_MAP_H_
+#define YUKINO_FLAT_HASH_MAP_H_
+
+#include "mem_table.h"
+#include "rw_spin_lock.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace yukino {
+
+struct KeyBoundle;
+
+//
+// Open-addressing hash map (swiss table like):
+// Every group has 16 control bytes and 16 slots, the control bytes in one
+// group be matched in one time by SSE2. Short key boundles are stored in
+// the slot directly.
+//
+// The key space be split to NUM_SHARDS shards by the high hash bits, every
+// shard has its own lock and table.
+//
+class FlatHashMap : public MemTable {
+public:
+    enum {
+        GROUP_SIZE      = 16,
+        NUM_SHARDS      = 16,
+        INLINE_KEY_SIZE = 23,
+    };
+
+    // Control bytes: full slot store the low 7 bits of hash.
+    enum : int8_t {
+        CTRL_EMPTY   = -128,
+        CTRL_DELETED = -2,
+    };
+
+    struct Slot {
+        Obj    *value;
+        uint8_t key[INLINE_KEY_SIZE];
+        uint8_t is_inline;
+
+        inline KeyBoundle *key_boundle() const;
+    };
+
+    struct Shard {
+        RWSpinLock rwlock;
+        int8_t *ctrl;
+        Slot   *slots;
+        int64_t num_groups;
+        int64_t num_keys;
+        int64_t growth_left;
+    };
+
+    FlatHashMap(int64_t initial_size);
+    virtual ~FlatHashMap() override;
+
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) override;
+    virtual bool Delete(yuki::SliceRef key) override;
+
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) override;
+
+    virtual yuki::Status
+    Exec(yuki::SliceRef key,
+         std::function<void (const Version &, Obj *)> proc) override;
+
+    virtual yuki::Status
+    Update(yuki::SliceRef key, uint64_t version_number,
+           std::function<Obj *(Obj *)> proc) override;
+
+    virtual Iterator *iterator() override;
+
+    // The cursor be [shard(8 bits)] [group(56 bits)], visits whole groups
+    // under the shard lock (reader). Keys may be missed or visited twice if
+    // the shard resized between calls.
+    virtual uint64_t Scan(uint64_t cursor, int64_t count,
+                          std::function<void (KeyBoundle *, Obj *)> proc)
+                          override;
+
+    // Open-addressing table be resized in one time.
+    virtual bool IncrementalRehash(int /*num_steps*/) override {
+        return false;
+    }
+
+    // Every shard be resized for its part of keys in one time.
+    virtual void Reserve(int64_t num_keys) override;
+
+    virtual int64_t num_keys() const override { return num_keys_.load(); }
+
+    int64_t num_groups() const;
+
+    static inline int64_t Capacity(int64_t num_groups) {
+        return num_groups * GROUP_SIZE;
+    }
+
+    // Max load fator: 7/8
+    static inline int64_t MaxLoad(int64_t num_groups) {
+        return Capacity(num_groups) - Capacity(num_groups) / 8;
+    }
+
+private:
+    inline Shard *TakeShard(uint64_t hash);
+
+    yuki::Status UnsafePut(Shard *shard, yuki::SliceRef key, uint64_t hash,
+                           uint64_t version_number, Obj *value);
+    int64_t UnsafeFind(Shard *shard, yuki::SliceRef key, uint64_t hash);
+    int64_t UnsafeFindFree(Shard *shard, uint64_t hash);
+    bool    UnsafeResize(Shard *shard, int64_t num_groups);
+
+    static bool InitShard(Shard *shard, int64_t num_groups);
+    static void FreeSlot(Slot *slot);
+
+    Shard shards_[NUM_SHARDS];
+    const int64_t min_num_groups_;
+    std::atomic<int64_t> num_keys_;
+};
+
+static_assert(sizeof(FlatHashMap::Slot) == 32, "Fixed flat slot size.");
+
+inline KeyBoundle *FlatHashMap::Slot::key_boundle() const {
+    if (is_inline) {
+        return reinterpret_cast<KeyBoundle *>(const_cast<uint8_t *>(key));
+    }
+    return *reinterpret_cast<KeyBoundle * const *>(key);
+}
+
+} // namespace yukino
+
+#endif // YUKINO_FLAT_HASH_MAP_H_
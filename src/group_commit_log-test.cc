@@ -0,0 +1,178 @@
+#include "group_commit_log.h"
+#include "basic_io.h"
+#include "obj.h"
+#include "yuki/file_path.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <thread>
+#include <memory>
+
+namespace yukino {
+
+class GroupCommitLogTest : public ::testing::Test {
+public:
+    virtual void TearDown() override {
+        for (auto fd : fds_) {
+            close(fd);
+        }
+        for (const auto &name : names_) {
+            unlink(Path(name).c_str());
+        }
+    }
+
+protected:
+    std::string Path(const std::string &name) {
+        yuki::FilePath path(kDataDir);
+        path.Append(name);
+        return path.Get();
+    }
+
+    int OpenLog(const std::string &name) {
+        auto fd = open(Path(name).c_str(), O_CREAT|O_TRUNC|O_WRONLY|O_APPEND,
+                       0664);
+        EXPECT_LE(0, fd);
+        fds_.push_back(fd);
+        names_.push_back(name);
+        return fd;
+    }
+
+    void ReadLog(const std::string &name, std::vector<Operator> *ops,
+                 size_t *size) {
+        std::string buf;
+        auto rv = yuki::Strings::FromFile(yuki::FilePath(Path(name)), &buf);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        *size = buf.size();
+
+        BinLogReader reader(NewBufferedInputStream(yuki::Slice(buf)), true,
+                            kLogBlockSize);
+        Operator op;
+        while (reader.Read(&op, &rv)) {
+            ops->push_back(op);
+        }
+    }
+
+    static std::vector<Handle<Obj>> Args(const std::string &key) {
+        std::vector<Handle<Obj>> args;
+        args.emplace_back(String::New(yuki::Slice(key)));
+        return args;
+    }
+
+    static const char kDataDir[];
+
+    std::vector<int> fds_;
+    std::vector<std::string> names_;
+};
+
+const char GroupCommitLogTest::kDataDir[] = "tests";
+
+TEST_F(GroupCommitLogTest, FsyncPolicyName) {
+    FsyncPolicy policy;
+
+    ASSERT_TRUE(ParseFsyncPolicy(yuki::Slice("always"), &policy));
+    EXPECT_EQ(FSYNC_ALWAYS, policy);
+    ASSERT_TRUE(ParseFsyncPolicy(yuki::Slice("everysec"), &policy));
+    EXPECT_EQ(FSYNC_EVERYSEC, policy);
+    ASSERT_TRUE(ParseFsyncPolicy(yuki::Slice("no"), &policy));
+    EXPECT_EQ(FSYNC_NO, policy);
+    EXPECT_FALSE(ParseFsyncPolicy(yuki::Slice("never"), &policy));
+
+    EXPECT_STREQ("everysec", FsyncPolicyName(FSYNC_EVERYSEC));
+}
+
+TEST_F(GroupCommitLogTest, GroupCommit) {
+    static const int kNumThreads = 4;
+    static const int kNumRecords = 500;
+
+    auto fd = OpenLog("group-commit-log");
+    size_t written = 0;
+    {
+        GroupCommitLog log(fd, FSYNC_ALWAYS, 0);
+
+        std::thread threads[kNumThreads];
+        for (int i = 0; i < kNumThreads; i++) {
+            threads[i] = std::move(std::thread([&log] (int id) {
+                auto key = yuki::Strings::Format("key.%d", id);
+                for (int j = 0; j < kNumRecords; j++) {
+                    int64_t lsn;
+                    auto rv = log.Append(CMD_SET, j, Args(key), &lsn);
+                    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+                    rv = log.Sync(lsn);
+                    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+                }
+            }, i));
+        }
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        written = log.written_bytes();
+    }
+
+    std::vector<Operator> ops;
+    size_t size;
+    ReadLog("group-commit-log", &ops, &size);
+    EXPECT_EQ(written, size);
+    ASSERT_EQ(kNumThreads * kNumRecords, ops.size());
+
+    // Records of one writer be in its appending order.
+    int64_t next[kNumThreads] = {0};
+    for (const auto &op : ops) {
+        ASSERT_EQ(CMD_SET, op.cmd);
+        auto key = static_cast<String *>(op.args[0].get())->data();
+        int id = key.Data()[key.Length() - 1] - '0';
+        ASSERT_LT(id, kNumThreads);
+        EXPECT_EQ(next[id]++, op.version);
+    }
+}
+
+TEST_F(GroupCommitLogTest, Rotate) {
+    auto old_fd = OpenLog("group-commit-log");
+    auto new_fd = OpenLog("group-commit-log.1");
+    size_t written = 0;
+    {
+        GroupCommitLog log(old_fd, FSYNC_NO, 0);
+
+        int64_t lsn;
+        for (int i = 0; i < 10; i++) {
+            log.Append(CMD_DEL, i, Args("a"), &lsn);
+        }
+        EXPECT_EQ(old_fd, log.Rotate(new_fd));
+
+        for (int i = 0; i < 5; i++) {
+            log.Append(CMD_DEL, i, Args("b"), &lsn);
+        }
+        written = log.written_bytes();
+
+        std::vector<Operator> ops;
+        size_t size;
+        ReadLog("group-commit-log", &ops, &size);
+        EXPECT_EQ(10, ops.size());
+    }
+
+    std::vector<Operator> ops;
+    size_t size;
+    ReadLog("group-commit-log.1", &ops, &size);
+    EXPECT_EQ(5, ops.size());
+    EXPECT_EQ(written, size);
+}
+
+TEST_F(GroupCommitLogTest, StickyError) {
+    auto fd = open("/dev/full", O_WRONLY);
+    ASSERT_LE(0, fd);
+    fds_.push_back(fd);
+
+    GroupCommitLog log(fd, FSYNC_ALWAYS, 0);
+    int64_t lsn;
+    auto rv = log.Append(CMD_SET, 1, Args("a"), &lsn);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_TRUE(log.Sync(lsn).Failed());
+
+    // No more records be accepted, the failed one not be retried.
+    auto failed_lsn = lsn;
+    EXPECT_TRUE(log.Append(CMD_SET, 2, Args("b"), &lsn).Failed());
+    EXPECT_EQ(failed_lsn, lsn);
+    EXPECT_TRUE(log.Sync(failed_lsn).Failed());
+}
+
+} // namespace yukino
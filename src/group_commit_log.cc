@@ -0,0 +1,214 @@
+#include "group_commit_log.h"
+#include "basic_io.h"
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+
+namespace yukino {
+
+namespace {
+
+inline int64_t NowMilsces() {
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(
+            steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+const char *FsyncPolicyName(FsyncPolicy policy) {
+    switch (policy) {
+        case FSYNC_ALWAYS:
+            return "always";
+        case FSYNC_NO:
+            return "no";
+        default:
+            return "everysec";
+    }
+}
+
+bool ParseFsyncPolicy(yuki::SliceRef name, FsyncPolicy *policy) {
+    static const FsyncPolicy kPolicies[] = {
+        FSYNC_ALWAYS, FSYNC_EVERYSEC, FSYNC_NO,
+    };
+
+    for (auto p : kPolicies) {
+        if (name.Compare(yuki::Slice(FsyncPolicyName(p))) == 0) {
+            *policy = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+GroupCommitLog::GroupCommitLog(int fd, FsyncPolicy policy,
+                               size_t initial_size)
+    : policy_(policy)
+    , writer_(NewBufferedOutputStream(&pending_), true, kLogBlockSize,
+              initial_size)
+    , fd_(fd)
+    , last_sync_milsces_(NowMilsces()) {
+    thread_ = std::move(std::thread([this] () { Run(); }));
+}
+
+GroupCommitLog::~GroupCommitLog() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        stop_ = true;
+        wakeup_.notify_one();
+    }
+    thread_.join();
+}
+
+yuki::Status GroupCommitLog::Append(CmdCode cmd_code, int64_t version,
+                                    const std::vector<Handle<Obj>> &args,
+                                    int64_t *lsn) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (error_.Failed()) {
+        return error_;
+    }
+    auto size = pending_.size();
+    writer_.Append(cmd_code, version, args);
+    appended_lsn_ += pending_.size() - size;
+    *lsn = appended_lsn_;
+
+    wakeup_.notify_one();
+    return yuki::Status::OK();
+}
+
+yuki::Status GroupCommitLog::Sync(int64_t lsn) {
+    if (policy_ != FSYNC_ALWAYS) {
+        return yuki::Status::OK();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    synced_.wait(lock, [this, lsn] () {
+        return durable_lsn_ >= lsn || error_.Failed() || stop_;
+    });
+    return durable_lsn_ >= lsn ? yuki::Status::OK() : error_;
+}
+
+int GroupCommitLog::Rotate(int fd) {
+    std::unique_lock<std::mutex> write_lock(write_mutex_);
+
+    std::string batch;
+    int64_t lsn;
+    bool failed;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        batch.swap(pending_);
+        lsn = appended_lsn_;
+        failed = error_.Failed();
+        // Blocks of the new file start from zero.
+        writer_.Reset(NewBufferedOutputStream(&pending_));
+    }
+    auto rv = failed ? yuki::Status::OK() : WriteBatch(batch, true);
+    auto old_fd = fd_;
+    fd_ = fd;
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    UnsafeDone(rv, lsn);
+    return old_fd;
+}
+
+size_t GroupCommitLog::written_bytes() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return writer_.written_bytes();
+}
+
+void GroupCommitLog::Run() {
+    using yuki::Status;
+
+    std::string batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (;;) {
+        if (pending_.empty() && !stop_) {
+            // Wake up every second at least, for FSYNC_EVERYSEC.
+            wakeup_.wait_for(lock, std::chrono::seconds(1));
+        }
+        auto stop = stop_;
+        lock.unlock();
+
+        Status rv;
+        int64_t lsn;
+        {
+            // Take the batch under write_mutex_, so a rotating can not
+            // cut in between.
+            std::unique_lock<std::mutex> write_lock(write_mutex_);
+            lock.lock();
+            batch.swap(pending_);
+            lsn = appended_lsn_;
+            bool failed = error_.Failed();
+            lock.unlock();
+
+            bool sync = stop || policy_ == FSYNC_ALWAYS ||
+                        (policy_ == FSYNC_EVERYSEC &&
+                         NowMilsces() - last_sync_milsces_ >= 1000);
+            if (!failed) { // or be dropped.
+                rv = WriteBatch(batch, sync);
+            }
+            batch.clear();
+        }
+
+        lock.lock();
+        UnsafeDone(rv, lsn);
+        if (stop && pending_.empty()) {
+            break;
+        }
+    }
+}
+
+void GroupCommitLog::UnsafeDone(const yuki::Status &rv, int64_t lsn) {
+    if (rv.Failed()) {
+        error_ = rv;
+    } else if (error_.Ok()) {
+        durable_lsn_ = std::max(durable_lsn_, lsn);
+    }
+    synced_.notify_all();
+}
+
+yuki::Status GroupCommitLog::WriteBatch(const std::string &batch, bool sync) {
+    using yuki::Status;
+
+    size_t written = 0;
+    while (written < batch.size()) {
+        auto rv = write(fd_, batch.data() + written, batch.size() - written);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG(ERROR) << "write log fail.";
+            TruncateBatch(written);
+            return Status::Systemf("write log fail");
+        }
+        written += static_cast<size_t>(rv);
+    }
+    dirty_ = dirty_ || !batch.empty();
+
+    if (sync && dirty_) {
+        if (fdatasync(fd_) != 0) {
+            PLOG(ERROR) << "sync log fail.";
+            TruncateBatch(written);
+            return Status::Systemf("sync log fail");
+        }
+        dirty_ = false;
+        last_sync_milsces_ = NowMilsces();
+    }
+    return Status::OK();
+}
+
+// Cut the written part of a failed batch, so the redo never meets torn
+// bytes or records whose writers got the error. The fd be O_APPEND, its
+// offset be the end.
+void GroupCommitLog::TruncateBatch(size_t written) {
+    if (written == 0) {
+        return;
+    }
+    auto end = lseek(fd_, 0, SEEK_CUR);
+    if (end < 0 || ftruncate(fd_, end - static_cast<off_t>(written)) != 0) {
+        PLOG(ERROR) << "truncate log fail.";
+    }
+}
+
+} // namespace yukino
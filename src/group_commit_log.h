@@ -0,0 +1,95 @@
+#ifndef YUKINO_GROUP_COMMIT_LOG_H_
+#define YUKINO_GROUP_COMMIT_LOG_H_
+
+#include "bin_log.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace yukino {
+
+// When the log be synced to the disk.
+enum FsyncPolicy {
+    FSYNC_ALWAYS,   // every write waits for its batch be synced.
+    FSYNC_EVERYSEC, // synced once per second, lose one second at most.
+    FSYNC_NO,       // never synced, left to the OS.
+};
+
+const char *FsyncPolicyName(FsyncPolicy policy);
+bool ParseFsyncPolicy(yuki::SliceRef name, FsyncPolicy *policy);
+
+//
+// Write-ahead log with group commit:
+// Writers only serialize their records into the pending batch, the log
+// thread writes and syncs batches. Records appended during one writing
+// come in the next batch, so one fsync covers all of them.
+//
+// Once a batch fails, its bytes be truncated and the error be sticky: the
+// pending batches be dropped, no more records be accepted.
+//
+class GroupCommitLog {
+public:
+    GroupCommitLog(int fd, FsyncPolicy policy, size_t initial_size);
+    GroupCommitLog(const GroupCommitLog &) = delete;
+    GroupCommitLog(GroupCommitLog &&) = delete;
+    void operator = (const GroupCommitLog &) = delete;
+
+    // Write and sync all pending records, then stop the log thread.
+    // The fd be not closed.
+    ~GroupCommitLog();
+
+    // `lsn' be the end of this record in the whole log, for Sync(). The
+    // record be not queued if the log be failed.
+    yuki::Status Append(CmdCode cmd_code, int64_t version,
+                        const std::vector<Handle<Obj>> &args, int64_t *lsn);
+
+    // Wait until records before `lsn' be durable, if FSYNC_ALWAYS. Fail if
+    // the log be failed before them.
+    yuki::Status Sync(int64_t lsn);
+
+    // Write and sync all pending records to the current file, then log to
+    // `fd' from now on. Return the old fd.
+    int Rotate(int fd);
+
+    // Bytes of the current file, including the pending ones.
+    size_t written_bytes() const;
+
+    FsyncPolicy policy() const { return policy_; }
+
+private:
+    void Run();
+
+    // Must be called under write_mutex_.
+    yuki::Status WriteBatch(const std::string &batch, bool sync);
+    void TruncateBatch(size_t written);
+
+    // Must be called under mutex_.
+    void UnsafeDone(const yuki::Status &rv, int64_t lsn);
+
+    const FsyncPolicy policy_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wakeup_; // the log thread waits for records.
+    std::condition_variable synced_; // writers wait for durability.
+    std::string pending_;
+    BinLogWriter writer_;            // into pending_
+    int64_t appended_lsn_ = 0;
+    int64_t durable_lsn_ = 0;
+    yuki::Status error_;             // sticky.
+    bool stop_ = false;
+
+    std::mutex write_mutex_;         // batches be written in order.
+    int fd_;
+    bool dirty_ = false;             // written, but not synced yet.
+    int64_t last_sync_milsces_ = 0;
+
+    std::thread thread_;
+}; // class GroupCommitLog
+
+} // namespace yukino
+
+#endif // YUKINO_GROUP_COMMIT_LOG_H_
@@ -1,6 +1,8 @@
 #ifndef YUKINO_HANDLE_H_
 #define YUKINO_HANDLE_H_
 
+#include "glog/logging.h"
+
 namespace yukino {
 
 template<class T>
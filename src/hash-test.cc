@@ -0,0 +1,103 @@
+#include "hash.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <set>
+#include <string>
+#include <vector>
+#include <string.h>
+
+namespace yukino {
+
+namespace {
+
+// The old CocurrentHashMap hash, for comparing only.
+unsigned int JSHash(const char *p, size_t n) {
+    unsigned int hash = 1315423911;
+    for (size_t i = 0; i < n; i++) {
+        hash ^= ((hash << 5) + (*p++) + (hash >> 2));
+    }
+    return (hash & 0x7FFFFFFF);
+}
+
+} // namespace
+
+TEST(HashTest, Sanity) {
+    const char *s = "The quick brown fox jumps over the lazy dog, "
+                    "then jumps over the lazy dog again.";
+    const auto len = strlen(s);
+
+    // Every length path: 0, 1~3, 4~16, 17~48, > 48
+    for (size_t n = 0; n <= len; n++) {
+        EXPECT_EQ(Hash64(s, n, 0), Hash64(std::string(s, n).data(), n, 0));
+        EXPECT_NE(Hash64(s, n, 0), Hash64(s, n, 1)) << n;
+    }
+
+    std::set<uint64_t> hashes;
+    for (size_t n = 0; n <= len; n++) {
+        hashes.insert(Hash64(s, n, 0));
+    }
+    EXPECT_EQ(len + 1, hashes.size());
+
+    EXPECT_EQ(HashSeed(), HashSeed());
+}
+
+TEST(HashTest, Distribution) {
+    const int N = 100000;
+    const int kNumSlots = 1024;
+
+    int slots[kNumSlots] = {0};
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("key.%d", i);
+        slots[Hash64(key.data(), key.size(), HashSeed()) & (kNumSlots - 1)]++;
+    }
+
+    // Mask of power of 2 table must spread well.
+    auto avg = N / kNumSlots;
+    for (int i = 0; i < kNumSlots; i++) {
+        EXPECT_GT(slots[i], avg / 2) << i;
+        EXPECT_LT(slots[i], avg * 2) << i;
+    }
+}
+
+TEST(HashTest, Benchmark) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+
+    const int N = 1000000;
+    const size_t lengths[] = {8, 16, 24, 40, 64, 128};
+
+    for (auto len : lengths) {
+        std::vector<std::string> keys;
+        for (int i = 0; i < 1024; i++) {
+            auto key = yuki::Strings::Format("user:%d:", i);
+            key.resize(len, 'x');
+            keys.push_back(key);
+        }
+
+        uint64_t sink = 0;
+        auto start = steady_clock::now();
+        for (int i = 0; i < N; i++) {
+            auto &key = keys[i & 1023];
+            sink += JSHash(key.data(), key.size());
+        }
+        auto old_ns = duration_cast<nanoseconds>(steady_clock::now() -
+                                                 start).count();
+
+        start = steady_clock::now();
+        for (int i = 0; i < N; i++) {
+            auto &key = keys[i & 1023];
+            sink += Hash64(key.data(), key.size(), HashSeed());
+        }
+        auto new_ns = duration_cast<nanoseconds>(steady_clock::now() -
+                                                 start).count();
+
+        printf("key len %3zu: JSHash %.2f ns/key, Hash64 %.2f ns/key (%llu)\n",
+               len, static_cast<double>(old_ns) / N,
+               static_cast<double>(new_ns) / N,
+               static_cast<unsigned long long>(sink & 1));
+    }
+}
+
+} // namespace yukino
@@ -0,0 +1,102 @@
+#include "hash.h"
+#include <string.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+
+namespace yukino {
+
+namespace {
+
+const uint64_t kSecret[4] = {
+    0xa0761d6478bd642full, 0xe7037ed1a0b428dbull,
+    0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull,
+};
+
+inline void Mum(uint64_t *a, uint64_t *b) {
+    __uint128_t r = *a;
+    r *= *b;
+    *a = static_cast<uint64_t>(r);
+    *b = static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t Mix(uint64_t a, uint64_t b) {
+    Mum(&a, &b);
+    return a ^ b;
+}
+
+// Little-endian loading.
+inline uint64_t Read8(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t Read4(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t Read3(const uint8_t *p, size_t k) {
+    return (static_cast<uint64_t>(p[0]) << 16) |
+           (static_cast<uint64_t>(p[k >> 1]) << 8) | p[k - 1];
+}
+
+} // namespace
+
+uint64_t Hash64(const void *key, size_t n, uint64_t seed) {
+    auto p = static_cast<const uint8_t *>(key);
+    uint64_t a, b;
+
+    seed ^= Mix(seed ^ kSecret[0], kSecret[1]);
+    if (n <= 16) {
+        if (n >= 4) {
+            a = (Read4(p) << 32) | Read4(p + ((n >> 3) << 2));
+            b = (Read4(p + n - 4) << 32) | Read4(p + n - 4 - ((n >> 3) << 2));
+        } else if (n > 0) {
+            a = Read3(p, n);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        auto i = n;
+        if (i > 48) {
+            auto see1 = seed, see2 = seed;
+            do {
+                seed = Mix(Read8(p) ^ kSecret[1], Read8(p + 8) ^ seed);
+                see1 = Mix(Read8(p + 16) ^ kSecret[2], Read8(p + 24) ^ see1);
+                see2 = Mix(Read8(p + 32) ^ kSecret[3], Read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = Mix(Read8(p) ^ kSecret[1], Read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = Read8(p + i - 16);
+        b = Read8(p + i - 8);
+    }
+    a ^= kSecret[1];
+    b ^= seed;
+    Mum(&a, &b);
+    return Mix(a ^ kSecret[0] ^ n, b ^ kSecret[1]);
+}
+
+uint64_t HashSeed() {
+    static const uint64_t seed = [] () {
+        std::random_device rd;
+        uint64_t s = (static_cast<uint64_t>(rd()) << 32) | rd();
+        s ^= static_cast<uint64_t>(
+                std::chrono::steady_clock::now().time_since_epoch().count());
+        s ^= static_cast<uint64_t>(getpid()) << 16;
+        return s;
+    }();
+    return seed;
+}
+
+} // namespace yukino
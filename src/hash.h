@@ -0,0 +1,19 @@
+#ifndef YUKINO_HASH_H_
+#define YUKINO_HASH_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace yukino {
+
+// wyhash: 64 bits hash, eat 16 or 48 bytes in one step by 64x64->128
+// multiplication.
+uint64_t Hash64(const void *p, size_t n, uint64_t seed);
+
+// Random seed for this process, be made at first calling. The table hash
+// should use it to resist hash flooding.
+uint64_t HashSeed();
+
+} // namespace yukino
+
+#endif // YUKINO_HASH_H_
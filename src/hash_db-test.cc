@@ -3,11 +3,14 @@
 #include "configuration.h"
 #include "key.h"
 #include "obj.h"
+#include "persistent.h"
 #include "protocol.h"
 #include "yuki/strings.h"
 #include "yuki/file.h"
 #include "yuki/file_path.h"
 #include "gtest/gtest.h"
+#include <memory>
+#include <unistd.h>
 
 namespace yukino {
 
@@ -60,6 +63,44 @@ TEST_F(HashDBTest, Sanity) {
     ASSERT_TRUE(rv.Ok());
 }
 
+TEST_F(HashDBTest, FlatPersistent) {
+    using yuki::Slice;
+
+    DBConf conf;
+
+    conf.type = DB_HASH_FLAT;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<DB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(Slice("key")));
+    args.emplace_back(String::New(Slice("obj")));
+
+    rv = db->AppendLog(CMD_SET, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Put(Slice("key"), 0, args[1].get());
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    rv = db->Checkpoint(true);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset();
+
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(1, db->num_keys());
+
+    Obj *obj = nullptr;
+    rv = db->Get(Slice("key"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ("obj", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+}
+
 TEST_F(HashDBTest, Persistent) {
     using yuki::Slice;
 
@@ -88,6 +129,465 @@ TEST_F(HashDBTest, Persistent) {
     ASSERT_TRUE(rv.Ok()) << rv.ToString();
 }
 
+TEST_F(HashDBTest, TornLogRecord) {
+    using yuki::Slice;
+
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<DB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(Slice("a")));
+    args.emplace_back(String::New(Slice("1")));
+    rv = db->AppendLog(CMD_SET, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset();
+
+    // Crashed in writing a record.
+    yuki::FilePath log_path(kDataDir);
+    log_path.Append("db-0/log-0");
+    FILE *fp = fopen(log_path.Get().c_str(), "a");
+    ASSERT_TRUE(fp != nullptr);
+    fwrite("\x12\x34\x56\x78\x40\x00\x01garbage", 1, 14, fp);
+    fclose(fp);
+
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_TRUE(db->Get(Slice("a"), nullptr, nullptr).Ok());
+
+    args[0] = String::New(Slice("b"));
+    rv = db->AppendLog(CMD_SET, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset();
+
+    // The new record follows the last good one.
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_TRUE(db->Get(Slice("a"), nullptr, nullptr).Ok());
+    EXPECT_TRUE(db->Get(Slice("b"), nullptr, nullptr).Ok());
+}
+
+TEST_F(HashDBTest, EvictionLimit) {
+    using yuki::Slice;
+
+    static const int N = 100000;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = false;
+    conf.memory_limit = 1024 * 1024;
+    conf.eviction = EVICT_LRU;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("key.%d", i);
+        auto rv = db->Put(Slice(key), 0, String::New(Slice(key)));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        ASSERT_LE(db->memory_usage(), conf.memory_limit) << i;
+    }
+    EXPECT_LT(0, db->num_evicted());
+    EXPECT_EQ(N, db->num_keys() + db->num_evicted());
+
+    // The last one is the newest.
+    EXPECT_TRUE(db->Get(Slice(yuki::Strings::Format("key.%d", N - 1)),
+                        nullptr, nullptr).Ok());
+}
+
+TEST_F(HashDBTest, EvictionByListGrowth) {
+    using yuki::Slice;
+
+    static const int N = 100;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = false;
+    conf.memory_limit = 256 * 1024;
+    conf.eviction = EVICT_LRU;
+
+    // Lists grow in place as LPUSH, the limit still holds.
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    std::string large(100, 'v');
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("list.%d", i);
+        Handle<List> list(List::New());
+        ASSERT_TRUE(db->Put(Slice(key), 0, list.get()).Ok());
+        for (int j = 0; j < 100; j++) {
+            ASSERT_TRUE(list->stub()->InsertHead(String::New(Slice(large))));
+        }
+        db->RecountUsage(Slice(key));
+        ASSERT_LE(db->memory_usage(), conf.memory_limit) << i;
+    }
+    EXPECT_LT(0, db->num_evicted());
+    EXPECT_EQ(N, db->num_keys() + db->num_evicted());
+}
+
+TEST_F(HashDBTest, EvictionLFU) {
+    using yuki::Slice;
+
+    static const int kNumHotKeys = 100;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = false;
+    conf.memory_limit = 256 * 1024;
+    conf.eviction = EVICT_LFU;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    for (int i = 0; i < kNumHotKeys; i++) {
+        auto key = yuki::Strings::Format("hot.%d", i);
+        db->Put(Slice(key), 0, Integer::New(i));
+    }
+    for (int j = 0; j < 100; j++) {
+        for (int i = 0; i < kNumHotKeys; i++) {
+            auto key = yuki::Strings::Format("hot.%d", i);
+            ASSERT_TRUE(db->Get(Slice(key), nullptr, nullptr).Ok());
+        }
+    }
+
+    for (int i = 0; db->num_evicted() < 20000; i++) {
+        auto key = yuki::Strings::Format("cold.%d", i);
+        db->Put(Slice(key), 0, Integer::New(i));
+    }
+
+    int num_hot_keys = 0;
+    for (int i = 0; i < kNumHotKeys; i++) {
+        auto key = yuki::Strings::Format("hot.%d", i);
+        if (db->Get(Slice(key), nullptr, nullptr).Ok()) {
+            num_hot_keys++;
+        }
+    }
+    EXPECT_LE(kNumHotKeys * 9 / 10, num_hot_keys);
+}
+
+TEST_F(HashDBTest, EvictionPersistent) {
+    using yuki::Slice;
+
+    static const int N = 20000;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 256 * 1024;
+    conf.eviction = EVICT_RANDOM;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    for (int i = 0; i < N; i++) {
+        std::vector<Handle<Obj>> args;
+        args.emplace_back(String::New(yuki::Strings::Format("key.%d", i)));
+        args.emplace_back(Integer::New(i));
+
+        rv = db->AppendLog(CMD_SET, 0, args);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        rv = db->Put(static_cast<String *>(args[0].get())->data(), 0,
+                     args[1].get());
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    ASSERT_LT(0, db->num_evicted());
+    auto num_keys = db->num_keys();
+
+    // Evicted keys do not come back by redo.
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_GE(num_keys, db->num_keys());
+    EXPECT_LE(db->memory_usage(), conf.memory_limit);
+}
+
+TEST_F(HashDBTest, ExpirePersistent) {
+    static const int N = 100;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    ASSERT_TRUE(db->expirable());
+
+    // key.0, key.3 ...: expired; key.1, key.4 ...: living; others: plain.
+    auto now = WallMilsces();
+    for (int i = 0; i < N; i++) {
+        std::vector<Handle<Obj>> args;
+        args.emplace_back(String::New(yuki::Strings::Format("key.%d", i)));
+        args.emplace_back(Integer::New(i));
+        auto key = static_cast<String *>(args[0].get())->data();
+        int64_t expire_at = i % 3 == 0 ? now - 1 : now + 60000;
+
+        if (i % 3 == 0) {
+            args.emplace_back(String::New("PXAT"));
+            args.emplace_back(Integer::New(expire_at));
+        }
+        rv = db->AppendLog(CMD_SET, 0, args);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        rv = db->Put(key, 0, args[1].get());
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+        if (i % 3 == 1) {
+            args.resize(1);
+            args.emplace_back(Integer::New(expire_at));
+            rv = db->AppendLog(CMD_PEXPIREAT, 0, args);
+            ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        }
+        db->Expire(key, i % 3 == 2 ? 0 : expire_at);
+    }
+    EXPECT_EQ(N - N / 3, db->num_expires());
+
+    db->ActiveExpire(100);
+    EXPECT_EQ(N - N / 3 - 1, db->num_keys());
+    EXPECT_EQ(N / 3, db->num_expires());
+
+    auto check = [&db] () {
+        Version ver;
+        for (int i = 0; i < N; i++) {
+            auto key = yuki::Strings::Format("key.%d", i);
+            auto rv = db->Get(yuki::Slice(key), &ver, nullptr);
+            if (i % 3 == 0) {
+                EXPECT_EQ(yuki::Status::kNotFound, rv.Code()) << key;
+            } else {
+                ASSERT_TRUE(rv.Ok()) << key;
+                EXPECT_EQ(i % 3 == 1 ? VERSION_EXPIRE : VERSION_PLAIN,
+                          ver.type) << key;
+            }
+        }
+    };
+
+    // Redo from the log.
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    check();
+
+    // Load from the table.
+    rv = db->Checkpoint(true);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    check();
+    EXPECT_EQ(N / 3, db->num_expires());
+}
+
+TEST_F(HashDBTest, IncrExpiredPersistent) {
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // SET k 5 PXAT t, then INCR k before t.
+    auto now = WallMilsces();
+    auto expire_at = now + 200;
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(yuki::Slice("k")));
+    args.emplace_back(Integer::New(5));
+    args.emplace_back(String::New(yuki::Slice("PXAT")));
+    args.emplace_back(Integer::New(expire_at));
+    ASSERT_TRUE(db->AppendLog(CMD_SET, now, args).Ok());
+    ASSERT_TRUE(db->PutExpire(yuki::Slice("k"), expire_at, args[1].get()).Ok());
+
+    args.resize(1);
+    args.emplace_back(Integer::New(1));
+    ASSERT_TRUE(db->AppendLog(CMD_INCRBY, now, args).Ok());
+    auto incr = [] (Obj *old) { return ObjIncrBy(old, 1); };
+    ASSERT_TRUE(db->Update(yuki::Slice("k"), now, incr).Ok());
+
+    // Redo after t, the key be still expired.
+    while (WallMilsces() <= expire_at) {
+        usleep(10000);
+    }
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Get(yuki::Slice("k"), nullptr, nullptr);
+    EXPECT_EQ(yuki::Status::kNotFound, rv.Code()) << rv.ToString();
+}
+
+TEST_F(HashDBTest, ParallelLoad) {
+    using yuki::Slice;
+
+    static const int N = 30000;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // About 4 MB, be dumped in chunks.
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("key.%d", i);
+        rv = db->Put(Slice(key), 0, String::New(Slice(key + std::string(128, 'v'))));
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    rv = db->Checkpoint(true);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset();
+
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(N, db->num_keys());
+    for (int i = 0; i < N; i += 97) {
+        auto key = yuki::Strings::Format("key.%d", i);
+        Obj *value;
+        rv = db->Get(Slice(key), nullptr, &value);
+        ASSERT_TRUE(rv.Ok()) << key;
+        EXPECT_EQ(key + std::string(128, 'v'),
+                  static_cast<String *>(value)->data().ToString());
+        ObjRelease(value);
+    }
+    db.reset();
+
+    // Load by more threads than the CPUs.
+    yuki::FilePath table_path(kDataDir);
+    table_path.Append("db-0/table-1");
+    conf.persistent = false;
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    TableOptions options;
+    options.file_name = Slice(table_path.Get());
+    options.num_threads = 4;
+    rv = LoadTable(options, db.get());
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(N, db->num_keys());
+    db.reset();
+
+    // A broken chunk be found.
+    conf.persistent = true;
+    FILE *fp = fopen(table_path.Get().c_str(), "r+");
+    ASSERT_TRUE(fp != nullptr);
+    fseek(fp, 2 * 1024 * 1024, SEEK_SET);
+    fputc(0xff, fp);
+    fclose(fp);
+
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    EXPECT_TRUE(rv.Failed());
+}
+
+TEST_F(HashDBTest, OldTableFormat) {
+    DBConf conf;
+    conf.type = DB_HASH;
+    conf.persistent = false;
+    conf.memory_limit = 0;
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+
+    yuki::FilePath table_path(kDataDir);
+    table_path.Append("old-table");
+    TableOptions options;
+    options.file_name = yuki::Slice(table_path.Get());
+
+    // format 1: [*YKN] [crc32] [01 00 'x' '0' '1' 00 00 00], empty.
+    FILE *fp = fopen(table_path.Get().c_str(), "w");
+    ASSERT_TRUE(fp != nullptr);
+    fwrite("*YKN\x12\x34\x56\x78\x01\0x01\0\0\0", 1, 16, fp);
+    fclose(fp);
+    auto rv = LoadTable(options, db.get());
+    ASSERT_TRUE(rv.Failed());
+    EXPECT_NE(std::string::npos,
+              rv.ToString().find("unsupported table format 1"))
+        << rv.ToString();
+
+    // format 2: numbered.
+    char header[32] = {'*', 'Y', 'K', 'N', 2};
+    fp = fopen(table_path.Get().c_str(), "w");
+    ASSERT_TRUE(fp != nullptr);
+    fwrite(header, 1, sizeof(header), fp);
+    fclose(fp);
+    rv = LoadTable(options, db.get());
+    ASSERT_TRUE(rv.Failed());
+    EXPECT_NE(std::string::npos,
+              rv.ToString().find("unsupported table format 2"))
+        << rv.ToString();
+
+    yuki::File::Remove(table_path, false);
+}
+
+TEST_F(HashDBTest, SnapshotCheckpoint) {
+    static const int N = 5000;
+    DBConf conf;
+
+    conf.type = DB_HASH;
+    conf.persistent = true;
+    conf.memory_limit = 0;
+
+    std::unique_ptr<HashDB> db(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // Pushing be not idempotent, any write lost or replayed twice by the
+    // checkpoints breaks the lengths.
+    std::thread workers[4];
+    std::atomic<int> num_done(0);
+    for (int i = 0; i < arraysize(workers); i++) {
+        workers[i] = std::thread([&db, &num_done] (int id) {
+            std::vector<Handle<Obj>> args;
+            args.emplace_back(String::New(yuki::Strings::Format("list.%d", id)));
+            auto key = static_cast<String *>(args[0].get())->data();
+            {
+                WriteScope writing(db.get());
+                db->AppendLog(CMD_LIST, 0, args);
+                Handle<List> list(List::New());
+                db->Put(key, 0, list.get());
+            }
+
+            args.emplace_back(Integer::New(id));
+            for (int j = 0; j < N; j++) {
+                Obj *list;
+                ASSERT_TRUE(db->Get(key, nullptr, &list).Ok());
+                {
+                    WriteScope writing(db.get());
+                    db->AppendLog(CMD_RPUSH, 0, args);
+                    static_cast<List *>(list)->stub()->InsertTail(
+                            args[1].get());
+                }
+                ObjRelease(list);
+            }
+            num_done.fetch_add(1);
+        }, i);
+    }
+
+    int num_checkpoints = 0;
+    while (num_done.load() < arraysize(workers)) {
+        rv = db->Checkpoint(true);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        num_checkpoints++;
+    }
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    EXPECT_LT(0, num_checkpoints);
+
+    db.reset(new HashDB(conf, kDataDir, 0, 1023, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    for (int i = 0; i < arraysize(workers); i++) {
+        auto key = yuki::Strings::Format("list.%d", i);
+        Obj *list;
+        ASSERT_TRUE(db->Get(yuki::Slice(key), nullptr, &list).Ok()) << key;
+        EXPECT_EQ(N, static_cast<List *>(list)->stub()->size()) << key;
+        ObjRelease(list);
+    }
+}
+
 // in-memory:  251193.16 QPS
 // 8 threads:  363967.24 QPS
 // 16 threads: 332709.50 QPS
@@ -1,36 +1,71 @@
 #include "hash_db.h"
-#include "bin_log.h"
+#include "flat_hash_map.h"
+#include "sharded_hash_map.h"
+#include "skip_list.h"
+#include "group_commit_log.h"
+#include "epoch.h"
 #include "configuration.h"
 #include "basic_io.h"
 #include "value_traits.h"
 #include "persistent.h"
 #include "background.h"
 #include "server.h"
+#include "key.h"
+#include "obj.h"
+#include "protocol.h"
 #include "yuki/file_path.h"
 #include "yuki/file.h"
 #include "yuki/strings.h"
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 
 namespace yukino {
 
 static const size_t kLogSizeForCheckpoint = 50UL * 1024UL * 1024UL;
 
+static MemTable *NewMemTable(const DBConf &conf, int64_t initialize_size) {
+    switch (conf.type) {
+        case DB_HASH_FLAT:
+            return new FlatHashMap(initialize_size);
+
+        case DB_ORDER:
+            return new SkipList();
+
+        default:
+            return new ShardedHashMap(initialize_size,
+                                      ShardedHashMap::DEFAULT_NUM_SHARDS);
+    }
+}
+
 HashDB::HashDB(const DBConf &conf,
                const std::string &data_dir,
                int id,
-               int initialize_size,
+               int64_t initialize_size,
                BackgroundWorkQueue *work_queue)
-    : hash_map_(initialize_size)
+    : hash_map_(NewMemTable(conf, initialize_size))
     , db_dir_(data_dir)
     , id_(id)
     , memory_limit_(conf.memory_limit)
+    , eviction_(conf.memory_limit > 0 ? conf.eviction : EVICT_NONE)
+    , num_evicted_(0)
     , persistent_(conf.persistent)
+    , log_fsync_(conf.log_fsync)
     , is_saving_(false)
+    , freezing_(false)
+    , num_writing_(0)
     , work_queue_(DCHECK_NOTNULL(work_queue)) {
 
     // db dir: data_dir/db-<id>/
     db_dir_.Append(yuki::Strings::Format("db-%d", id_));
+
+    if (eviction_ != EVICT_NONE && conf.type != DB_HASH) {
+        LOG(WARNING) << "db-" << id_ << ": memory_limit only be held by "
+                     << "hash db, ignored.";
+        eviction_ = EVICT_NONE;
+    }
+    hash_map_->set_access_policy(eviction_);
 }
 
 HashDB::~HashDB() {
@@ -41,6 +76,8 @@ HashDB::~HashDB() {
         saving_thread_.join();
     }
 
+    delete hash_map_;
+
     delete log_;
 
     if (log_fd_ >= 0) {
@@ -105,18 +142,33 @@ yuki::Status HashDB::Open() {
         PLOG(ERROR) << "open " << log_path.Get() << " fail";
         return Status::Systemf("open %s fail", log_path.Get().c_str());
     }
-    log_ = new BinLogWriter(NewPosixFileOutputStream(log_fd_), true, 512,
-                            origin_size);
+    // Drop the torn record in the end, the new ones follow the last good one.
+    if (!is_new && ftruncate(log_fd_, origin_size) != 0) {
+        PLOG(ERROR) << "truncate " << log_path.Get() << " fail";
+        return Status::Systemf("truncate %s fail", log_path.Get().c_str());
+    }
+    log_ = new GroupCommitLog(log_fd_, log_fsync_, origin_size);
     return Status::OK();
 }
 
 yuki::Status HashDB::Checkpoint(bool force) {
+    using yuki::Status;
+
     if (!persistent_) {
-        return yuki::Status::Corruptionf("db do not need persistent");
+        return Status::Corruptionf("db do not need persistent");
     }
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    return DoCheckpoint(force);
+    if (!force && log_->written_bytes() < kLogSizeForCheckpoint) {
+        return Status::OK();
+    }
+
+    bool expected = false;
+    if (!is_saving_.compare_exchange_strong(expected, true)) {
+        return Status::Corruptionf("checkpoint in progress...");
+    }
+    auto rv = DoSave();
+    is_saving_.store(false);
+    return rv;
 }
 
 yuki::Status
@@ -128,61 +180,259 @@ HashDB::AppendLog(int code, int64_t version,
         return Status::OK();
     }
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    auto rv = log_->Append(static_cast<CmdCode>(code), version, args);
+    int64_t lsn;
+    auto rv = log_->Append(static_cast<CmdCode>(code), version, args, &lsn);
     if (rv.Failed()) {
         LOG(ERROR) << "write log error: " << rv.ToString();
         return rv;
     }
-    work_queue_->PostSyncFile(log_fd_);
 
-    if (is_saving_.load() || log_->written_bytes() < kLogSizeForCheckpoint) {
-        return Status::OK();
+    bool expected = false;
+    if (log_->written_bytes() >= kLogSizeForCheckpoint &&
+        is_saving_.compare_exchange_strong(expected, true)) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (saving_thread_.joinable()) {
+            saving_thread_.join();
+        }
+        saving_thread_ = std::move(std::thread([this]() {
+            auto jiffies = Server::current_milsces();
+            auto status = DoSave();
+            if (status.Failed()) {
+                LOG(ERROR) << "save table fail. " << status.ToString();
+            }
+            LOG(INFO) << "save done, cost: "
+                      << Server::current_milsces() - jiffies << " ms";
+
+            Epoch::Quiescent();
+            is_saving_.store(false);
+        }));
     }
 
-    if (saving_thread_.joinable()) {
-        saving_thread_.join();
+    // Reply after the batch of this record be durable.
+    rv = log_->Sync(lsn);
+    if (rv.Failed()) {
+        LOG(ERROR) << "sync log error: " << rv.ToString();
     }
-    saving_thread_ = std::move(std::thread([&]() {
-        is_saving_.store(true);
+    return rv;
+}
 
-        auto jiffies = Server::current_milsces();
-        auto status = DoSave();
-        if (status.Failed()) {
-            LOG(ERROR) << "save table fail. " << status.ToString();
-        }
-        LOG(INFO) << "save done, cost: " << Server::current_milsces() - jiffies
-                  << " ms";
+Iterator *HashDB::iterator() {
+    return hash_map_->iterator();
+}
 
-        is_saving_.store(false);
-    }));
-    return Status::OK();
+uint64_t HashDB::Scan(uint64_t cursor, int64_t count,
+                      std::function<void (KeyBoundle *, Obj *)> proc) {
+    return hash_map_->Scan(cursor, count, std::move(proc));
 }
 
-Iterator *HashDB::iterator() {
-    return hash_map_.iterator();
+int64_t HashDB::num_keys() const {
+    return hash_map_->num_keys();
 }
 
-int HashDB::num_keys() const {
-    return hash_map_.num_keys();
+bool HashDB::ordered() const {
+    return hash_map_->ordered();
 }
 
 yuki::Status HashDB::Put(yuki::SliceRef key, uint64_t version_number,
                          Obj *value) {
     using yuki::Status;
 
-    return hash_map_.Put(key, version_number, value);
+    auto rv = hash_map_->Put(key, version_number, value);
+    if (rv.Ok()) {
+        EvictIfNeed(MAX_EVICTIONS_PER_WRITE);
+    }
+    return rv;
+}
+
+void HashDB::Reserve(int64_t num_keys) {
+    hash_map_->Reserve(num_keys);
+}
+
+yuki::Status HashDB::BulkPut(yuki::SliceRef key, const Version &version,
+                             Obj *value) {
+    if (eviction_ != EVICT_NONE) {
+        // Over the memory limit, keys be evicted in loading as well.
+        return DB::BulkPut(key, version, value);
+    }
+    return hash_map_->BulkPut(key, version, value);
+}
+
+yuki::Status HashDB::Update(yuki::SliceRef key, uint64_t version_number,
+                            std::function<Obj *(Obj *)> proc) {
+    auto rv = hash_map_->Update(key, version_number, std::move(proc));
+    if (rv.Ok()) {
+        EvictIfNeed(MAX_EVICTIONS_PER_WRITE);
+    }
+    return rv;
 }
 
 bool HashDB::Delete(yuki::SliceRef key) {
-    return hash_map_.Delete(key);
+    return hash_map_->Delete(key);
+}
+
+void HashDB::RecountUsage(yuki::SliceRef key) {
+    hash_map_->RecountUsage(key);
+    EvictIfNeed(MAX_EVICTIONS_PER_WRITE);
 }
 
 yuki::Status HashDB::Get(yuki::SliceRef key, Version *ver,
                  Obj **value) {
     using yuki::Status;
 
-    return hash_map_.Get(key, ver, value);
+    return hash_map_->Get(key, ver, value);
+}
+
+size_t HashDB::MultiGet(size_t n, const yuki::Slice *keys, Obj **values) {
+    return hash_map_->MultiGet(n, keys, values);
+}
+
+void HashDB::BeginWrite() {
+    if (!persistent_) {
+        return;
+    }
+
+    for (;;) {
+        while (freezing_.load()) {
+            std::this_thread::yield();
+        }
+        num_writing_.fetch_add(1);
+        if (!freezing_.load()) {
+            return;
+        }
+        // The snapshot came first, let it go.
+        num_writing_.fetch_sub(1);
+    }
+}
+
+void HashDB::EndWrite() {
+    if (persistent_) {
+        num_writing_.fetch_sub(1);
+    }
+}
+
+void HashDB::Cron(int64_t budget_milsces) {
+    // Resizing and evicting be held by snapshots, as other writers.
+    WriteScope scope(this);
+    auto deadline = Server::current_milsces() + budget_milsces;
+
+    while (hash_map_->IncrementalRehash(100)) {
+        if (Server::current_milsces() >= deadline) {
+            break;
+        }
+    }
+
+    // Go on evicting, if writers left the limit exceeded.
+    while (!EvictIfNeed(MAX_EVICTIONS_PER_WRITE)) {
+        if (Server::current_milsces() >= deadline) {
+            break;
+        }
+    }
+}
+
+bool HashDB::Expire(yuki::SliceRef key, int64_t expire_at) {
+    return hash_map_->Expire(key, expire_at);
+}
+
+yuki::Status HashDB::PutExpire(yuki::SliceRef key, int64_t expire_at,
+                               Obj *value) {
+    auto rv = hash_map_->PutExpire(key, expire_at, value);
+    if (rv.Ok()) {
+        EvictIfNeed(MAX_EVICTIONS_PER_WRITE);
+    }
+    return rv;
+}
+
+void HashDB::ActiveExpire(int64_t budget_milsces) {
+    if (hash_map_->num_expires() == 0) {
+        return;
+    }
+
+    // Workers take turns, the others just skip it.
+    std::unique_lock<std::mutex> lock(expire_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return;
+    }
+
+    WriteScope scope(this);
+    auto deadline = Server::current_milsces() + budget_milsces;
+    std::vector<std::string> expired;
+    do {
+        auto now = WallMilsces();
+        expire_cursor_ = hash_map_->Scan(expire_cursor_, EXPIRE_SCAN_STEP,
+                                         [&] (KeyBoundle *key, Obj *) {
+            if (key->version().expired(now)) {
+                expired.emplace_back(key->key().ToString());
+            }
+        });
+
+        // Delete them out of the scanning, it holds the slot lock.
+        for (const auto &key : expired) {
+            hash_map_->DeleteExpired(yuki::Slice(key), now);
+        }
+        expired.clear();
+    } while (expire_cursor_ != 0 && Server::current_milsces() < deadline);
+}
+
+bool HashDB::EvictIfNeed(int max_keys) {
+    if (eviction_ == EVICT_NONE || hash_map_->memory_usage() <= memory_limit_) {
+        return true;
+    }
+
+    // Only one thread evicts, the others go on writing.
+    std::unique_lock<std::mutex> lock(eviction_mutex_, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return false;
+    }
+
+    std::string key;
+    for (int i = 0; i < max_keys; i++) {
+        if (hash_map_->memory_usage() <= memory_limit_) {
+            return true;
+        }
+        if (!NextEvictionKey(&key)) {
+            break; // no key can be evicted.
+        }
+        Handle<Obj> value;
+        if (hash_map_->Get(yuki::Slice(key), nullptr,
+                           value.address()).Failed()) {
+            continue; // deleted by others after sampled.
+        }
+
+        // Logged before deleted as other writers, so a writer logged after
+        // the DEL never be dropped by the redo. Evicted keys can not come
+        // back after redo, so never evict one can not be logged.
+        if (log_) {
+            std::vector<Handle<Obj>> args;
+            args.emplace_back(String::New(yuki::Slice(key)));
+            if (!args[0].get() || AppendLog(CMD_DEL, 0, args).Failed()) {
+                break;
+            }
+        }
+        // Kept if written by others after read, the writer wins.
+        if (hash_map_->DeleteValue(yuki::Slice(key), value.get())) {
+            num_evicted_.fetch_add(1);
+        }
+    }
+    return hash_map_->memory_usage() <= memory_limit_;
+}
+
+// Must be called under eviction_mutex_.
+bool HashDB::NextEvictionKey(std::string *key) {
+    if (eviction_ == EVICT_RANDOM) {
+        bool found = false;
+        hash_map_->Sample(1, [&] (KeyBoundle *k, uint32_t) {
+            if (!found) {
+                key->assign(k->key().Data(), k->key().Length());
+                found = true;
+            }
+        });
+        return found;
+    }
+
+    hash_map_->Sample(EVICTION_SAMPLES, [this] (KeyBoundle *k, uint32_t clock) {
+        eviction_pool_.Insert(k->key(), AccessClock::Idle(eviction_, clock));
+    });
+    return eviction_pool_.Pop(key);
 }
 
 yuki::Status HashDB::DoOpen(size_t *be_read) {
@@ -227,100 +477,114 @@ yuki::Status HashDB::DoOpen(size_t *be_read) {
         }
     }
 
-    FilePath log_path(db_dir_);
-    log_path.Append(yuki::Strings::Format("log-%d", version));
-    rv = DBRedo(yuki::Slice(log_path.Get()), this, be_read);
-    if (rv.Failed()) {
-        LOG(ERROR) << "redo fail, from file: " << log_path.Get();
-        return rv;
+    // The log be cut before its table dumped, so logs after the MANIFEST
+    // version be left if the last saving not finished.
+    for (;;) {
+        FilePath log_path(db_dir_);
+        log_path.Append(yuki::Strings::Format("log-%d", version));
+        rv = DBRedo(yuki::Slice(log_path.Get()), this, be_read);
+        if (rv.Failed()) {
+            LOG(ERROR) << "redo fail, from file: " << log_path.Get();
+            return rv;
+        }
+
+        FilePath next_path(db_dir_);
+        next_path.Append(yuki::Strings::Format("log-%d", version + 1));
+        rv = next_path.Exist(&exist);
+        if (rv.Failed() || !exist) {
+            break;
+        }
+        version++;
     }
 
     version_ = version;
     return Status::OK();
 }
 
-yuki::Status HashDB::DoCheckpoint(bool force) {
+// The snapshot be taken by fork(), pages of the frozen image be copied on
+// write by the kernel, so writers only wait for the forking. The new log
+// starts at the same point, so table-N and log-N make the db exactly.
+yuki::Status HashDB::DoSave() {
     using yuki::Status;
-    using yuki::Slice;
-    using yuki::Strings;
-
-    // 10mb
-    if (is_saving_.load()) {
-        return Status::Corruptionf("checkpoint in progress...");
-    }
-    if (!force && log_->written_bytes() < kLogSizeForCheckpoint) {
-        return Status::OK();
-    }
-    is_saving_.store(true);
 
+    mutex_.lock();
     auto new_version = version_ + 1;
-    auto rv = SaveTable(new_version);
-    if (rv.Failed()) {
-        is_saving_.store(false);
-        return rv;
-    }
+    mutex_.unlock();
 
-    rv = CreateLogFile(new_version, &log_fd_);
-    log_->Reset(NewPosixFileOutputStream(log_fd_));
-    version_ = new_version;
+    yuki::FilePath table_path(db_dir_);
+    table_path.Append(yuki::Strings::Format("table-%d", new_version));
 
-    if (rv.Failed()) {
-        is_saving_.store(false);
-        return rv;
+    // Open it before forking, the child should not log anything.
+    TableOptions options;
+    options.file_name = yuki::Slice(table_path.Get());
+    options.fd = open(table_path.Get().c_str(), O_CREAT|O_TRUNC|O_WRONLY,
+                      0644);
+    if (options.fd < 0) {
+        PLOG(ERROR) << "can not open table file: " << table_path.Get();
+        return Status::Systemf("can not open table file: %s",
+                               table_path.Get().c_str());
     }
 
-    rv = SaveVersion();
-    is_saving_.store(false);
-    return rv;
-}
-
-yuki::Status HashDB::DoSave() {
-    using yuki::Status;
-    using yuki::Slice;
-    using yuki::Strings;
+    // Wait for writes in flight, and hold the new ones.
+    freezing_.store(true);
+    while (num_writing_.load() > 0) {
+        std::this_thread::yield();
+    }
 
-    // 10mb
     mutex_.lock();
-    auto new_version = version_ + 1;
+    auto rv = CreateLogFile(new_version, &log_fd_);
+    if (rv.Ok()) {
+        version_ = new_version;
+    }
     mutex_.unlock();
-
-    auto rv = SaveTable(new_version);
     if (rv.Failed()) {
+        freezing_.store(false);
+        work_queue_->PostCloseFile(options.fd);
         return rv;
     }
 
-    mutex_.lock();
-    rv = CreateLogFile(new_version, &log_fd_);
-    log_->Reset(NewPosixFileOutputStream(log_fd_));
-    version_ = new_version;
-    mutex_.unlock();
+    auto pid = fork();
+    if (pid == 0) {
+        // Only this thread in the child, no one can change the image.
+        rv = DumpTable(&options, this);
+        if (rv.Ok() && fsync(options.fd) != 0) {
+            _exit(1);
+        }
+        _exit(rv.Ok() ? 0 : 1);
+    }
 
+    if (pid < 0) {
+        PLOG(WARNING) << "fork fail, save table with writers held.";
+        rv = DumpTable(&options, this);
+        freezing_.store(false);
+    } else {
+        freezing_.store(false);
+        rv = WaitForSnapshot(pid);
+    }
+    work_queue_->PostCloseFile(options.fd);
     if (rv.Failed()) {
+        LOG(ERROR) << "save table fail" << rv.ToString();
         return rv;
     }
 
+    std::unique_lock<std::mutex> lock(mutex_);
     return SaveVersion();
 }
 
-yuki::Status HashDB::SaveTable(int version) {
+yuki::Status HashDB::WaitForSnapshot(int pid) {
     using yuki::Status;
-    using yuki::Slice;
-    using yuki::Strings;
-
-    yuki::FilePath table_path(db_dir_);
-    table_path.Append(yuki::Strings::Format("table-%d", version));
 
-    TableOptions options;
-    options.file_name = Slice(table_path.Get());
-    options.overwrite = false;
-
-    auto rv = DumpTable(&options, this);
-    if (rv.Failed()) {
-        LOG(ERROR) << "save table fail" << rv.ToString();
-        return rv;
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) {
+            PLOG(ERROR) << "wait for snapshot process fail.";
+            return Status::Systemf("wait for snapshot process %d fail", pid);
+        }
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return Status::Corruptionf("snapshot process %d fail, status: %d",
+                                   pid, status);
     }
-    work_queue_->PostCloseFile(options.fd);
-
     return Status::OK();
 }
 
@@ -332,14 +596,15 @@ yuki::Status HashDB::CreateLogFile(int version, int *fd) {
     yuki::FilePath log_path(db_dir_);
     log_path.Append(yuki::Strings::Format("log-%d", version));
 
-    work_queue_->PostCloseFile(log_fd_);
-
-    *fd = open(log_path.Get().c_str(), O_CREAT|O_WRONLY|O_APPEND, 0664);
-    if (*fd < 0) {
+    int new_fd = open(log_path.Get().c_str(), O_CREAT|O_WRONLY|O_APPEND, 0664);
+    if (new_fd < 0) {
         PLOG(ERROR) << "create log file fail.";
         return Status::Systemf("open %s fail", log_path.Get().c_str());
     }
 
+    // Switch the log first, the old file be closed after all written.
+    work_queue_->PostCloseFile(log_->Rotate(new_fd));
+    *fd = new_fd;
     return Status::OK();
 }
 
@@ -2,7 +2,8 @@
 #define YUKINO_HASH_DB_H_
 
 #include "db.h"
-#include "cocurrent_hash_map.h"
+#include "group_commit_log.h"
+#include "mem_table.h"
 #include "yuki/file_path.h"
 #include <atomic>
 #include <string>
@@ -12,15 +13,18 @@
 namespace yukino {
 
 class BackgroundWorkQueue;
-class BinLogWriter;
 struct DBConf;
 
+//
+// DB on a MemTable, with the WAL and table files. The MemTable be one of
+// the hash maps, or the skip list for DB_ORDER.
+//
 class HashDB : public DB {
 public:
     HashDB(const DBConf &conf,
            const std::string &data_dir,
            int id,
-           int initialize_size,
+           int64_t initialize_size,
            BackgroundWorkQueue *work_queue);
     virtual ~HashDB() override;
 
@@ -30,29 +34,74 @@ public:
     AppendLog(int code, int64_t version,
               const std::vector<Handle<Obj>> &args) override;
     virtual Iterator *iterator() override;
-    virtual int num_keys() const override;
+    virtual uint64_t
+    Scan(uint64_t cursor, int64_t count,
+         std::function<void (KeyBoundle *, Obj *)> proc) override;
+    virtual int64_t num_keys() const override;
+    virtual bool ordered() const override;
     virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
                              Obj *value) override;
+    virtual void Reserve(int64_t num_keys) override;
+    virtual yuki::Status BulkPut(yuki::SliceRef key, const Version &version,
+                                 Obj *value) override;
     virtual bool Delete(yuki::SliceRef key) override;
+    virtual void RecountUsage(yuki::SliceRef key) override;
+    virtual yuki::Status Update(yuki::SliceRef key, uint64_t version_number,
+                                std::function<Obj *(Obj *)> proc) override;
     virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
                              Obj **value) override;
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys,
+                            Obj **values) override;
+    virtual void BeginWrite() override;
+    virtual void EndWrite() override;
+    virtual void Cron(int64_t budget_milsces) override;
+    virtual bool expirable() const override { return hash_map_->expirable(); }
+    virtual bool Expire(yuki::SliceRef key, int64_t expire_at) override;
+    virtual yuki::Status PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                   Obj *value) override;
+    virtual void ActiveExpire(int64_t budget_milsces) override;
+
+    int64_t memory_usage() const { return hash_map_->memory_usage(); }
+    int64_t num_expires() const { return hash_map_->num_expires(); }
+    int64_t num_evicted() const { return num_evicted_.load(); }
+
+    // Evict at most `max_keys' keys for every write over the memory limit,
+    // so the limit holds without long pauses.
+    enum { MAX_EVICTIONS_PER_WRITE = 16, EVICTION_SAMPLES = 5 };
+
+    // Keys be checked in every step of the active expiring.
+    enum { EXPIRE_SCAN_STEP = 20 };
+
 private:
+    // Return false if the memory usage still over the limit. Must be called
+    // between BeginWrite() and EndWrite(), evicted keys be logged as DEL.
+    bool EvictIfNeed(int max_keys);
+    bool NextEvictionKey(std::string *key);
+
     yuki::Status DoOpen(size_t *be_read);
-    yuki::Status DoCheckpoint(bool force);
     yuki::Status DoSave();
-    yuki::Status SaveTable(int version);
+    yuki::Status WaitForSnapshot(int pid);
     yuki::Status CreateLogFile(int version, int *fd);
     yuki::Status SaveVersion();
 
-    CocurrentHashMap hash_map_;
+    MemTable *hash_map_;
     yuki::FilePath db_dir_;
-    size_t memory_limit_;
+    int64_t memory_limit_;
+    EvictionPolicy eviction_;
+    EvictionPool eviction_pool_; // under eviction_mutex_
+    std::mutex eviction_mutex_;
+    std::atomic<int64_t> num_evicted_;
+    uint64_t expire_cursor_ = 0; // under expire_mutex_
+    std::mutex expire_mutex_;
     bool persistent_;
     int id_;
-    BinLogWriter *log_ = nullptr;
+    FsyncPolicy log_fsync_;
+    GroupCommitLog *log_ = nullptr;
     int log_fd_ = -1;
     int version_ = 0;
     std::atomic<bool> is_saving_;
+    std::atomic<bool> freezing_;    // writers wait, the snapshot be taking.
+    std::atomic<int> num_writing_;  // writers between BeginWrite/EndWrite.
     std::mutex mutex_;
     BackgroundWorkQueue *work_queue_;
     std::thread saving_thread_;
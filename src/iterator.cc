@@ -1,4 +1,5 @@
 #include "iterator.h"
+#include "key.h"
 
 namespace yukino {
 
@@ -8,4 +9,12 @@ Iterator::Iterator() {
 Iterator::~Iterator() {
 }
 
+void Iterator::Seek(yuki::SliceRef target) {
+    for (SeekToFirst(); Valid(); Next()) {
+        if (key()->key().Compare(target) >= 0) {
+            break;
+        }
+    }
+}
+
 } // namespace yukino
\ No newline at end of file
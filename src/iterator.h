@@ -1,6 +1,7 @@
 #ifndef YUKINO_ITERATOR_H_
 #define YUKINO_ITERATOR_H_
 
+#include "yuki/slice.h"
 #include "yuki/status.h"
 
 namespace yukino {
@@ -21,6 +22,10 @@ public:
 
     virtual void SeekToFirst() = 0;
 
+    // Seek to the first key >= target. Only the ordered iterators jump to
+    // it directly, the default one walks from the first key.
+    virtual void Seek(yuki::SliceRef target);
+
     virtual void Next() = 0;
 
     virtual yuki::Status status() const = 0;
@@ -1,8 +1,18 @@
 #include "key.h"
 #include "glog/logging.h"
+#include <sys/time.h>
 
 namespace yukino {
 
+int64_t WallMilsces() {
+    struct timeval tv;
+    if (::gettimeofday(&tv, nullptr) != 0) {
+        PLOG(ERROR) << "can not get time!";
+        return 0;
+    }
+    return tv.tv_sec * 1000LL + tv.tv_usec / 1000LL;
+}
+
 Version KeyBoundle::version() const {
     auto key_slice = key();
 
@@ -8,11 +8,23 @@
 
 namespace yukino {
 
+enum VersionType {
+    VERSION_PLAIN  = 0, // number: milliseconds of the last writing.
+    VERSION_EXPIRE = 1, // number: milliseconds the key expires at.
+};
+
 struct Version {
     uint64_t type  :  8;
     uint64_t number: 56;
+
+    bool expired(int64_t now) const {
+        return type == VERSION_EXPIRE && static_cast<int64_t>(number) <= now;
+    }
 };
 
+// Milliseconds of the wall clock, the time base of expiring.
+int64_t WallMilsces();
+
 //
 // Key Boundle:
 // [key-length(varint32)][key bytes][version(varint32)]
@@ -0,0 +1,89 @@
+#include "list_pack.h"
+#include "handle.h"
+#include "obj.h"
+#include "gtest/gtest.h"
+#include <string>
+
+namespace yukino {
+
+TEST(ListPackTest, Sanity) {
+    ListPack pack;
+    EXPECT_EQ(0, pack.size());
+    EXPECT_EQ(pack.begin(), pack.end());
+
+    Handle<Obj> name(String::New(yuki::Slice("Jake")));
+    Handle<Obj> age(Integer::New(-100));
+    pack.PushTail(name.get());
+    pack.PushTail(age.get());
+    pack.PushHead(age.get());
+    EXPECT_EQ(3, pack.size());
+
+    auto offset = pack.begin();
+    Handle<Obj> value(pack.Get(offset));
+    ASSERT_EQ(YKN_INTEGER, value->type());
+    EXPECT_EQ(-100, static_cast<Integer *>(value.get())->data());
+
+    offset = pack.Next(offset);
+    EXPECT_TRUE(pack.Equals(offset, yuki::Slice("Jake")));
+    EXPECT_FALSE(pack.Equals(offset, yuki::Slice("Jak")));
+    EXPECT_FALSE(pack.Equals(pack.begin(), yuki::Slice("Jake")));
+    value = pack.Get(offset);
+    ASSERT_EQ(YKN_STRING, value->type());
+    EXPECT_EQ("Jake", static_cast<String *>(value.get())->data().ToString());
+
+    EXPECT_EQ(pack.Next(offset), pack.Last());
+    EXPECT_EQ(pack.end(), pack.Next(pack.Last()));
+}
+
+TEST(ListPackTest, EraseAndReplace) {
+    ListPack pack;
+    for (int i = 0; i < 10; i++) {
+        Handle<Obj> value(Integer::New(i * 1000));
+        pack.PushTail(value.get());
+    }
+
+    // Erase odd ones.
+    auto offset = pack.begin();
+    while (offset < pack.end()) {
+        offset = pack.Next(offset);
+        if (offset < pack.end()) {
+            pack.Erase(offset);
+        }
+    }
+    EXPECT_EQ(5, pack.size());
+
+    Handle<Obj> large(String::New(yuki::Slice(
+        std::string(ListPack::MAX_STRING_SIZE, 'x'))));
+    ASSERT_TRUE(ListPack::Packable(large.get()));
+    pack.Replace(pack.begin(), large.get());
+    EXPECT_EQ(5, pack.size());
+
+    Handle<Obj> value(pack.Get(pack.begin()));
+    EXPECT_EQ(ListPack::MAX_STRING_SIZE,
+              static_cast<String *>(value.get())->size());
+
+    int i = 1;
+    for (offset = pack.Next(pack.begin()); offset < pack.end();
+         offset = pack.Next(offset)) {
+        value = pack.Get(offset);
+        EXPECT_EQ(i * 2000, static_cast<Integer *>(value.get())->data());
+        i++;
+    }
+    EXPECT_EQ(5, i);
+
+    pack.Clear();
+    EXPECT_EQ(0, pack.size());
+    EXPECT_EQ(0, pack.bytes());
+}
+
+TEST(ListPackTest, Packable) {
+    std::string s(ListPack::MAX_STRING_SIZE + 1, 'x');
+    Handle<Obj> large(String::New(yuki::Slice(s)));
+    EXPECT_FALSE(ListPack::Packable(large.get()));
+    EXPECT_FALSE(ListPack::Packable(yuki::Slice(s)));
+
+    Handle<Obj> list(List::New());
+    EXPECT_FALSE(ListPack::Packable(list.get()));
+}
+
+} // namespace yukino
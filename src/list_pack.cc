@@ -0,0 +1,118 @@
+#include "list_pack.h"
+#include "obj.h"
+#include "yuki/varint.h"
+#include "glog/logging.h"
+#include <string.h>
+
+namespace yukino {
+
+namespace {
+
+// Encode the entry to `buf', at most 1 + kMax64Len + MAX_STRING_SIZE bytes.
+size_t EncodeEntry(const Obj *value, char *buf) {
+    auto p = buf;
+    if (value->type() == YKN_INTEGER) {
+        *p++ = ListPack::PACK_INTEGER;
+        p += yuki::Varint::EncodeS64(static_cast<const Integer *>(value)->data(),
+                                     p);
+    } else {
+        auto s = static_cast<const String *>(value)->data();
+        *p++ = ListPack::PACK_STRING;
+        p += yuki::Varint::Encode32(static_cast<uint32_t>(s.Length()), p);
+        memcpy(p, s.Data(), s.Length());
+        p += s.Length();
+    }
+    return p - buf;
+}
+
+} // namespace
+
+/*static*/ bool ListPack::Packable(const Obj *value) {
+    switch (value->type()) {
+        case YKN_INTEGER:
+            return true;
+        case YKN_STRING:
+            return static_cast<const String *>(value)->size() <=
+                   MAX_STRING_SIZE;
+        default:
+            return false;
+    }
+}
+
+size_t ListPack::Insert(size_t offset, const Obj *value) {
+    DCHECK(Packable(value));
+    char buf[1 + yuki::Varint::kMax64Len + MAX_STRING_SIZE];
+    auto size = EncodeEntry(value, buf);
+    buf_.insert(offset, buf, size);
+    num_entries_++;
+    return offset + size;
+}
+
+size_t ListPack::Insert(size_t offset, yuki::SliceRef s) {
+    DCHECK(Packable(s));
+    char buf[1 + yuki::Varint::kMax32Len + MAX_STRING_SIZE];
+    auto p = buf;
+    *p++ = PACK_STRING;
+    p += yuki::Varint::Encode32(static_cast<uint32_t>(s.Length()), p);
+    memcpy(p, s.Data(), s.Length());
+    p += s.Length();
+    buf_.insert(offset, buf, p - buf);
+    num_entries_++;
+    return offset + (p - buf);
+}
+
+void ListPack::Erase(size_t offset) {
+    buf_.erase(offset, Next(offset) - offset);
+    num_entries_--;
+}
+
+void ListPack::Replace(size_t offset, const Obj *value) {
+    DCHECK(Packable(value));
+    char buf[1 + yuki::Varint::kMax64Len + MAX_STRING_SIZE];
+    auto size = EncodeEntry(value, buf);
+    buf_.replace(offset, Next(offset) - offset, buf, size);
+}
+
+Obj *ListPack::Get(size_t offset) const {
+    DCHECK_LT(offset, buf_.size());
+    auto p = buf_.data() + offset;
+    size_t len;
+    if (*p == PACK_INTEGER) {
+        return Integer::New(yuki::Varint::DecodeS64(p + 1, &len));
+    }
+    auto size = yuki::Varint::Decode32(p + 1, &len);
+    return String::New(yuki::Slice(p + 1 + len, size));
+}
+
+bool ListPack::Equals(size_t offset, yuki::SliceRef s) const {
+    auto p = buf_.data() + offset;
+    if (*p != PACK_STRING) {
+        return false;
+    }
+    size_t len;
+    auto size = yuki::Varint::Decode32(p + 1, &len);
+    return yuki::Slice(p + 1 + len, size).Compare(s) == 0;
+}
+
+size_t ListPack::Next(size_t offset) const {
+    DCHECK_LT(offset, buf_.size());
+    auto p = buf_.data() + offset;
+    size_t len;
+    if (*p == PACK_INTEGER) {
+        yuki::Varint::DecodeS64(p + 1, &len);
+        return offset + 1 + len;
+    }
+    auto size = yuki::Varint::Decode32(p + 1, &len);
+    return offset + 1 + len + size;
+}
+
+size_t ListPack::Last() const {
+    DCHECK_GT(num_entries_, 0);
+    size_t offset = 0;
+    for (auto next = Next(offset); next < end(); next = Next(next)) {
+        offset = next;
+    }
+    return offset;
+}
+
+} // namespace yukino
@@ -0,0 +1,79 @@
+#ifndef YUKINO_LIST_PACK_H_
+#define YUKINO_LIST_PACK_H_
+
+#include "yuki/slice.h"
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace yukino {
+
+struct Obj;
+
+//
+// Small strings and integers packed in one buffer, no Obj for elements:
+// entry := [PACK_STRING] [length(varint32)] [bytes]
+//        | [PACK_INTEGER] [zigzag(varint64)]
+// Entries be addressed by offsets of the buffer, walked from the begin.
+// Not thread-safe, the owner locks it.
+//
+class ListPack {
+public:
+    enum : uint8_t {
+        PACK_STRING,
+        PACK_INTEGER,
+    };
+
+    // Strings longer than it be not packed.
+    enum { MAX_STRING_SIZE = 64 };
+
+    ListPack() : num_entries_(0) {}
+
+    // Only small String and Integer can be packed.
+    static bool Packable(const Obj *value);
+    static bool Packable(yuki::SliceRef s) {
+        return s.Length() <= MAX_STRING_SIZE;
+    }
+
+    // Insert before the entry at `offset', return the offset after it.
+    size_t Insert(size_t offset, const Obj *value);
+    size_t Insert(size_t offset, yuki::SliceRef s);
+
+    size_t PushHead(const Obj *value) { return Insert(0, value); }
+    size_t PushTail(const Obj *value) { return Insert(end(), value); }
+
+    // Erase the entry at `offset'.
+    void Erase(size_t offset);
+
+    // Replace the entry at `offset'.
+    void Replace(size_t offset, const Obj *value);
+
+    // Decode the entry as a new Obj (no reference), null if out of memory.
+    Obj *Get(size_t offset) const;
+
+    // Is the entry a string same as `s'?
+    bool Equals(size_t offset, yuki::SliceRef s) const;
+
+    size_t Next(size_t offset) const;
+    // O(n), from the begin.
+    size_t Last() const;
+
+    size_t begin() const { return 0; }
+    size_t end() const { return buf_.size(); }
+
+    size_t size() const { return num_entries_; }
+    size_t bytes() const { return buf_.size(); }
+
+    void Clear() {
+        std::string().swap(buf_);
+        num_entries_ = 0;
+    }
+
+private:
+    std::string buf_;
+    size_t num_entries_;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_LIST_PACK_H_
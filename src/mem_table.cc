@@ -0,0 +1,70 @@
+#include "mem_table.h"
+#include "iterator.h"
+#include "key.h"
+#include <memory>
+
+namespace yukino {
+
+MemTable::MemTable() {
+}
+
+MemTable::~MemTable() {
+}
+
+size_t MemTable::MultiGet(size_t n, const yuki::Slice *keys, Obj **values) {
+    size_t num_found = 0;
+    for (size_t i = 0; i < n; i++) {
+        values[i] = nullptr;
+        if (Get(keys[i], nullptr, &values[i]).Ok()) {
+            num_found++;
+        } else {
+            values[i] = nullptr;
+        }
+    }
+    return num_found;
+}
+
+uint64_t MemTable::Scan(uint64_t cursor, int64_t count,
+                        std::function<void (KeyBoundle *, Obj *)> proc) {
+    std::unique_ptr<Iterator> iter(iterator());
+
+    uint64_t i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+        if (i < cursor) {
+            continue;
+        }
+        if (i >= cursor + count) {
+            return i;
+        }
+        proc(iter->key(), iter->value());
+    }
+    return 0;
+}
+
+yuki::Status MemTable::BulkPut(yuki::SliceRef key, const Version &version,
+                               Obj *value) {
+    if (version.type != VERSION_EXPIRE) {
+        return Put(key, version.number, value);
+    }
+    auto rv = Put(key, 0, value);
+    if (rv.Ok()) {
+        Expire(key, static_cast<int64_t>(version.number));
+    }
+    return rv;
+}
+
+yuki::Status MemTable::PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                 Obj *value) {
+    auto rv = Put(key, 0, value);
+    if (rv.Ok()) {
+        Expire(key, expire_at);
+    }
+    return rv;
+}
+
+int64_t MemTable::Sample(int64_t /*n*/,
+                         std::function<void (KeyBoundle *, uint32_t)> /*proc*/) {
+    return 0;
+}
+
+} // namespace yukino
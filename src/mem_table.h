@@ -0,0 +1,133 @@
+#ifndef YUKINO_MEM_TABLE_H_
+#define YUKINO_MEM_TABLE_H_
+
+#include "eviction.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <functional>
+#include <stdint.h>
+
+namespace yukino {
+
+struct Obj;
+struct Version;
+struct KeyBoundle;
+class Iterator;
+
+//
+// The in-memory key-value map under a DB.
+//
+class MemTable {
+public:
+    MemTable();
+    MemTable(const MemTable &) = delete;
+    MemTable(MemTable &&) = delete;
+    void operator = (const MemTable &) = delete;
+
+    virtual ~MemTable();
+
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) = 0;
+
+    virtual bool Delete(yuki::SliceRef key) = 0;
+
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) = 0;
+
+    virtual yuki::Status
+    Exec(yuki::SliceRef key,
+         std::function<void (const Version &, Obj *)> proc) = 0;
+
+    // Replace the value by proc(old) under the lock of the key, so
+    // read-modify-write be atomic. `old' be null if the key not found, the
+    // new value be put then. Return null from proc() to keep it unchanged.
+    // Expiring time of the key be kept. `version_number' be the time of the
+    // command, the expiring be checked at it (0 for now), so the redo of a
+    // logged command sees the key as the command saw.
+    virtual yuki::Status
+    Update(yuki::SliceRef key, uint64_t version_number,
+           std::function<Obj *(Obj *)> proc) = 0;
+
+    // Look up `n' keys in batch. values[i] be null if keys[i] not found,
+    // otherwise it holds a reference. Return number of found keys.
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys, Obj **values);
+
+    virtual Iterator *iterator() = 0;
+
+    // Stateless cursor scan: visit about `count' keys from `cursor' (0 for
+    // the first call), return the cursor to continue, or 0 at the end.
+    // The default one counts by position of the iterator, keys may be
+    // missed if others be deleted between calls.
+    virtual uint64_t Scan(uint64_t cursor, int64_t count,
+                          std::function<void (KeyBoundle *, Obj *)> proc);
+
+    // Set the expiring time of the key, in milliseconds of the wall clock,
+    // 0 to persist it. Return false if the key not found, or the table can
+    // not expire keys. Expired keys be not found any more.
+    virtual bool Expire(yuki::SliceRef /*key*/, int64_t /*expire_at*/) {
+        return false;
+    }
+
+    // Put the value with the expiring time (`expire_at' > 0) in one entry,
+    // so no one sees it persistent. The default one be Put() then Expire().
+    virtual yuki::Status PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                   Obj *value);
+
+    // Delete the key only if it expired at `now'.
+    virtual bool DeleteExpired(yuki::SliceRef /*key*/, int64_t /*now*/) {
+        return false;
+    }
+
+    // Delete the key only if it still holds `value', so the writers came
+    // after `value' be read win.
+    virtual bool DeleteValue(yuki::SliceRef /*key*/, Obj * /*value*/) {
+        return false;
+    }
+
+    // Number of keys with the expiring time.
+    virtual int64_t num_expires() const { return 0; }
+
+    virtual bool expirable() const { return false; }
+
+    // Move at most `num_steps' buckets for an in-progress resizing.
+    // Return true if the resizing still in progress.
+    virtual bool IncrementalRehash(int num_steps) = 0;
+
+    virtual int64_t num_keys() const = 0;
+
+    // Make room for `num_keys' more keys in one time, so putting them later
+    // never resizes the table.
+    virtual void Reserve(int64_t /*num_keys*/) {}
+
+    // Put for loading tables, with the version of the key boundle. Can run
+    // with other BulkPut() callers and readers, but no other writers. The
+    // duplicated keys must have the same value, any one of them be kept.
+    virtual yuki::Status BulkPut(yuki::SliceRef key, const Version &version,
+                                 Obj *value);
+
+    // Approximate bytes of entries and values, 0 if it's not counted.
+    // Lists and hashes be changed in place, their elements be counted at
+    // the writing of the key, or by RecountUsage().
+    virtual int64_t memory_usage() const { return 0; }
+
+    // Count the elements of the key's list or hash again, after they be
+    // changed in place.
+    virtual void RecountUsage(yuki::SliceRef /*key*/) {}
+
+    // Keep the access clock of keys by `policy' from now on.
+    virtual void set_access_policy(EvictionPolicy /*policy*/) {}
+
+    // Visit about `n' keys picked randomly, with their access clock.
+    // Return number of visited keys, 0 if sampling not supported.
+    virtual int64_t Sample(int64_t n,
+                           std::function<void (KeyBoundle *, uint32_t)> proc);
+
+    // Is the iterator ordered by key?
+    virtual bool ordered() const { return false; }
+
+    bool Exist(yuki::SliceRef key) { return Get(key, nullptr, nullptr).Ok(); }
+}; // class MemTable
+
+} // namespace yukino
+
+#endif // YUKINO_MEM_TABLE_H_
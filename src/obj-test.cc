@@ -1,6 +1,12 @@
 #include "obj.h"
 #include "handle.h"
+#include "basic_io.h"
+#include "serialized_io.h"
 #include "gtest/gtest.h"
+#include <string>
+#include <thread>
+#include <atomic>
+#include <stdlib.h>
 
 namespace yukino {
 
@@ -16,13 +22,157 @@ TEST(ObjTest, HandleRefCounting) {
 }
 
 TEST(ObjTest, HandleAssign) {
-    Handle<Integer> obj(Integer::New(100));
+    static const int64_t kBase = Integer::NUM_SHARED;
+
+    Handle<Integer> obj(Integer::New(kBase + 100));
     EXPECT_EQ(1, obj.ref_count());
-    EXPECT_EQ(100, obj->data());
+    EXPECT_EQ(kBase + 100, obj->data());
 
-    obj = Integer::New(99);
+    obj = Integer::New(kBase + 99);
     EXPECT_EQ(1, obj.ref_count());
+    EXPECT_EQ(kBase + 99, obj->data());
+}
+
+TEST(ObjTest, SharedInteger) {
+    auto obj = Integer::New(99);
+    EXPECT_EQ(obj, Integer::New(99));
+    EXPECT_TRUE(obj->immortal());
     EXPECT_EQ(99, obj->data());
+
+    auto ref_count = obj->RefCount();
+    {
+        Handle<Integer> handle(obj);
+        EXPECT_EQ(ref_count, handle.ref_count());
+    }
+    ObjRelease(obj);
+    EXPECT_EQ(ref_count, obj->RefCount());
+    EXPECT_EQ(0, Integer::New(0)->data());
+    EXPECT_EQ(Integer::NUM_SHARED - 1, Integer::New(Integer::NUM_SHARED - 1)->data());
+
+    Handle<Integer> other(Integer::New(-1));
+    EXPECT_FALSE(other->immortal());
+    EXPECT_EQ(1, other.ref_count());
+}
+
+TEST(ObjTest, IntegerIf) {
+    static const struct {
+        const char *z;
+        bool integer;
+    } kCases[] = {
+        {"0", true},
+        {"42", true},
+        {"-42", true},
+        {"9223372036854775807", true},
+        {"-9223372036854775807", true},
+        {"9223372036854775808", false},
+        {"042", false},
+        {"-0", false},
+        {"+1", false},
+        {" 1", false},
+        {"1.5", false},
+        {"", false},
+        {"abc", false},
+    };
+
+    for (const auto &c : kCases) {
+        Handle<Obj> str(String::New(yuki::Slice(c.z)));
+        Handle<Obj> obj(ObjIntegerIf(str.get()));
+        if (c.integer) {
+            ASSERT_EQ(YKN_INTEGER, obj->type()) << c.z;
+            EXPECT_EQ(strtoll(c.z, nullptr, 10),
+                      static_cast<Integer *>(obj.get())->data());
+        } else {
+            EXPECT_EQ(str.get(), obj.get()) << c.z;
+        }
+    }
+
+    Handle<Obj> integer(Integer::New(-7));
+    EXPECT_EQ(integer.get(), ObjIntegerIf(integer.get()));
+}
+
+TEST(ObjTest, IncrBy) {
+    Handle<Obj> obj(ObjIncrBy(nullptr, 5));
+    ASSERT_EQ(YKN_INTEGER, obj->type());
+    EXPECT_EQ(5, static_cast<Integer *>(obj.get())->data());
+
+    obj = ObjIncrBy(obj.get(), -15);
+    EXPECT_EQ(-10, static_cast<Integer *>(obj.get())->data());
+
+    Handle<Obj> str(String::New(yuki::Slice("41")));
+    obj = ObjIncrBy(str.get(), 1);
+    EXPECT_EQ(42, static_cast<Integer *>(obj.get())->data());
+
+    str = String::New(yuki::Slice("x"));
+    EXPECT_EQ(nullptr, ObjIncrBy(str.get(), 1));
+
+    Handle<Obj> max(Integer::New(INT64_MAX));
+    EXPECT_EQ(nullptr, ObjIncrBy(max.get(), 1));
+    Handle<Obj> min(Integer::New(INT64_MIN + 1));
+    EXPECT_EQ(nullptr, ObjIncrBy(min.get(), -2));
+}
+
+TEST(ObjTest, HashSerialization) {
+    Handle<Hash> hash(Hash::New(Hash::DEFAULT_SIZE));
+    hash->stub()->Put(yuki::Slice("name"), String::New(yuki::Slice("Jake")));
+    hash->stub()->Put(yuki::Slice("age"), Integer::New(100));
+
+    std::string buf;
+    {
+        SerializedOutputStream serializer(NewBufferedOutputStream(&buf), true);
+        EXPECT_LT(0, ObjSerialize(hash.get(), &serializer));
+    }
+
+    SerializedInputStream deserializer(NewBufferedInputStream(yuki::Slice(buf)),
+                                       true);
+    Handle<Obj> obj(ObjDeserialize(&deserializer));
+    ASSERT_NE(nullptr, obj.get());
+    ASSERT_EQ(YKN_HASH, obj->type());
+
+    auto stub = static_cast<Hash *>(obj.get())->stub();
+    EXPECT_EQ(2, stub->num_keys());
+
+    Obj *value = nullptr;
+    ASSERT_TRUE(stub->Get(yuki::Slice("age"), &value).Ok());
+    ASSERT_EQ(YKN_INTEGER, value->type());
+    EXPECT_EQ(100, static_cast<Integer *>(value)->data());
+    ObjRelease(value);
+}
+
+TEST(ObjTest, HashSerializationWithWriter) {
+    Handle<Hash> hash(Hash::New(Hash::DEFAULT_SIZE));
+    std::atomic<bool> stop(false);
+    std::thread writer([&] () {
+        for (int i = 0; !stop.load(); i = (i + 1) % 1000) {
+            auto key = std::to_string(i);
+            if (i % 3 == 0) {
+                hash->stub()->Delete(yuki::Slice(key));
+            } else {
+                hash->stub()->Put(yuki::Slice(key), Integer::New(i));
+            }
+        }
+    });
+    while (hash->stub()->num_keys() < 100) {
+        std::this_thread::yield();
+    }
+
+    // The number of fields always matches the fields written.
+    for (int i = 0; i < 200; i++) {
+        std::string buf;
+        {
+            SerializedOutputStream serializer(NewBufferedOutputStream(&buf),
+                                              true);
+            EXPECT_EQ(buf.size(), ObjSerialize(hash.get(), &serializer));
+        }
+
+        SerializedInputStream deserializer(
+                NewBufferedInputStream(yuki::Slice(buf)), true);
+        Handle<Obj> obj(ObjDeserialize(&deserializer));
+        ASSERT_NE(nullptr, obj.get()) << i;
+        uint8_t byte;
+        EXPECT_FALSE(deserializer.ReadByte(&byte));
+    }
+    stop.store(true);
+    writer.join();
 }
 
 } // namespace yukino
\ No newline at end of file
@@ -4,9 +4,44 @@
 #include "iterator.h"
 #include "value_traits.h"
 #include "serialized_io.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 namespace yukino {
 
+namespace {
+
+class SharedIntegers {
+public:
+    enum { SLOT_SIZE = 16 };
+
+    SharedIntegers() {
+        for (int64_t i = 0; i < Integer::NUM_SHARED; i++) {
+            auto size = Integer::PredictSize(i);
+            DCHECK_LE(size, SLOT_SIZE);
+            auto ob = Integer::Build(i, &buf_[i * SLOT_SIZE], size);
+            ob->ref_count.store(Obj::IMMORTAL_REF_COUNT);
+        }
+    }
+
+    Integer *Get(int64_t i) {
+        return reinterpret_cast<Integer *>(&buf_[i * SLOT_SIZE]);
+    }
+
+private:
+    alignas(SLOT_SIZE) char buf_[Integer::NUM_SHARED * SLOT_SIZE];
+};
+
+} // namespace
+
+/*static*/ Integer *Integer::Shared(int64_t i) {
+    DCHECK(i >= 0 && i < NUM_SHARED);
+    static SharedIntegers shared;
+    return shared.Get(i);
+}
+
 void ObjRelease(Obj *ob) {
     if (!ob) {
         return;
@@ -22,6 +57,10 @@ void ObjRelease(Obj *ob) {
         static_cast<List *>(ob)->Release();
         break;
 
+    case YKN_HASH:
+        static_cast<Hash *>(ob)->Release();
+        break;
+
     default:
         DLOG(FATAL) << "noreached";
         break;
@@ -48,6 +87,49 @@ bool ObjCastIntIf(Obj *ob, int64_t *value) {
     return false;
 }
 
+Obj *ObjIntegerIf(Obj *ob) {
+    if (!ob || ob->type() != YKN_STRING) {
+        return ob;
+    }
+
+    // longest int number: -9223372036854775808
+    auto s = static_cast<String *>(ob)->data();
+    if (s.Empty() || s.Length() > sizeof("-9223372036854775808") - 1) {
+        return ob;
+    }
+    char z[sizeof("-9223372036854775808")];
+    memcpy(z, s.Data(), s.Length());
+    z[s.Length()] = '\0';
+
+    char *end = nullptr;
+    errno = 0;
+    auto value = strtoll(z, &end, 10);
+    if (errno != 0 || end != z + s.Length()) {
+        return ob;
+    }
+
+    // Must be the same after formatted back, so no "+1", "01" or "-0".
+    char buf[sizeof(z)];
+    snprintf(buf, sizeof(buf), "%lld", value);
+    if (strcmp(buf, z) != 0) {
+        return ob;
+    }
+    auto rv = Integer::New(static_cast<int64_t>(value));
+    return rv ? rv : ob;
+}
+
+Obj *ObjIncrBy(Obj *ob, int64_t delta) {
+    int64_t value = 0;
+    if (ob && !ObjCastIntIf(ob, &value)) {
+        return nullptr;
+    }
+    if ((delta > 0 && value > INT64_MAX - delta) ||
+        (delta < 0 && value < INT64_MIN - delta)) {
+        return nullptr;
+    }
+    return Integer::New(value + delta);
+}
+
 size_t ObjSerialize(Obj *ob, SerializedOutputStream *serializer) {
     auto size = serializer->WriteByte(ob->raw);
 
@@ -73,28 +155,33 @@ size_t ObjSerialize(Obj *ob, SerializedOutputStream *serializer) {
         case YKN_LIST: {
             auto list = static_cast<List *>(ob)->stub();
 
+            // The length be counted under the lock of iterator.
+            List::Stub::Iterator iter(list);
             uint32_t n = static_cast<uint32_t>(list->size());
             size += serializer->WriteInt32(n);
-            List::Stub::Iterator iter(list);
             for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
-                if (n-- == 0) {
-                    break;
-                }
-                size += ObjSerialize(ObjAddRef(iter.value()), serializer);
-                ObjRelease(iter.value());
+                size += ObjSerialize(iter.value(), serializer);
             }
         } break;
 
         case YKN_HASH: {
             auto hash = static_cast<Hash *>(ob)->stub();
 
-            std::unique_ptr<Iterator> iter(hash->iterator());
-            auto num = hash->num_keys();
-            size += serializer->WriteInt64(num);
-            for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-                size += serializer->WriteSlice(iter->key()->key());
-                size += ObjSerialize(iter->value(), serializer);
+            // Fields be counted and buffered in one visiting, so the number
+            // always matches the fields, then be written.
+            std::string buf;
+            uint64_t n = 0;
+            {
+                SerializedOutputStream fields(NewBufferedOutputStream(&buf),
+                                              true);
+                hash->ForEach([&](yuki::SliceRef key, Obj *value) {
+                    fields.WriteSlice(key);
+                    ObjSerialize(value, &fields);
+                    ++n;
+                });
             }
+            size += serializer->WriteInt64(n);
+            size += serializer->stub()->Write(buf.data(), buf.size());
         } break;
 
         default:
@@ -126,37 +213,41 @@ Obj *ObjDeserialize(SerializedInputStream *deserializer) {
         } break;
 
         case YKN_LIST: {
-            auto list = List::New();
             uint32_t n;
             CALL(deserializer->ReadInt32(&n));
+            auto list = List::New();
+            CALL(list);
             while (n--) {
                 auto elem = ObjDeserialize(deserializer);
-                if (!elem) {
+                if (!elem || !list->stub()->InsertTail(elem)) {
+                    ObjRelease(ObjAddRef(elem));
                     list->~List();
-                    free(list);
+                    Slab::Free(list);
                     return nullptr;
                 }
-                list->stub()->InsertTail(elem);
             }
             return list;
         } break;
 
         case YKN_HASH: {
+            // Number of keys be written in 64 bits.
+            uint64_t n;
+            CALL(deserializer->ReadInt64(&n));
             auto hash = Hash::New(Hash::DEFAULT_SIZE);
-            uint32_t n;
-            CALL(deserializer->ReadInt32(&n));
+            CALL(hash);
 
             yuki::Slice key;
             std::string stub;
             while (n--) {
-                CALL(deserializer->ReadString(&key, &stub));
-
-                auto obj = ObjDeserialize(deserializer);
-                if (!obj) {
+                Obj *obj = nullptr;
+                if (!deserializer->ReadString(&key, &stub) ||
+                    !(obj = ObjDeserialize(deserializer)) ||
+                    hash->stub()->Put(key, obj).Failed()) {
+                    ObjRelease(ObjAddRef(obj));
                     hash->~Hash();
-                    free(hash);
+                    Slab::Free(hash);
+                    return nullptr;
                 }
-                hash->stub()->Put(key, 0, obj);
             }
             return hash;
         } break;
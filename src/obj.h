@@ -1,8 +1,9 @@
 #ifndef YUKINO_OBJ_H_
 #define YUKINO_OBJ_H_
 
-#include "lockfree_list.h"
-#include "cocurrent_hash_map.h"
+#include "compact_hash.h"
+#include "quick_list.h"
+#include "slab.h"
 #include "yuki/slice.h"
 #include "yuki/varint.h"
 #include "glog/logging.h"
@@ -23,6 +24,9 @@ enum ObjTy: uint8_t {
 };
 
 struct Obj {
+    // Shared objects hold it, never be counted or freed.
+    enum { IMMORTAL_REF_COUNT = 1 << 30 };
+
     std::atomic<int> ref_count;
     uint8_t raw;
 
@@ -31,10 +35,18 @@ struct Obj {
     Obj(const Obj &) = delete;
     Obj(Obj &&) = delete;
 
-    void AddRef() { ref_count.fetch_add(1); }
+    void AddRef() {
+        if (!immortal()) {
+            ref_count.fetch_add(1);
+        }
+    }
     inline void Release();
     inline int  RefCount();
 
+    bool immortal() const {
+        return ref_count.load(std::memory_order_relaxed) >= IMMORTAL_REF_COUNT;
+    }
+
     ObjTy type() const { return static_cast<ObjTy>(raw); }
 
     const uint8_t *payload() const { return &raw + 1; }
@@ -50,6 +62,15 @@ inline Obj *ObjAddRef(Obj *ob) {
 }
 
 bool ObjCastIntIf(Obj *ob, int64_t *value);
+
+// Convert a String of canonical integer (e.g. "-12", not "012") to an
+// Integer, or return itself.
+Obj *ObjIntegerIf(Obj *ob);
+
+// New Integer of `ob' + `delta', null `ob' be 0. Return null if `ob' not an
+// integer or overflow.
+Obj *ObjIncrBy(Obj *ob, int64_t delta);
+
 size_t ObjSerialize(Obj *ob, SerializedOutputStream *serializer);
 Obj *ObjDeserialize(SerializedInputStream *deserializer);
 
@@ -71,21 +92,23 @@ public:
 
 class Integer : public Obj {
 public:
+    // Integers in [0, NUM_SHARED) be made once and shared, New() them
+    // allocates nothing.
+    enum { NUM_SHARED = 10000 };
+
     inline int64_t data() const;
 
     static inline size_t PredictSize(int64_t i);
     static inline Integer *Build(int64_t i, void *buf, size_t size);
     static inline Integer *New(int64_t i);
-};
 
-struct ObjManaged {
-    void Grab(Obj *ob) { ObjAddRef(ob); }
-    void Drop(Obj *ob) { ObjRelease(ob); }
+private:
+    static Integer *Shared(int64_t i);
 };
 
 class List : public Obj {
 public:
-    typedef LockFreeList<Obj*, ObjManaged> Stub;
+    typedef QuickList Stub;
 
     ~List() { stub()->~Stub(); }
 
@@ -100,7 +123,7 @@ public:
 
 class Hash : public Obj {
 public:
-    typedef CocurrentHashMap Stub;
+    typedef CompactHash Stub;
 
     enum { DEFAULT_SIZE = 13 };
 
@@ -110,18 +133,21 @@ public:
 
     inline void Release();
 
-    static size_t PredictSize() { return sizeof(Stub) + sizeof(List); }
-    static inline Hash *Build(void *buf, size_t size, int initial_size);
-    static inline Hash *New(int initial_size);
+    static size_t PredictSize() { return sizeof(Stub) + sizeof(Hash); }
+    static inline Hash *Build(void *buf, size_t size, int64_t initial_size);
+    static inline Hash *New(int64_t initial_size);
 };
 
 static_assert(sizeof(Obj) == sizeof(String), "Fixed String size.");
 static_assert(sizeof(Obj) == sizeof(Integer), "Fixed Integer size.");
 
 inline void Obj::Release() {
+    if (immortal()) {
+        return;
+    }
     if (std::atomic_fetch_sub_explicit(&ref_count, 1,
                                        std::memory_order_release) == 1) {
-        free(this);
+        Slab::Free(this);
     }
 }
 
@@ -164,7 +190,7 @@ inline size_t String::PredictSize(yuki::SliceRef s) {
 
 /*static*/
 inline String *String::Build(yuki::SliceRef s, void *buf, size_t size) {
-    if (size < PredictSize(s)) {
+    if (!buf || size < PredictSize(s)) {
         return nullptr;
     }
     auto base = new (buf) Obj(YKN_STRING);
@@ -177,7 +203,7 @@ inline String *String::Build(yuki::SliceRef s, void *buf, size_t size) {
 /*static*/
 inline String *String::New(yuki::SliceRef s) {
     auto size = PredictSize(s);
-    auto buf  = malloc(size);
+    auto buf  = Slab::Allocate(size);
     return Build(s, buf, size);
 }
 
@@ -196,7 +222,7 @@ inline size_t Integer::PredictSize(int64_t i) {
 
 /*static*/
 inline Integer *Integer::Build(int64_t i, void *buf, size_t size) {
-    if (size < PredictSize(i)) {
+    if (!buf || size < PredictSize(i)) {
         return nullptr;
     }
     auto base = new (buf) Obj(YKN_INTEGER);
@@ -206,8 +232,11 @@ inline Integer *Integer::Build(int64_t i, void *buf, size_t size) {
 
 /*static*/
 inline Integer *Integer::New(int64_t i) {
+    if (i >= 0 && i < NUM_SHARED) {
+        return Shared(i);
+    }
     auto size = PredictSize(i);
-    auto buf  = malloc(size);
+    auto buf  = Slab::Allocate(size);
     return Build(i, buf, size);
 }
 
@@ -220,12 +249,12 @@ inline void List::Release() {
     if (std::atomic_fetch_sub_explicit(&ref_count, 1,
                                        std::memory_order_release) == 1) {
         this->~List();
-        free(this);
+        Slab::Free(this);
     }
 }
 
 /*static*/ inline List *List::Build(void *buf, size_t size) {
-    if (size < PredictSize()) {
+    if (!buf || size < PredictSize()) {
         return nullptr;
     }
 
@@ -236,7 +265,7 @@ inline void List::Release() {
 
 /*static*/ inline List *List::New() {
     auto size = PredictSize();
-    auto buf  = malloc(size);
+    auto buf  = Slab::Allocate(size);
     return Build(buf, size);
 }
 
@@ -244,12 +273,13 @@ inline void Hash::Release() {
     if (std::atomic_fetch_sub_explicit(&ref_count, 1,
                                        std::memory_order_release) == 1) {
         this->~Hash();
-        free(this);
+        Slab::Free(this);
     }
 }
 
-/*static*/ inline Hash *Hash::Build(void *buf, size_t size, int initial_size) {
-    if (size < PredictSize()) {
+/*static*/ inline Hash *Hash::Build(void *buf, size_t size,
+                                    int64_t initial_size) {
+    if (!buf || size < PredictSize()) {
         return nullptr;
     }
 
@@ -258,9 +288,9 @@ inline void Hash::Release() {
     return static_cast<Hash *>(base);
 }
 
-/*static*/ inline Hash *Hash::New(int initial_size) {
+/*static*/ inline Hash *Hash::New(int64_t initial_size) {
     auto size = PredictSize();
-    auto buf  = malloc(size);
+    auto buf  = Slab::Allocate(size);
     return Build(buf, size, initial_size);
 }
 
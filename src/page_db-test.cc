@@ -0,0 +1,250 @@
+#include "page_db.h"
+#include "background.h"
+#include "configuration.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "protocol.h"
+#include "yuki/strings.h"
+#include "yuki/file.h"
+#include "yuki/file_path.h"
+#include "gtest/gtest.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <fstream>
+#include <memory>
+
+namespace yukino {
+
+class PageDBTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        queue_ = new BackgroundWorkQueue;
+        background_ = new Background;
+        background_->set_queue(queue_);
+
+        background_->AsyncRun();
+
+        conf_.type = DB_PAGE;
+        conf_.persistent = true;
+        conf_.memory_limit = 0;
+    }
+
+    virtual void TearDown() override {
+        queue_->PostShutdown();
+        background_->WaitForShutdown();
+
+        delete background_;
+        delete queue_;
+
+        yuki::FilePath db_path(kDataDir);
+        db_path.Append("db-0");
+
+        yuki::File::Remove(db_path, true);
+    }
+
+protected:
+    BackgroundWorkQueue *queue_;
+    Background *background_;
+    DBConf conf_;
+
+    static const char kDataDir[];
+};
+
+const char PageDBTest::kDataDir[] = "tests";
+
+TEST_F(PageDBTest, Sanity) {
+    using yuki::Slice;
+
+    conf_.persistent = false;
+    std::unique_ptr<DB> db(DB::New(conf_, kDataDir, 0, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_TRUE(db->ordered());
+    EXPECT_TRUE(db->copy_values());
+
+    rv = db->Put(Slice("b"), 0, String::New(Slice("obj")));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Put(Slice("a"), 0, Integer::New(100));
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(2, db->num_keys());
+
+    Obj *obj = nullptr;
+    rv = db->Get(Slice("b"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    ASSERT_EQ(YKN_STRING, obj->type());
+    EXPECT_EQ("obj", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+
+    std::unique_ptr<Iterator> iter(db->iterator());
+    iter->SeekToFirst();
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("a", iter->key()->key().ToString());
+    int64_t value = 0;
+    EXPECT_TRUE(ObjCastIntIf(iter->value(), &value));
+    EXPECT_EQ(100, value);
+    iter->Next();
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("b", iter->key()->key().ToString());
+    iter->Next();
+    EXPECT_FALSE(iter->Valid());
+    iter.reset();
+
+    EXPECT_TRUE(db->Delete(Slice("b")));
+    EXPECT_TRUE(db->Get(Slice("b"), nullptr, nullptr).Failed());
+}
+
+TEST_F(PageDBTest, Persistent) {
+    using yuki::Slice;
+
+    std::unique_ptr<DB> db(DB::New(conf_, kDataDir, 0, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    for (int i = 0; i < 1000; i++) {
+        std::vector<Handle<Obj>> args;
+        args.emplace_back(String::New(Slice(yuki::Strings::Format("k%d", i))));
+        args.emplace_back(Integer::New(i));
+
+        rv = db->AppendLog(CMD_SET, 0, args);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        rv = db->Put(static_cast<String *>(args[0].get())->data(), 0,
+                     args[1].get());
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(Slice("list")));
+    args.emplace_back(String::New(Slice("a")));
+    rv = db->AppendLog(CMD_LIST, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    Handle<List> list(List::New());
+    list->stub()->InsertTail(args[1].get());
+    rv = db->Put(Slice("list"), 0, list.get());
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    rv = db->Checkpoint(true);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // After the checkpoint, only in the log and pages.
+    args[1] = String::New(Slice("b"));
+    rv = db->AppendLog(CMD_RPUSH, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    list->stub()->InsertTail(args[1].get());
+    rv = db->Put(Slice("list"), 0, list.get());
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // The redo can not push it twice.
+    for (int i = 0; i < 2; i++) {
+        db.reset(DB::New(conf_, kDataDir, 0, queue_));
+        rv = db->Open();
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        EXPECT_EQ(1001, db->num_keys());
+
+        Obj *obj = nullptr;
+        rv = db->Get(Slice("list"), nullptr, &obj);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        ASSERT_EQ(YKN_LIST, obj->type());
+        EXPECT_EQ(2, static_cast<List *>(obj)->stub()->size());
+        ObjRelease(obj);
+
+        rv = db->Get(Slice("k999"), nullptr, &obj);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        int64_t value = 0;
+        EXPECT_TRUE(ObjCastIntIf(obj, &value));
+        EXPECT_EQ(999, value);
+        ObjRelease(obj);
+    }
+}
+
+TEST_F(PageDBTest, Redo) {
+    using yuki::Slice;
+
+    std::unique_ptr<DB> db(DB::New(conf_, kDataDir, 0, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    db.reset();
+
+    // Logged but not applied, as a crash before Put(). A closed db
+    // records the end of log, so write it behind the db.
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(Slice("key")));
+    args.emplace_back(String::New(Slice("obj")));
+    yuki::FilePath log_path(kDataDir);
+    log_path.Append("db-0/log-0");
+    auto fd = open(log_path.Get().c_str(), O_WRONLY|O_APPEND);
+    ASSERT_LE(0, fd);
+    {
+        GroupCommitLog log(fd, FSYNC_ALWAYS, lseek(fd, 0, SEEK_END));
+        int64_t lsn;
+        rv = log.Append(CMD_SET, 0, args, &lsn);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+        rv = log.Sync(lsn);
+        ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    }
+    close(fd);
+
+    db.reset(DB::New(conf_, kDataDir, 0, queue_));
+    rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    EXPECT_EQ(1, db->num_keys());
+    EXPECT_TRUE(db->Get(Slice("key"), nullptr, nullptr).Ok());
+}
+
+TEST_F(PageDBTest, CrashRedo) {
+    using yuki::Slice;
+
+    std::unique_ptr<DB> db(DB::New(conf_, kDataDir, 0, queue_));
+    auto rv = db->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    std::vector<Handle<Obj>> args;
+    args.emplace_back(String::New(Slice("n")));
+    args.emplace_back(Integer::New(1));
+    rv = db->AppendLog(CMD_SET, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Put(Slice("n"), 0, args[1].get());
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Checkpoint(true);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    args[1] = Integer::New(5);
+    rv = db->AppendLog(CMD_INCRBY, 0, args);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    rv = db->Update(Slice("n"), 0, [] (Obj *old) { return ObjIncrBy(old, 5); });
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+
+    // The crash image: files as now, the changed pages be written back by
+    // the kernel after the checkpoint, as db-1.
+    yuki::FilePath crashed(kDataDir);
+    crashed.Append("db-1");
+    ASSERT_TRUE(yuki::File::MakeDir(crashed, true).Ok());
+    for (auto name : {"pages", "log-0", "log-1"}) {
+        yuki::FilePath from(kDataDir), to(crashed);
+        from.Append("db-0");
+        from.Append(name);
+        to.Append(name);
+        std::ifstream in(from.Get(), std::ios::binary);
+        if (in) {
+            std::ofstream out(to.Get(), std::ios::binary);
+            out << in.rdbuf();
+        }
+    }
+
+    // The INCRBY be redone once.
+    std::unique_ptr<DB> redone(DB::New(conf_, kDataDir, 1, queue_));
+    rv = redone->Open();
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    Obj *obj = nullptr;
+    rv = redone->Get(Slice("n"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok()) << rv.ToString();
+    int64_t value = 0;
+    EXPECT_TRUE(ObjCastIntIf(obj, &value));
+    EXPECT_EQ(6, value);
+    ObjRelease(obj);
+
+    redone.reset();
+    yuki::File::Remove(crashed, true);
+}
+
+} // namespace yukino
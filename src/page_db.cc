@@ -0,0 +1,476 @@
+#include "page_db.h"
+#include "group_commit_log.h"
+#include "epoch.h"
+#include "configuration.h"
+#include "basic_io.h"
+#include "serialized_io.h"
+#include "persistent.h"
+#include "background.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "server.h"
+#include "yuki/file_path.h"
+#include "yuki/file.h"
+#include "yuki/strings.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace yukino {
+
+static const size_t kLogSizeForCheckpoint = 50UL * 1024UL * 1024UL;
+
+namespace {
+
+class IteratorImpl : public Iterator {
+public:
+    IteratorImpl(BTree *tree)
+        : cursor_(tree) {
+    }
+
+    virtual ~IteratorImpl() override;
+    virtual bool Valid() const override;
+    virtual void SeekToFirst() override;
+    virtual void Seek(yuki::SliceRef target) override;
+    virtual void Next() override;
+    virtual yuki::Status status() const override;
+    virtual KeyBoundle *key() const override;
+    virtual Obj *value() const override;
+
+private:
+    void Reset();
+
+    BTree::Cursor cursor_;
+    // Key and value be built from the page in need, and live until Next().
+    mutable std::string key_buf_;
+    mutable Handle<Obj> value_;
+    mutable yuki::Status status_;
+};
+
+IteratorImpl::~IteratorImpl() {
+}
+
+bool IteratorImpl::Valid() const {
+    return cursor_.Valid();
+}
+
+void IteratorImpl::SeekToFirst() {
+    Reset();
+    cursor_.SeekToFirst();
+}
+
+void IteratorImpl::Seek(yuki::SliceRef target) {
+    Reset();
+    cursor_.Seek(target);
+}
+
+void IteratorImpl::Next() {
+    Reset();
+    cursor_.Next();
+}
+
+yuki::Status IteratorImpl::status() const {
+    return status_;
+}
+
+KeyBoundle *IteratorImpl::key() const {
+    if (key_buf_.empty()) {
+        auto key = cursor_.key();
+        auto version_number = cursor_.version_number();
+
+        key_buf_.resize(KeyBoundle::PredictBoundleSize(key, version_number));
+        KeyBoundle::Build(key, 0, version_number, &key_buf_[0],
+                          key_buf_.size());
+    }
+    return reinterpret_cast<KeyBoundle *>(&key_buf_[0]);
+}
+
+Obj *IteratorImpl::value() const {
+    if (!value_.get()) {
+        std::string buf;
+        cursor_.value(&buf);
+
+        SerializedInputStream deserializer(
+            NewBufferedInputStream(yuki::Slice(buf)), true);
+        value_ = ObjDeserialize(&deserializer);
+        if (!value_.get()) {
+            status_ = yuki::Status::Corruptionf("bad value of key: %s",
+                                                cursor_.key().ToString().c_str());
+        }
+    }
+    return value_.get();
+}
+
+void IteratorImpl::Reset() {
+    key_buf_.clear();
+    value_ = nullptr;
+}
+
+} // namespace
+
+PageDB::PageDB(const DBConf &conf,
+               const std::string &data_dir,
+               int id,
+               BackgroundWorkQueue *work_queue)
+    : db_dir_(data_dir)
+    , persistent_(conf.persistent)
+    , id_(id)
+    , log_fsync_(conf.log_fsync)
+    , is_saving_(false)
+    , freezing_(false)
+    , num_writing_(0)
+    , work_queue_(DCHECK_NOTNULL(work_queue)) {
+
+    // db dir: data_dir/db-<id>/
+    db_dir_.Append(yuki::Strings::Format("db-%d", id_));
+}
+
+PageDB::~PageDB() {
+    if (saving_thread_.joinable()) {
+        saving_thread_.join();
+    }
+
+    if (log_) {
+        // All be written and applied, no redo after reopening.
+        delete log_;
+        auto rv = SyncLogPosition(version_, num_logged_);
+        if (rv.Failed()) {
+            LOG(ERROR) << "sync pages fail: " << rv.ToString();
+        }
+    }
+
+    if (log_fd_ >= 0) {
+        close(log_fd_);
+    }
+}
+
+yuki::Status PageDB::Open() {
+    using yuki::Status;
+    using yuki::FilePath;
+    using yuki::Strings;
+
+    bool exist;
+    auto rv = db_dir_.Exist(&exist);
+    if (rv.Failed()) {
+        return rv;
+    }
+    if (!exist) {
+        rv = yuki::File::MakeDir(db_dir_, true);
+        if (rv.Failed()) {
+            return rv;
+        }
+        LOG(INFO) << "new db: db-" << id_ << " created. " << db_dir_.Get();
+    }
+
+    FilePath page_path(db_dir_);
+    page_path.Append("pages");
+    if (!persistent_) {
+        // Pages only be the memory of larger data, start from clean.
+        unlink(page_path.Get().c_str());
+    }
+    rv = tree_.Open(page_path.Get());
+    if (rv.Failed()) {
+        LOG(ERROR) << "open pages [" << id_ << "] fail: " << rv.ToString();
+        return rv;
+    }
+    if (!persistent_) {
+        return Status::OK();
+    }
+
+    int64_t version, applied;
+    tree_.GetLogPosition(&version, &applied);
+
+    // A failed checkpoint may leave newer logs after the recorded one, redo
+    // all of them, the last one be appended.
+    bool redone = false;
+    size_t origin_size = 0;
+    int64_t num_records = 0;
+    version_ = version;
+    for (;; version++, applied = 0) {
+        FilePath path(db_dir_);
+        path.Append(Strings::Format("log-%" PRId64, version));
+        rv = path.Exist(&exist);
+        if (rv.Failed()) {
+            return rv;
+        }
+        if (!exist) {
+            break;
+        }
+
+        rv = DBRedo(yuki::Slice(path.Get()), this, applied, &origin_size,
+                    &num_records);
+        if (rv.Failed()) {
+            LOG(ERROR) << "redo fail, from file: " << path.Get();
+            return rv;
+        }
+        redone   = true;
+        version_ = version;
+    }
+    num_logged_ = num_records;
+
+    FilePath log_path(db_dir_);
+    log_path.Append(Strings::Format("log-%" PRId64, version_));
+
+    log_fd_ = open(log_path.Get().c_str(), O_CREAT|O_WRONLY|O_APPEND, 0664);
+    if (log_fd_ < 0) {
+        PLOG(ERROR) << "open " << log_path.Get() << " fail";
+        return Status::Systemf("open %s fail", log_path.Get().c_str());
+    }
+    // Drop the torn record in the end, the new ones follow the last good one.
+    if (redone && ftruncate(log_fd_, origin_size) != 0) {
+        PLOG(ERROR) << "truncate " << log_path.Get() << " fail";
+        return Status::Systemf("truncate %s fail", log_path.Get().c_str());
+    }
+    log_ = new GroupCommitLog(log_fd_, log_fsync_, origin_size);
+    return Status::OK();
+}
+
+yuki::Status PageDB::Checkpoint(bool force) {
+    using yuki::Status;
+
+    if (!persistent_) {
+        return Status::Corruptionf("db do not need persistent");
+    }
+    if (is_saving_.exchange(true)) {
+        return Status::Corruptionf("checkpoint in progress...");
+    }
+
+    bool need = force || log_->written_bytes() >= kLogSizeForCheckpoint;
+
+    auto rv = need ? DoCheckpoint() : Status::OK();
+    is_saving_.store(false);
+    return rv;
+}
+
+yuki::Status
+PageDB::AppendLog(int code, int64_t version,
+                  const std::vector<Handle<Obj>> &args) {
+    using yuki::Status;
+
+    if (!persistent_) {
+        return Status::OK();
+    }
+
+    // num_logged_ counts records in the log order, append under mutex_.
+    std::unique_lock<std::mutex> lock(mutex_);
+    int64_t lsn;
+    auto rv = log_->Append(static_cast<CmdCode>(code), version, args, &lsn);
+    if (rv.Failed()) {
+        LOG(ERROR) << "write log error: " << rv.ToString();
+        return rv;
+    }
+    num_logged_++;
+
+    if (log_->written_bytes() >= kLogSizeForCheckpoint &&
+        !is_saving_.exchange(true)) {
+        if (saving_thread_.joinable()) {
+            saving_thread_.join();
+        }
+        saving_thread_ = std::move(std::thread([this]() {
+            auto jiffies = Server::current_milsces();
+            auto status = DoCheckpoint();
+            if (status.Failed()) {
+                LOG(ERROR) << "checkpoint fail. " << status.ToString();
+            }
+            LOG(INFO) << "checkpoint done, cost: "
+                      << Server::current_milsces() - jiffies << " ms";
+
+            Epoch::Quiescent();
+            is_saving_.store(false);
+        }));
+    }
+    lock.unlock();
+
+    // Reply after the batch of this record be durable.
+    rv = log_->Sync(lsn);
+    if (rv.Failed()) {
+        LOG(ERROR) << "sync log error: " << rv.ToString();
+    }
+    return rv;
+}
+
+Iterator *PageDB::iterator() {
+    return new IteratorImpl(&tree_);
+}
+
+int64_t PageDB::num_keys() const {
+    return tree_.num_keys();
+}
+
+yuki::Status PageDB::Put(yuki::SliceRef key, uint64_t version_number,
+                         Obj *value) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return UnsafePut(key, version_number, value);
+}
+
+yuki::Status PageDB::UnsafePut(yuki::SliceRef key, uint64_t version_number,
+                               Obj *value) {
+    std::string buf;
+
+    // Hold it, the new value be freed after serialized.
+    ObjAddRef(value);
+    {
+        SerializedOutputStream serializer(NewBufferedOutputStream(&buf), true);
+        ObjSerialize(value, &serializer);
+    }
+    ObjRelease(value);
+    return tree_.Put(key, version_number, yuki::Slice(buf));
+}
+
+bool PageDB::Delete(yuki::SliceRef key) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return tree_.Delete(key);
+}
+
+yuki::Status PageDB::Get(yuki::SliceRef key, Version *ver, Obj **value) {
+    using yuki::Status;
+
+    std::string buf;
+    uint64_t version_number;
+    auto rv = tree_.Get(key, &version_number, value ? &buf : nullptr);
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    if (ver) {
+        ver->type   = 0;
+        ver->number = version_number;
+    }
+    if (value) {
+        SerializedInputStream deserializer(
+            NewBufferedInputStream(yuki::Slice(buf)), true);
+        auto ob = ObjDeserialize(&deserializer);
+        if (!ob) {
+            return Status::Corruptionf("bad value of key: %s",
+                                       key.ToString().c_str());
+        }
+        *value = ObjAddRef(ob);
+    }
+    return Status::OK();
+}
+
+yuki::Status PageDB::Update(yuki::SliceRef key, uint64_t version_number,
+                            std::function<Obj *(Obj *)> proc) {
+    using yuki::Status;
+
+    // Under the same lock as Put() and Delete(), no write gets in between.
+    std::unique_lock<std::mutex> lock(mutex_);
+    Obj *old = nullptr;
+    auto rv = Get(key, nullptr, &old);
+    if (rv.Failed() && rv.Code() != Status::kNotFound) {
+        return rv;
+    }
+
+    // The old one be a copy, hold it until the new one put.
+    auto value = proc(old);
+    rv = value ? UnsafePut(key, version_number, value) : Status::OK();
+    ObjRelease(old);
+    return rv;
+}
+
+size_t PageDB::MultiGet(size_t n, const yuki::Slice *keys, Obj **values) {
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+        values[i] = nullptr;
+        if (Get(keys[i], nullptr, &values[i]).Ok()) {
+            found++;
+        }
+    }
+    return found;
+}
+
+void PageDB::BeginWrite() {
+    if (!persistent_) {
+        return;
+    }
+
+    for (;;) {
+        while (freezing_.load()) {
+            std::this_thread::yield();
+        }
+        num_writing_.fetch_add(1);
+        if (!freezing_.load()) {
+            return;
+        }
+        // The checkpoint came first, let it go.
+        num_writing_.fetch_sub(1);
+    }
+}
+
+void PageDB::EndWrite() {
+    if (persistent_) {
+        num_writing_.fetch_sub(1);
+    }
+}
+
+void PageDB::Cron(int64_t /*budget_milsces*/) {
+    // Dirty pages be written back by the kernel or the checkpoint.
+}
+
+yuki::Status PageDB::DoCheckpoint() {
+    using yuki::Status;
+    using yuki::Strings;
+
+    // Most dirty pages be written back before holding writers.
+    auto rv = tree_.Sync();
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    // Wait for writes in flight, and hold the new ones, so every record in
+    // the old logs be applied.
+    freezing_.store(true);
+    while (num_writing_.load() > 0) {
+        std::this_thread::yield();
+    }
+
+    int64_t old_version, applied;
+    tree_.GetLogPosition(&old_version, &applied);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    rv = CreateLogFile(version_ + 1);
+    if (rv.Ok()) {
+        version_++;
+        num_logged_ = 0;
+        rv = SyncLogPosition(version_, 0);
+    }
+    lock.unlock();
+    freezing_.store(false);
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    // The committed tree points to the new log, the old ones be useless.
+    for (auto version = old_version; version < version_; version++) {
+        yuki::FilePath log_path(db_dir_);
+        log_path.Append(Strings::Format("log-%" PRId64, version));
+        unlink(log_path.Get().c_str());
+    }
+    return Status::OK();
+}
+
+yuki::Status PageDB::SyncLogPosition(int64_t version, int64_t applied) {
+    return tree_.Commit(version, applied);
+}
+
+yuki::Status PageDB::CreateLogFile(int64_t version) {
+    using yuki::Status;
+
+    yuki::FilePath log_path(db_dir_);
+    log_path.Append(yuki::Strings::Format("log-%" PRId64, version));
+
+    auto fd = open(log_path.Get().c_str(), O_CREAT|O_WRONLY|O_APPEND, 0664);
+    if (fd < 0) {
+        PLOG(ERROR) << "create log file fail.";
+        return Status::Systemf("open %s fail", log_path.Get().c_str());
+    }
+
+    // Switch the log first, the old file be closed after all written.
+    work_queue_->PostCloseFile(log_->Rotate(fd));
+    log_fd_ = fd;
+    return Status::OK();
+}
+
+} // namespace yukino
@@ -0,0 +1,95 @@
+#ifndef YUKINO_PAGE_DB_H_
+#define YUKINO_PAGE_DB_H_
+
+#include "db.h"
+#include "b_tree.h"
+#include "group_commit_log.h"
+#include "yuki/file_path.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <mutex>
+
+namespace yukino {
+
+class BackgroundWorkQueue;
+struct DBConf;
+
+//
+// DB_PAGE: DB on the B+tree page file, values be serialized into the pages.
+// The page file is the table, opening it needs no loading, only the log
+// records after the applied position (recorded in the meta page) be redone.
+// Checkpoint holds writers, switches to a new log file, then commits the
+// tree with the start of the new log as the position.
+//
+// Pages of the last commit never be changed (see BTree), the kernel writing
+// pages back between checkpoints touches only the new ones. So after a crash
+// the tree be exactly the one at the recorded position, every record after it
+// be redone once, commands not idempotent (e.g. INCRBY, LPUSH) too. A clean
+// close records the position at the end of log.
+//
+// db dir: data_dir/db-<id>/
+// pages: the page file.
+// log-<version>: the WAL.
+//
+class PageDB : public DB {
+public:
+    PageDB(const DBConf &conf,
+           const std::string &data_dir,
+           int id,
+           BackgroundWorkQueue *work_queue);
+    virtual ~PageDB() override;
+
+    virtual yuki::Status Open() override;
+    virtual yuki::Status Checkpoint(bool force) override;
+    virtual yuki::Status
+    AppendLog(int code, int64_t version,
+              const std::vector<Handle<Obj>> &args) override;
+    virtual Iterator *iterator() override;
+    virtual int64_t num_keys() const override;
+    virtual bool ordered() const override { return true; }
+    virtual bool copy_values() const override { return true; }
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) override;
+    virtual bool Delete(yuki::SliceRef key) override;
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) override;
+    virtual yuki::Status Update(yuki::SliceRef key, uint64_t version_number,
+                                std::function<Obj *(Obj *)> proc) override;
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys,
+                            Obj **values) override;
+    virtual void BeginWrite() override;
+    virtual void EndWrite() override;
+    virtual void Cron(int64_t budget_milsces) override;
+
+private:
+    yuki::Status DoCheckpoint();
+
+    // Must be called without writers. Commit the tree with the position.
+    yuki::Status SyncLogPosition(int64_t version, int64_t applied);
+
+    // Must be called under mutex_.
+    yuki::Status UnsafePut(yuki::SliceRef key, uint64_t version_number,
+                           Obj *value);
+    yuki::Status CreateLogFile(int64_t version);
+
+    BTree tree_;
+    yuki::FilePath db_dir_;
+    bool persistent_;
+    int id_;
+    FsyncPolicy log_fsync_;
+    GroupCommitLog *log_ = nullptr;
+    int log_fd_ = -1;
+    int64_t version_ = 0;
+    int64_t num_logged_ = 0; // records in the current log.
+    std::atomic<bool> is_saving_;
+    std::atomic<bool> freezing_;    // writers wait, the checkpoint be taking.
+    std::atomic<int> num_writing_;  // writers between BeginWrite/EndWrite.
+    std::mutex mutex_;
+    BackgroundWorkQueue *work_queue_;
+    std::thread saving_thread_;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_PAGE_DB_H_
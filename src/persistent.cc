@@ -7,13 +7,31 @@
 #include "bin_log.h"
 #include "basic_io.h"
 #include "handle.h"
-#include "basic_io.h"
 #include "serialized_io.h"
+#include "crc32.h"
+#include "epoch.h"
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 
 namespace yukino {
 
+static const int64_t kDumpBatchSize = 1024;
+
+// Records be parsed ahead in batches, at most kRedoMaxBatches batches.
+static const size_t kRedoBatchSize = 256;
+static const size_t kRedoMaxBatches = 4;
+
 yuki::Status RedoCommand(const Command &cmd,
                          const std::vector<Handle<Obj>> &args,
                          int64_t version,
@@ -24,163 +42,498 @@ yuki::Status DumpKeyValuePair(KeyBoundle *key, Obj *value,
 
 TableOptions::TableOptions()
     : overwrite(false)
-    , fd(-1) {
+    , fd(-1)
+    , num_threads(0) {
 }
 
-yuki::Status DumpTable(TableOptions *options, DB *db) {
-    using yuki::Slice;
-    using yuki::Status;
-
-    int fd = -1;
-    if (options->overwrite) {
-        fd = open(options->file_name.ToString().c_str(),
-                  O_CREAT|O_TRUNC|O_WRONLY, 0644);
-    } else {
-        fd = open(options->file_name.ToString().c_str(),
-                  O_CREAT|O_EXCL|O_WRONLY, 0644);
-    }
-    if (fd < 0) {
-        PLOG(ERROR) << "can not open table file: " <<
-                       options->file_name.ToString();
-        return Status::Systemf("can not open table file: %s",
-                               options->file_name.ToString().c_str());
+namespace {
+
+// table  := [header(32 bytes)] [chunk]*
+// header := [*YKN] [format(fixed32)] [num_keys(fixed64)]
+//           [payload_size(fixed64)] [reserved(8 bytes)]
+// chunk  := [size(fixed32)] [crc32(fixed32)] [entry]*
+// Entries never cross chunks, so chunks can be checked and loaded alone.
+// The header be written at last, the loader reserves the table by it.
+static const uint32_t kTableFormat = 3;
+static const size_t kTableHeaderSize = 32;
+static const size_t kChunkHeaderSize = 8;
+static const size_t kTableChunkSize = 1024 * 1024;
+
+// format 1: [*YKN] [crc32(fixed32)] [01 00 'x' '0' '1' 00 00 00] [entry]*
+static const size_t kTableFormat1HeaderSize = 16;
+static const char kTableFormat1Mark[] = {1, 0, 'x', '0', '1', 0, 0, 0};
+
+yuki::Status WriteFully(int fd, const char *buf, size_t size) {
+    while (size > 0) {
+        auto rv = write(fd, buf, size);
+        if (rv < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG(ERROR) << "write table fail";
+            return yuki::Status::Systemf("write table fail");
+        }
+        buf += rv;
+        size -= static_cast<size_t>(rv);
     }
+    return yuki::Status::OK();
+}
 
-    auto output = NewPosixFileOutputStream(fd);
-    // write 16 bytes header
-    output->Write(Slice("*YKN\x00\x00\x00\x00\x01\0x01\x00\x00\x00\x00\x00\x00",
-                        16));
-    options->fd = fd;
+class TableChunkWriter {
+public:
+    TableChunkWriter(int fd)
+        : fd_(fd)
+        , serializer_(NewBufferedOutputStream(&buf_), true) {
+        buf_.resize(kChunkHeaderSize);
+    }
 
-    VerifiedOutputStreamProxy proxy(output, true, 0);
-    SerializedOutputStream serializer(&proxy, false);
-    std::unique_ptr<Iterator> iter(db->iterator());
-    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-        auto rv = DumpKeyValuePair(iter->key(), iter->value(), &serializer);
-        if (rv.Failed()) {
+    yuki::Status Add(KeyBoundle *key, Obj *value) {
+        auto rv = DumpKeyValuePair(key, value, &serializer_);
+        num_keys_++;
+        if (rv.Failed() || buf_.size() < kTableChunkSize) {
             return rv;
         }
+        return Flush();
     }
 
-    if (lseek(options->fd, 4, SEEK_SET) < 0) {
-        PLOG(ERROR) << "seek fail";
-
-        close(options->fd);
-        options->fd = -1;
-        return Status::Systemf("seek fail");
+    // The header and entries be written by one write(2).
+    yuki::Status Flush() {
+        if (buf_.size() == kChunkHeaderSize) {
+            return yuki::Status::OK();
+        }
+        uint32_t size = static_cast<uint32_t>(buf_.size() - kChunkHeaderSize);
+        uint32_t checksum = crc32(0, buf_.data() + kChunkHeaderSize, size);
+        memcpy(&buf_[0], &size, sizeof(size));
+        memcpy(&buf_[4], &checksum, sizeof(checksum));
+
+        auto rv = WriteFully(fd_, buf_.data(), buf_.size());
+        buf_.resize(kChunkHeaderSize);
+        payload_size_ += size;
+        return rv;
     }
-    serializer.WriteFixed32(proxy.crc32_checksum());
-    return Status::OK();
-}
 
-yuki::Status LoadTable(const TableOptions &options, DB *db) {
-    using yuki::Slice;
-    using yuki::Status;
+    uint64_t num_keys() const { return num_keys_; }
+    uint64_t payload_size() const { return payload_size_; }
 
-    FILE *fp = fopen(options.file_name.ToString().c_str(), "r");
-    if (!fp) {
-        PLOG(ERROR) << "can not open file: " << options.file_name.ToString();
-        return Status::Systemf("can not open file: %s",
-                               options.file_name.ToString().c_str());
-    }
+private:
+    int fd_;
+    uint64_t num_keys_ = 0;
+    uint64_t payload_size_ = 0;
+    std::string buf_;
+    SerializedOutputStream serializer_;
+};
 
-    char magic[4];
-    if (fread(magic, 1, sizeof(magic), fp) != sizeof(magic) ||
-        memcmp(magic, "*YKN", 4) != 0) {
-        fclose(fp);
-        return Status::Corruptionf("bad table file header. "
-                                   "Is not yukino db table file?");
-    }
+struct TableChunk {
+    yuki::Slice data;
+    uint32_t checksum;
+};
 
-    uint32_t checksum = 0;
-    if (fread(&checksum, 1, sizeof(checksum), fp) != sizeof(checksum)) {
-        fclose(fp);
-        return Status::Corruptionf("bad table file header. "
-                                   "Is not yukino db table file?");
-    }
+yuki::Status LoadChunk(const TableChunk &chunk, DB *db, int64_t *num_keys) {
+    using yuki::Status;
 
-    if (fseek(fp, 16, SEEK_SET) != 0) {
-        PLOG(ERROR) << "can not seek file: " << options.file_name.ToString();
-        fclose(fp);
-        return Status::Systemf("can not seek file: %s",
-                               options.file_name.ToString().c_str());
+    if (crc32(0, chunk.data.Data(), chunk.data.Length()) != chunk.checksum) {
+        return Status::Corruptionf("crc32 checksum fail");
     }
 
-    VerifiedInputStreamProxy proxy(NewFileInputStream(fp), true, 0);
-    SerializedInputStream deserializer(&proxy, false);
-
+    SerializedInputStream deserializer(NewBufferedInputStream(chunk.data),
+                                       true);
     uint32_t key_size;
     std::string stub;
+    auto now = WallMilsces();
     while (deserializer.ReadInt32(&key_size)) {
         // key:
         yuki::Slice key;
-        if (!deserializer.stub()->Read(key_size, &key, &stub)) {
-            fclose(fp);
+        if (!deserializer.stub()->Read(key_size, &key, &stub) ||
+            key.Length() != key_size) {
             return Status::Corruptionf("bad table file format.");
         }
 
         uint8_t type;
         if (!deserializer.ReadByte(&type)) {
-            fclose(fp);
             return Status::Corruptionf("bad table file format.");
         }
 
         uint64_t version;
         if (!deserializer.ReadInt64(&version)) {
-            fclose(fp);
             return Status::Corruptionf("bad table file format.");
         }
 
         // value:
         auto obj = ObjDeserialize(&deserializer);
         if (!obj) {
-            return deserializer.status();
+            return deserializer.status().Failed() ? deserializer.status() :
+                   Status::Corruptionf("bad table file format.");
         }
-        db->Put(key, version, obj);
-    }
-
-    fclose(fp);
-    if (checksum != proxy.crc32_checksum()) {
-        return Status::Corruptionf("crc32 checksum fail %u vs %u", checksum,
-                                   proxy.crc32_checksum());
+        Handle<Obj> holder(obj);
+        if (type == VERSION_EXPIRE && static_cast<int64_t>(version) <= now) {
+            continue; // expired after dumping.
+        }
+        Version ver;
+        ver.type   = type;
+        ver.number = version;
+        auto rv = db->BulkPut(key, ver, obj);
+        if (rv.Failed()) {
+            return rv;
+        }
+        (*num_keys)++;
     }
     return deserializer.status();
 }
 
-yuki::Status DBRedo(yuki::SliceRef file_name, DB *db, size_t *be_read) {
+// Parse the log in a thread ahead of the applying, so the applying
+// never waits for the reading and decoding.
+class LogPrefetcher {
+public:
+    LogPrefetcher(BinLogReader *reader)
+        : reader_(reader)
+        , thread_([this] () { Run(); }) {
+    }
+
+    ~LogPrefetcher() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+            cv_.notify_all();
+        }
+        thread_.join();
+    }
+
+    // Return false at the end, `status' be the status of reading.
+    bool Next(std::vector<Operator> *batch, yuki::Status *status) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this] () { return !batches_.empty() || done_; });
+        if (batches_.empty()) {
+            *status = status_;
+            return false;
+        }
+        *batch = std::move(batches_.front());
+        batches_.pop_front();
+        cv_.notify_all();
+        return true;
+    }
+
+private:
+    void Run() {
+        std::vector<Operator> batch;
+        Operator op;
+        yuki::Status rv;
+        for (;;) {
+            bool ok = reader_->Read(&op, &rv);
+            if (ok) {
+                batch.push_back(std::move(op));
+                if (batch.size() < kRedoBatchSize) {
+                    continue;
+                }
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] () {
+                return batches_.size() < kRedoMaxBatches || stop_;
+            });
+            if (stop_) {
+                return;
+            }
+            if (!batch.empty()) {
+                batches_.push_back(std::move(batch));
+                batch.clear();
+            }
+            if (!ok) {
+                status_ = rv;
+                done_ = true;
+            }
+            cv_.notify_all();
+            if (!ok) {
+                return;
+            }
+        }
+    }
+
+    BinLogReader *reader_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::vector<Operator>> batches_;
+    yuki::Status status_;
+    bool done_ = false;
+    bool stop_ = false;
+    std::thread thread_;
+}; // class LogPrefetcher
+
+} // namespace
+
+yuki::Status DumpTable(TableOptions *options, DB *db) {
     using yuki::Slice;
     using yuki::Status;
 
-    FILE *fp = fopen(file_name.ToString().c_str(), "r");
-    if (!fp) {
-        PLOG(ERROR) << "can not open: " << file_name.ToString();
-        return Status::Systemf("can not open: %s", file_name.ToString().c_str());
+    int fd = options->fd; // opened by the caller, if not -1.
+    if (fd < 0) {
+        if (options->overwrite) {
+            fd = open(options->file_name.ToString().c_str(),
+                      O_CREAT|O_TRUNC|O_WRONLY, 0644);
+        } else {
+            fd = open(options->file_name.ToString().c_str(),
+                      O_CREAT|O_EXCL|O_WRONLY, 0644);
+        }
     }
+    if (fd < 0) {
+        PLOG(ERROR) << "can not open table file: " <<
+                       options->file_name.ToString();
+        return Status::Systemf("can not open table file: %s",
+                               options->file_name.ToString().c_str());
+    }
+    options->fd = fd;
 
-    BinLogReader reader(NewFileInputStream(fp), true, 512);
+    // Counters in the header be filled after all chunks written.
+    char header[kTableHeaderSize] = {'*', 'Y', 'K', 'N'};
+    memcpy(header + 4, &kTableFormat, sizeof(kTableFormat));
+    auto rv = WriteFully(fd, header, sizeof(header));
+    if (rv.Failed()) {
+        return rv;
+    }
 
-    Operator op;
-    yuki::Status status;
-    while (reader.Read(&op, &status)) {
-        if (status.Failed()) {
-            break;
+    TableChunkWriter chunk(fd);
+    auto now = WallMilsces();
+    if (db->ordered()) {
+        std::unique_ptr<Iterator> iter(db->iterator());
+        for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+            if (iter->key()->version().expired(now)) {
+                continue;
+            }
+            rv = chunk.Add(iter->key(), iter->value());
+            if (rv.Failed()) {
+                return rv;
+            }
+        }
+    } else {
+        // Dump in batches, the iterator of hash map blocks resizing for
+        // the whole dumping. Keys visited twice be loaded twice, they be
+        // the same in the snapshot, no matter which one wins.
+        uint64_t cursor = 0;
+        do {
+            cursor = db->Scan(cursor, kDumpBatchSize,
+                              [&] (KeyBoundle *key, Obj *value) {
+                if (rv.Ok() && !key->version().expired(now)) {
+                    rv = chunk.Add(key, value);
+                }
+            });
+            if (rv.Failed()) {
+                return rv;
+            }
+        } while (cursor != 0);
+    }
+    rv = chunk.Flush();
+    if (rv.Failed()) {
+        return rv;
+    }
+
+    auto num_keys = chunk.num_keys(), payload_size = chunk.payload_size();
+    memcpy(header + 8, &num_keys, sizeof(num_keys));
+    memcpy(header + 16, &payload_size, sizeof(payload_size));
+    if (pwrite(fd, header, sizeof(header), 0) !=
+        static_cast<ssize_t>(sizeof(header))) {
+        PLOG(ERROR) << "write table header fail";
+        return Status::Systemf("write table header fail");
+    }
+    return Status::OK();
+}
+
+yuki::Status LoadTable(const TableOptions &options, DB *db) {
+    using yuki::Slice;
+    using yuki::Status;
+
+    auto jiffies = WallMilsces();
+    auto file_name = options.file_name.ToString();
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        PLOG(ERROR) << "can not open file: " << file_name;
+        return Status::Systemf("can not open file: %s", file_name.c_str());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        PLOG(ERROR) << "can not stat file: " << file_name;
+        close(fd);
+        return Status::Systemf("can not stat file: %s", file_name.c_str());
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+
+    uint32_t format = 0;
+    uint64_t num_keys_hint = 0, payload_size = 0;
+    const char *base = nullptr;
+    if (size >= kTableFormat1HeaderSize) {
+        auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            PLOG(ERROR) << "can not map file: " << file_name;
+            close(fd);
+            return Status::Systemf("can not map file: %s", file_name.c_str());
         }
+        madvise(addr, size, MADV_WILLNEED);
+        base = static_cast<const char *>(addr);
+        memcpy(&format, base + 4, sizeof(format));
+        memcpy(&num_keys_hint, base + 8, sizeof(num_keys_hint));
+    }
+    close(fd);
 
-        if (op.cmd < 0 || op.cmd >= MAX_COMMANDS) {
-            status = Status::Corruptionf("bad command code %d", op.cmd);
+    if (!base || memcmp(base, "*YKN", 4) != 0 ||
+        (format == kTableFormat && size < kTableHeaderSize)) {
+        if (base) {
+            munmap(const_cast<char *>(base), size);
+        }
+        return Status::Corruptionf("bad table file header. "
+                                   "Is not yukino db table file?");
+    }
+    if (format != kTableFormat) {
+        // The first format has no format number, a crc32 in its place.
+        if (memcmp(base + 8, kTableFormat1Mark, sizeof(kTableFormat1Mark)) ==
+            0) {
+            format = 1;
+        }
+        munmap(const_cast<char *>(base), size);
+        return Status::Corruptionf("unsupported table format %u, "
+                                   "rewrite it with an older build.", format);
+    }
+    memcpy(&payload_size, base + 16, sizeof(payload_size));
+
+    // Chunks be independent, find them all, then check and decode them in
+    // parallel.
+    Status status;
+    std::vector<TableChunk> chunks;
+    size_t pos = kTableHeaderSize;
+    while (pos < size) {
+        uint32_t chunk_size, checksum;
+        if (size - pos < kChunkHeaderSize) {
+            status = Status::Corruptionf("bad chunk header at %zu", pos);
             break;
         }
-        status = RedoCommand(kCommands[op.cmd], op.args,op. version, db);
-        if (status.Failed()) {
+        memcpy(&chunk_size, base + pos, sizeof(chunk_size));
+        memcpy(&checksum, base + pos + 4, sizeof(checksum));
+        pos += kChunkHeaderSize;
+        if (size - pos < chunk_size) {
+            status = Status::Corruptionf("bad chunk size %u at %zu",
+                                         chunk_size, pos);
             break;
         }
+        chunks.push_back(TableChunk{Slice(base + pos, chunk_size), checksum});
+        pos += chunk_size;
+        payload_size -= chunk_size;
+    }
+    if (status.Ok() && payload_size != 0) {
+        status = Status::Corruptionf("table payload size mismatch");
+    }
+
+    std::atomic<size_t> next_chunk(0);
+    std::atomic<int64_t> num_keys(0);
+    std::mutex mutex;
+    auto load = [&] () {
+        int64_t n = 0;
+        for (;;) {
+            auto i = next_chunk.fetch_add(1);
+            if (i >= chunks.size()) {
+                break;
+            }
+            auto rv = LoadChunk(chunks[i], db, &n);
+            if (rv.Failed()) {
+                std::unique_lock<std::mutex> lock(mutex);
+                status = rv;
+                next_chunk.store(chunks.size()); // stop others.
+            }
+        }
+        num_keys.fetch_add(n);
+        // Retired by the inserting, be reclaimed before the thread exits.
+        Epoch::Quiescent();
+    };
+
+    size_t num_threads = options.num_threads > 0 ? options.num_threads :
+                         std::thread::hardware_concurrency();
+    num_threads = std::max<size_t>(1, std::min(num_threads, chunks.size()));
+    if (status.Ok()) {
+        // Make room for all keys first, no resizing in the loading.
+        db->Reserve(static_cast<int64_t>(num_keys_hint));
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < num_threads; i++) {
+            threads.emplace_back(load);
+        }
+        load();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+    }
+    munmap(const_cast<char *>(base), size);
+
+    if (status.Failed()) {
+        return status;
+    }
+
+    auto cost = std::max<int64_t>(1, WallMilsces() - jiffies);
+    auto mb = static_cast<double>(size) / 1024 / 1024;
+    LOG(INFO) << yuki::Strings::Format("load table: %s, %" PRId64 " keys, "
+                                       "%.1f MB in %" PRId64 " ms by %zu "
+                                       "threads, %.1f MB/s, %" PRId64
+                                       " keys/s", file_name.c_str(),
+                                       num_keys.load(), mb, cost, num_threads,
+                                       mb * 1000 / cost,
+                                       num_keys.load() * 1000 / cost);
+    return status;
+}
+
+yuki::Status DBRedo(yuki::SliceRef file_name, DB *db, size_t *be_read) {
+    return DBRedo(file_name, db, 0, be_read, nullptr);
+}
+
+yuki::Status DBRedo(yuki::SliceRef file_name, DB *db, int64_t skip,
+                    size_t *be_read, int64_t *num_records) {
+    using yuki::Slice;
+    using yuki::Status;
+
+    FILE *fp = fopen(file_name.ToString().c_str(), "r");
+    if (!fp) {
+        PLOG(ERROR) << "can not open: " << file_name.ToString();
+        return Status::Systemf("can not open: %s", file_name.ToString().c_str());
+    }
+    posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    BinLogReader reader(NewFileInputStream(fp), true, kLogBlockSize);
+
+    auto jiffies = WallMilsces();
+    Status status;
+    int64_t num_read = 0;
+    {
+        LogPrefetcher prefetcher(&reader);
+        std::vector<Operator> batch;
+        while (status.Ok() && prefetcher.Next(&batch, &status)) {
+            for (const auto &op : batch) {
+                if (num_read++ < skip) {
+                    continue;
+                }
+
+                if (op.cmd < 0 || op.cmd >= MAX_COMMANDS) {
+                    status = Status::Corruptionf("bad command code %d", op.cmd);
+                    break;
+                }
+                status = RedoCommand(kCommands[op.cmd], op.args, op.version, db);
+                if (status.Failed()) {
+                    break;
+                }
+            }
+        }
+    }
 
-        status = Status::OK();
+    auto size = reader.offset();
+    if (status.Ok()) {
+        auto cost = std::max<int64_t>(1, WallMilsces() - jiffies);
+        auto mb = static_cast<double>(size) / 1024 / 1024;
+        LOG(INFO) << yuki::Strings::Format("redo log: %s, %" PRId64 " records, "
+                                           "%.1f MB in %" PRId64 " ms, "
+                                           "%.1f MB/s, %" PRId64 " records/s",
+                                           file_name.ToString().c_str(),
+                                           num_read, mb, cost, mb * 1000 / cost,
+                                           num_read * 1000 / cost);
     }
 
-final:
     if (be_read) {
-        *be_read = ftell(fp);
+        *be_read = size;
+    }
+    if (num_records) {
+        *num_records = num_read;
     }
     fclose(fp);
     return status;
@@ -205,19 +558,73 @@ yuki::Status RedoCommand(const Command &cmd,
     switch (cmd.code) {
         case CMD_SET: {
             GET_KEY(key, 0);
-            db->Put(key->data(), version, args[1].get());
-        }break;
+            // Same as the SET command, numeric strings be integers.
+            Handle<Obj> value(ObjIntegerIf(args[1].get()));
+
+            // SET key value PXAT unix-milliseconds
+            int64_t expire_at = 0;
+            if (args.size() > 3 && ObjCastIntIf(args[3].get(), &expire_at) &&
+                expire_at > 0) {
+                db->PutExpire(key->data(), expire_at, value.get());
+            } else {
+                db->Put(key->data(), version, value.get());
+            }
+        } break;
+
+        case CMD_INCRBY: {
+            GET_KEY(key, 0);
+            int64_t delta = 0;
+            if (!ObjCastIntIf(args[1].get(), &delta)) {
+                return Status::Corruptionf("%s: bad delta", cmd.z);
+            }
+            // Failed as well as the command did, if not an integer.
+            Handle<Obj> value;
+            db->Update(key->data(), version, [&value, delta] (Obj *old) {
+                value = ObjIncrBy(old, delta);
+                return value.get();
+            });
+        } break;
+
+        case CMD_PEXPIREAT: {
+            GET_KEY(key, 0);
+            int64_t expire_at = 0;
+            if (!ObjCastIntIf(args[1].get(), &expire_at)) {
+                return Status::Corruptionf("%s: bad expire time", cmd.z);
+            }
+            db->Expire(key->data(), expire_at);
+        } break;
+
+        case CMD_PERSIST: {
+            GET_KEY(key, 0);
+            db->Expire(key->data(), 0);
+        } break;
 
         case CMD_DEL: {
             GET_KEY(key, 0);
             db->Delete(key->data());
         } break;
 
+        case CMD_MSET: {
+            for (size_t i = 0; i + 1 < args.size(); i += 2) {
+                if (args[i]->type() != YKN_STRING) {
+                    return Status::Corruptionf("bad key type");
+                }
+                auto key = static_cast<String *>(args[i].get());
+                Handle<Obj> value(ObjIntegerIf(args[i + 1].get()));
+                db->Put(key->data(), version, value.get());
+            }
+        } break;
+
         case CMD_LIST: {
             GET_KEY(key, 0);
             Handle<List> list(List::New());
+            if (!list.get()) {
+                return Status::Systemf("not enough memory.");
+            }
             for (size_t i = 1; i < args.size(); i++) {
-                list->stub()->InsertTail(args[i].get());
+                if (!list->stub()->InsertTail(args[i].get())) {
+                    return Status::Systemf("not enough memory.");
+                }
             }
             db->Put(key->data(), version, list.get());
         } break;
@@ -236,15 +643,20 @@ yuki::Status RedoCommand(const Command &cmd,
             }
 
             List *list = static_cast<List *>(obj);
-            if (cmd.code == CMD_LPUSH) {
-                for (size_t i = 1; i < args.size(); i++) {
-                    list->stub()->InsertHead(args[i].get());
-                }
-            } else {
-                for (size_t i = 1; i < args.size(); i++) {
+            for (size_t i = 1; i < args.size(); i++) {
+                auto ok = (cmd.code == CMD_LPUSH) ?
+                    list->stub()->InsertHead(args[i].get()) :
                     list->stub()->InsertTail(args[i].get());
+                if (!ok) {
+                    ObjRelease(list);
+                    return Status::Systemf("not enough memory.");
                 }
             }
+            if (db->copy_values()) {
+                db->Put(key->data(), version, list);
+            } else {
+                db->RecountUsage(key->data());
+            }
             ObjRelease(list);
         } break;
 
@@ -268,6 +680,11 @@ yuki::Status RedoCommand(const Command &cmd,
             } else {
                 list->stub()->PopTail(&stub);
             }
+            if (db->copy_values()) {
+                db->Put(key->data(), version, list);
+            } else {
+                db->RecountUsage(key->data());
+            }
             ObjRelease(stub);
             ObjRelease(obj);
         } break;
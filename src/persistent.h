@@ -4,6 +4,7 @@
 #include "yuki/status.h"
 #include "yuki/slice.h"
 #include <string>
+#include <stdint.h>
 
 namespace yukino {
 
@@ -14,7 +15,8 @@ class OutputStream;
 struct TableOptions {
     yuki::Slice   file_name;
     bool          overwrite;
-    int           fd;
+    int           fd; // the opened table file, or -1 to open `file_name'.
+    int           num_threads; // for loading, 0 for the number of CPUs.
 
     TableOptions();
 };
@@ -24,6 +26,11 @@ yuki::Status LoadTable(const TableOptions &options, DB *db);
 
 yuki::Status DBRedo(yuki::SliceRef file_name, DB *db, size_t *be_read);
 
+// Same as above, but skip the first `skip' records, they be applied already.
+// `num_records' be the number of all records in the log.
+yuki::Status DBRedo(yuki::SliceRef file_name, DB *db, int64_t skip,
+                    size_t *be_read, int64_t *num_records);
+
 } // namespace yukino
 
 #endif // YUKINO_PERSISTENT_H_
\ No newline at end of file
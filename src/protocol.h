@@ -18,7 +18,20 @@ namespace yukino {
     _(LPUSH,  2) \
     _(LPOP,   1) \
     _(RPUSH,  2) \
-    _(RPOP,   1)
+    _(RPOP,   1) \
+    _(MGET,   1) \
+    _(MSET,   2) \
+    _(RANGE,  2) \
+    _(PREFIX, 1) \
+    _(RCOUNT, 2) \
+    _(SCAN,   1) \
+    _(EXPIRE, 2) \
+    _(PEXPIREAT, 2) \
+    _(TTL,    1) \
+    _(PERSIST, 1) \
+    _(INCR,   1) \
+    _(DECR,   1) \
+    _(INCRBY, 2)
 
 enum CmdCode {
 #define DEF_CMD_CODE(name, argc) CMD_##name,
@@ -0,0 +1,208 @@
+#include "quick_list.h"
+#include "handle.h"
+#include "obj.h"
+#include "yuki/utils.h"
+#include "gtest/gtest.h"
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace {
+
+int64_t IntegerOf(Obj *ob) {
+    return static_cast<Integer *>(ob)->data();
+}
+
+} // namespace
+
+TEST(QuickListTest, Sanity) {
+    QuickList list;
+    Obj *value = nullptr;
+
+    EXPECT_TRUE(list.empty());
+    EXPECT_FALSE(list.PopHead(&value));
+    EXPECT_FALSE(list.PopTail(&value));
+
+    list.InsertTail(Integer::New(1));
+    list.InsertTail(Integer::New(2));
+    list.InsertHead(Integer::New(0));
+    EXPECT_EQ(3, list.size());
+
+    ASSERT_TRUE(list.Index(0, &value));
+    EXPECT_EQ(0, IntegerOf(value));
+    ObjRelease(value);
+    ASSERT_TRUE(list.Index(-1, &value));
+    EXPECT_EQ(2, IntegerOf(value));
+    ObjRelease(value);
+    EXPECT_FALSE(list.Index(3, &value));
+    EXPECT_FALSE(list.Index(-4, &value));
+
+    ASSERT_TRUE(list.PopHead(&value));
+    EXPECT_EQ(0, IntegerOf(value));
+    ObjRelease(value);
+    ASSERT_TRUE(list.PopTail(&value));
+    EXPECT_EQ(2, IntegerOf(value));
+    ObjRelease(value);
+    EXPECT_EQ(1, list.size());
+}
+
+TEST(QuickListTest, Chunks) {
+    static const int N = QuickList::CHUNK_SIZE * 10;
+
+    QuickList list;
+    for (int i = 0; i < N; i++) {
+        list.InsertTail(Integer::New(i));
+    }
+    for (int i = 1; i <= N; i++) {
+        list.InsertHead(Integer::New(-i));
+    }
+    EXPECT_EQ(2 * N, list.size());
+    EXPECT_EQ(20, list.TEST_num_chunks());
+
+    // [-N, N)
+    for (int i = 0; i < 2 * N; i += 7) {
+        Obj *value;
+        ASSERT_TRUE(list.Index(i, &value));
+        EXPECT_EQ(i - N, IntegerOf(value));
+        ObjRelease(value);
+    }
+
+    int64_t expected = -N;
+    QuickList::Iterator iter(&list);
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        EXPECT_EQ(expected++, IntegerOf(iter.value()));
+    }
+    EXPECT_EQ(N, expected);
+}
+
+TEST(QuickListTest, PopFreesChunks) {
+    QuickList list;
+    for (int i = 0; i < QuickList::CHUNK_SIZE * 3; i++) {
+        list.InsertTail(Integer::New(i));
+    }
+    EXPECT_EQ(3, list.TEST_num_chunks());
+
+    Obj *value;
+    for (int i = 0; i < QuickList::CHUNK_SIZE; i++) {
+        ASSERT_TRUE(list.PopHead(&value));
+        EXPECT_EQ(i, IntegerOf(value));
+        ObjRelease(value);
+    }
+    EXPECT_EQ(2, list.TEST_num_chunks());
+
+    while (list.PopTail(&value)) {
+        ObjRelease(value);
+    }
+    EXPECT_EQ(0, list.TEST_num_chunks());
+    EXPECT_TRUE(list.empty());
+
+    // Reused as a queue after drained.
+    list.InsertHead(Integer::New(7));
+    ASSERT_TRUE(list.PopTail(&value));
+    EXPECT_EQ(7, IntegerOf(value));
+    ObjRelease(value);
+}
+
+TEST(QuickListTest, Packed) {
+    QuickList list;
+    ASSERT_TRUE(list.packed());
+
+    list.InsertTail(Integer::New(1));
+    list.InsertTail(String::New(yuki::Slice("two")));
+    list.InsertHead(Integer::New(0));
+    EXPECT_TRUE(list.packed());
+    EXPECT_EQ(0, list.TEST_num_chunks());
+
+    Obj *value;
+    ASSERT_TRUE(list.Index(1, &value));
+    EXPECT_EQ(1, IntegerOf(value));
+    ObjRelease(value);
+    ASSERT_TRUE(list.Index(-1, &value));
+    ASSERT_EQ(YKN_STRING, value->type());
+    EXPECT_EQ("two", static_cast<String *>(value)->data().ToString());
+    ObjRelease(value);
+
+    // Too long string, converted to chunks.
+    std::string large(ListPack::MAX_STRING_SIZE + 1, 'x');
+    list.InsertTail(String::New(yuki::Slice(large)));
+    EXPECT_FALSE(list.packed());
+    EXPECT_EQ(1, list.TEST_num_chunks());
+    EXPECT_EQ(4, list.size());
+
+    int i = 0;
+    QuickList::Iterator iter(&list);
+    for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        if (i < 2) {
+            EXPECT_EQ(i, IntegerOf(iter.value()));
+        }
+        i++;
+    }
+    EXPECT_EQ(4, i);
+}
+
+TEST(QuickListTest, PackedOverMax) {
+    QuickList list;
+    for (int i = 0; i < QuickList::max_packed(); i++) {
+        list.InsertTail(Integer::New(i));
+    }
+    EXPECT_TRUE(list.packed());
+
+    Obj *value;
+    ASSERT_TRUE(list.PopTail(&value));
+    EXPECT_EQ(QuickList::max_packed() - 1, IntegerOf(value));
+    ObjRelease(value);
+
+    list.InsertTail(Integer::New(-1));
+    list.InsertTail(Integer::New(-2));
+    EXPECT_FALSE(list.packed());
+    EXPECT_EQ(QuickList::max_packed() + 1, list.size());
+
+    ASSERT_TRUE(list.Index(-2, &value));
+    EXPECT_EQ(-1, IntegerOf(value));
+    ObjRelease(value);
+}
+
+TEST(QuickListTest, MutliThreadPushPop) {
+    static const int kNumRecords = 10000;
+
+    QuickList list;
+    std::thread producers[2];
+    for (int i = 0; i < arraysize(producers); i++) {
+        producers[i] = std::move(std::thread([&list] (int id) {
+            for (int j = 0; j < kNumRecords; j++) {
+                if (id == 0) {
+                    list.InsertHead(Integer::New(j));
+                } else {
+                    list.InsertTail(Integer::New(j));
+                }
+            }
+        }, i));
+    }
+
+    std::atomic<int> num_popped(0);
+    std::thread consumers[2];
+    for (int i = 0; i < arraysize(consumers); i++) {
+        consumers[i] = std::move(std::thread([&] (int id) {
+            while (num_popped.load() < kNumRecords) {
+                Obj *value;
+                bool ok = id == 0 ? list.PopHead(&value) : list.PopTail(&value);
+                if (ok) {
+                    ObjRelease(value);
+                    num_popped.fetch_add(1);
+                }
+            }
+        }, i));
+    }
+
+    for (auto &thread : producers) {
+        thread.join();
+    }
+    for (auto &thread : consumers) {
+        thread.join();
+    }
+    EXPECT_LE(kNumRecords, num_popped.load());
+    EXPECT_EQ(2 * kNumRecords - num_popped.load(), list.size());
+}
+
+} // namespace yukino
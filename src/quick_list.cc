@@ -0,0 +1,360 @@
+#include "quick_list.h"
+#include "obj.h"
+#include "slab.h"
+#include "glog/logging.h"
+
+namespace yukino {
+
+namespace {
+
+// Bytes of an element out of the chunk, shared ones be not counted.
+size_t ElemBytes(Obj *value) {
+    if (value->immortal()) {
+        return 0;
+    }
+    switch (value->type()) {
+        case YKN_STRING:
+            return String::PredictSize(static_cast<String *>(value)->data());
+        case YKN_INTEGER:
+            return Integer::PredictSize(static_cast<Integer *>(value)->data());
+        default:
+            return 0;
+    }
+}
+
+} // namespace
+
+/*static*/ int QuickList::max_packed_ = QuickList::DEFAULT_MAX_PACKED;
+
+QuickList::QuickList()
+    : head_(nullptr)
+    , tail_(nullptr)
+    , size_(0)
+    , packed_(max_packed_ > 0)
+    , chunk_bytes_(0)
+    , counted_bytes_(0) {
+}
+
+QuickList::~QuickList() {
+    UnsafeFreeChunks();
+}
+
+bool QuickList::InsertHead(Obj *value) {
+    WriterLock scope(&rwlock_);
+    if (packed_) {
+        if (UnsafePackable(value)) {
+            pack_.PushHead(value);
+            ObjRelease(ObjAddRef(value)); // Copied, no reference.
+            size_.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+        if (!UnsafeUnpack()) {
+            return false;
+        }
+    }
+    if (!UnsafeInsertHead(value)) {
+        return false;
+    }
+    size_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool QuickList::InsertTail(Obj *value) {
+    WriterLock scope(&rwlock_);
+    if (packed_) {
+        if (UnsafePackable(value)) {
+            pack_.PushTail(value);
+            ObjRelease(ObjAddRef(value));
+            size_.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+        if (!UnsafeUnpack()) {
+            return false;
+        }
+    }
+    if (!UnsafeInsertTail(value)) {
+        return false;
+    }
+    size_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool QuickList::PopHead(Obj **value) {
+    WriterLock scope(&rwlock_);
+    if (packed_) {
+        if (pack_.size() == 0) {
+            return false;
+        }
+        *value = ObjAddRef(pack_.Get(pack_.begin()));
+        if (!*value) {
+            return false;
+        }
+        pack_.Erase(pack_.begin());
+        size_.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    if (!head_) {
+        return false;
+    }
+    *value = head_->elems[head_->begin++];
+    chunk_bytes_ -= ElemBytes(*value);
+    if (head_->size() == 0) {
+        auto chunk = head_;
+        head_ = chunk->next;
+        if (head_) {
+            head_->prev = nullptr;
+        } else {
+            tail_ = nullptr;
+        }
+        FreeChunk(chunk);
+    }
+    size_.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool QuickList::PopTail(Obj **value) {
+    WriterLock scope(&rwlock_);
+    if (packed_) {
+        if (pack_.size() == 0) {
+            return false;
+        }
+        auto last = pack_.Last();
+        *value = ObjAddRef(pack_.Get(last));
+        if (!*value) {
+            return false;
+        }
+        pack_.Erase(last);
+        size_.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    if (!tail_) {
+        return false;
+    }
+    *value = tail_->elems[--tail_->end];
+    chunk_bytes_ -= ElemBytes(*value);
+    if (tail_->size() == 0) {
+        auto chunk = tail_;
+        tail_ = chunk->prev;
+        if (tail_) {
+            tail_->next = nullptr;
+        } else {
+            head_ = nullptr;
+        }
+        FreeChunk(chunk);
+    }
+    size_.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+bool QuickList::Index(int64_t index, Obj **value) {
+    ReaderLock scope(&rwlock_);
+    auto size = static_cast<int64_t>(size_.load(std::memory_order_relaxed));
+    if (index < 0) {
+        index += size;
+    }
+    if (index < 0 || index >= size) {
+        return false;
+    }
+
+    if (packed_) {
+        auto offset = pack_.begin();
+        while (index--) {
+            offset = pack_.Next(offset);
+        }
+        *value = ObjAddRef(pack_.Get(offset));
+        return *value != nullptr;
+    }
+
+    // Walk chunks from the nearer end.
+    if (index < size / 2) {
+        auto chunk = head_;
+        while (index >= chunk->size()) {
+            index -= chunk->size();
+            chunk = chunk->next;
+        }
+        *value = ObjAddRef(chunk->elems[chunk->begin + index]);
+    } else {
+        auto rindex = size - 1 - index;
+        auto chunk = tail_;
+        while (rindex >= chunk->size()) {
+            rindex -= chunk->size();
+            chunk = chunk->prev;
+        }
+        *value = ObjAddRef(chunk->elems[chunk->end - 1 - rindex]);
+    }
+    return true;
+}
+
+size_t QuickList::bytes() const {
+    ReaderLock scope(&rwlock_);
+    return packed_ ? pack_.bytes() : chunk_bytes_;
+}
+
+int64_t QuickList::Recount() {
+    auto now = static_cast<int64_t>(bytes());
+    return now - counted_bytes_.exchange(now, std::memory_order_relaxed);
+}
+
+size_t QuickList::TEST_num_chunks() {
+    ReaderLock scope(&rwlock_);
+    size_t n = 0;
+    for (auto chunk = head_; chunk; chunk = chunk->next) {
+        n++;
+    }
+    return n;
+}
+
+bool QuickList::UnsafePackable(const Obj *value) const {
+    return pack_.size() < static_cast<size_t>(max_packed_) &&
+           ListPack::Packable(value);
+}
+
+// Keep packed if out of memory.
+bool QuickList::UnsafeUnpack() {
+    DCHECK(packed_);
+    for (auto i = pack_.begin(); i < pack_.end(); i = pack_.Next(i)) {
+        auto value = pack_.Get(i);
+        if (!value || !UnsafeInsertTail(value)) {
+            ObjRelease(ObjAddRef(value));
+            UnsafeFreeChunks();
+            return false;
+        }
+    }
+    pack_.Clear();
+    packed_ = false;
+    return true;
+}
+
+void QuickList::UnsafeFreeChunks() {
+    auto chunk = head_;
+    while (chunk) {
+        for (auto i = chunk->begin; i < chunk->end; i++) {
+            ObjRelease(chunk->elems[i]);
+        }
+        auto next = chunk->next;
+        FreeChunk(chunk);
+        chunk = next;
+    }
+    head_ = nullptr;
+    tail_ = nullptr;
+    chunk_bytes_ = 0;
+}
+
+bool QuickList::UnsafeInsertHead(Obj *value) {
+    if (!head_ || head_->begin == 0) {
+        // Fill the new head chunk from its end.
+        auto chunk = NewChunk(CHUNK_SIZE);
+        if (!chunk) {
+            return false;
+        }
+        chunk->next = head_;
+        if (head_) {
+            head_->prev = chunk;
+        } else {
+            tail_ = chunk;
+        }
+        head_ = chunk;
+    }
+    head_->elems[--head_->begin] = ObjAddRef(value);
+    chunk_bytes_ += ElemBytes(value);
+    return true;
+}
+
+bool QuickList::UnsafeInsertTail(Obj *value) {
+    if (!tail_ || tail_->end == CHUNK_SIZE) {
+        auto chunk = NewChunk(0);
+        if (!chunk) {
+            return false;
+        }
+        chunk->prev = tail_;
+        if (tail_) {
+            tail_->next = chunk;
+        } else {
+            head_ = chunk;
+        }
+        tail_ = chunk;
+    }
+    tail_->elems[tail_->end++] = ObjAddRef(value);
+    chunk_bytes_ += ElemBytes(value);
+    return true;
+}
+
+QuickList::Chunk *QuickList::NewChunk(uint32_t offset) {
+    auto chunk = static_cast<Chunk *>(Slab::Allocate(sizeof(Chunk)));
+    if (!chunk) {
+        return nullptr;
+    }
+    chunk->prev  = nullptr;
+    chunk->next  = nullptr;
+    chunk->begin = offset;
+    chunk->end   = offset;
+    chunk_bytes_ += sizeof(Chunk);
+    return chunk;
+}
+
+void QuickList::FreeChunk(Chunk *chunk) {
+    chunk_bytes_ -= sizeof(Chunk);
+    Slab::Free(chunk);
+}
+
+QuickList::Iterator::Iterator(QuickList *list)
+    : list_(DCHECK_NOTNULL(list))
+    , chunk_(nullptr)
+    , index_(0)
+    , offset_(0)
+    , value_(nullptr) {
+    list_->rwlock_.ReadLock();
+    if (list_->packed_) {
+        offset_ = list_->pack_.end();
+    }
+}
+
+QuickList::Iterator::~Iterator() {
+    if (list_->packed_) {
+        ObjRelease(value_);
+    }
+    list_->rwlock_.Unlock();
+}
+
+void QuickList::Iterator::SeekToFirst() {
+    if (list_->packed_) {
+        offset_ = list_->pack_.begin();
+    } else {
+        chunk_ = list_->head_;
+        index_ = chunk_ ? chunk_->begin : 0;
+    }
+    Decode();
+}
+
+bool QuickList::Iterator::Valid() const {
+    if (list_->packed_) {
+        return offset_ < list_->pack_.end();
+    }
+    return chunk_ != nullptr;
+}
+
+void QuickList::Iterator::Next() {
+    DCHECK(Valid());
+    if (list_->packed_) {
+        offset_ = list_->pack_.Next(offset_);
+    } else if (++index_ >= chunk_->end) {
+        chunk_ = chunk_->next;
+        index_ = chunk_ ? chunk_->begin : 0;
+    }
+    Decode();
+}
+
+// Packed values be decoded and held by the iterator.
+void QuickList::Iterator::Decode() {
+    if (!list_->packed_) {
+        value_ = Valid() ? chunk_->elems[index_] : nullptr;
+        return;
+    }
+    ObjRelease(value_);
+    value_ = Valid() ? ObjAddRef(list_->pack_.Get(offset_)) : nullptr;
+    CHECK(value_ || !Valid()) << "Out of memory for decoding.";
+}
+
+} // namespace yukino
@@ -0,0 +1,135 @@
+#ifndef YUKINO_QUICK_LIST_H_
+#define YUKINO_QUICK_LIST_H_
+
+#include "list_pack.h"
+#include "rw_spin_lock.h"
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace yukino {
+
+struct Obj;
+
+//
+// Doubly-linked chain of chunks, every chunk packs at most CHUNK_SIZE
+// elements in one array. Pushing and popping at both ends be O(1), the
+// length be counted, indexing be O(n / CHUNK_SIZE).
+//
+// Small lists of small strings and integers be packed in a ListPack first,
+// values be copied in and decoded out. It be converted to chunks when
+// grows over `max_packed' elements or any value can not be packed.
+//
+// Writers lock the list (writer), readers and iterators lock it (reader).
+// Elements be referenced by the list.
+//
+class QuickList {
+public:
+    enum { CHUNK_SIZE = 64 };
+
+    // Elements be in [begin, end) of `elems'.
+    struct Chunk {
+        Chunk   *prev;
+        Chunk   *next;
+        uint32_t begin;
+        uint32_t end;
+        Obj     *elems[CHUNK_SIZE];
+
+        uint32_t size() const { return end - begin; }
+    };
+
+    // Holds the reader lock in its life time. The value be valid until
+    // Next(). Dies if a packed value can not be decoded for out of memory.
+    class Iterator {
+    public:
+        Iterator(QuickList *list);
+        ~Iterator();
+
+        void SeekToFirst();
+
+        bool Valid() const;
+
+        void Next();
+
+        Obj *value() const { return value_; }
+
+    private:
+        void Decode();
+
+        QuickList *list_;
+        const Chunk *chunk_;
+        uint32_t index_;
+        size_t offset_; // of the packed list
+        Obj *value_;
+    };
+
+    QuickList();
+    QuickList(const QuickList &) = delete;
+    QuickList(QuickList &&) = delete;
+    void operator = (const QuickList &) = delete;
+
+    ~QuickList();
+
+    // Return false if out of memory, the list be unchanged.
+    bool InsertHead(Obj *value);
+    bool InsertTail(Obj *value);
+
+    // The popped value's reference be moved to the caller.
+    bool PopHead(Obj **value);
+    bool PopTail(Obj **value);
+
+    // Negative `index' counts from the tail, -1 is the last one. The value
+    // holds a reference.
+    bool Index(int64_t index, Obj **value);
+
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+
+    bool empty() const { return size() == 0; }
+
+    bool packed() const { return packed_; }
+
+    // Approximate bytes of the elements and chunks, out of the list itself.
+    size_t bytes() const;
+
+    // Bytes be counted by the table holding the list. Return the change since
+    // the last counting, and count it. Must be called under the lock of the
+    // entry, see CocurrentHashMap::RecountUsage().
+    int64_t Recount();
+    int64_t counted_bytes() const {
+        return counted_bytes_.load(std::memory_order_relaxed);
+    }
+
+    // Must be set before any list be made.
+    static void set_max_packed(int n) { max_packed_ = n; }
+    static int max_packed() { return max_packed_; }
+
+    enum { DEFAULT_MAX_PACKED = 128 };
+
+    // For testing:
+    size_t TEST_num_chunks();
+
+private:
+    // Must be called under the writer lock.
+    bool UnsafePackable(const Obj *value) const;
+    bool UnsafeUnpack();
+    void UnsafeFreeChunks();
+    bool UnsafeInsertHead(Obj *value);
+    bool UnsafeInsertTail(Obj *value);
+    Chunk *NewChunk(uint32_t offset);
+    void FreeChunk(Chunk *chunk);
+
+    Chunk *head_;
+    Chunk *tail_;
+    std::atomic<size_t> size_;
+    mutable RWSpinLock rwlock_;
+    bool packed_;
+    ListPack pack_;
+    size_t chunk_bytes_; // of chunks and their elements.
+    std::atomic<int64_t> counted_bytes_;
+
+    static int max_packed_;
+};
+
+} // namespace yukino
+
+#endif // YUKINO_QUICK_LIST_H_
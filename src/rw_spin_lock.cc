@@ -91,7 +91,7 @@ void RWSpinLock::Unlock() {
                                             std::memory_order_relaxed);
     if (readers == 0) {
         std::atomic_store_explicit(&spin_lock_, kLockBais,
-                                   std::memory_order_relaxed);
+                                   std::memory_order_release);
         return;
     }
 
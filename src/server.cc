@@ -3,12 +3,18 @@
 #include "background.h"
 #include "db.h"
 #include "configuration.h"
+#include "quick_list.h"
+#include "compact_hash.h"
+#include "epoch.h"
 #include "ae.h"
 #include "anet.h"
 #include <sys/time.h>
 
 namespace yukino {
 
+static const int kCronInterval = 100; // ms
+static const int kCronBudget   = 1;   // ms for each db
+
 Server::Server(const std::string &conf_file, Configuration *conf, int num_events)
     : num_events_(num_events)
     , conf_file_(conf_file)
@@ -40,6 +46,10 @@ Server::~Server() {
 yuki::Status Server::Init() {
     using yuki::Status;
 
+    // Encoding of values must be set before any value be made.
+    QuickList::set_max_packed(conf().list_max_packed());
+    CompactHash::set_max_packed(conf().hash_max_packed());
+
     background_work_queue_ = new Background::Delegate;
     if (conf().num_db_conf() > 0) {
         dbs_ = new DB *[conf().num_db_conf()];
@@ -49,7 +59,9 @@ yuki::Status Server::Init() {
 
         memset(dbs_, 0, sizeof(DB *) * conf().num_db_conf());
         for (size_t i = 0; i < conf().num_db_conf(); i++) {
-            dbs_[i] = DB::New(conf().db_conf(i), conf().data_dir(),
+            auto db_conf = conf().db_conf(i);
+            db_conf.log_fsync = conf().log_fsync();
+            dbs_[i] = DB::New(db_conf, conf().data_dir(),
                               static_cast<int>(i), background_work_queue_);
             if (!dbs_[i]) {
                 return Status::Errorf(Status::kSystemError,
@@ -76,6 +88,7 @@ yuki::Status Server::Init() {
     }
     aeCreateFileEvent(event_loop_, listener_fd_, AE_READABLE,
                       HandleListenAccept, this);
+    aeCreateTimeEvent(event_loop_, kCronInterval, HandleCron, this, nullptr);
 
     int num_workers = conf().num_workers();
     workers_ = new Worker[num_workers];
@@ -137,6 +150,18 @@ void Server::HandleListenAccept(aeEventLoop *, int listener, void *data, int) {
     }
 }
 
+/*static*/
+int Server::HandleCron(aeEventLoop *, long long, void *data) {
+    auto self = static_cast<Server *>(DCHECK_NOTNULL(data));
+
+    for (size_t i = 0; i < self->conf().num_db_conf(); i++) {
+        self->db(static_cast<int>(i))->Cron(kCronBudget);
+    }
+    // The rehashing retires the old slots in this thread.
+    Epoch::Quiescent();
+    return kCronInterval;
+}
+
 void Server::IncomingClientAccept(int client_fd, yuki::SliceRef ip, int port) {
     int i = rand() % conf().num_workers();
 
@@ -50,6 +50,7 @@ public:
 private:
     static void HandleListenAccept(aeEventLoop *el, int fd, void *data,
                                    int mask);
+    static int HandleCron(aeEventLoop *el, long long id, void *data);
 
     void IncomingClientAccept(int client_fd, yuki::SliceRef ip, int port);
 
@@ -0,0 +1,314 @@
+#include "sharded_hash_map.h"
+#include "cocurrent_hash_map.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace yukino {
+
+class ShardedHashMapTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        ASSERT_EQ(nullptr, map_);
+        map_ = new ShardedHashMap(1023, ShardedHashMap::DEFAULT_NUM_SHARDS);
+    }
+
+    virtual void TearDown() override {
+        ASSERT_NE(nullptr, map_);
+        delete map_;
+        map_ = nullptr;
+    }
+
+protected:
+    ShardedHashMap *map_ = nullptr;
+};
+
+TEST_F(ShardedHashMapTest, Sanity) {
+    auto rv = map_->Put(yuki::Slice("name"), 0, String::New(yuki::Slice("Jake")));
+    ASSERT_TRUE(rv.Ok());
+    rv = map_->Put(yuki::Slice("age"), 0, String::New(yuki::Slice("100")));
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ(2, map_->num_keys());
+
+    Obj *obj = nullptr;
+    rv = map_->Get(yuki::Slice("name"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ(YKN_STRING, obj->type());
+    EXPECT_EQ("Jake", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+
+    EXPECT_TRUE(map_->Delete(yuki::Slice("name")));
+    EXPECT_FALSE(map_->Delete(yuki::Slice("name")));
+    EXPECT_FALSE(map_->Exist(yuki::Slice("name")));
+    EXPECT_TRUE(map_->Exist(yuki::Slice("age")));
+    EXPECT_EQ(1, map_->num_keys());
+}
+
+TEST_F(ShardedHashMapTest, Iterator) {
+    std::unique_ptr<Iterator> iter(map_->iterator());
+    iter->SeekToFirst();
+    EXPECT_FALSE(iter->Valid());
+    iter.reset();
+
+    const auto N = 1000;
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+
+    // Every shard got its part of keys.
+    for (int i = 0; i < map_->num_shards(); i++) {
+        EXPECT_GT(map_->shard(i)->num_keys(), 0) << i;
+    }
+
+    std::set<std::string> keys;
+    iter.reset(map_->iterator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        keys.insert(iter->key()->key().ToString());
+    }
+    EXPECT_EQ(N, keys.size());
+}
+
+TEST_F(ShardedHashMapTest, IndependentResizing) {
+    const auto N = 20000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        map_->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+    while (map_->IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+        ;
+    ASSERT_EQ(N, map_->num_keys());
+
+    for (int i = 0; i < map_->num_shards(); i++) {
+        auto shard = map_->shard(i);
+        EXPECT_FALSE(shard->is_rehashing());
+        EXPECT_LE(shard->num_keys(), shard->num_slots()) << i;
+    }
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("k.%d", i);
+        ASSERT_TRUE(map_->Exist(yuki::Slice(key))) << key;
+    }
+}
+
+TEST_F(ShardedHashMapTest, MultiGet) {
+    const int N = 1000;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < N; i++) {
+        keys.push_back(yuki::Strings::Format("key.%d", i));
+        if (i % 2 == 0) {
+            map_->Put(yuki::Slice(keys.back()), 0, Integer::New(i));
+        }
+    }
+
+    std::vector<yuki::Slice> slices(keys.begin(), keys.end());
+    std::vector<Obj *> values(N, nullptr);
+    EXPECT_EQ(N / 2, map_->MultiGet(N, slices.data(), values.data()));
+    for (int i = 0; i < N; i++) {
+        if (i % 2 != 0) {
+            EXPECT_EQ(nullptr, values[i]) << keys[i];
+            continue;
+        }
+        ASSERT_NE(nullptr, values[i]) << keys[i];
+        ASSERT_EQ(YKN_INTEGER, values[i]->type());
+        EXPECT_EQ(i, static_cast<Integer *>(values[i])->data());
+        ObjRelease(values[i]);
+    }
+}
+
+TEST_F(ShardedHashMapTest, Scan) {
+    const int N = 1000;
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("key.%d", i);
+        map_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+
+    std::set<std::string> keys;
+    uint64_t cursor = 0;
+    do {
+        cursor = map_->Scan(cursor, 10, [&keys] (KeyBoundle *key, Obj *) {
+            keys.insert(key->key().ToString());
+        });
+    } while (cursor != 0);
+    EXPECT_EQ(N, keys.size());
+}
+
+TEST(ShardedHashMapBenchmark, MultiGet) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    const int kNumKeys  = 1000000;
+    const int kNumReads = 2000000;
+    const int kBatch    = 100;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < kNumKeys; i++) {
+        keys.push_back(yuki::Strings::Format("key.%d", i));
+    }
+
+    ShardedHashMap map(1023, ShardedHashMap::DEFAULT_NUM_SHARDS);
+    for (auto &key : keys) {
+        map.Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+    }
+    while (map.IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+        ;
+
+    std::vector<yuki::Slice> batch(kBatch);
+    std::vector<Obj *> values(kBatch);
+    for (int pipelined = 0; pipelined < 2; pipelined++) {
+        int hit = 0;
+        auto start = steady_clock::now();
+        for (int i = 0; i < kNumReads; i += kBatch) {
+            for (int j = 0; j < kBatch; j++) {
+                batch[j] = yuki::Slice(keys[((i + j) * 7919L) % kNumKeys]);
+            }
+            if (pipelined) {
+                hit += map.MultiGet(kBatch, batch.data(), values.data());
+            } else {
+                for (int j = 0; j < kBatch; j++) {
+                    if (map.Get(batch[j], nullptr, &values[j]).Ok()) {
+                        hit++;
+                    }
+                }
+            }
+            for (auto value : values) {
+                ObjRelease(value);
+            }
+        }
+        auto cost = duration_cast<microseconds>(steady_clock::now() -
+                                                start).count();
+
+        EXPECT_EQ(kNumReads, hit);
+        printf("%-8s batch %d: %.2f get QPS\n",
+               pipelined ? "MultiGet" : "Get", kBatch,
+               static_cast<double>(hit) * 1000000.0 / cost);
+    }
+}
+
+// Needs about 200GB memory for 3B keys. The slab region be as large as the
+// physical memory, and objects over it come from malloc(), so only the
+// physical memory limits it. Fewer keys be set by YUKINO_TEST_NUM_KEYS, run
+// it by:
+//     yukino-test --gtest_also_run_disabled_tests --gtest_filter=*BillionKeys
+TEST(ShardedHashMapBenchmark, DISABLED_BillionKeys) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::seconds;
+
+    int64_t num_keys = 3000000000LL;
+    if (getenv("YUKINO_TEST_NUM_KEYS")) {
+        num_keys = strtoll(getenv("YUKINO_TEST_NUM_KEYS"), nullptr, 10);
+    }
+    auto num_threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+
+    ShardedHashMap map(1023, 256);
+    auto start = steady_clock::now();
+    std::vector<std::thread> writers;
+    for (int i = 0; i < num_threads; i++) {
+        writers.emplace_back([&, i] () {
+            char key[32];
+            for (int64_t j = i; j < num_keys; j += num_threads) {
+                auto n = snprintf(key, sizeof(key), "%" PRId64, j);
+                map.Put(yuki::Slice(key, n), 0, Integer::New(j));
+            }
+        });
+    }
+    for (auto &writer : writers) {
+        writer.join();
+    }
+    while (map.IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+        ;
+    auto cost = duration_cast<seconds>(steady_clock::now() - start).count();
+    printf("load %" PRId64 " keys: %" PRId64 " s\n", num_keys,
+           static_cast<int64_t>(cost));
+
+    ASSERT_EQ(num_keys, map.num_keys());
+    for (int64_t j = 0; j < num_keys; j += num_keys / 1000 + 1) {
+        char key[32];
+        auto n = snprintf(key, sizeof(key), "%" PRId64, j);
+        Obj *value = nullptr;
+        ASSERT_TRUE(map.Get(yuki::Slice(key, n), nullptr, &value).Ok()) << j;
+        EXPECT_EQ(j, static_cast<Integer *>(value)->data());
+        ObjRelease(value);
+    }
+}
+
+TEST(ShardedHashMapBenchmark, ReadScaling) {
+    using std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    const int kNumKeys  = 100000;
+    const int kNumReads = 400000;
+    const int kThreads[] = {1, 2, 4, 8, 16, 32, 64};
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < kNumKeys; i++) {
+        keys.push_back(yuki::Strings::Format("key.%d", i));
+    }
+
+    std::unique_ptr<MemTable> maps[] = {
+        std::unique_ptr<MemTable>(new CocurrentHashMap(1023)),
+        std::unique_ptr<MemTable>(
+            new ShardedHashMap(1023, ShardedHashMap::DEFAULT_NUM_SHARDS)),
+    };
+    const char *names[] = {"single", "sharded"};
+
+    for (auto &map : maps) {
+        for (auto &key : keys) {
+            map->Put(yuki::Slice(key), 0, String::New(yuki::Slice(key)));
+        }
+        while (map->IncrementalRehash(CocurrentHashMap::REHASH_STEPS_PER_OP))
+            ;
+    }
+
+    for (auto num_threads : kThreads) {
+        for (int m = 0; m < arraysize(maps); m++) {
+            auto map = maps[m].get();
+            std::vector<std::thread> readers;
+            std::atomic<int> hit(0);
+
+            auto start = steady_clock::now();
+            for (int i = 0; i < num_threads; i++) {
+                readers.emplace_back([&, i] () {
+                    int n = 0;
+                    auto num_reads = kNumReads / num_threads;
+                    for (int j = 0; j < num_reads; j++) {
+                        auto &key = keys[(j * 7919L + i) % kNumKeys];
+                        if (map->Exist(yuki::Slice(key))) {
+                            n++;
+                        }
+                    }
+                    hit.fetch_add(n);
+                });
+            }
+            for (auto &reader : readers) {
+                reader.join();
+            }
+            auto cost = duration_cast<microseconds>(steady_clock::now() -
+                                                    start).count();
+
+            EXPECT_EQ(kNumReads / num_threads * num_threads, hit.load());
+            printf("%-7s %2d threads: %.2f get QPS\n", names[m], num_threads,
+                   static_cast<double>(hit.load()) * 1000000.0 / cost);
+        }
+    }
+}
+
+} // namespace yukino
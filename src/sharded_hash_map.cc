@@ -0,0 +1,323 @@
+#include "sharded_hash_map.h"
+#include "cocurrent_hash_map.h"
+#include "iterator.h"
+#include "key.h"
+#include "glog/logging.h"
+#include <memory>
+#include <vector>
+
+namespace yukino {
+
+namespace {
+
+// Walk shards one by one, only hold the iterator (and the gaint lock) of
+// the current shard.
+class IteratorImpl : public Iterator {
+public:
+    IteratorImpl(CocurrentHashMap **shards, int num_shards)
+        : shards_(DCHECK_NOTNULL(shards))
+        , num_shards_(num_shards)
+        , shard_(num_shards) {
+    }
+
+    virtual ~IteratorImpl() override;
+    virtual bool Valid() const override;
+    virtual void SeekToFirst() override;
+    virtual void Next() override;
+    virtual yuki::Status status() const override;
+    virtual KeyBoundle *key() const override;
+    virtual Obj *value() const override;
+
+private:
+    void SeekToNonEmptyShard();
+
+    CocurrentHashMap **shards_;
+    const int num_shards_;
+    int shard_;
+    std::unique_ptr<Iterator> iter_;
+};
+
+IteratorImpl::~IteratorImpl() {
+}
+
+bool IteratorImpl::Valid() const {
+    return shard_ < num_shards_;
+}
+
+void IteratorImpl::SeekToFirst() {
+    shard_ = 0;
+    iter_.reset(shards_[shard_]->iterator());
+    iter_->SeekToFirst();
+    SeekToNonEmptyShard();
+}
+
+void IteratorImpl::Next() {
+    DCHECK(Valid());
+
+    iter_->Next();
+    SeekToNonEmptyShard();
+}
+
+yuki::Status IteratorImpl::status() const {
+    return iter_ ? iter_->status() : yuki::Status::OK();
+}
+
+KeyBoundle *IteratorImpl::key() const {
+    DCHECK(Valid());
+    return iter_->key();
+}
+
+Obj *IteratorImpl::value() const {
+    DCHECK(Valid());
+    return iter_->value();
+}
+
+void IteratorImpl::SeekToNonEmptyShard() {
+    while (!iter_->Valid()) {
+        iter_.reset(); // Release the last shard first.
+        if (++shard_ >= num_shards_) {
+            return;
+        }
+        iter_.reset(shards_[shard_]->iterator());
+        iter_->SeekToFirst();
+    }
+}
+
+} // namespace
+
+ShardedHashMap::ShardedHashMap(int64_t initial_size, int num_shards)
+    : shards_(new CocurrentHashMap *[num_shards])
+    , num_shards_(num_shards)
+    , shard_shift_(64)
+    , sample_shard_(0) {
+    DCHECK_GT(num_shards, 0);
+    DCHECK_EQ(0, num_shards & (num_shards - 1));
+
+    for (auto n = num_shards; n > 1; n >>= 1) {
+        shard_shift_--;
+    }
+
+    auto shard_size = initial_size / num_shards;
+    if (shard_size < 1) {
+        shard_size = 1;
+    }
+    for (int i = 0; i < num_shards_; i++) {
+        shards_[i] = new CocurrentHashMap(shard_size);
+    }
+}
+
+ShardedHashMap::~ShardedHashMap() {
+    for (int i = 0; i < num_shards_; i++) {
+        delete shards_[i];
+    }
+    delete[] shards_;
+}
+
+yuki::Status ShardedHashMap::Put(yuki::SliceRef key, uint64_t version_number,
+                                 Obj *value) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    Version version;
+    version.type   = VERSION_PLAIN;
+    version.number = version_number;
+    return TakeShard(hash)->Put(key, hash, version, value);
+}
+
+bool ShardedHashMap::Delete(yuki::SliceRef key) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->Delete(key, hash);
+}
+
+yuki::Status ShardedHashMap::Get(yuki::SliceRef key, Version *ver,
+                                 Obj **value) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->Get(key, hash, ver, value);
+}
+
+yuki::Status
+ShardedHashMap::Exec(yuki::SliceRef key,
+                     std::function<void (const Version &, Obj *)> proc) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->Exec(key, hash, std::move(proc));
+}
+
+yuki::Status
+ShardedHashMap::Update(yuki::SliceRef key, uint64_t version_number,
+                       std::function<Obj *(Obj *)> proc) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->Update(key, hash, version_number, std::move(proc));
+}
+
+size_t ShardedHashMap::MultiGet(size_t n, const yuki::Slice *keys,
+                                Obj **values) {
+    std::vector<uint64_t> hashes(n);
+    std::vector<size_t> offsets(num_shards_ + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        hashes[i] = CocurrentHashMap::Hash(keys[i].Data(), keys[i].Length());
+        offsets[ShardIndex(hashes[i]) + 1]++;
+    }
+    for (int i = 0; i < num_shards_; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // Counting sort by shard.
+    std::vector<size_t> order(n);
+    std::vector<yuki::Slice> sorted_keys(n);
+    std::vector<uint64_t> sorted_hashes(n);
+    std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < n; i++) {
+        auto pos = next[ShardIndex(hashes[i])]++;
+        order[pos]         = i;
+        sorted_keys[pos]   = keys[i];
+        sorted_hashes[pos] = hashes[i];
+    }
+
+    std::vector<Obj *> sorted_values(n);
+    size_t num_found = 0;
+    for (int i = 0; i < num_shards_; i++) {
+        auto begin = offsets[i], end = offsets[i + 1];
+        if (begin == end) {
+            continue;
+        }
+        num_found += shards_[i]->MultiGet(end - begin, &sorted_keys[begin],
+                                          &sorted_hashes[begin],
+                                          &sorted_values[begin]);
+    }
+    for (size_t i = 0; i < n; i++) {
+        values[order[i]] = sorted_values[i];
+    }
+    return num_found;
+}
+
+Iterator *ShardedHashMap::iterator() {
+    return new IteratorImpl(shards_, num_shards_);
+}
+
+uint64_t
+ShardedHashMap::Scan(uint64_t cursor, int64_t count,
+                     std::function<void (KeyBoundle *, Obj *)> proc) {
+    auto shift = shard_shift_ - 1;
+    auto shard_mask = (1ULL << shift) - 1;
+    auto shard = cursor >> shift;
+    auto shard_cursor = cursor & shard_mask;
+
+    int64_t num_visited = 0;
+    auto counting = [&] (KeyBoundle *key, Obj *value) {
+        num_visited++;
+        proc(key, value);
+    };
+    while (shard < static_cast<uint64_t>(num_shards_)) {
+        shard_cursor = shards_[shard]->Scan(shard_cursor, count - num_visited,
+                                            counting);
+        DCHECK_EQ(0, shard_cursor & ~shard_mask);
+        if (shard_cursor != 0) {
+            break; // the shard not finish yet.
+        }
+        shard++;
+        if (num_visited >= count) {
+            break;
+        }
+    }
+
+    if (shard >= static_cast<uint64_t>(num_shards_)) {
+        return 0;
+    }
+    return (shard << shift) | shard_cursor;
+}
+
+bool ShardedHashMap::IncrementalRehash(int num_steps) {
+    bool rehashing = false;
+    for (int i = 0; i < num_shards_; i++) {
+        if (shards_[i]->IncrementalRehash(num_steps)) {
+            rehashing = true;
+        }
+    }
+    return rehashing;
+}
+
+void ShardedHashMap::Reserve(int64_t num_keys) {
+    auto shard_size = (num_keys + num_shards_ - 1) / num_shards_;
+    for (int i = 0; i < num_shards_; i++) {
+        shards_[i]->Reserve(shard_size);
+    }
+}
+
+yuki::Status ShardedHashMap::BulkPut(yuki::SliceRef key,
+                                     const Version &version, Obj *value) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->BulkPut(key, hash, version, value);
+}
+
+int64_t ShardedHashMap::num_keys() const {
+    int64_t num_keys = 0;
+    for (int i = 0; i < num_shards_; i++) {
+        num_keys += shards_[i]->num_keys();
+    }
+    return num_keys;
+}
+
+bool ShardedHashMap::Expire(yuki::SliceRef key, int64_t expire_at) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->Expire(key, hash, expire_at);
+}
+
+yuki::Status ShardedHashMap::PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                       Obj *value) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    Version version;
+    version.type   = VERSION_EXPIRE;
+    version.number = expire_at;
+    return TakeShard(hash)->Put(key, hash, version, value);
+}
+
+bool ShardedHashMap::DeleteExpired(yuki::SliceRef key, int64_t now) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->DeleteExpired(key, hash, now);
+}
+
+bool ShardedHashMap::DeleteValue(yuki::SliceRef key, Obj *value) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    return TakeShard(hash)->DeleteValue(key, hash, value);
+}
+
+int64_t ShardedHashMap::num_expires() const {
+    int64_t num_expires = 0;
+    for (int i = 0; i < num_shards_; i++) {
+        num_expires += shards_[i]->num_expires();
+    }
+    return num_expires;
+}
+
+int64_t ShardedHashMap::memory_usage() const {
+    int64_t usage = 0;
+    for (int i = 0; i < num_shards_; i++) {
+        usage += shards_[i]->memory_usage();
+    }
+    return usage;
+}
+
+void ShardedHashMap::RecountUsage(yuki::SliceRef key) {
+    auto hash = CocurrentHashMap::Hash(key.Data(), key.Length());
+    TakeShard(hash)->RecountUsage(key, hash);
+}
+
+void ShardedHashMap::set_access_policy(EvictionPolicy policy) {
+    for (int i = 0; i < num_shards_; i++) {
+        shards_[i]->set_access_policy(policy);
+    }
+}
+
+int64_t
+ShardedHashMap::Sample(int64_t n,
+                       std::function<void (KeyBoundle *, uint32_t)> proc) {
+    auto base = sample_shard_.fetch_add(1, std::memory_order_relaxed);
+    for (int i = 0; i < num_shards_; i++) {
+        auto shard = shards_[(base + i) & (num_shards_ - 1)];
+        auto num_visited = shard->Sample(n, proc);
+        if (num_visited > 0) {
+            return num_visited;
+        }
+    }
+    return 0;
+}
+
+} // namespace yukino
@@ -0,0 +1,107 @@
+#ifndef YUKINO_SHARDED_HASH_MAP_H_
+#define YUKINO_SHARDED_HASH_MAP_H_
+
+#include "mem_table.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace yukino {
+
+class CocurrentHashMap;
+
+//
+// The key space be split to `num_shards' CocurrentHashMaps by the high hash
+// bits. Every shard has its own gaint lock, key counter and resizing, so
+// readers of different shards never touch the same lock.
+//
+class ShardedHashMap : public MemTable {
+public:
+    enum { DEFAULT_NUM_SHARDS = 16 };
+
+    // `num_shards' must be power of 2.
+    ShardedHashMap(int64_t initial_size, int num_shards);
+    virtual ~ShardedHashMap() override;
+
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) override;
+    virtual bool Delete(yuki::SliceRef key) override;
+
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) override;
+
+    virtual yuki::Status
+    Exec(yuki::SliceRef key,
+         std::function<void (const Version &, Obj *)> proc) override;
+
+    virtual yuki::Status
+    Update(yuki::SliceRef key, uint64_t version_number,
+           std::function<Obj *(Obj *)> proc) override;
+
+    // Keys be grouped by shard, then looked up by the shard in batch.
+    virtual size_t MultiGet(size_t n, const yuki::Slice *keys,
+                            Obj **values) override;
+
+    virtual Iterator *iterator() override;
+
+    // Cursor: [0][shard index][cursor of the shard], the highest bit be
+    // kept 0, so it can be replied as an integer.
+    virtual uint64_t
+    Scan(uint64_t cursor, int64_t count,
+         std::function<void (KeyBoundle *, Obj *)> proc) override;
+
+    virtual bool Expire(yuki::SliceRef key, int64_t expire_at) override;
+    virtual yuki::Status PutExpire(yuki::SliceRef key, int64_t expire_at,
+                                   Obj *value) override;
+    virtual bool DeleteExpired(yuki::SliceRef key, int64_t now) override;
+    virtual bool DeleteValue(yuki::SliceRef key, Obj *value) override;
+    virtual int64_t num_expires() const override;
+    virtual bool expirable() const override { return true; }
+
+    virtual bool IncrementalRehash(int num_steps) override;
+
+    // Keys be spread by hash, every shard reserves its part.
+    virtual void Reserve(int64_t num_keys) override;
+    virtual yuki::Status BulkPut(yuki::SliceRef key, const Version &version,
+                                 Obj *value) override;
+
+    virtual int64_t num_keys() const override;
+
+    virtual int64_t memory_usage() const override;
+    virtual void RecountUsage(yuki::SliceRef key) override;
+
+    virtual void set_access_policy(EvictionPolicy policy) override;
+
+    // Shards take turns, so keys be sampled from the whole key space in
+    // rounds.
+    virtual int64_t
+    Sample(int64_t n,
+           std::function<void (KeyBoundle *, uint32_t)> proc) override;
+
+    int num_shards() const { return num_shards_; }
+
+    CocurrentHashMap *shard(int i) const { return shards_[i]; }
+
+private:
+    inline int ShardIndex(uint64_t hash) const;
+    inline CocurrentHashMap *TakeShard(uint64_t hash) const;
+
+    CocurrentHashMap **shards_;
+    const int num_shards_;
+    int shard_shift_;
+    std::atomic<uint32_t> sample_shard_;
+};
+
+inline int ShardedHashMap::ShardIndex(uint64_t hash) const {
+    // The shard maps index slots by low bits, so use the high bits here.
+    return shard_shift_ >= 64 ? 0 : static_cast<int>(hash >> shard_shift_);
+}
+
+inline CocurrentHashMap *ShardedHashMap::TakeShard(uint64_t hash) const {
+    return shards_[ShardIndex(hash)];
+}
+
+} // namespace yukino
+
+#endif // YUKINO_SHARDED_HASH_MAP_H_
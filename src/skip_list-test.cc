@@ -0,0 +1,179 @@
+#include "skip_list.h"
+#include "epoch.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "yuki/strings.h"
+#include "gtest/gtest.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+class SkipListTest : public ::testing::Test {
+public:
+    virtual void SetUp() override {
+        ASSERT_EQ(nullptr, list_);
+        list_ = new SkipList();
+    }
+
+    virtual void TearDown() override {
+        ASSERT_NE(nullptr, list_);
+        delete list_;
+        list_ = nullptr;
+    }
+
+protected:
+    SkipList *list_ = nullptr;
+};
+
+TEST_F(SkipListTest, Sanity) {
+    auto rv = list_->Put(yuki::Slice("name"), 0, String::New(yuki::Slice("Jake")));
+    ASSERT_TRUE(rv.Ok());
+    rv = list_->Put(yuki::Slice("age"), 0, Integer::New(100));
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ(2, list_->num_keys());
+    EXPECT_TRUE(list_->ordered());
+
+    Obj *obj = nullptr;
+    rv = list_->Get(yuki::Slice("name"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ(YKN_STRING, obj->type());
+    EXPECT_EQ("Jake", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+
+    rv = list_->Put(yuki::Slice("name"), 1, String::New(yuki::Slice("Mike")));
+    ASSERT_TRUE(rv.Ok());
+    ASSERT_EQ(2, list_->num_keys());
+    rv = list_->Get(yuki::Slice("name"), nullptr, &obj);
+    ASSERT_TRUE(rv.Ok());
+    EXPECT_EQ("Mike", static_cast<String *>(obj)->data().ToString());
+    ObjRelease(obj);
+
+    EXPECT_TRUE(list_->Delete(yuki::Slice("name")));
+    EXPECT_FALSE(list_->Delete(yuki::Slice("name")));
+    EXPECT_FALSE(list_->Exist(yuki::Slice("name")));
+    EXPECT_TRUE(list_->Exist(yuki::Slice("age")));
+    EXPECT_EQ(1, list_->num_keys());
+    Epoch::Quiescent();
+}
+
+TEST_F(SkipListTest, OrderedIterator) {
+    const int N = 1000;
+
+    for (int i = N - 1; i >= 0; i--) {
+        auto key = yuki::Strings::Format("k.%04d", i);
+        list_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+
+    std::unique_ptr<Iterator> iter(list_->iterator());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        EXPECT_EQ(yuki::Strings::Format("k.%04d", i),
+                  iter->key()->key().ToString());
+        EXPECT_EQ(i, static_cast<Integer *>(iter->value())->data());
+        i++;
+    }
+    EXPECT_EQ(N, i);
+
+    iter->Seek(yuki::Slice("k.0500"));
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("k.0500", iter->key()->key().ToString());
+
+    // Between keys.
+    iter->Seek(yuki::Slice("k.05000"));
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("k.0501", iter->key()->key().ToString());
+
+    iter->Seek(yuki::Slice("a"));
+    ASSERT_TRUE(iter->Valid());
+    EXPECT_EQ("k.0000", iter->key()->key().ToString());
+
+    iter->Seek(yuki::Slice("z"));
+    EXPECT_FALSE(iter->Valid());
+}
+
+TEST_F(SkipListTest, Count) {
+    for (int i = 0; i < 100; i++) {
+        auto key = yuki::Strings::Format("k.%02d", i);
+        list_->Put(yuki::Slice(key), 0, Integer::New(i));
+    }
+
+    EXPECT_EQ(100, list_->Count(yuki::Slice("a"), yuki::Slice("z")));
+    EXPECT_EQ(10, list_->Count(yuki::Slice("k.10"), yuki::Slice("k.20")));
+    EXPECT_EQ(0, list_->Count(yuki::Slice("k.20"), yuki::Slice("k.20")));
+    EXPECT_EQ(0, list_->Count(yuki::Slice("x"), yuki::Slice("z")));
+
+    for (int i = 10; i < 15; i++) {
+        auto key = yuki::Strings::Format("k.%02d", i);
+        EXPECT_TRUE(list_->Delete(yuki::Slice(key)));
+    }
+    EXPECT_EQ(5, list_->Count(yuki::Slice("k.10"), yuki::Slice("k.20")));
+    Epoch::Quiescent();
+}
+
+TEST_F(SkipListTest, Update) {
+    auto incr = [] (Obj *old) { return ObjIncrBy(old, -1); };
+    ASSERT_TRUE(list_->Update(yuki::Slice("b"), 0, incr).Ok());
+    ASSERT_TRUE(list_->Update(yuki::Slice("b"), 0, incr).Ok());
+
+    // Not an integer, unchanged.
+    ASSERT_TRUE(list_->Put(yuki::Slice("a"), 0,
+                           String::New(yuki::Slice("x"))).Ok());
+    ASSERT_TRUE(list_->Update(yuki::Slice("a"), 0, incr).Ok());
+    EXPECT_EQ(2, list_->num_keys());
+
+    Obj *obj = nullptr;
+    ASSERT_TRUE(list_->Get(yuki::Slice("b"), nullptr, &obj).Ok());
+    EXPECT_EQ(-2, static_cast<Integer *>(obj)->data());
+    ObjRelease(obj);
+    ASSERT_TRUE(list_->Get(yuki::Slice("a"), nullptr, &obj).Ok());
+    EXPECT_EQ(YKN_STRING, obj->type());
+    ObjRelease(obj);
+}
+
+TEST_F(SkipListTest, ReadingWhileWriting) {
+    const int N = 20000;
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; i++) {
+        readers.emplace_back([&] () {
+            while (!stop.load()) {
+                std::unique_ptr<Iterator> iter(list_->iterator());
+                std::string last;
+                for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+                    auto key = iter->key()->key().ToString();
+                    EXPECT_LT(last, key);
+                    last = key;
+                }
+                Epoch::Quiescent();
+            }
+        });
+    }
+
+    for (int i = 0; i < N; i++) {
+        auto key = yuki::Strings::Format("%d", (i * 7919) % N);
+        list_->Put(yuki::Slice(key), 0, Integer::New(i));
+        if (i % 3 == 0) {
+            key = yuki::Strings::Format("%d", i / 3);
+            list_->Delete(yuki::Slice(key));
+        }
+    }
+    stop.store(true);
+    for (auto &reader : readers) {
+        reader.join();
+    }
+
+    int64_t count = 0;
+    std::unique_ptr<Iterator> iter(list_->iterator());
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+        count++;
+    }
+    EXPECT_EQ(list_->num_keys(), count);
+}
+
+} // namespace yukino
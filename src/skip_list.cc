@@ -0,0 +1,300 @@
+#include "skip_list.h"
+#include "epoch.h"
+#include "hash.h"
+#include "iterator.h"
+#include "key.h"
+#include "obj.h"
+#include "slab.h"
+#include <stddef.h>
+
+namespace yukino {
+
+namespace {
+
+class IteratorImpl : public Iterator {
+public:
+    typedef SkipList::Node Node;
+
+    IteratorImpl(SkipList *list)
+        : list_(DCHECK_NOTNULL(list)) {
+    }
+
+    virtual ~IteratorImpl() override;
+    virtual bool Valid() const override;
+    virtual void SeekToFirst() override;
+    virtual void Seek(yuki::SliceRef target) override;
+    virtual void Next() override;
+    virtual yuki::Status status() const override;
+    virtual KeyBoundle *key() const override;
+    virtual Obj *value() const override;
+
+private:
+    // Unlinked nodes can not be freed under the iterator.
+    EpochGuard epoch_;
+    SkipList *list_;
+    Node *node_ = nullptr;
+};
+
+IteratorImpl::~IteratorImpl() {
+}
+
+bool IteratorImpl::Valid() const {
+    return node_ != nullptr;
+}
+
+void IteratorImpl::SeekToFirst() {
+    node_ = list_->head()->next(0);
+}
+
+void IteratorImpl::Seek(yuki::SliceRef target) {
+    node_ = list_->FindGreaterOrEqual(target, nullptr);
+}
+
+void IteratorImpl::Next() {
+    DCHECK(Valid());
+    node_ = node_->next(0);
+}
+
+yuki::Status IteratorImpl::status() const {
+    return yuki::Status::OK();
+}
+
+KeyBoundle *IteratorImpl::key() const {
+    DCHECK(Valid());
+    return node_->key();
+}
+
+Obj *IteratorImpl::value() const {
+    DCHECK(Valid());
+    return DCHECK_NOTNULL(node_->value.load(std::memory_order_acquire));
+}
+
+void ReleaseObj(void *p) {
+    ObjRelease(static_cast<Obj *>(p));
+}
+
+} // namespace
+
+/*static*/ SkipList::Node *
+SkipList::NewNode(yuki::SliceRef key, const Version &version, int height,
+                  Obj *value) {
+    auto key_size = KeyBoundle::PredictBoundleSize(key, version.number);
+    auto size = offsetof(Node, links) + sizeof(std::atomic<Node *>) * height +
+                key_size;
+
+    auto node = static_cast<Node *>(Slab::Allocate(size));
+    if (!node) {
+        return nullptr;
+    }
+    node->value.store(value ? ObjAddRef(value) : nullptr,
+                      std::memory_order_relaxed);
+    node->height  = height;
+    node->padding = 0;
+    for (int i = 0; i < height; i++) {
+        node->links[i].store(nullptr, std::memory_order_relaxed);
+    }
+    KeyBoundle::Build(key, version.type, version.number, node->key(),
+                      key_size);
+    return node;
+}
+
+/*static*/ void SkipList::FreeNode(void *p) {
+    auto node = static_cast<Node *>(p);
+    auto value = node->value.load(std::memory_order_relaxed);
+    if (value) {
+        ObjRelease(value);
+    }
+    Slab::Free(node);
+}
+
+SkipList::SkipList()
+    : head_(CHECK_NOTNULL(NewNode(yuki::Slice(), Version(), MAX_HEIGHT,
+                                  nullptr)))
+    , max_height_(1)
+    , num_keys_(0) {
+}
+
+SkipList::~SkipList() {
+    auto node = head_;
+    while (node) {
+        auto next = node->next(0);
+        FreeNode(node);
+        node = next;
+    }
+}
+
+yuki::Status SkipList::Put(yuki::SliceRef key, uint64_t version_number,
+                           Obj *value) {
+    WriterLock scope(&write_lock_);
+    return UnsafePut(key, version_number, value);
+}
+
+yuki::Status SkipList::Update(yuki::SliceRef key, uint64_t version_number,
+                              std::function<Obj *(Obj *)> proc) {
+    WriterLock scope(&write_lock_);
+
+    auto node = FindGreaterOrEqual(key, nullptr);
+    if (node && node->key()->key().Compare(key) != 0) {
+        node = nullptr;
+    }
+    auto value = proc(node ? node->value.load(std::memory_order_acquire)
+                           : nullptr);
+    if (!value) {
+        return yuki::Status::OK();
+    }
+    return UnsafePut(key, version_number, value);
+}
+
+// Must be called under the write lock.
+yuki::Status SkipList::UnsafePut(yuki::SliceRef key, uint64_t version_number,
+                                 Obj *value) {
+    using yuki::Status;
+
+    Node *prev[MAX_HEIGHT];
+    auto node = FindGreaterOrEqual(key, prev);
+    if (node && node->key()->key().Compare(key) == 0) {
+        auto old = node->value.exchange(ObjAddRef(value),
+                                        std::memory_order_acq_rel);
+        Epoch::Retire(old, ReleaseObj);
+        return Status::OK();
+    }
+
+    auto height = RandomHeight();
+    auto max_height = max_height_.load(std::memory_order_relaxed);
+    if (height > max_height) {
+        for (int i = max_height; i < height; i++) {
+            prev[i] = head_;
+        }
+        // Readers see the new height before the node linked is fine, they
+        // just go down from the empty levels of head.
+        max_height_.store(height, std::memory_order_relaxed);
+    }
+
+    Version version;
+    version.type   = 0;
+    version.number = version_number;
+    node = NewNode(key, version, height, value);
+    if (!node) {
+        return Status::Systemf("not enough memory.");
+    }
+    for (int i = 0; i < height; i++) {
+        node->links[i].store(prev[i]->next(i), std::memory_order_relaxed);
+        prev[i]->set_next(i, node);
+    }
+
+    num_keys_.fetch_add(1, std::memory_order_release);
+    return Status::OK();
+}
+
+bool SkipList::Delete(yuki::SliceRef key) {
+    WriterLock scope(&write_lock_);
+
+    Node *prev[MAX_HEIGHT];
+    auto node = FindGreaterOrEqual(key, prev);
+    if (!node || node->key()->key().Compare(key) != 0) {
+        return false;
+    }
+
+    // Unlink from top to bottom, readers on the node still go forward by
+    // its links.
+    for (int i = static_cast<int>(node->height) - 1; i >= 0; i--) {
+        prev[i]->set_next(i, node->next(i));
+    }
+    Epoch::Retire(node, FreeNode);
+
+    num_keys_.fetch_sub(1, std::memory_order_release);
+    return true;
+}
+
+yuki::Status SkipList::Get(yuki::SliceRef key, Version *ver, Obj **value) {
+    using yuki::Status;
+
+    EpochGuard epoch;
+    auto node = FindGreaterOrEqual(key, nullptr);
+    if (!node || node->key()->key().Compare(key) != 0) {
+        return Status::NotFoundf("key not found.");
+    }
+
+    if (ver) {
+        *ver = node->key()->version();
+    }
+    if (value) {
+        *value = ObjAddRef(node->value.load(std::memory_order_acquire));
+    }
+    return Status::OK();
+}
+
+yuki::Status
+SkipList::Exec(yuki::SliceRef key,
+               std::function<void (const Version &, Obj *)> proc) {
+    using yuki::Status;
+
+    // The value can not be freed in the epoch, no need to hold a reference.
+    EpochGuard epoch;
+    auto node = FindGreaterOrEqual(key, nullptr);
+    if (!node || node->key()->key().Compare(key) != 0) {
+        return Status::NotFoundf("key not found.");
+    }
+
+    proc(node->key()->version(), node->value.load(std::memory_order_acquire));
+    return Status::OK();
+}
+
+Iterator *SkipList::iterator() {
+    return new IteratorImpl(this);
+}
+
+int64_t SkipList::Count(yuki::SliceRef begin, yuki::SliceRef end) {
+    EpochGuard epoch;
+
+    int64_t count = 0;
+    for (auto node = FindGreaterOrEqual(begin, nullptr); node;
+         node = node->next(0)) {
+        if (node->key()->key().Compare(end) >= 0) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+SkipList::Node *SkipList::FindGreaterOrEqual(yuki::SliceRef key,
+                                             Node **prev) const {
+    auto x = head_;
+    auto level = max_height_.load(std::memory_order_relaxed) - 1;
+    for (;;) {
+        auto next = x->next(level);
+        if (next && next->key()->key().Compare(key) < 0) {
+            x = next; // keep searching in this level
+            continue;
+        }
+        if (prev) {
+            prev[level] = x;
+        }
+        if (level == 0) {
+            return next;
+        }
+        level--;
+    }
+}
+
+// Branching factor 4.
+int SkipList::RandomHeight() {
+    static thread_local uint64_t seed = (HashSeed() ^
+        reinterpret_cast<uintptr_t>(&seed)) | 1;
+
+    int height = 1;
+    for (;;) {
+        // xorshift64
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        if (height >= MAX_HEIGHT || (seed & 3) != 0) {
+            break;
+        }
+        height++;
+    }
+    return height;
+}
+
+} // namespace yukino
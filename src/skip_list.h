@@ -0,0 +1,109 @@
+#ifndef YUKINO_SKIP_LIST_H_
+#define YUKINO_SKIP_LIST_H_
+
+#include "mem_table.h"
+#include "rw_spin_lock.h"
+#include "yuki/slice.h"
+#include "yuki/status.h"
+#include <atomic>
+#include <stdint.h>
+
+namespace yukino {
+
+struct KeyBoundle;
+
+//
+// Ordered map for DB_ORDER, keys be sorted by bytes.
+// Writers be serialized by the write lock, readers and iterators only run in
+// an epoch guard without any lock. Unlinked nodes and replaced values be
+// retired to the epoch.
+//
+class SkipList : public MemTable {
+public:
+    enum { MAX_HEIGHT = 16 };
+
+    //
+    // Node, in one allocation:
+    // [Node][next links (height)][KeyBoundle]
+    //
+    struct Node {
+        std::atomic<Obj *>  value;
+        uint32_t            height;
+        uint32_t            padding;
+        std::atomic<Node *> links[1];
+
+        inline Node *next(int level) const;
+        inline void  set_next(int level, Node *node);
+
+        KeyBoundle *key() const {
+            return reinterpret_cast<KeyBoundle *>(
+                const_cast<std::atomic<Node *> *>(links + height));
+        }
+    };
+
+    SkipList();
+    virtual ~SkipList() override;
+
+    virtual yuki::Status Put(yuki::SliceRef key, uint64_t version_number,
+                             Obj *value) override;
+    virtual bool Delete(yuki::SliceRef key) override;
+
+    virtual yuki::Status Get(yuki::SliceRef key, Version *ver,
+                             Obj **value) override;
+
+    virtual yuki::Status
+    Exec(yuki::SliceRef key,
+         std::function<void (const Version &, Obj *)> proc) override;
+
+    virtual yuki::Status
+    Update(yuki::SliceRef key, uint64_t version_number,
+           std::function<Obj *(Obj *)> proc) override;
+
+    // The iterator is ordered, and Seek() jumps in O(log n).
+    virtual Iterator *iterator() override;
+
+    virtual bool IncrementalRehash(int /*num_steps*/) override {
+        return false;
+    }
+
+    virtual bool ordered() const override { return true; }
+
+    virtual int64_t num_keys() const override { return num_keys_.load(); }
+
+    // Number of keys in [begin, end).
+    int64_t Count(yuki::SliceRef begin, yuki::SliceRef end);
+
+    // First node >= key, or null. Fill `prev' with the last node < key of
+    // every level if it not null.
+    // Can be called in an epoch guard without the write lock.
+    Node *FindGreaterOrEqual(yuki::SliceRef key, Node **prev) const;
+
+    Node *head() const { return head_; }
+
+    static Node *NewNode(yuki::SliceRef key, const Version &version,
+                         int height, Obj *value);
+    static void FreeNode(void *node);
+
+private:
+    yuki::Status UnsafePut(yuki::SliceRef key, uint64_t version_number,
+                           Obj *value);
+    int RandomHeight();
+
+    Node *const head_;
+    std::atomic<int> max_height_;
+    std::atomic<int64_t> num_keys_;
+    RWSpinLock write_lock_;
+};
+
+inline SkipList::Node *SkipList::Node::next(int level) const {
+    return links[level].load(std::memory_order_acquire);
+}
+
+inline void SkipList::Node::set_next(int level, Node *node) {
+    // Publish the node after it be made.
+    links[level].store(node, std::memory_order_release);
+}
+
+} // namespace yukino
+
+#endif // YUKINO_SKIP_LIST_H_
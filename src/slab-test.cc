@@ -0,0 +1,128 @@
+#include "slab.h"
+#include "gtest/gtest.h"
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+namespace yukino {
+
+namespace {
+
+size_t NumObjects(size_t object_size) {
+    std::vector<SlabStats> stats;
+    Slab::GetStats(&stats);
+    for (const auto &stat : stats) {
+        if (stat.object_size == object_size) {
+            return stat.num_objects;
+        }
+    }
+    return 0;
+}
+
+} // namespace
+
+TEST(SlabTest, Sanity) {
+    std::vector<void *> objs;
+    for (size_t size = 1; size <= Slab::MAX_SIZE; size += 7) {
+        auto p = Slab::Allocate(size);
+        ASSERT_NE(nullptr, p);
+        EXPECT_TRUE(Slab::Owns(p));
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(p) % 16);
+        memset(p, 0xfe, size);
+        objs.push_back(p);
+    }
+    for (auto p : objs) {
+        Slab::Free(p);
+    }
+}
+
+TEST(SlabTest, LargeFallback) {
+    auto p = Slab::Allocate(Slab::MAX_SIZE + 1);
+    ASSERT_NE(nullptr, p);
+    EXPECT_FALSE(Slab::Owns(p));
+    Slab::Free(p);
+
+    // Free the malloc()-ed memory.
+    p = malloc(16);
+    EXPECT_FALSE(Slab::Owns(p));
+    Slab::Free(p);
+}
+
+TEST(SlabTest, Reusing) {
+    auto p = Slab::Allocate(40);
+    Slab::Free(p);
+    EXPECT_EQ(p, Slab::Allocate(48));
+    Slab::Free(p);
+}
+
+TEST(SlabTest, Stats) {
+    auto living = NumObjects(96);
+
+    std::vector<void *> objs;
+    for (int i = 0; i < 1000; i++) {
+        objs.push_back(Slab::Allocate(90));
+    }
+    EXPECT_EQ(living + 1000, NumObjects(96));
+    EXPECT_LT(0.0, Slab::fragmentation());
+    EXPECT_GT(1.0, Slab::fragmentation());
+
+    for (auto p : objs) {
+        Slab::Free(p);
+    }
+    EXPECT_EQ(living, NumObjects(96));
+}
+
+TEST(SlabTest, CrossThreadFreeing) {
+    auto living = NumObjects(256);
+
+    std::vector<void *> objs;
+    std::thread producer([&] () {
+        for (int i = 0; i < 10000; i++) {
+            objs.push_back(Slab::Allocate(256));
+        }
+    });
+    producer.join();
+
+    std::thread consumer([&] () {
+        for (auto p : objs) {
+            Slab::Free(p);
+        }
+    });
+    consumer.join();
+
+    // All exited threads flushed their caches.
+    EXPECT_EQ(living, NumObjects(256));
+    std::vector<SlabStats> stats;
+    Slab::GetStats(&stats);
+    for (const auto &stat : stats) {
+        if (stat.object_size == 256) {
+            EXPECT_LE(10000, stat.num_cached);
+        }
+    }
+}
+
+TEST(SlabTest, MultiThreadAllocating) {
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i] () {
+            std::vector<uint64_t *> objs;
+            for (int j = 0; j < 10000; j++) {
+                auto p = static_cast<uint64_t *>(Slab::Allocate(32));
+                p[0] = i;
+                p[1] = j;
+                objs.push_back(p);
+            }
+            for (int j = 0; j < 10000; j++) {
+                EXPECT_EQ(static_cast<uint64_t>(i), objs[j][0]);
+                EXPECT_EQ(static_cast<uint64_t>(j), objs[j][1]);
+                Slab::Free(objs[j]);
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+} // namespace yukino
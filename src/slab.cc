@@ -0,0 +1,387 @@
+#include "slab.h"
+#include "glog/logging.h"
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <atomic>
+#include <mutex>
+
+namespace yukino {
+
+namespace {
+
+// Reserved address space, pages be committed on touching. It be as large
+// as the physical memory, but no less than kMinRegionSize.
+const size_t kMinRegionSize = 1ULL << 36;
+const size_t kMaxRegionSize = 1ULL << 46; // half of x86-64 user space.
+const uint32_t kSpanMagic = 0x51ab51ab;
+
+const size_t kClassSizes[] = {
+    16,  32,  48,  64,  80,  96,  112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024,
+};
+const int kNumClasses = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+
+struct SpanHeader {
+    uint32_t magic;
+    uint32_t size_class;
+    uint64_t padding;
+};
+
+struct FreeObject {
+    FreeObject *next;
+};
+
+size_t PhysicalMemorySize() {
+    auto pages = sysconf(_SC_PHYS_PAGES);
+    auto page_size = sysconf(_SC_PAGESIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return 0;
+    }
+    return static_cast<size_t>(pages) * static_cast<size_t>(page_size);
+}
+
+struct Region {
+    char *base = nullptr;
+    char *end  = nullptr;
+    size_t size = 0;
+    std::atomic<size_t> next_span;
+
+    Region() : next_span(0) {
+        size = kMinRegionSize;
+        while (size < PhysicalMemorySize() && size < kMaxRegionSize) {
+            size <<= 1;
+        }
+
+        // Try smaller if the address space be limited.
+        void *p = MAP_FAILED;
+        for (; size >= kMinRegionSize; size >>= 1) {
+            p = mmap(nullptr, size + Slab::SPAN_SIZE, PROT_READ|PROT_WRITE,
+                     MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+            if (p != MAP_FAILED) {
+                break;
+            }
+        }
+        if (p == MAP_FAILED) {
+            PLOG(ERROR) << "reserve slab region fail, use malloc only.";
+            size = 0;
+            return;
+        }
+        auto addr = reinterpret_cast<uintptr_t>(p);
+        addr = (addr + Slab::SPAN_SIZE - 1) & ~(Slab::SPAN_SIZE - 1ULL);
+        base = reinterpret_cast<char *>(addr);
+        end  = base + size;
+    }
+
+    char *NewSpan() {
+        auto offset = next_span.fetch_add(Slab::SPAN_SIZE);
+        if (!base || offset + Slab::SPAN_SIZE > size) {
+            return nullptr;
+        }
+        return base + offset;
+    }
+};
+
+struct Depot {
+    std::mutex   mutex;
+    FreeObject  *head = nullptr;
+    size_t       count = 0;
+    size_t       num_spans = 0;
+};
+
+struct FreeList {
+    FreeObject *head  = nullptr;
+    uint32_t    count = 0;
+};
+
+struct Counters {
+    std::atomic<uint64_t> num_allocs;
+    std::atomic<uint64_t> num_frees;
+
+    Counters() : num_allocs(0), num_frees(0) {}
+
+    // Only the owner thread writes them, no need RMW.
+    void Alloc() {
+        num_allocs.store(num_allocs.load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+    }
+    void Free() {
+        num_frees.store(num_frees.load(std::memory_order_relaxed) + 1,
+                        std::memory_order_relaxed);
+    }
+};
+
+struct ThreadCache {
+    FreeList lists[kNumClasses];
+    Counters counters[kNumClasses];
+};
+
+// All of them live until the process exit.
+Region *region = new Region;
+Depot *depots = new Depot[kNumClasses];
+
+std::mutex caches_mutex;
+std::vector<ThreadCache *> *caches = new std::vector<ThreadCache *>;
+Counters *exited_counters = new Counters[kNumClasses];
+
+// Class index for every 16 bytes.
+struct ClassTable {
+    uint8_t index[Slab::MAX_SIZE / 16 + 1];
+
+    ClassTable() {
+        int cls = 0;
+        for (size_t i = 0; i < sizeof(index); i++) {
+            while (kClassSizes[cls] < i * 16) {
+                cls++;
+            }
+            index[i] = static_cast<uint8_t>(cls);
+        }
+    }
+};
+const ClassTable class_table;
+
+inline int SizeClassOf(size_t size) {
+    return class_table.index[(size + 15) >> 4];
+}
+
+inline int BatchSize(int cls) {
+    auto n = static_cast<int>(4096 / kClassSizes[cls]);
+    return n < 4 ? 4 : (n > 64 ? 64 : n);
+}
+
+inline SpanHeader *SpanOf(const void *p) {
+    auto addr = reinterpret_cast<uintptr_t>(p);
+    return reinterpret_cast<SpanHeader *>(addr & ~(Slab::SPAN_SIZE - 1ULL));
+}
+
+// Depot mutex must be held.
+bool CarveSpan(int cls) {
+    auto span = region->NewSpan();
+    if (!span) {
+        return false;
+    }
+    auto header = reinterpret_cast<SpanHeader *>(span);
+    header->magic      = kSpanMagic;
+    header->size_class = cls;
+
+    auto depot = &depots[cls];
+    auto size  = kClassSizes[cls];
+    for (auto p = span + sizeof(SpanHeader); p + size <= span + Slab::SPAN_SIZE;
+         p += size) {
+        auto obj = reinterpret_cast<FreeObject *>(p);
+        obj->next = depot->head;
+        depot->head = obj;
+        depot->count++;
+    }
+    depot->num_spans++;
+    return true;
+}
+
+// Move at most `n' objects from depot to the list.
+void FetchFromDepot(int cls, int n, FreeList *list) {
+    auto depot = &depots[cls];
+    std::unique_lock<std::mutex> lock(depot->mutex);
+
+    if (!depot->head && !CarveSpan(cls)) {
+        return;
+    }
+    while (n-- && depot->head) {
+        auto obj = depot->head;
+        depot->head = obj->next;
+        depot->count--;
+
+        obj->next = list->head;
+        list->head = obj;
+        list->count++;
+    }
+}
+
+// Move at most `n' objects from the list to depot.
+void ReleaseToDepot(int cls, int n, FreeList *list) {
+    auto depot = &depots[cls];
+    std::unique_lock<std::mutex> lock(depot->mutex);
+
+    while (n-- && list->head) {
+        auto obj = list->head;
+        list->head = obj->next;
+        list->count--;
+
+        obj->next = depot->head;
+        depot->head = obj;
+        depot->count++;
+    }
+}
+
+thread_local ThreadCache *tls_cache = nullptr;
+thread_local bool tls_cache_destroyed = false;
+
+class ThreadCacheReaper {
+public:
+    void Touch() {}
+
+    ~ThreadCacheReaper() {
+        tls_cache_destroyed = true;
+        if (!tls_cache) {
+            return;
+        }
+        Slab::FlushThreadCache();
+
+        std::unique_lock<std::mutex> lock(caches_mutex);
+        for (int i = 0; i < kNumClasses; i++) {
+            auto &counters = tls_cache->counters[i];
+            exited_counters[i].num_allocs.fetch_add(counters.num_allocs.load());
+            exited_counters[i].num_frees.fetch_add(counters.num_frees.load());
+        }
+        for (auto iter = caches->begin(); iter != caches->end(); ++iter) {
+            if (*iter == tls_cache) {
+                caches->erase(iter);
+                break;
+            }
+        }
+        delete tls_cache;
+        tls_cache = nullptr;
+    }
+};
+
+thread_local ThreadCacheReaper reaper;
+
+// Return null if the thread already exited.
+inline ThreadCache *GetThreadCache() {
+    if (tls_cache) {
+        return tls_cache;
+    }
+    if (tls_cache_destroyed) {
+        return nullptr;
+    }
+    reaper.Touch();
+
+    tls_cache = new ThreadCache;
+    std::unique_lock<std::mutex> lock(caches_mutex);
+    caches->push_back(tls_cache);
+    return tls_cache;
+}
+
+} // namespace
+
+/*static*/ void *Slab::Allocate(size_t size) {
+    if (size > MAX_SIZE || !region->base) {
+        return malloc(size);
+    }
+
+    auto cls   = SizeClassOf(size);
+    auto cache = GetThreadCache();
+    if (!cache) {
+        FreeList list;
+        FetchFromDepot(cls, 1, &list);
+        if (!list.head) {
+            return malloc(size);
+        }
+        exited_counters[cls].num_allocs.fetch_add(1);
+        return list.head;
+    }
+
+    auto list = &cache->lists[cls];
+    if (!list->head) {
+        FetchFromDepot(cls, BatchSize(cls), list);
+        if (!list->head) {
+            // The region be used up, Free() tells it by address.
+            return malloc(size);
+        }
+    }
+    auto obj = list->head;
+    list->head = obj->next;
+    list->count--;
+    cache->counters[cls].Alloc();
+    return obj;
+}
+
+/*static*/ void Slab::Free(void *p) {
+    if (!Owns(p)) {
+        free(p);
+        return;
+    }
+
+    auto span = SpanOf(p);
+    DCHECK_EQ(kSpanMagic, span->magic);
+    auto cls = static_cast<int>(span->size_class);
+
+    auto obj   = static_cast<FreeObject *>(p);
+    auto cache = GetThreadCache();
+    if (!cache) {
+        FreeList list;
+        obj->next  = nullptr;
+        list.head  = obj;
+        list.count = 1;
+        ReleaseToDepot(cls, 1, &list);
+        exited_counters[cls].num_frees.fetch_add(1);
+        return;
+    }
+
+    auto list = &cache->lists[cls];
+    obj->next = list->head;
+    list->head = obj;
+    list->count++;
+    cache->counters[cls].Free();
+
+    auto batch = BatchSize(cls);
+    if (list->count > static_cast<uint32_t>(batch * 2)) {
+        ReleaseToDepot(cls, batch, list);
+    }
+}
+
+/*static*/ void Slab::FlushThreadCache() {
+    if (!tls_cache) {
+        return;
+    }
+    for (int i = 0; i < kNumClasses; i++) {
+        auto list = &tls_cache->lists[i];
+        ReleaseToDepot(i, static_cast<int>(list->count), list);
+    }
+}
+
+/*static*/ bool Slab::Owns(const void *p) {
+    auto addr = static_cast<const char *>(p);
+    return addr >= region->base && addr < region->end;
+}
+
+/*static*/ void Slab::GetStats(std::vector<SlabStats> *stats) {
+    stats->clear();
+    stats->resize(kNumClasses);
+
+    std::unique_lock<std::mutex> lock(caches_mutex);
+    for (int i = 0; i < kNumClasses; i++) {
+        uint64_t num_allocs = exited_counters[i].num_allocs.load();
+        uint64_t num_frees  = exited_counters[i].num_frees.load();
+        for (auto cache : *caches) {
+            num_allocs += cache->counters[i].num_allocs.load();
+            num_frees  += cache->counters[i].num_frees.load();
+        }
+
+        auto stat = &(*stats)[i];
+        stat->object_size = kClassSizes[i];
+        // Objects can be freed by another thread, count them at last.
+        stat->num_objects = num_allocs > num_frees ? num_allocs - num_frees : 0;
+
+        std::unique_lock<std::mutex> depot_lock(depots[i].mutex);
+        stat->num_spans  = depots[i].num_spans;
+        stat->num_cached = depots[i].count;
+    }
+}
+
+/*static*/ double Slab::fragmentation() {
+    std::vector<SlabStats> stats;
+    GetStats(&stats);
+
+    size_t living = 0, carved = 0;
+    for (const auto &stat : stats) {
+        living += stat.num_objects * stat.object_size;
+        carved += stat.num_spans * SPAN_SIZE;
+    }
+    if (carved == 0) {
+        return 0.0;
+    }
+    return 1.0 - static_cast<double>(living) / static_cast<double>(carved);
+}
+
+} // namespace yukino
@@ -0,0 +1,53 @@
+#ifndef YUKINO_SLAB_H_
+#define YUKINO_SLAB_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+namespace yukino {
+
+struct SlabStats {
+    size_t object_size; // size class
+    size_t num_spans;   // spans carved for this class
+    size_t num_objects; // living objects
+    size_t num_cached;  // free objects in depot
+};
+
+//
+// Size-class slab allocator for the small and hot objects: map entries,
+// key boundles, String/Integer objects and list nodes.
+//
+// Spans (64KB) be carved from one reserved virtual region, as large as the
+// physical memory but at least 64GB, so Free() knows a pointer belongs to
+// slab or malloc by address only, without any header.
+// Every thread caches free objects for every size class, and exchanges
+// them with the central depot in batch.
+// Sizes larger than MAX_SIZE fall back to malloc(), as well as all sizes
+// after the region be used up. Return null only if malloc() fails.
+//
+class Slab {
+public:
+    enum {
+        SPAN_SHIFT = 16,
+        SPAN_SIZE  = 1 << SPAN_SHIFT,
+        MAX_SIZE   = 1024,
+    };
+
+    static void *Allocate(size_t size);
+    static void Free(void *p);
+
+    // Return the free objects cached by this thread to the depot.
+    static void FlushThreadCache();
+
+    static bool Owns(const void *p);
+
+    static void GetStats(std::vector<SlabStats> *stats);
+
+    // Wasted rate of carved spans: 1 - living bytes / spans bytes
+    static double fragmentation();
+}; // class Slab
+
+} // namespace yukino
+
+#endif // YUKINO_SLAB_H_
@@ -1,5 +1,8 @@
 #include "worker.h"
 #include "client.h"
+#include "configuration.h"
+#include "db.h"
+#include "epoch.h"
 #include "server.h"
 #include "ae.h"
 #include "anet.h"
@@ -7,6 +10,9 @@
 
 namespace yukino {
 
+static const int kActiveExpireInterval = 100; // ms
+static const int kActiveExpireBudget   = 1;   // ms for each db
+
 Worker::Worker() {
 }
 
@@ -29,6 +35,9 @@ yuki::Status Worker::Init(Server *server, int id) {
     if (!event_loop_) {
         return Status::Errorf(Status::kSystemError, "not enough memory");
     }
+    aeSetBeforeSleepProc(event_loop_, HandleBeforeSleep);
+    aeCreateTimeEvent(event_loop_, kActiveExpireInterval, HandleActiveExpire,
+                      this, nullptr);
     return Status::OK();
 }
 
@@ -86,6 +95,23 @@ void Worker::Stop() {
     thread_.join();
 }
 
+/* static */
+void Worker::HandleBeforeSleep(aeEventLoop *) {
+    // No one request in flight, a quiescent point for memory reclamation.
+    Epoch::Quiescent();
+}
+
+/* static */
+int Worker::HandleActiveExpire(aeEventLoop *, long long, void *data) {
+    auto self = static_cast<Worker *>(DCHECK_NOTNULL(data));
+
+    for (size_t i = 0; i < self->server_->conf().num_db_conf(); i++) {
+        self->server_->db(static_cast<int>(i))->ActiveExpire(
+                kActiveExpireBudget);
+    }
+    return kActiveExpireInterval;
+}
+
 /* static */
 void Worker::HandleClientReadWrite(aeEventLoop *, int fd, void *data, int mask) {
     using yuki::Status;
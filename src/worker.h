@@ -40,6 +40,8 @@ public:
     aeEventLoop *event_loop() const { return event_loop_; }
 
 private:
+    static void HandleBeforeSleep(aeEventLoop *el);
+    static int HandleActiveExpire(aeEventLoop *el, long long id, void *data);
     static void HandleClientReadWrite(aeEventLoop *el, int fd, void *data,
                                       int mask);
 